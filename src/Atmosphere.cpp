@@ -0,0 +1,434 @@
+// ----------------------------------------------------------------------------
+// Atmosphere.cpp
+//
+// Description: Atmospheres of the planets, from precomputed lookup tables.
+//              At load time, the transmittance and single-scattering tables
+//              of every profile are computed on worker threads, or read back
+//              from the disk cache; atmosphereFragmentShader.glsl then shades
+//              each shell with a few texture fetches per fragment.
+// ----------------------------------------------------------------------------
+
+#include "Atmosphere.hpp"
+#include "FileUtil.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
+#include "ShaderLibrary.hpp"
+#include "UniformBlocks.hpp"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+// Table sizes, injected into the shader. The parameterization is that of
+// Bruneton ("Precomputed Atmospheric Scattering", 2008, as revised in 2017):
+// transmittance is indexed by (view zenith, altitude), single scattering by
+// (view-sun angle, sun zenith) in x, view zenith in y and altitude in z,
+// with the view zenith axis split at the horizon so that rays that hit the
+// ground are never interpolated with rays that do not.
+const int kTransmittanceMu = 64;
+const int kTransmittanceR = 32;
+const int kScatteringNu = 8;
+const int kScatteringMuS = 16;
+const int kScatteringMu = 64;
+const int kScatteringR = 16;
+
+const int kTransmittanceSteps = 64;
+const int kScatteringSteps = 32;
+
+const uint32_t kMagic = 0x4c4d5441; // "ATML"
+const uint32_t kVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+};
+
+// 64-bit FNV-1a
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for(size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// Everything the tables of a profile depend on; the phase function is
+// applied when shading
+uint64_t profileKey(const AtmosphereProfile &profile) {
+  const int layout[] = { static_cast<int>(kVersion), kTransmittanceMu, kTransmittanceR, kScatteringNu, kScatteringMuS,
+                         kScatteringMu, kScatteringR, kTransmittanceSteps, kScatteringSteps };
+  const float params[] = { profile.height, profile.rayleighScaleHeight, profile.rayleighDepth.r, profile.rayleighDepth.g,
+                           profile.rayleighDepth.b, profile.mieScaleHeight, profile.mieDepth, profile.absorptionDepth.r,
+                           profile.absorptionDepth.g, profile.absorptionDepth.b };
+  return fnv1a(params, sizeof(params), fnv1a(layout, sizeof(layout), 0xcbf29ce484222325ull));
+}
+
+inline float unitFromTexel(int i, int n) { return static_cast<float>(i)/(n - 1); }
+
+// Scattering coefficient of an exponential layer whose vertical optical
+// depth, from the ground to the top, is depth
+inline float coefficientFromDepth(float depth, float scaleHeight, float top) {
+  return depth/(scaleHeight*(1.0f - std::exp(-(top - 1.0f)/scaleHeight)));
+}
+
+// Tables of one profile, in planet radii (ground at r = 1)
+class TableBuilder {
+public:
+  explicit TableBuilder(const AtmosphereProfile &profile) : m_profile(profile) {
+    m_top = 1.0f + profile.height;
+    m_horizon = std::sqrt(m_top*m_top - 1.0f);
+    const float top = m_top;
+    m_rayleigh = glm::vec3(coefficientFromDepth(profile.rayleighDepth.r, profile.rayleighScaleHeight, top),
+                           coefficientFromDepth(profile.rayleighDepth.g, profile.rayleighScaleHeight, top),
+                           coefficientFromDepth(profile.rayleighDepth.b, profile.rayleighScaleHeight, top));
+    m_absorption = glm::vec3(coefficientFromDepth(profile.absorptionDepth.r, profile.rayleighScaleHeight, top),
+                             coefficientFromDepth(profile.absorptionDepth.g, profile.rayleighScaleHeight, top),
+                             coefficientFromDepth(profile.absorptionDepth.b, profile.rayleighScaleHeight, top));
+    m_mie = coefficientFromDepth(profile.mieDepth, profile.mieScaleHeight, top);
+  }
+
+  inline glm::vec3 rayleighScattering() const { return m_rayleigh; }
+  inline float top() const { return m_top; }
+
+  void build(std::vector<uint16_t> &transmittance, std::vector<uint16_t> &scattering) {
+    buildTransmittance();
+    transmittance.resize(3*m_transmittance.size());
+    for(size_t i = 0; i < m_transmittance.size(); ++i)
+      for(int c = 0; c < 3; ++c)
+        transmittance[3*i + c] = glm::packHalf1x16(m_transmittance[i][c]);
+
+    scattering.resize(4*kScatteringNu*kScatteringMuS*kScatteringMu*kScatteringR);
+    size_t texel = 0;
+    for(int l = 0; l < kScatteringR; ++l)
+      for(int j = 0; j < kScatteringMu; ++j) {
+        sampleViewRay(l, j);
+        for(int k = 0; k < kScatteringNu; ++k)
+          for(int i = 0; i < kScatteringMuS; ++i, texel += 4) {
+            const glm::vec4 value = singleScattering(k, i);
+            for(int c = 0; c < 4; ++c)
+              scattering[texel + c] = glm::packHalf1x16(value[c]);
+          }
+      }
+  }
+
+private:
+  float distanceToTop(float r, float mu) const {
+    return std::max(0.0f, -r*mu + std::sqrt(std::max(r*r*(mu*mu - 1.0f) + m_top*m_top, 0.0f)));
+  }
+
+  float distanceToGround(float r, float mu) const {
+    return std::max(0.0f, -r*mu - std::sqrt(std::max(r*r*(mu*mu - 1.0f) + 1.0f, 0.0f)));
+  }
+
+  bool hitsGround(float r, float mu) const {
+    return mu < 0.0f && r*r*(mu*mu - 1.0f) + 1.0f >= 0.0f;
+  }
+
+  glm::vec3 extinction(float altitude) const {
+    const float rayleighDensity = std::exp(-altitude/m_profile.rayleighScaleHeight);
+    const float mieDensity = std::exp(-altitude/m_profile.mieScaleHeight);
+    return (m_rayleigh + m_absorption)*rayleighDensity + glm::vec3(m_mie/0.9f*mieDensity); // Mie albedo of 0.9
+  }
+
+  // Transmittance from altitude r, towards mu, to the top of the atmosphere
+  void buildTransmittance() {
+    m_transmittance.resize(kTransmittanceMu*kTransmittanceR);
+    for(int j = 0; j < kTransmittanceR; ++j) {
+      const float rho = m_horizon*unitFromTexel(j, kTransmittanceR);
+      const float r = std::sqrt(rho*rho + 1.0f);
+      for(int i = 0; i < kTransmittanceMu; ++i) {
+        const float dMin = m_top - r, dMax = rho + m_horizon;
+        const float d = dMin + unitFromTexel(i, kTransmittanceMu)*(dMax - dMin);
+        const float mu = d == 0.0f ? 1.0f : glm::clamp((m_horizon*m_horizon - rho*rho - d*d)/(2.0f*r*d), -1.0f, 1.0f);
+        const float dt = distanceToTop(r, mu)/kTransmittanceSteps;
+        glm::vec3 depth(0.0f);
+        for(int s = 0; s <= kTransmittanceSteps; ++s) {
+          const float t = s*dt;
+          const float altitude = std::sqrt(t*t + 2.0f*r*mu*t + r*r) - 1.0f;
+          depth += extinction(altitude)*(s == 0 || s == kTransmittanceSteps ? 0.5f : 1.0f);
+        }
+        m_transmittance[j*kTransmittanceMu + i] = glm::exp(-depth*dt);
+      }
+    }
+  }
+
+  glm::vec3 transmittanceToTop(float r, float mu) const {
+    const float rho = std::sqrt(std::max(r*r - 1.0f, 0.0f));
+    const float dMin = m_top - r, dMax = rho + m_horizon;
+    const float x = glm::clamp((distanceToTop(r, mu) - dMin)/(dMax - dMin), 0.0f, 1.0f)*(kTransmittanceMu - 1);
+    const float y = glm::clamp(rho/m_horizon, 0.0f, 1.0f)*(kTransmittanceR - 1);
+    const int x0 = std::min(static_cast<int>(x), kTransmittanceMu - 2), y0 = std::min(static_cast<int>(y), kTransmittanceR - 2);
+    const float fx = x - x0, fy = y - y0;
+    const glm::vec3 *row0 = &m_transmittance[y0*kTransmittanceMu + x0];
+    const glm::vec3 *row1 = row0 + kTransmittanceMu;
+    return glm::mix(glm::mix(row0[0], row0[1], fx), glm::mix(row1[0], row1[1], fx), fy);
+  }
+
+  // Transmittance over the distance d along (r, mu). For rays that hit the
+  // ground, both ends are looked up in the opposite direction, which goes up
+  // and stays within the parameterization of the table.
+  glm::vec3 transmittance(float r, float mu, float d, bool ground) const {
+    const float rd = glm::clamp(std::sqrt(d*d + 2.0f*r*mu*d + r*r), 1.0f, m_top);
+    const float mud = glm::clamp((r*mu + d)/rd, -1.0f, 1.0f);
+    const glm::vec3 ratio = ground ? transmittanceToTop(rd, -mud)/glm::max(transmittanceToTop(r, -mu), glm::vec3(1e-20f))
+                                   : transmittanceToTop(r, mu)/glm::max(transmittanceToTop(rd, mud), glm::vec3(1e-20f));
+    return glm::min(ratio, glm::vec3(1.0f));
+  }
+
+  // Samples of the view ray of altitude l and zenith j, which all the texels
+  // of the sun directions share: altitude, and the transmittance from the
+  // eye times the densities and the integration weight
+  void sampleViewRay(int l, int j) {
+    const float rho = m_horizon*unitFromTexel(l, kScatteringR);
+    m_r = std::sqrt(rho*rho + 1.0f);
+    const float r = m_r;
+
+    const int halfMu = kScatteringMu/2;
+    const bool ground = j < halfMu;
+    if(ground) {
+      const float dMin = r - 1.0f, dMax = rho;
+      const float d = dMin + unitFromTexel(halfMu - 1 - j, halfMu)*(dMax - dMin);
+      m_mu = d == 0.0f ? -1.0f : glm::clamp(-(rho*rho + d*d)/(2.0f*r*d), -1.0f, 1.0f);
+    } else {
+      const float dMin = m_top - r, dMax = rho + m_horizon;
+      const float d = dMin + unitFromTexel(j - halfMu, halfMu)*(dMax - dMin);
+      m_mu = d == 0.0f ? 1.0f : glm::clamp((m_horizon*m_horizon - rho*rho - d*d)/(2.0f*r*d), -1.0f, 1.0f);
+    }
+    const float mu = m_mu;
+
+    m_dt = (ground ? distanceToGround(r, mu) : distanceToTop(r, mu))/kScatteringSteps;
+    for(int s = 0; s <= kScatteringSteps; ++s) {
+      const float t = s*m_dt;
+      ViewSample &sample = m_viewSamples[s];
+      sample.r = glm::clamp(std::sqrt(t*t + 2.0f*r*mu*t + r*r), 1.0f, m_top);
+      const glm::vec3 weighted = transmittance(r, mu, t, ground)*(s == 0 || s == kScatteringSteps ? 0.5f : 1.0f);
+      sample.rayleigh = weighted*std::exp(-(sample.r - 1.0f)/m_profile.rayleighScaleHeight);
+      sample.mie = weighted*std::exp(-(sample.r - 1.0f)/m_profile.mieScaleHeight);
+    }
+  }
+
+  // Light of the sun scattered once towards the eye along the sampled view
+  // ray, for the view-sun angle k and the sun zenith i, per unit of solar
+  // irradiance and without the phase functions: Rayleigh in rgb, the red
+  // channel of Mie in a
+  glm::vec4 singleScattering(int k, int i) const {
+    const float r = m_r, mu = m_mu;
+    // Sun zenith in [-0.2, 1], denser towards the horizon
+    const float uMuS = unitFromTexel(i, kScatteringMuS);
+    const float muS = -(std::log(1.0f - uMuS*(1.0f - std::exp(-3.6f))) + 0.6f)/3.0f;
+    // The view-sun angle is bounded by the two zenith angles
+    const float spread = std::sqrt(std::max((1.0f - mu*mu)*(1.0f - muS*muS), 0.0f));
+    const float nu = glm::clamp(2.0f*unitFromTexel(k, kScatteringNu) - 1.0f, mu*muS - spread, mu*muS + spread);
+
+    glm::vec3 rayleigh(0.0f), mie(0.0f);
+    for(int s = 0; s <= kScatteringSteps; ++s) {
+      const ViewSample &sample = m_viewSamples[s];
+      const float muSt = glm::clamp((r*muS + s*m_dt*nu)/sample.r, -1.0f, 1.0f);
+      if(hitsGround(sample.r, muSt))
+        continue; // In the shadow of the planet
+      const glm::vec3 sun = transmittanceToTop(sample.r, muSt);
+      rayleigh += sample.rayleigh*sun;
+      mie += sample.mie*sun;
+    }
+    rayleigh *= m_rayleigh*m_dt;
+    mie *= m_mie*m_dt;
+    return glm::vec4(rayleigh, mie.r);
+  }
+
+  struct ViewSample {
+    float r;
+    glm::vec3 rayleigh;
+    glm::vec3 mie;
+  };
+
+  const AtmosphereProfile &m_profile;
+  float m_top;
+  float m_horizon; // Distance from the ground to the top along the horizon
+  glm::vec3 m_rayleigh;
+  glm::vec3 m_absorption;
+  float m_mie;
+  std::vector<glm::vec3> m_transmittance;
+
+  // View ray of the texels being computed
+  float m_r = 1.0f;
+  float m_mu = 1.0f;
+  float m_dt = 0.0f;
+  ViewSample m_viewSamples[kScatteringSteps + 1];
+};
+
+std::string cachePath(const std::string &directory, uint64_t key) {
+  char name[48];
+  std::snprintf(name, sizeof(name), "/atmosphere_%016llx.bin", static_cast<unsigned long long>(key));
+  return directory + name;
+}
+
+bool loadTables(const std::string &path, uint64_t key, std::vector<uint16_t> &transmittance, std::vector<uint16_t> &scattering) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  Header header;
+  if(!file.read(reinterpret_cast<char *>(&header), sizeof(header))
+     || header.magic != kMagic || header.version != kVersion || header.key != key)
+    return false;
+  transmittance.resize(3*kTransmittanceMu*kTransmittanceR);
+  scattering.resize(4*kScatteringNu*kScatteringMuS*kScatteringMu*kScatteringR);
+  return file.read(reinterpret_cast<char *>(transmittance.data()), transmittance.size()*sizeof(uint16_t))
+    && file.read(reinterpret_cast<char *>(scattering.data()), scattering.size()*sizeof(uint16_t));
+}
+
+void storeTables(const std::string &path, uint64_t key, const std::vector<uint16_t> &transmittance, const std::vector<uint16_t> &scattering) {
+  const Header header = { kMagic, kVersion, key };
+  std::ofstream file(path.c_str(), std::ios::binary);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(transmittance.data()), transmittance.size()*sizeof(uint16_t));
+  file.write(reinterpret_cast<const char *>(scattering.data()), scattering.size()*sizeof(uint16_t));
+  if(!file)
+    std::cerr << "ERROR: Failed to write the atmosphere cache " << path << std::endl;
+}
+
+void setTableParameters(GLenum target) {
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+} // namespace
+
+bool Atmosphere::init(ProgramCache &cache, const std::string &depthDefines, const std::string &cacheDirectory,
+                      const std::vector<AtmosphereProfile> &profiles) {
+  const std::string defines = depthDefines + "#define TRANSMITTANCE_MU " + std::to_string(kTransmittanceMu) + "\n"
+    "#define TRANSMITTANCE_R " + std::to_string(kTransmittanceR) + "\n"
+    "#define SCATTERING_NU " + std::to_string(kScatteringNu) + "\n"
+    "#define SCATTERING_MU_S " + std::to_string(kScatteringMuS) + "\n"
+    "#define SCATTERING_MU " + std::to_string(kScatteringMu) + "\n"
+    "#define SCATTERING_R " + std::to_string(kScatteringR) + "\n";
+  m_program = loadProgram(cache, { { GL_VERTEX_SHADER, "atmosphereVertexShader.glsl" }, { GL_FRAGMENT_SHADER, "atmosphereFragmentShader.glsl" } },
+                          defines);
+  GLint success = GL_FALSE;
+  glGetProgramiv(m_program, GL_LINK_STATUS, &success);
+  if(!success)
+    return false;
+  g_glState.useProgram(m_program);
+  glUniform1i(glGetUniformLocation(m_program, "transmittanceTable"), 0);
+  glUniform1i(glGetUniformLocation(m_program, "scatteringTable"), 1);
+  glUniformBlockBinding(m_program, glGetUniformBlockIndex(m_program, "FrameBlock"), FRAME_BLOCK_BINDING);
+  m_planetLoc = glGetUniformLocation(m_program, "planet");
+  m_topLoc = glGetUniformLocation(m_program, "top");
+  m_rayleighScatteringLoc = glGetUniformLocation(m_program, "rayleighScattering");
+  m_mieGLoc = glGetUniformLocation(m_program, "mieG");
+  m_sunIrradianceLoc = glGetUniformLocation(m_program, "sunIrradiance");
+  g_glState.useProgram(0);
+  glGenVertexArrays(1, &m_vao);
+
+  // Tables from the cache first; the others are built in parallel, one
+  // profile per job, and stored for the next run
+  makeDirectory(cacheDirectory);
+  const size_t numProfiles = profiles.size();
+  std::vector<uint64_t> keys(numProfiles);
+  std::vector<std::vector<uint16_t> > transmittance(numProfiles), scattering(numProfiles);
+  std::vector<size_t> missing;
+  for(size_t p = 0; p < numProfiles; ++p) {
+    keys[p] = profileKey(profiles[p]);
+    if(loadTables(cachePath(cacheDirectory, keys[p]), keys[p], transmittance[p], scattering[p]))
+      ++m_cacheHits;
+    else
+      missing.push_back(p);
+  }
+
+  Timer timer;
+  if(!missing.empty()) {
+    const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    m_buildThreads = std::min(cores, static_cast<unsigned int>(missing.size()));
+    std::atomic<size_t> next(0);
+    const auto work = [&]() {
+      for(size_t job = next++; job < missing.size(); job = next++) {
+        const size_t p = missing[job];
+        TableBuilder(profiles[p]).build(transmittance[p], scattering[p]);
+      }
+    };
+    std::vector<std::thread> workers;
+    for(unsigned int t = 1; t < m_buildThreads; ++t)
+      workers.emplace_back(work);
+    work(); // The calling thread takes its share
+    for(std::thread &worker : workers)
+      worker.join();
+    for(size_t p : missing)
+      storeTables(cachePath(cacheDirectory, keys[p]), keys[p], transmittance[p], scattering[p]);
+    m_built = static_cast<unsigned int>(missing.size());
+  }
+  m_buildMs = timer.elapsedMs();
+
+  m_tables.resize(numProfiles);
+  for(size_t p = 0; p < numProfiles; ++p) {
+    Tables &tables = m_tables[p];
+    const TableBuilder builder(profiles[p]);
+    tables.rayleighScattering = builder.rayleighScattering();
+    tables.top = builder.top();
+    tables.mieG = profiles[p].mieG;
+
+    glGenTextures(1, &tables.transmittance);
+    g_glState.bindTexture(GL_TEXTURE_2D, tables.transmittance);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, kTransmittanceMu, kTransmittanceR, 0, GL_RGB, GL_HALF_FLOAT, transmittance[p].data());
+    setTableParameters(GL_TEXTURE_2D);
+    glGenTextures(1, &tables.scattering);
+    g_glState.bindTexture(GL_TEXTURE_3D, tables.scattering);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, kScatteringNu*kScatteringMuS, kScatteringMu, kScatteringR, 0, GL_RGBA, GL_HALF_FLOAT,
+                 scattering[p].data());
+    setTableParameters(GL_TEXTURE_3D);
+  }
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  g_glState.bindTexture(GL_TEXTURE_3D, 0);
+  return true;
+}
+
+void Atmosphere::render(const std::vector<glm::vec4> &bodies, const glm::vec3 &sunIrradiance) {
+  if(m_tables.empty())
+    return;
+  g_glState.useProgram(m_program);
+  glUniform3fv(m_sunIrradianceLoc, 1, &sunIrradiance[0]);
+  // Dual-source blending: in-scattered light plus what lies behind times
+  // the transmittance, per channel. Shells are tested against the bodies in
+  // front of them but do not hide each other.
+  g_glState.enable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_SRC1_COLOR);
+  glDepthMask(GL_FALSE);
+  g_glState.bindVertexArray(m_vao);
+  for(size_t p = 0; p < m_tables.size(); ++p) {
+    const Tables &tables = m_tables[p];
+    glUniform4fv(m_planetLoc, 1, &bodies[p][0]);
+    glUniform1f(m_topLoc, tables.top);
+    glUniform3fv(m_rayleighScatteringLoc, 1, &tables.rayleighScattering[0]);
+    glUniform1f(m_mieGLoc, tables.mieG);
+    g_glState.activeTexture(GL_TEXTURE0);
+    g_glState.bindTexture(GL_TEXTURE_2D, tables.transmittance);
+    g_glState.activeTexture(GL_TEXTURE1);
+    g_glState.bindTexture(GL_TEXTURE_3D, tables.scattering);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // Corners come from gl_VertexID
+  }
+  g_glState.bindTexture(GL_TEXTURE_3D, 0);
+  g_glState.activeTexture(GL_TEXTURE0);
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  g_glState.bindVertexArray(0);
+  glDepthMask(GL_TRUE);
+  g_glState.disable(GL_BLEND);
+}
+
+void Atmosphere::clear() {
+  for(Tables &tables : m_tables) {
+    g_glState.deleteTextures(1, &tables.transmittance);
+    g_glState.deleteTextures(1, &tables.scattering);
+  }
+  g_glState.deleteVertexArrays(1, &m_vao);
+  g_glState.deleteProgram(m_program);
+  *this = Atmosphere();
+}
@@ -0,0 +1,80 @@
+// ----------------------------------------------------------------------------
+// Atmosphere.hpp
+//
+// Description: Atmospheres of the planets, from precomputed lookup tables.
+//              At load time, the transmittance and single-scattering tables
+//              of every profile are computed on worker threads, or read back
+//              from the disk cache; atmosphereFragmentShader.glsl then shades
+//              each shell with a few texture fetches per fragment.
+// ----------------------------------------------------------------------------
+
+#ifndef ATMOSPHERE_HPP
+#define ATMOSPHERE_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+class ProgramCache;
+
+// Scattering properties of an atmosphere. Lengths are in planet radii, so
+// that a profile does not depend on the size of its body; densities decrease
+// exponentially with the altitude.
+struct AtmosphereProfile {
+  float height = 0.06f;                               // Top of the atmosphere above the ground
+  float rayleighScaleHeight = 0.008f;
+  glm::vec3 rayleighDepth = glm::vec3(0.046f, 0.108f, 0.265f); // Vertical optical depth, ground to top, per channel
+  float mieScaleHeight = 0.0015f;
+  float mieDepth = 0.025f;                            // Aerosols and haze, gray
+  float mieG = 0.8f;                                  // Asymmetry of the Cornette-Shanks phase function
+  glm::vec3 absorptionDepth = glm::vec3(0.0f);        // Absorbing gas (e.g., methane), distributed as Rayleigh
+};
+
+class Atmosphere {
+public:
+  // Takes the tables of each profile from the cache directory, or computes
+  // them on worker threads and stores them there, then uploads them. The
+  // defines select the depth mode (see depth.glsl).
+  bool init(ProgramCache &cache, const std::string &depthDefines, const std::string &cacheDirectory,
+            const std::vector<AtmosphereProfile> &profiles);
+
+  // Draws the shell of each profile around its body (center, radius), over
+  // the opaque bodies: the light scattered towards the eye is added, and what
+  // lies behind is attenuated. The FrameBlock must be bound.
+  void render(const std::vector<glm::vec4> &bodies, const glm::vec3 &sunIrradiance);
+
+  inline size_t count() const { return m_tables.size(); }
+  inline unsigned int cacheHits() const { return m_cacheHits; }
+  inline unsigned int built() const { return m_built; }
+  inline unsigned int buildThreads() const { return m_buildThreads; }
+  inline double buildMs() const { return m_buildMs; }
+
+  void clear();
+
+private:
+  struct Tables {
+    GLuint transmittance = 0; // 2D, RGB16F
+    GLuint scattering = 0;    // 3D, RGBA16F: Rayleigh, then the red channel of Mie
+    glm::vec3 rayleighScattering;
+    float top = 1.0f;
+    float mieG = 0.0f;
+  };
+
+  GLuint m_program = 0;
+  GLint m_planetLoc = -1;
+  GLint m_topLoc = -1;
+  GLint m_rayleighScatteringLoc = -1;
+  GLint m_mieGLoc = -1;
+  GLint m_sunIrradianceLoc = -1;
+  GLuint m_vao = 0;
+  std::vector<Tables> m_tables;
+
+  unsigned int m_cacheHits = 0;
+  unsigned int m_built = 0;
+  unsigned int m_buildThreads = 0;
+  double m_buildMs = 0.0;
+};
+
+#endif // ATMOSPHERE_HPP
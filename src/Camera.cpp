@@ -0,0 +1,52 @@
+// ----------------------------------------------------------------------------
+// Camera.cpp
+//
+// Description: Basic perspective camera model
+// ----------------------------------------------------------------------------
+
+#include "Camera.hpp"
+
+#include <glm/ext.hpp>
+
+#include <cmath>
+
+const glm::mat4 &Camera::computeViewMatrix() const {
+  updateMatrices();
+  return m_view;
+}
+
+const glm::mat4 &Camera::computeProjectionMatrix() const {
+  updateMatrices();
+  return m_projection;
+}
+
+const glm::mat4 &Camera::computeViewProjectionMatrix() const {
+  updateMatrices();
+  return m_viewProjection;
+}
+
+void Camera::updateMatrices() const {
+  if(m_matricesVersion == m_version)
+    return;
+  m_matricesVersion = m_version;
+
+  // Looks at the target (the world origin unless set)
+  m_view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(m_target - m_pos), glm::vec3(m_up));
+
+  if(m_depthMode != DEPTH_REVERSED) {
+    m_projection = glm::perspective(glm::radians(m_fov), m_aspectRatio, m_near, m_far);
+  } else {
+    // Reversed-Z with an infinite far plane: the clip depth is the constant
+    // near and w the view distance, so that the depth is near/distance. With a
+    // floating-point buffer, the exponent follows the 1/distance falloff and
+    // the precision stays nearly uniform in relative terms at any distance.
+    const float f = 1.0f/std::tan(0.5f*glm::radians(m_fov));
+    m_projection = glm::mat4(0.0f);
+    m_projection[0][0] = f/m_aspectRatio;
+    m_projection[1][1] = f;
+    m_projection[2][3] = -1.0f;
+    m_projection[3][2] = m_near;
+  }
+
+  m_viewProjection = m_projection*m_view;
+}
@@ -0,0 +1,78 @@
+// ----------------------------------------------------------------------------
+// Camera.hpp
+//
+// Description: Basic perspective camera model
+// ----------------------------------------------------------------------------
+
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#include <glm/glm.hpp>
+
+// How view distances map to the depth buffer
+enum DepthMode {
+  DEPTH_STANDARD = 0, // Clip depth in [-1, 1], near to far
+  DEPTH_REVERSED,     // Clip depth in [0, 1] (glClipControl), from 1 at the near plane to 0 at infinity
+  DEPTH_LOGARITHMIC   // Standard projection; the fragment shaders write a logarithmic depth
+};
+
+// Basic camera model
+class Camera {
+public:
+  inline float getFov() const { return m_fov; }
+  inline void setFoV(const float f) { assign(m_fov, f); }
+  inline float getAspectRatio() const { return m_aspectRatio; }
+  inline void setAspectRatio(const float a) { assign(m_aspectRatio, a); }
+  inline float getNear() const { return m_near; }
+  inline void setNear(const float n) { assign(m_near, n); }
+  inline float getFar() const { return m_far; }
+  inline void setFar(const float n) { assign(m_far, n); }
+  inline DepthMode getDepthMode() const { return m_depthMode; }
+  inline void setDepthMode(const DepthMode m) { assign(m_depthMode, m); }
+  inline void setPosition(const glm::dvec3 &p) { assign(m_pos, p); }
+  inline glm::dvec3 getPosition() const { return m_pos; }
+  inline void setTarget(const glm::dvec3 &target, const glm::dvec3 &up) { assign(m_target, target); assign(m_up, up); }
+
+  // Incremented by the setters when a parameter actually changes, so that
+  // what is derived from the camera can be kept until then
+  inline unsigned long long getVersion() const { return m_version; }
+
+  // Rendering is camera-relative: world positions, in double precision, are
+  // translated by -getPosition() before the cast to float, so the view
+  // matrix only rotates
+  const glm::mat4 &computeViewMatrix() const;
+
+  // Returns the projection matrix stemming from the camera intrinsic parameter.
+  const glm::mat4 &computeProjectionMatrix() const;
+
+  // computeProjectionMatrix()*computeViewMatrix()
+  const glm::mat4 &computeViewProjectionMatrix() const;
+
+private:
+  glm::dvec3 m_pos = glm::dvec3(0, 0, 0); // World space
+  glm::dvec3 m_target = glm::dvec3(0, 0, 0); // Point looked at, in world space
+  glm::dvec3 m_up = glm::dvec3(0, 1, 0);
+  float m_fov = 45.f;        // Field of view, in degrees
+  float m_aspectRatio = 1.f; // Ratio between the width and the height of the image
+  float m_near = 0.1f; // Distance before which geometry is excluded from the rasterization process
+  float m_far = 10.f; // Distance after which the geometry is excluded from the rasterization process (not with reversed-Z)
+  DepthMode m_depthMode = DEPTH_STANDARD;
+
+  template <typename T> inline void assign(T &parameter, const T &value) {
+    if(parameter != value) {
+      parameter = value;
+      ++m_version;
+    }
+  }
+
+  // The matrices are computed on demand, at most once per version
+  void updateMatrices() const;
+
+  unsigned long long m_version = 1;
+  mutable unsigned long long m_matricesVersion = 0;
+  mutable glm::mat4 m_view;
+  mutable glm::mat4 m_projection;
+  mutable glm::mat4 m_viewProjection;
+};
+
+#endif // CAMERA_HPP
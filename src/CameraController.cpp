@@ -0,0 +1,105 @@
+// ----------------------------------------------------------------------------
+// CameraController.cpp
+//
+// Description: Interactive control of the camera, which orbits a target.
+//              Keys are tracked as held or released, and the target moves
+//              with a velocity integrated every frame (acceleration while a
+//              key is held, damping always), so that the motion follows the
+//              frame time rather than the key repeat of the system. Dragging
+//              with the left button orbits the target, the wheel zooms.
+// ----------------------------------------------------------------------------
+
+#include "CameraController.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Motion of the target: the speed tends to kAcceleration/kDamping (10 units
+// per second) while a key is held, and decays by e every 1/kDamping seconds
+const double kAcceleration = 40.0; // Units per second squared
+const double kDamping = 4.0;       // Per second
+
+const double kOrbitRadiansPerPixel = 0.005;
+const double kMaxPitch = 1.55;       // Short of the poles, where the view would flip
+const double kZoomPerNotch = 0.1;    // Distance factor e^-0.1 per notch of the wheel
+const double kMinDistance = 0.5;
+const double kMaxDistance = 60.0;
+
+} // namespace
+
+void CameraController::reset(double distance) {
+  m_homeDistance = distance;
+  m_target = glm::dvec3(0.0);
+  m_velocity = glm::dvec3(0.0);
+  m_distance = distance;
+  m_yaw = 0.0;
+  m_pitch = 0.0;
+}
+
+bool CameraController::onKey(int key, int action) {
+  if(action == GLFW_REPEAT)
+    return false; // The held state is already known
+  const bool pressed = action == GLFW_PRESS;
+  switch(key) {
+  case GLFW_KEY_UP: m_held[FORWARD] = pressed; return true;
+  case GLFW_KEY_DOWN: m_held[BACKWARD] = pressed; return true;
+  case GLFW_KEY_LEFT: m_held[LEFT] = pressed; return true;
+  case GLFW_KEY_RIGHT: m_held[RIGHT] = pressed; return true;
+  case GLFW_KEY_S: m_held[UP] = pressed; return true;
+  case GLFW_KEY_X: m_held[DOWN] = pressed; return true;
+  case GLFW_KEY_C:
+    if(pressed)
+      reset(m_homeDistance);
+    return true;
+  default: return false;
+  }
+}
+
+void CameraController::onMouseButton(int button, int action, double x, double y) {
+  if(button != GLFW_MOUSE_BUTTON_LEFT)
+    return;
+  m_dragging = action == GLFW_PRESS;
+  m_cursorX = x;
+  m_cursorY = y;
+}
+
+bool CameraController::onCursor(double x, double y) {
+  const bool turned = m_dragging && (x != m_cursorX || y != m_cursorY);
+  if(turned) {
+    // Applied at once: the cursor is already smooth, and the view follows it
+    // without lag
+    m_yaw -= kOrbitRadiansPerPixel*(x - m_cursorX);
+    m_pitch = std::max(-kMaxPitch, std::min(kMaxPitch, m_pitch + kOrbitRadiansPerPixel*(y - m_cursorY)));
+  }
+  m_cursorX = x;
+  m_cursorY = y;
+  return turned;
+}
+
+bool CameraController::onScroll(double offset) {
+  const double distance = std::max(kMinDistance, std::min(kMaxDistance, m_distance*std::exp(-kZoomPerNotch*offset)));
+  const bool zoomed = distance != m_distance;
+  m_distance = distance;
+  return zoomed;
+}
+
+void CameraController::update(Camera &camera, double dt) {
+  const glm::dvec3 up(0.0, 1.0, 0.0);
+  const glm::dvec3 toCamera(std::cos(m_pitch)*std::sin(m_yaw), std::sin(m_pitch), std::cos(m_pitch)*std::cos(m_yaw));
+  const glm::dvec3 forward = -toCamera;
+  const glm::dvec3 right = glm::normalize(glm::cross(forward, up));
+
+  const glm::dvec3 input = axis(FORWARD, BACKWARD)*forward + axis(RIGHT, LEFT)*right + axis(UP, DOWN)*up;
+  if(glm::length(input) > 0.0)
+    m_velocity += kAcceleration*dt*glm::normalize(input);
+  m_velocity *= std::exp(-kDamping*dt);
+  m_target += m_velocity*dt;
+
+  const glm::dvec3 position = m_target + m_distance*toCamera;
+  camera.setPosition(position);
+  camera.setTarget(m_target, up);
+}
@@ -0,0 +1,57 @@
+// ----------------------------------------------------------------------------
+// CameraController.hpp
+//
+// Description: Interactive control of the camera, which orbits a target.
+//              Keys are tracked as held or released, and the target moves
+//              with a velocity integrated every frame (acceleration while a
+//              key is held, damping always), so that the motion follows the
+//              frame time rather than the key repeat of the system. Dragging
+//              with the left button orbits the target, the wheel zooms.
+// ----------------------------------------------------------------------------
+
+#ifndef CAMERA_CONTROLLER_HPP
+#define CAMERA_CONTROLLER_HPP
+
+#include "Camera.hpp"
+
+#include <glm/glm.hpp>
+
+class CameraController {
+public:
+  // Looking at the origin from (0, 0, distance), at rest; the C key comes
+  // back there
+  void reset(double distance);
+
+  // GLFW events; onKey is true when the controller uses the key, onCursor
+  // when the drag turns the view and onScroll when the zoom changes the
+  // distance
+  bool onKey(int key, int action);
+  void onMouseButton(int button, int action, double x, double y);
+  bool onCursor(double x, double y);
+  bool onScroll(double offset);
+
+  // Integrates the motion over dt seconds and places the camera
+  void update(Camera &camera, double dt);
+
+private:
+  // Held keys
+  enum Control { FORWARD = 0, BACKWARD, LEFT, RIGHT, UP, DOWN, NUM_CONTROLS };
+
+  // 1, -1 or 0 along an axis from its two keys
+  inline double axis(Control positive, Control negative) const {
+    return (m_held[positive] ? 1.0 : 0.0) - (m_held[negative] ? 1.0 : 0.0);
+  }
+
+  glm::dvec3 m_target = glm::dvec3(0.0);
+  glm::dvec3 m_velocity = glm::dvec3(0.0); // Of the target, in world units per second
+  double m_distance = 30.0;
+  double m_homeDistance = 30.0;
+  double m_yaw = 0.0;   // Around the vertical, 0 on the +z side of the target
+  double m_pitch = 0.0; // Above the horizontal plane of the target
+  bool m_held[NUM_CONTROLS] = { false };
+  bool m_dragging = false;
+  double m_cursorX = 0.0;
+  double m_cursorY = 0.0;
+};
+
+#endif // CAMERA_CONTROLLER_HPP
@@ -0,0 +1,88 @@
+// ----------------------------------------------------------------------------
+// EclipseShadows.cpp
+//
+// Description: Soft shadows cast by spherical bodies onto each other, from
+//              the sun seen as a sphere. Every frame a broad phase on the CPU
+//              keeps the occluders that intersect the hull between the sun
+//              and some receiver, up to kMaxOccluders; the fragment shader
+//              then computes the fraction of the solar disc they hide,
+//              analytically, for the occluders flagged in its body's mask.
+// ----------------------------------------------------------------------------
+
+#include "EclipseShadows.hpp"
+#include "UniformBlocks.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+const float EclipseShadows::kMinOccluderRadius = 0.1f;
+
+namespace {
+
+// Whether the occluder crosses the convex hull of the light and receiver
+// spheres, which contains every ray from the light to the receiver
+bool occludes(const glm::vec4 &light, const glm::vec4 &receiver, const glm::vec4 &occluder) {
+  const glm::vec3 axis = glm::vec3(receiver) - glm::vec3(light);
+  const glm::vec3 toOccluder = glm::vec3(occluder) - glm::vec3(light);
+  const float t = glm::dot(toOccluder, axis)/glm::dot(axis, axis);
+  if(t <= 0.0f || t >= 1.0f)
+    return false; // Beyond the light or the receiver
+  const float hullRadius = light.w + t*(receiver.w - light.w);
+  const glm::vec3 offset = toOccluder - t*axis;
+  const float reach = occluder.w + hullRadius;
+  return glm::dot(offset, offset) < reach*reach;
+}
+
+} // namespace
+
+void EclipseShadows::select(const glm::vec4 &lightSphere, const std::vector<glm::vec4> &spheres, const std::vector<bool> &casters,
+                            ShadowBlock &block, std::vector<uint32_t> &masks) {
+  // Candidates by decreasing radius, so that the largest shadows are kept
+  // when the list is full
+  m_candidates.clear();
+  for(size_t i = 0; i < spheres.size(); ++i)
+    if(casters[i] && spheres[i].w >= kMinOccluderRadius)
+      m_candidates.push_back(i);
+  std::stable_sort(m_candidates.begin(), m_candidates.end(), [&](size_t a, size_t b) { return spheres[a].w > spheres[b].w; });
+
+  // Keep the candidates that shadow at least one body
+  size_t numWanted = 0;
+  int numOccluders = 0;
+  for(size_t candidate : m_candidates) {
+    bool needed = false;
+    for(size_t j = 0; j < spheres.size() && !needed; ++j)
+      needed = j != candidate && occludes(lightSphere, spheres[j], spheres[candidate]);
+    if(!needed)
+      continue;
+    ++numWanted;
+    if(numOccluders < kMaxOccluders)
+      m_candidates[numOccluders++] = candidate;
+  }
+
+  block.lightSphere = lightSphere;
+  block.occluderCount = glm::ivec4(numOccluders, 0, 0, 0);
+  masks.assign(spheres.size(), 0u);
+  for(int k = 0; k < numOccluders; ++k) {
+    const size_t occluder = m_candidates[k];
+    block.occluders[k] = spheres[occluder];
+    for(size_t j = 0; j < spheres.size(); ++j)
+      if(j != occluder && occludes(lightSphere, spheres[j], spheres[occluder]))
+        masks[j] |= 1u << k;
+  }
+
+  ++m_frames;
+  m_sumOccluders += numOccluders;
+  m_maxOccluders = std::max(m_maxOccluders, static_cast<size_t>(numOccluders));
+  m_maxWanted = std::max(m_maxWanted, numWanted);
+  m_cappedFrames += numWanted > static_cast<size_t>(kMaxOccluders);
+}
+
+void EclipseShadows::printStats() const {
+  if(m_frames == 0)
+    return;
+  char line[256];
+  std::snprintf(line, sizeof(line), "Shadows: %.2f occluders per frame (max %zu of %d), %zu frames over the cap (up to %zu wanted)",
+                static_cast<double>(m_sumOccluders)/m_frames, m_maxOccluders, kMaxOccluders, m_cappedFrames, m_maxWanted);
+  std::cout << line << std::endl;
+}
@@ -0,0 +1,48 @@
+// ----------------------------------------------------------------------------
+// EclipseShadows.hpp
+//
+// Description: Soft shadows cast by spherical bodies onto each other, from
+//              the sun seen as a sphere. Every frame a broad phase on the CPU
+//              keeps the occluders that intersect the hull between the sun
+//              and some receiver, up to kMaxOccluders; the fragment shader
+//              then computes the fraction of the solar disc they hide,
+//              analytically, for the occluders flagged in its body's mask.
+// ----------------------------------------------------------------------------
+
+#ifndef ECLIPSE_SHADOWS_HPP
+#define ECLIPSE_SHADOWS_HPP
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct ShadowBlock;
+
+class EclipseShadows {
+public:
+  // Bodies smaller than this do not cast shadows: their umbra would rarely
+  // cover a pixel, and they would crowd the occluder list
+  static const float kMinOccluderRadius;
+
+  // Fills the block with the occluders of the frame and, per body, the mask
+  // of the occluders that may shadow it. Bodies are bounding spheres; those
+  // flagged in casters may cast shadows, all may receive them.
+  void select(const glm::vec4 &lightSphere, const std::vector<glm::vec4> &spheres, const std::vector<bool> &casters,
+              ShadowBlock &block, std::vector<uint32_t> &masks);
+
+  // Occluders per frame, and frames where the list was full
+  void printStats() const;
+
+private:
+  std::vector<size_t> m_candidates;
+
+  // Accumulated over the frames
+  size_t m_frames = 0;
+  size_t m_sumOccluders = 0;
+  size_t m_maxOccluders = 0;
+  size_t m_cappedFrames = 0;
+  size_t m_maxWanted = 0; // Occluders that would have been kept without the cap
+};
+
+#endif // ECLIPSE_SHADOWS_HPP
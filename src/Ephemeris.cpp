@@ -0,0 +1,233 @@
+// ----------------------------------------------------------------------------
+// Ephemeris.cpp
+//
+// Description: Planetary positions from a JPL DE binary ephemeris (e.g.,
+//              linux_p1550p2650.440): records of Chebyshev coefficients over
+//              fixed intervals, mapped from disk and evaluated in place with
+//              Clenshaw's recurrence, on SSE2 lanes when available
+// ----------------------------------------------------------------------------
+
+#include "Ephemeris.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define EPHEMERIS_SSE2 1
+#else
+#define EPHEMERIS_SSE2 0
+#endif
+
+namespace {
+
+// Layout of the first record (the header) of a DE binary file
+const size_t kTitleBytes = 3*84;
+const size_t kNamesOffset = kTitleBytes;         // 400 constant names of 6 characters
+const size_t kRangeOffset = kNamesOffset + 400*6; // Start, end and interval, in days
+const size_t kNumConstantsOffset = kRangeOffset + 3*sizeof(double);
+const size_t kAuOffset = kNumConstantsOffset + sizeof(int32_t);
+const size_t kEmratOffset = kAuOffset + sizeof(double);
+const size_t kPointersOffset = kEmratOffset + sizeof(double); // 12 triplets
+const size_t kVersionOffset = kPointersOffset + 12*3*sizeof(int32_t);
+const size_t kLibrationOffset = kVersionOffset + sizeof(int32_t); // 13th triplet
+const size_t kHeaderBytes = kLibrationOffset + 3*sizeof(int32_t);
+
+template<typename T>
+T readAt(const char *data, size_t offset) {
+  T value;
+  std::memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+// Last coefficient used by a pointer of the file, from 1 (0 if unused)
+size_t pointerEnd(const int32_t *pointer, size_t numComponents) {
+  if(pointer[0] <= 0 || pointer[1] <= 0 || pointer[2] <= 0)
+    return 0;
+  return static_cast<size_t>(pointer[0]) - 1 + numComponents*pointer[1]*pointer[2];
+}
+
+// Position and derivative in x of three Chebyshev series of n coefficients
+// each, stored one after the other, at x in [-1, 1]. Clenshaw's recurrence
+// b_k = c_k + 2x b_(k+1) - b_(k+2) gives f = c_0 + x b_1 - b_2, and its
+// derivative in x, d_k = 2 b_(k+1) + 2x d_(k+1) - d_(k+2), gives
+// f' = b_1 + x d_1 - d_2.
+void clenshawScalar(const double *c, uint32_t n, double x, glm::dvec3 &f, glm::dvec3 &df) {
+  for(int axis = 0; axis < 3; ++axis, c += n) {
+    double b1 = 0.0, b2 = 0.0, d1 = 0.0, d2 = 0.0;
+    for(uint32_t k = n - 1; k >= 1; --k) {
+      const double b = c[k] + 2.0*x*b1 - b2;
+      const double d = 2.0*b1 + 2.0*x*d1 - d2;
+      b2 = b1;
+      b1 = b;
+      d2 = d1;
+      d1 = d;
+    }
+    f[axis] = c[0] + x*b1 - b2;
+    df[axis] = b1 + x*d1 - d2;
+  }
+}
+
+#if EPHEMERIS_SSE2
+// Same recurrence, with x and y in the lanes of one register and z in the
+// low lane of another: the three series advance together
+void clenshawSse2(const double *c, uint32_t n, double x, glm::dvec3 &f, glm::dvec3 &df) {
+  const double *cx = c, *cy = c + n, *cz = c + 2*n;
+  const __m128d x1 = _mm_set1_pd(x);
+  const __m128d x2 = _mm_set1_pd(2.0*x);
+  __m128d b1xy = _mm_setzero_pd(), b2xy = b1xy, d1xy = b1xy, d2xy = b1xy;
+  __m128d b1z = b1xy, b2z = b1xy, d1z = b1xy, d2z = b1xy;
+  for(uint32_t k = n - 1; k >= 1; --k) {
+    const __m128d bxy = _mm_sub_pd(_mm_add_pd(_mm_set_pd(cy[k], cx[k]), _mm_mul_pd(x2, b1xy)), b2xy);
+    const __m128d dxy = _mm_sub_pd(_mm_add_pd(_mm_add_pd(b1xy, b1xy), _mm_mul_pd(x2, d1xy)), d2xy);
+    const __m128d bz = _mm_sub_pd(_mm_add_pd(_mm_set_sd(cz[k]), _mm_mul_pd(x2, b1z)), b2z);
+    const __m128d dz = _mm_sub_pd(_mm_add_pd(_mm_add_pd(b1z, b1z), _mm_mul_pd(x2, d1z)), d2z);
+    b2xy = b1xy;
+    b1xy = bxy;
+    d2xy = d1xy;
+    d1xy = dxy;
+    b2z = b1z;
+    b1z = bz;
+    d2z = d1z;
+    d1z = dz;
+  }
+  double fxy[2], fz[2], dfxy[2], dfz[2];
+  _mm_storeu_pd(fxy, _mm_sub_pd(_mm_add_pd(_mm_set_pd(cy[0], cx[0]), _mm_mul_pd(x1, b1xy)), b2xy));
+  _mm_storeu_pd(fz, _mm_sub_pd(_mm_add_pd(_mm_set_sd(cz[0]), _mm_mul_pd(x1, b1z)), b2z));
+  _mm_storeu_pd(dfxy, _mm_sub_pd(_mm_add_pd(b1xy, _mm_mul_pd(x1, d1xy)), d2xy));
+  _mm_storeu_pd(dfz, _mm_sub_pd(_mm_add_pd(b1z, _mm_mul_pd(x1, d1z)), d2z));
+  f = glm::dvec3(fxy[0], fxy[1], fz[0]);
+  df = glm::dvec3(dfxy[0], dfxy[1], dfz[0]);
+}
+#endif
+
+} // namespace
+
+bool Ephemeris::load(const std::string &path) {
+  clear();
+  if(!m_file.open(path)) {
+    std::cerr << "ERROR: Failed to read the ephemeris " << path << std::endl;
+    return false;
+  }
+  const char *data = m_file.data();
+  if(m_file.size() < kHeaderBytes) {
+    std::cerr << "ERROR: " << path << ": truncated ephemeris header" << std::endl;
+    clear();
+    return false;
+  }
+  m_start = readAt<double>(data, kRangeOffset);
+  m_end = readAt<double>(data, kRangeOffset + sizeof(double));
+  m_interval = readAt<double>(data, kRangeOffset + 2*sizeof(double));
+  m_au = readAt<double>(data, kAuOffset);
+  m_emrat = readAt<double>(data, kEmratOffset);
+  m_version = readAt<int32_t>(data, kVersionOffset);
+  const int32_t numConstants = readAt<int32_t>(data, kNumConstantsOffset);
+  if(m_version < 100 || m_version > 9999 || !(m_interval > 0.0) || !(m_end > m_start) || !(m_au > 0.0) || !(m_emrat > 0.0)) {
+    std::cerr << "ERROR: " << path << ": not a DE binary ephemeris in the byte order of this host" << std::endl;
+    clear();
+    return false;
+  }
+
+  // The record length is not stored: it is the end of the last series, with
+  // the nutations (2 components), the librations and, in files that have
+  // more than 400 constants, possibly TT-TDB (1 component). The first data
+  // record, which starts at the start epoch, tells which.
+  int32_t pointers[14][3] = {};
+  std::memcpy(pointers, data + kPointersOffset, 12*3*sizeof(int32_t));
+  std::memcpy(pointers[12], data + kLibrationOffset, 3*sizeof(int32_t));
+  const size_t extraNamesBytes = numConstants > 400 ? (numConstants - 400)*6 : 0;
+  if(kHeaderBytes + extraNamesBytes + 3*sizeof(int32_t) <= m_file.size())
+    std::memcpy(pointers[13], data + kHeaderBytes + extraNamesBytes, 3*sizeof(int32_t));
+  size_t length = 0;
+  for(int i = 0; i < 13; ++i)
+    length = std::max(length, pointerEnd(pointers[i], i == 11 ? 2 : 3));
+  const size_t candidates[2] = { length, std::max(length, pointerEnd(pointers[13], 1)) };
+  for(size_t candidate : candidates) {
+    const size_t recordBytes = candidate*sizeof(double);
+    if(candidate < 2 || m_file.size() < 3*recordBytes)
+      continue;
+    const double first = readAt<double>(data, 2*recordBytes);
+    const double second = readAt<double>(data, 2*recordBytes + sizeof(double));
+    if(first == m_start && std::fabs(second - (m_start + m_interval)) < 1e-6) {
+      m_recordLength = candidate;
+      break;
+    }
+  }
+  if(m_recordLength == 0) {
+    std::cerr << "ERROR: " << path << ": the first data record does not match the header" << std::endl;
+    clear();
+    return false;
+  }
+  const size_t recordBytes = m_recordLength*sizeof(double);
+  m_numRecords = std::min(static_cast<size_t>(std::floor((m_end - m_start)/m_interval + 0.5)), m_file.size()/recordBytes - 2);
+  if(m_numRecords == 0) {
+    std::cerr << "ERROR: " << path << ": the time span is shorter than one record" << std::endl;
+    clear();
+    return false;
+  }
+  m_end = m_start + m_numRecords*m_interval;
+  m_records = reinterpret_cast<const double *>(data + 2*recordBytes); // Aligned: the mapping is, and records are whole doubles
+
+  for(int i = 0; i < NUM_SERIES; ++i) {
+    if(pointerEnd(pointers[i], 3) == 0 || pointerEnd(pointers[i], 3) > m_recordLength) {
+      std::cerr << "ERROR: " << path << ": invalid coefficient pointer " << i << std::endl;
+      clear();
+      return false;
+    }
+    m_pointers[i] = { static_cast<uint32_t>(pointers[i][0] - 1), static_cast<uint32_t>(pointers[i][1]), static_cast<uint32_t>(pointers[i][2]) };
+  }
+  return true;
+}
+
+Ephemeris::Target Ephemeris::find(const std::string &name) {
+  static const char *names[NUM_TARGETS] = { "mercury", "venus", "earth", "mars", "jupiter", "saturn", "uranus", "neptune", "pluto", "moon", "sun" };
+  for(int i = 0; i < NUM_TARGETS; ++i)
+    if(name == names[i])
+      return static_cast<Target>(i);
+  return NUM_TARGETS;
+}
+
+void Ephemeris::evaluate(const double *epochs, size_t numEpochs, State *states, bool simd) const {
+  static const Series kTargetSeries[NUM_TARGETS] = { SERIES_MERCURY, SERIES_VENUS, SERIES_EMB, SERIES_MARS, SERIES_JUPITER,
+                                                     SERIES_SATURN, SERIES_URANUS, SERIES_NEPTUNE, SERIES_PLUTO, SERIES_MOON, SERIES_SUN };
+#if EPHEMERIS_SSE2
+  void (*clenshaw)(const double *, uint32_t, double, glm::dvec3 &, glm::dvec3 &) = simd ? clenshawSse2 : clenshawScalar;
+#else
+  void (*clenshaw)(const double *, uint32_t, double, glm::dvec3 &, glm::dvec3 &) = clenshawScalar;
+  (void)simd;
+#endif
+  for(size_t e = 0; e < numEpochs; ++e) {
+    // Record, then sub-interval of each series, mapped to [-1, 1]
+    const double t = std::min(std::max(epochs[e], m_start), m_end);
+    const size_t record = std::min(static_cast<size_t>((t - m_start)/m_interval), m_numRecords - 1);
+    const double *coeffs = m_records + record*m_recordLength;
+    const double u = (t - coeffs[0])/m_interval;
+    State *out = states + e*NUM_TARGETS;
+    for(int i = 0; i < NUM_TARGETS; ++i) {
+      const Pointer &pointer = m_pointers[kTargetSeries[i]];
+      const double scaled = u*pointer.numIntervals;
+      const uint32_t sub = std::min(static_cast<uint32_t>(std::max(scaled, 0.0)), pointer.numIntervals - 1);
+      clenshaw(coeffs + pointer.offset + sub*3*pointer.numCoeffs, pointer.numCoeffs, 2.0*(scaled - sub) - 1.0,
+               out[i].position, out[i].velocity);
+      out[i].velocity *= 2.0*pointer.numIntervals/m_interval; // d/dx to d/dt
+    }
+
+    // Barycenter and geocentric Moon to the Earth and the Moon
+    const State emb = out[EARTH], moon = out[MOON];
+    out[EARTH].position = emb.position - moon.position/(1.0 + m_emrat);
+    out[EARTH].velocity = emb.velocity - moon.velocity/(1.0 + m_emrat);
+    out[MOON].position = out[EARTH].position + moon.position;
+    out[MOON].velocity = out[EARTH].velocity + moon.velocity;
+  }
+}
+
+void Ephemeris::clear() {
+  m_file.close();
+  m_records = nullptr;
+  m_numRecords = 0;
+  m_recordLength = 0;
+  m_start = m_end = m_interval = 0.0;
+  m_version = 0;
+}
@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------
+// Ephemeris.hpp
+//
+// Description: Planetary positions from a JPL DE binary ephemeris (e.g.,
+//              linux_p1550p2650.440): records of Chebyshev coefficients over
+//              fixed intervals, mapped from disk and evaluated in place with
+//              Clenshaw's recurrence, on SSE2 lanes when available
+// ----------------------------------------------------------------------------
+
+#ifndef EPHEMERIS_HPP
+#define EPHEMERIS_HPP
+
+#include "MappedFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+
+class Ephemeris {
+public:
+  // Bodies evaluated, barycentric; the file stores the Earth-Moon barycenter
+  // and the geocentric Moon, from which the Earth and the Moon are derived
+  enum Target { MERCURY = 0, VENUS, EARTH, MARS, JUPITER, SATURN, URANUS, NEPTUNE, PLUTO, MOON, SUN, NUM_TARGETS };
+
+  struct State {
+    glm::dvec3 position; // km
+    glm::dvec3 velocity; // km/day
+  };
+
+  // Maps the file and checks its layout against the header
+  bool load(const std::string &path);
+
+  inline double startEpoch() const { return m_start; } // Julian days (TDB)
+  inline double endEpoch() const { return m_end; }
+  inline double au() const { return m_au; }            // km
+  inline int version() const { return m_version; }    // DE number
+
+  // Target of a lower-case body name ("earth"), or NUM_TARGETS
+  static Target find(const std::string &name);
+
+  // States of every target at each epoch, epoch-major: states[e*NUM_TARGETS + t].
+  // Epochs outside the file are clamped to it. The scalar recurrence is kept
+  // for comparison (simd = false).
+  void evaluate(const double *epochs, size_t numEpochs, State *states, bool simd = true) const;
+
+  void clear();
+
+private:
+  // Raw series of the file, in the order of its coefficient pointers
+  enum Series { SERIES_MERCURY = 0, SERIES_VENUS, SERIES_EMB, SERIES_MARS, SERIES_JUPITER, SERIES_SATURN,
+                SERIES_URANUS, SERIES_NEPTUNE, SERIES_PLUTO, SERIES_MOON, SERIES_SUN, NUM_SERIES };
+
+  struct Pointer {
+    uint32_t offset;       // First coefficient in the record, from 0
+    uint32_t numCoeffs;    // Per component
+    uint32_t numIntervals; // Sub-intervals per record
+  };
+
+  MappedFile m_file;
+  Pointer m_pointers[NUM_SERIES];
+  const double *m_records = nullptr; // First data record
+  size_t m_numRecords = 0;
+  size_t m_recordLength = 0;         // In doubles
+  double m_start = 0.0;
+  double m_end = 0.0;
+  double m_interval = 0.0;           // Days per record
+  double m_au = 0.0;
+  double m_emrat = 0.0;              // Earth/Moon mass ratio
+  int m_version = 0;
+};
+
+#endif // EPHEMERIS_HPP
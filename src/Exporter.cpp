@@ -0,0 +1,298 @@
+// ----------------------------------------------------------------------------
+// Exporter.cpp
+//
+// Description: Offline frame export (PNG sequence or Y4M video). Frames are
+//              rendered into an FBO, read back asynchronously through a ring
+//              of PBOs and encoded on worker threads.
+// ----------------------------------------------------------------------------
+
+#include "Exporter.hpp"
+#include "FileUtil.hpp"
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+namespace {
+
+double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned char clampByte(const int v) {
+  return static_cast<unsigned char>(std::min(255, std::max(0, v)));
+}
+
+} // namespace
+
+bool Exporter::init(const Settings &settings) {
+  m_settings = settings;
+  if(m_settings.numThreads == 0) {
+    const unsigned int cores = std::thread::hardware_concurrency();
+    m_settings.numThreads = cores > 1 ? cores - 1 : 1;
+  }
+  m_settings.numPbos = std::max(2u, m_settings.numPbos);
+  if(m_settings.format == FORMAT_Y4M) {
+    // 4:2:0 chroma subsampling needs even dimensions
+    m_settings.width &= ~1;
+    m_settings.height &= ~1;
+  }
+  m_frameBytes = static_cast<size_t>(m_settings.width)*m_settings.height*4;
+
+  GLint maxSize = 0;
+  glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+  if(m_settings.width > maxSize || m_settings.height > maxSize) {
+    std::cerr << "ERROR: Export size " << m_settings.width << "x" << m_settings.height
+              << " exceeds the renderbuffer limit of " << maxSize << std::endl;
+    return false;
+  }
+
+  // Output first, so that nothing is allocated when it cannot be written
+  if(m_settings.format == FORMAT_Y4M) {
+    if(m_settings.output == "-") {
+      m_stream = stdout;
+      std::cout.rdbuf(std::cerr.rdbuf()); // Keep the log out of the video stream
+    } else {
+      m_stream = std::fopen(m_settings.output.c_str(), "wb");
+    }
+    if(!m_stream) {
+      std::cerr << "ERROR: Failed to open " << m_settings.output << std::endl;
+      return false;
+    }
+  } else if(!makeDirectory(m_settings.output)) {
+    std::cerr << "ERROR: Failed to create the directory " << m_settings.output << std::endl;
+    return false;
+  }
+
+  // Off-screen render target, independent of the window size
+  glGenFramebuffers(1, &m_fbo);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glGenRenderbuffers(1, &m_colorRbo);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, m_colorRbo);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_settings.width, m_settings.height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRbo);
+  glGenRenderbuffers(1, &m_depthRbo);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, m_depthRbo);
+  glRenderbufferStorage(GL_RENDERBUFFER, m_settings.depthFormat, m_settings.width, m_settings.height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRbo);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, 0);
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+  if(status != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "ERROR: Export framebuffer incomplete (0x" << std::hex << status << std::dec << ")" << std::endl;
+    release();
+    return false;
+  }
+
+  // Ring of pixel pack buffers: glReadPixels into a PBO returns immediately,
+  // and the copy is only mapped numPbos-1 frames later when it has landed.
+  m_pbos.resize(m_settings.numPbos);
+  m_fences.assign(m_settings.numPbos, nullptr);
+  glGenBuffers(static_cast<GLsizei>(m_pbos.size()), m_pbos.data());
+  for(GLuint pbo : m_pbos) {
+    g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, m_frameBytes, nullptr, GL_STREAM_READ);
+  }
+  g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  if(m_settings.format == FORMAT_Y4M) {
+    std::fprintf(m_stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", m_settings.width, m_settings.height, m_settings.fps);
+  } else {
+    stbi_flip_vertically_on_write(1); // glReadPixels returns rows bottom-up
+    stbi_write_png_compression_level = 4; // Favor encoding speed over file size
+  }
+
+  m_startTime = now();
+  for(unsigned int i = 0; i < m_settings.numThreads; ++i)
+    m_workers.emplace_back(&Exporter::workerLoop, this);
+  return true;
+}
+
+void Exporter::beginFrame() {
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  g_glState.viewport(0, 0, m_settings.width, m_settings.height);
+}
+
+void Exporter::endFrame() {
+  // At most numPbos-1 readbacks are in flight, so this slot is free
+  const size_t slot = m_framesIssued % m_pbos.size();
+  g_glState.bindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[slot]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, m_settings.width, m_settings.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  m_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  ++m_framesIssued;
+
+  // Retire anything older than the newest numPbos-1 readbacks
+  while(m_framesIssued - m_framesRetired >= m_pbos.size())
+    retireOldest();
+}
+
+void Exporter::retireOldest() {
+  const size_t slot = m_framesRetired % m_pbos.size();
+
+  const double t0 = now();
+  const GLenum wait = glClientWaitSync(m_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(10)*1000*1000*1000);
+  glDeleteSync(m_fences[slot]);
+  m_fences[slot] = nullptr;
+  m_stallTime += now() - t0;
+
+  // A frame that cannot be read back goes to the encoders without pixels,
+  // which skip it, rather than as a black frame
+  Job job;
+  job.index = m_framesRetired;
+  if(wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
+    g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[slot]);
+    const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_frameBytes, GL_MAP_READ_BIT);
+    if(mapped) {
+      job.pixels.assign(static_cast<const unsigned char *>(mapped), static_cast<const unsigned char *>(mapped) + m_frameBytes);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+      std::cerr << "ERROR: Failed to map the readback of frame " << job.index << std::endl;
+    }
+    g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  } else {
+    std::cerr << "ERROR: The readback of frame " << job.index
+              << (wait == GL_TIMEOUT_EXPIRED ? " timed out" : " failed") << std::endl;
+  }
+  if(job.pixels.empty())
+    ++m_failedFrames;
+  ++m_framesRetired;
+
+  // Bound the queue so a slow encoder cannot make us buffer the whole animation
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_jobTaken.wait(lock, [this] { return m_jobs.size() < 2*m_workers.size(); });
+  m_jobs.push_back(std::move(job));
+  m_jobAvailable.notify_one();
+}
+
+void Exporter::workerLoop() {
+  std::vector<unsigned char> scratch;
+  while(true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobAvailable.wait(lock, [this] { return m_done || !m_jobs.empty(); });
+      if(m_jobs.empty())
+        return;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+      m_jobTaken.notify_one();
+    }
+    const double t0 = now();
+    if(job.pixels.empty())
+      writeInOrder(job.index, std::vector<unsigned char>()); // Keeps the order of the stream
+    else if(m_settings.format == FORMAT_PNG)
+      encodePng(job);
+    else
+      encodeY4m(job, scratch);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_encodeTime += now() - t0;
+  }
+}
+
+void Exporter::encodePng(const Job &job) {
+  char filename[64];
+  std::snprintf(filename, sizeof(filename), "/frame_%06zu.png", job.index);
+  const std::string path = m_settings.output + filename;
+  if(!stbi_write_png(path.c_str(), m_settings.width, m_settings.height, 4, job.pixels.data(), m_settings.width*4))
+    std::cerr << "ERROR: Failed to write " << path << std::endl;
+}
+
+void Exporter::encodeY4m(const Job &job, std::vector<unsigned char> &yuv) {
+  // Full-range BT.601 RGB -> YCbCr 4:2:0, flipping rows to top-down order
+  const int w = m_settings.width, h = m_settings.height;
+  const size_t header = 6; // "FRAME\n"
+  yuv.resize(header + w*h + 2*(w/2)*(h/2));
+  std::memcpy(yuv.data(), "FRAME\n", header);
+  unsigned char *yPlane = yuv.data() + header;
+  unsigned char *uPlane = yPlane + w*h;
+  unsigned char *vPlane = uPlane + (w/2)*(h/2);
+  const unsigned char *src = job.pixels.data();
+
+  for(int y = 0; y < h; ++y) {
+    const unsigned char *row = src + static_cast<size_t>(h - 1 - y)*w*4;
+    unsigned char *dst = yPlane + static_cast<size_t>(y)*w;
+    for(int x = 0; x < w; ++x)
+      dst[x] = clampByte((77*row[4*x] + 150*row[4*x + 1] + 29*row[4*x + 2] + 128) >> 8);
+  }
+  for(int y = 0; y < h/2; ++y) {
+    const unsigned char *row0 = src + static_cast<size_t>(h - 1 - 2*y)*w*4;
+    const unsigned char *row1 = row0 - static_cast<size_t>(w)*4;
+    for(int x = 0; x < w/2; ++x) {
+      const int i = 8*x;
+      const int r = row0[i] + row0[i + 4] + row1[i] + row1[i + 4];
+      const int g = row0[i + 1] + row0[i + 5] + row1[i + 1] + row1[i + 5];
+      const int b = row0[i + 2] + row0[i + 6] + row1[i + 2] + row1[i + 6];
+      uPlane[y*(w/2) + x] = clampByte(((-43*r - 85*g + 128*b + 512) >> 10) + 128);
+      vPlane[y*(w/2) + x] = clampByte(((128*r - 107*g - 21*b + 512) >> 10) + 128);
+    }
+  }
+  writeInOrder(job.index, yuv);
+}
+
+void Exporter::writeInOrder(size_t index, const std::vector<unsigned char> &data) {
+  if(!m_stream)
+    return;
+  // Frames are converted in parallel but must reach the stream in order
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_written.wait(lock, [this, index] { return m_nextToWrite == index; });
+  lock.unlock();
+  if(!data.empty())
+    std::fwrite(data.data(), 1, data.size(), m_stream);
+  lock.lock();
+  ++m_nextToWrite;
+  m_written.notify_all();
+}
+
+bool Exporter::finish() {
+  while(m_framesRetired < m_framesIssued)
+    retireOldest();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done = true;
+  }
+  m_jobAvailable.notify_all();
+  for(std::thread &t : m_workers)
+    t.join();
+  m_workers.clear();
+  const double elapsed = now() - m_startTime;
+
+  release();
+
+  std::cout << "Export: " << m_framesRetired << " frames " << m_settings.width << "x" << m_settings.height
+            << " in " << elapsed << " s (" << m_framesRetired/std::max(elapsed, 1e-9) << " frames/s)"
+            << ", " << m_settings.numThreads << " encoder thread(s)"
+            << ", encoder utilization " << 100.0*m_encodeTime/std::max(elapsed*m_settings.numThreads, 1e-9) << "%"
+            << ", readback stall " << 1000.0*m_stallTime/std::max<size_t>(m_framesRetired, 1) << " ms/frame" << std::endl;
+  if(m_failedFrames > 0) {
+    std::cerr << "ERROR: " << m_failedFrames << " of " << m_framesRetired << " frames could not be read back and are missing from "
+              << m_settings.output << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void Exporter::release() {
+  if(m_stream) {
+    std::fflush(m_stream);
+    if(m_stream != stdout)
+      std::fclose(m_stream);
+    m_stream = nullptr;
+  }
+  if(!m_pbos.empty())
+    g_glState.deleteBuffers(static_cast<GLsizei>(m_pbos.size()), m_pbos.data());
+  m_pbos.clear();
+  m_fences.clear();
+  g_glState.deleteRenderbuffers(1, &m_colorRbo);
+  g_glState.deleteRenderbuffers(1, &m_depthRbo);
+  g_glState.deleteFramebuffers(1, &m_fbo);
+  m_colorRbo = m_depthRbo = m_fbo = 0;
+}
@@ -0,0 +1,103 @@
+// ----------------------------------------------------------------------------
+// Exporter.hpp
+//
+// Description: Offline frame export (PNG sequence or Y4M video). Frames are
+//              rendered into an FBO, read back asynchronously through a ring
+//              of PBOs and encoded on worker threads.
+// ----------------------------------------------------------------------------
+
+#ifndef EXPORTER_HPP
+#define EXPORTER_HPP
+
+#include <glad/gl.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Exporter {
+public:
+  enum Format { FORMAT_PNG, FORMAT_Y4M };
+
+  struct Settings {
+    int width = 1920;
+    int height = 1080;
+    int fps = 60;
+    Format format = FORMAT_PNG;
+    std::string output = "export"; // Directory for PNG, file or "-" (stdout) for Y4M
+    unsigned int numThreads = 0;   // 0 = hardware concurrency minus the render thread
+    unsigned int numPbos = 3;      // Depth of the readback ring
+    GLenum depthFormat = GL_DEPTH_COMPONENT24;
+  };
+
+  // Creates the FBO, the PBO ring and starts the encoder threads
+  bool init(const Settings &settings);
+
+  // Binds the export framebuffer and sets the viewport; call before render()
+  void beginFrame();
+
+  // Queues an asynchronous readback of the frame and hands the oldest
+  // completed readback to the encoders
+  void endFrame();
+
+  // Drains the ring and the encoders, joins the threads and prints the
+  // report; false when frames could not be read back
+  bool finish();
+
+  inline GLuint framebuffer() const { return m_fbo; }
+  inline const Settings &settings() const { return m_settings; }
+
+private:
+  struct Job {
+    size_t index;
+    std::vector<unsigned char> pixels; // RGBA8, bottom-up rows as returned by glReadPixels; empty when not read back
+  };
+
+  void retireOldest();
+  void workerLoop();
+  void encodePng(const Job &job);
+  void encodeY4m(const Job &job, std::vector<unsigned char> &yuv);
+  void writeInOrder(size_t index, const std::vector<unsigned char> &data);
+
+  // Closes the output and deletes the FBO and the PBOs
+  void release();
+
+  Settings m_settings;
+  size_t m_frameBytes = 0;
+
+  // OpenGL objects
+  GLuint m_fbo = 0;
+  GLuint m_colorRbo = 0;
+  GLuint m_depthRbo = 0;
+  std::vector<GLuint> m_pbos;
+  std::vector<GLsync> m_fences;
+
+  // Readback ring state
+  size_t m_framesIssued = 0;  // Frames whose readback was queued
+  size_t m_framesRetired = 0; // Frames copied out of the ring
+  size_t m_failedFrames = 0;  // Whose readback failed, left out of the output
+
+  // Encoder queue
+  std::vector<std::thread> m_workers;
+  std::deque<Job> m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_jobAvailable;
+  std::condition_variable m_jobTaken;
+  bool m_done = false;
+
+  // Ordered output for the video stream
+  std::FILE *m_stream = nullptr;
+  size_t m_nextToWrite = 0;
+  std::condition_variable m_written;
+
+  // Statistics
+  double m_startTime = 0.0;
+  double m_stallTime = 0.0;   // Time spent waiting on readback fences
+  double m_encodeTime = 0.0;  // Sum of the encoding time of all workers
+};
+
+#endif // EXPORTER_HPP
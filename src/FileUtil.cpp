@@ -0,0 +1,23 @@
+// ----------------------------------------------------------------------------
+// FileUtil.cpp
+//
+// Description: Small portable helpers over the file system
+// ----------------------------------------------------------------------------
+
+#include "FileUtil.hpp"
+
+#include <cerrno>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+bool makeDirectory(const std::string &path) {
+#ifdef _WIN32
+  const int result = _mkdir(path.c_str());
+#else
+  const int result = mkdir(path.c_str(), 0755);
+#endif
+  return result == 0 || errno == EEXIST;
+}
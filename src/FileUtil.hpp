@@ -0,0 +1,15 @@
+// ----------------------------------------------------------------------------
+// FileUtil.hpp
+//
+// Description: Small portable helpers over the file system
+// ----------------------------------------------------------------------------
+
+#ifndef FILE_UTIL_HPP
+#define FILE_UTIL_HPP
+
+#include <string>
+
+// Creates a directory (not its parents); true when it exists afterwards
+bool makeDirectory(const std::string &path);
+
+#endif // FILE_UTIL_HPP
@@ -0,0 +1,84 @@
+// ----------------------------------------------------------------------------
+// GLExtensions.cpp
+//
+// Description: OpenGL entry points and tokens beyond the 3.3 core profile
+//              generated by glad. They are resolved at startup and only used
+//              when the matching capability flag is set.
+// ----------------------------------------------------------------------------
+
+#include "GLExtensions.hpp"
+
+#include <cstring>
+
+PFNGLGETPROGRAMBINARYPROC glad_glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC glad_glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC glad_glProgramParameteri = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glad_glMaxShaderCompilerThreadsKHR = nullptr;
+PFNGLPATCHPARAMETERIPROC glad_glPatchParameteri = nullptr;
+PFNGLBUFFERSTORAGEPROC glad_glBufferStorage = nullptr;
+PFNGLDISPATCHCOMPUTEPROC glad_glDispatchCompute = nullptr;
+PFNGLMEMORYBARRIERPROC glad_glMemoryBarrier = nullptr;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glad_glMultiDrawElementsIndirect = nullptr;
+PFNGLCLIPCONTROLPROC glad_glClipControl = nullptr;
+PFNGLTEXSTORAGE2DPROC glad_glTexStorage2D = nullptr;
+
+GLCapabilities g_glCaps;
+
+bool hasGLVersion(int major, int minor) {
+  return g_glCaps.major > major || (g_glCaps.major == major && g_glCaps.minor >= minor);
+}
+
+bool hasGLExtension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for(GLint i = 0; i < count; ++i) {
+    const char *ext = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+    if(ext && !std::strcmp(ext, name))
+      return true;
+  }
+  return false;
+}
+
+void loadGLExtensions(GLADloadfunc load) {
+  glGetIntegerv(GL_MAJOR_VERSION, &g_glCaps.major);
+  glGetIntegerv(GL_MINOR_VERSION, &g_glCaps.minor);
+
+  if(hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary")) {
+    glad_glGetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>(load("glGetProgramBinary"));
+    glad_glProgramBinary = reinterpret_cast<PFNGLPROGRAMBINARYPROC>(load("glProgramBinary"));
+    glad_glProgramParameteri = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>(load("glProgramParameteri"));
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    g_glCaps.programBinary = glGetProgramBinary && glProgramBinary && glProgramParameteri && numFormats > 0;
+  }
+
+  if(hasGLExtension("GL_KHR_parallel_shader_compile")) {
+    glad_glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsKHR"));
+  } else if(hasGLExtension("GL_ARB_parallel_shader_compile")) {
+    glad_glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsARB"));
+  }
+  g_glCaps.parallelShaderCompile = glMaxShaderCompilerThreadsKHR != nullptr;
+
+  if(hasGLVersion(4, 0)) // The stages are #version 400
+    glad_glPatchParameteri = reinterpret_cast<PFNGLPATCHPARAMETERIPROC>(load("glPatchParameteri"));
+  g_glCaps.tessellation = glPatchParameteri != nullptr;
+
+  if(hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+    glad_glBufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(load("glBufferStorage"));
+  g_glCaps.bufferStorage = glBufferStorage != nullptr;
+
+  if(hasGLVersion(4, 2) || hasGLExtension("GL_ARB_texture_storage"))
+    glad_glTexStorage2D = reinterpret_cast<PFNGLTEXSTORAGE2DPROC>(load("glTexStorage2D"));
+  g_glCaps.textureStorage = glTexStorage2D != nullptr;
+
+  if(hasGLVersion(4, 3)) {
+    glad_glDispatchCompute = reinterpret_cast<PFNGLDISPATCHCOMPUTEPROC>(load("glDispatchCompute"));
+    glad_glMemoryBarrier = reinterpret_cast<PFNGLMEMORYBARRIERPROC>(load("glMemoryBarrier"));
+    glad_glMultiDrawElementsIndirect = reinterpret_cast<PFNGLMULTIDRAWELEMENTSINDIRECTPROC>(load("glMultiDrawElementsIndirect"));
+  }
+  g_glCaps.gpuDriven = glDispatchCompute && glMemoryBarrier && glMultiDrawElementsIndirect;
+
+  if(hasGLVersion(4, 5) || hasGLExtension("GL_ARB_clip_control"))
+    glad_glClipControl = reinterpret_cast<PFNGLCLIPCONTROLPROC>(load("glClipControl"));
+  g_glCaps.clipControl = glClipControl != nullptr;
+}
@@ -0,0 +1,273 @@
+// ----------------------------------------------------------------------------
+// GLState.cpp
+//
+// Description: Shadow copy of the OpenGL bindings, capabilities, viewport
+//              and polygon mode. Every bind, enable, program use, texture
+//              unit and viewport change of the renderer goes through
+//              g_glState, which only forwards the calls that change the
+//              current state to the driver and counts those it drops, per
+//              frame. Passes that must restore the state read it back from
+//              g_glState rather than query the driver. Objects are deleted
+//              through it as well, so that a name reused by a new object is
+//              never taken as bound.
+// ----------------------------------------------------------------------------
+
+#include "GLState.hpp"
+#include "GLExtensions.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+const GLuint GLState::kUnknown;
+
+GLState g_glState;
+
+int GLState::textureTarget(GLenum target) {
+  switch(target) {
+  case GL_TEXTURE_2D: return TEXTURE_2D;
+  case GL_TEXTURE_2D_ARRAY: return TEXTURE_2D_ARRAY;
+  case GL_TEXTURE_3D: return TEXTURE_3D;
+  case GL_TEXTURE_BUFFER: return TEXTURE_BUFFER;
+  default: return -1;
+  }
+}
+
+int GLState::bufferTarget(GLenum target) {
+  switch(target) {
+  case GL_ARRAY_BUFFER: return ARRAY_BUFFER;
+  case GL_ELEMENT_ARRAY_BUFFER: return ELEMENT_ARRAY_BUFFER;
+  case GL_UNIFORM_BUFFER: return UNIFORM_BUFFER;
+  case GL_SHADER_STORAGE_BUFFER: return SHADER_STORAGE_BUFFER;
+  case GL_DRAW_INDIRECT_BUFFER: return DRAW_INDIRECT_BUFFER;
+  case GL_PIXEL_PACK_BUFFER: return PIXEL_PACK_BUFFER;
+  case GL_PIXEL_UNPACK_BUFFER: return PIXEL_UNPACK_BUFFER;
+  case GL_TEXTURE_BUFFER: return TEXTURE_BUFFER_TARGET;
+  default: return -1;
+  }
+}
+
+int GLState::indexedTarget(GLenum target) {
+  switch(target) {
+  case GL_UNIFORM_BUFFER: return INDEXED_UNIFORM;
+  case GL_SHADER_STORAGE_BUFFER: return INDEXED_SHADER_STORAGE;
+  default: return -1;
+  }
+}
+
+int GLState::capability(GLenum cap) {
+  switch(cap) {
+  case GL_BLEND: return BLEND;
+  case GL_CULL_FACE: return CULL_FACE;
+  case GL_DEPTH_TEST: return DEPTH_TEST;
+  case GL_PROGRAM_POINT_SIZE: return PROGRAM_POINT_SIZE;
+  default: return -1;
+  }
+}
+
+void GLState::useProgram(GLuint program) {
+  if(filter(program == m_program))
+    return;
+  glUseProgram(program);
+  m_program = program;
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+  if(filter(vao == m_vao))
+    return;
+  glBindVertexArray(vao);
+  m_vao = vao;
+  // The index buffer binding belongs to the vertex array
+  m_buffers[ELEMENT_ARRAY_BUFFER] = kUnknown;
+}
+
+void GLState::activeTexture(GLenum unit) {
+  if(filter(unit == m_activeTexture))
+    return;
+  glActiveTexture(unit);
+  m_activeTexture = unit;
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture) {
+  const int t = textureTarget(target);
+  const int unit = static_cast<int>(m_activeTexture) - GL_TEXTURE0;
+  GLuint *binding = t >= 0 && unit >= 0 && unit < kMaxTextureUnits ? &m_textures[unit][t] : nullptr;
+  if(filter(binding && *binding == texture))
+    return;
+  glBindTexture(target, texture);
+  if(binding)
+    *binding = texture;
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+  const int t = bufferTarget(target);
+  if(filter(t >= 0 && m_buffers[t] == buffer))
+    return;
+  glBindBuffer(target, buffer);
+  if(t >= 0)
+    m_buffers[t] = buffer;
+}
+
+bool GLState::setIndexed(GLenum target, GLuint index, const IndexedBinding &binding) {
+  const int t = indexedTarget(target);
+  IndexedBinding *current = t >= 0 && index < static_cast<GLuint>(kMaxIndexedBindings) ? &m_indexed[t][index] : nullptr;
+  if(filter(current && current->buffer == binding.buffer && current->offset == binding.offset && current->size == binding.size))
+    return false;
+  if(current)
+    *current = binding;
+  // The indexed binds set the generic binding too
+  const int generic = bufferTarget(target);
+  if(generic >= 0)
+    m_buffers[generic] = binding.buffer;
+  return true;
+}
+
+void GLState::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+  if(setIndexed(target, index, { buffer, 0, 0 }))
+    glBindBufferBase(target, index, buffer);
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+  if(setIndexed(target, index, { buffer, offset, size }))
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint framebuffer) {
+  const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  if(filter((!draw || m_drawFramebuffer == framebuffer) && (!read || m_readFramebuffer == framebuffer)))
+    return;
+  glBindFramebuffer(target, framebuffer);
+  if(draw)
+    m_drawFramebuffer = framebuffer;
+  if(read)
+    m_readFramebuffer = framebuffer;
+}
+
+void GLState::bindRenderbuffer(GLenum target, GLuint renderbuffer) {
+  if(filter(renderbuffer == m_renderbuffer))
+    return;
+  glBindRenderbuffer(target, renderbuffer);
+  m_renderbuffer = renderbuffer;
+}
+
+void GLState::setEnabled(GLenum cap, bool enabled) {
+  const int c = capability(cap);
+  if(filter(c >= 0 && m_capabilities[c] == (enabled ? 1 : 0)))
+    return;
+  if(enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  if(c >= 0)
+    m_capabilities[c] = enabled ? 1 : 0;
+}
+
+void GLState::enable(GLenum cap) {
+  setEnabled(cap, true);
+}
+
+void GLState::disable(GLenum cap) {
+  setEnabled(cap, false);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  if(filter(m_viewport[0] == x && m_viewport[1] == y && m_viewport[2] == width && m_viewport[3] == height))
+    return;
+  glViewport(x, y, width, height);
+  m_viewport[0] = x;
+  m_viewport[1] = y;
+  m_viewport[2] = width;
+  m_viewport[3] = height;
+}
+
+void GLState::polygonMode(GLenum mode) {
+  if(filter(mode == m_polygonMode))
+    return;
+  glPolygonMode(GL_FRONT_AND_BACK, mode);
+  m_polygonMode = mode;
+}
+
+void GLState::forget(GLuint *bindings, size_t count, GLsizei n, const GLuint *names) {
+  for(size_t i = 0; i < count; ++i)
+    if(bindings[i] != 0 && std::find(names, names + n, bindings[i]) != names + n)
+      bindings[i] = kUnknown;
+}
+
+void GLState::deleteProgram(GLuint program) {
+  glDeleteProgram(program);
+  forget(&m_program, 1, 1, &program);
+}
+
+void GLState::deleteVertexArrays(GLsizei n, const GLuint *vaos) {
+  glDeleteVertexArrays(n, vaos);
+  if(m_vao != 0 && std::find(vaos, vaos + n, m_vao) != vaos + n) {
+    m_vao = kUnknown;
+    m_buffers[ELEMENT_ARRAY_BUFFER] = kUnknown;
+  }
+}
+
+void GLState::deleteTextures(GLsizei n, const GLuint *textures) {
+  glDeleteTextures(n, textures);
+  forget(&m_textures[0][0], kMaxTextureUnits*NUM_TEXTURE_TARGETS, n, textures);
+}
+
+void GLState::deleteBuffers(GLsizei n, const GLuint *buffers) {
+  glDeleteBuffers(n, buffers);
+  forget(m_buffers, NUM_BUFFER_TARGETS, n, buffers);
+  for(auto &target : m_indexed)
+    for(IndexedBinding &binding : target)
+      if(binding.buffer != 0 && std::find(buffers, buffers + n, binding.buffer) != buffers + n)
+        binding.buffer = kUnknown;
+}
+
+void GLState::deleteFramebuffers(GLsizei n, const GLuint *framebuffers) {
+  glDeleteFramebuffers(n, framebuffers);
+  forget(&m_drawFramebuffer, 1, n, framebuffers);
+  forget(&m_readFramebuffer, 1, n, framebuffers);
+}
+
+void GLState::deleteRenderbuffers(GLsizei n, const GLuint *renderbuffers) {
+  glDeleteRenderbuffers(n, renderbuffers);
+  forget(&m_renderbuffer, 1, n, renderbuffers);
+}
+
+void GLState::invalidate() {
+  m_program = kUnknown;
+  m_vao = kUnknown;
+  m_activeTexture = 0;
+  std::fill(&m_textures[0][0], &m_textures[0][0] + kMaxTextureUnits*NUM_TEXTURE_TARGETS, kUnknown);
+  std::fill(m_buffers, m_buffers + NUM_BUFFER_TARGETS, kUnknown);
+  for(auto &target : m_indexed)
+    std::fill(target, target + kMaxIndexedBindings, IndexedBinding{ kUnknown, 0, 0 });
+  m_drawFramebuffer = kUnknown;
+  m_readFramebuffer = kUnknown;
+  m_renderbuffer = kUnknown;
+  std::fill(m_capabilities, m_capabilities + NUM_CAPABILITIES, -1);
+  std::fill(m_viewport, m_viewport + 4, 0);
+  m_viewport[2] = -1;
+  m_polygonMode = 0;
+}
+
+void GLState::beginFrame() {
+  m_issued = 0;
+  m_filtered = 0;
+}
+
+void GLState::endFrame() {
+  ++m_frames;
+  m_totalIssued += m_issued;
+  m_totalFiltered += m_filtered;
+  m_maxIssued = std::max(m_maxIssued, m_issued);
+}
+
+void GLState::printStats() const {
+  if(m_frames == 0)
+    return;
+  const size_t total = m_totalIssued + m_totalFiltered;
+  char line[256];
+  std::snprintf(line, sizeof(line), "GL state: %.1f calls issued per frame (max %zu), %.1f redundant ones filtered (%.0f%%)",
+                static_cast<double>(m_totalIssued)/m_frames, m_maxIssued, static_cast<double>(m_totalFiltered)/m_frames,
+                total ? 100.0*m_totalFiltered/total : 0.0);
+  std::cout << line << std::endl;
+}
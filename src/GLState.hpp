@@ -0,0 +1,127 @@
+// ----------------------------------------------------------------------------
+// GLState.hpp
+//
+// Description: Shadow copy of the OpenGL bindings, capabilities, viewport
+//              and polygon mode. Every bind, enable, program use, texture
+//              unit and viewport change of the renderer goes through
+//              g_glState, which only forwards the calls that change the
+//              current state to the driver and counts those it drops, per
+//              frame. Passes that must restore the state read it back from
+//              g_glState rather than query the driver. Objects are deleted
+//              through it as well, so that a name reused by a new object is
+//              never taken as bound.
+// ----------------------------------------------------------------------------
+
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+#include <glad/gl.h>
+
+#include <algorithm>
+#include <cstddef>
+
+class GLState {
+public:
+  static const int kMaxTextureUnits = 16;
+  static const int kMaxIndexedBindings = 16; // Per indexed target (uniform and shader storage buffers)
+
+  GLState() { invalidate(); }
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  void activeTexture(GLenum unit);
+  void bindTexture(GLenum target, GLuint texture); // On the active unit
+  void bindBuffer(GLenum target, GLuint buffer);
+  void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+  void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+  void bindFramebuffer(GLenum target, GLuint framebuffer);
+  void bindRenderbuffer(GLenum target, GLuint renderbuffer);
+  void enable(GLenum cap);
+  void disable(GLenum cap);
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  void polygonMode(GLenum mode); // Of both faces, the only choice of core profiles
+
+  // State as last set through g_glState, for the passes that change it and
+  // restore it afterwards without querying the driver
+  inline GLuint getDrawFramebuffer() const { return m_drawFramebuffer; }
+  inline void getViewport(GLint viewport[4]) const { std::copy(m_viewport, m_viewport + 4, viewport); }
+  inline GLenum getPolygonMode() const { return m_polygonMode; }
+
+  void deleteProgram(GLuint program);
+  void deleteVertexArrays(GLsizei n, const GLuint *vaos);
+  void deleteTextures(GLsizei n, const GLuint *textures);
+  void deleteBuffers(GLsizei n, const GLuint *buffers);
+  void deleteFramebuffers(GLsizei n, const GLuint *framebuffers);
+  void deleteRenderbuffers(GLsizei n, const GLuint *renderbuffers);
+
+  // Forgets the whole state, after code that changes it behind g_glState
+  void invalidate();
+
+  // Calls between beginFrame() and endFrame() are those of the frame; those
+  // of the initialization are not counted
+  void beginFrame();
+  void endFrame();
+  inline size_t frameIssued() const { return m_issued; }
+  inline size_t frameFiltered() const { return m_filtered; }
+
+  // Issued and filtered calls per frame, over the run
+  void printStats() const;
+
+private:
+  static const GLuint kUnknown = ~0u; // Never a GL name, so the first call always goes through
+
+  // Tracked targets; calls on the others always go through
+  enum TextureTarget { TEXTURE_2D = 0, TEXTURE_2D_ARRAY, TEXTURE_3D, TEXTURE_BUFFER, NUM_TEXTURE_TARGETS };
+  enum BufferTarget {
+    ARRAY_BUFFER = 0, ELEMENT_ARRAY_BUFFER, UNIFORM_BUFFER, SHADER_STORAGE_BUFFER, DRAW_INDIRECT_BUFFER,
+    PIXEL_PACK_BUFFER, PIXEL_UNPACK_BUFFER, TEXTURE_BUFFER_TARGET, NUM_BUFFER_TARGETS
+  };
+  enum IndexedTarget { INDEXED_UNIFORM = 0, INDEXED_SHADER_STORAGE, NUM_INDEXED_TARGETS };
+  enum Capability { BLEND = 0, CULL_FACE, DEPTH_TEST, PROGRAM_POINT_SIZE, NUM_CAPABILITIES };
+
+  struct IndexedBinding {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size; // 0 for the whole buffer (glBindBufferBase)
+  };
+
+  static int textureTarget(GLenum target);
+  static int bufferTarget(GLenum target);
+  static int indexedTarget(GLenum target);
+  static int capability(GLenum cap);
+
+  // True when the call is redundant, and counts it either way
+  inline bool filter(bool redundant) {
+    ++(redundant ? m_filtered : m_issued);
+    return redundant;
+  }
+  bool setIndexed(GLenum target, GLuint index, const IndexedBinding &binding);
+  void setEnabled(GLenum cap, bool enabled);
+
+  // Sets the entries of a deleted name to kUnknown
+  static void forget(GLuint *bindings, size_t count, GLsizei n, const GLuint *names);
+
+  GLuint m_program = kUnknown;
+  GLuint m_vao = kUnknown;
+  GLenum m_activeTexture = 0; // Unknown
+  GLuint m_textures[kMaxTextureUnits][NUM_TEXTURE_TARGETS];
+  GLuint m_buffers[NUM_BUFFER_TARGETS];
+  IndexedBinding m_indexed[NUM_INDEXED_TARGETS][kMaxIndexedBindings];
+  GLuint m_drawFramebuffer = kUnknown;
+  GLuint m_readFramebuffer = kUnknown;
+  GLuint m_renderbuffer = kUnknown;
+  GLint m_viewport[4];        // Width -1 when unknown
+  GLenum m_polygonMode = 0;   // Unknown
+  int m_capabilities[NUM_CAPABILITIES]; // 0 or 1, -1 when unknown
+
+  size_t m_issued = 0;   // Calls of the current frame forwarded to the driver
+  size_t m_filtered = 0; // And dropped
+  size_t m_frames = 0;
+  size_t m_totalIssued = 0;
+  size_t m_totalFiltered = 0;
+  size_t m_maxIssued = 0;
+};
+
+extern GLState g_glState;
+
+#endif // GL_STATE_HPP
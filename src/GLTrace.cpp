@@ -0,0 +1,555 @@
+// ----------------------------------------------------------------------------
+// GLTrace.cpp
+//
+// Description: Interception of the OpenGL calls, for development builds
+//              (Debug builds, unless configured with -DGL_TRACE=OFF). Every
+//              entry point of the glad table, and of GLExtensions.hpp, is
+//              replaced by a wrapper that counts its calls and the CPU time
+//              spent in the driver. Each frame is written to a report, with
+//              the glGet* calls of the frame flagged: they stall the driver
+//              on the hot path. Without GL_TRACE, nothing is compiled in.
+// ----------------------------------------------------------------------------
+
+#include "GLTrace.hpp"
+#include "GLExtensions.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct EntryPoint {
+  const char *name;
+  bool get;             // A glGet* query, which waits for the driver
+  size_t frameCalls = 0;
+  double frameNs = 0.0; // Spent in the driver this frame
+  size_t calls = 0;     // Within the frames, over the run
+  double ns = 0.0;
+  size_t outsideCalls = 0; // Before the first frame and between frames
+};
+
+std::vector<EntryPoint> g_entryPoints;
+bool g_inFrame = false;
+size_t g_frames = 0;
+std::ofstream g_reportFile;
+std::ostream *g_report = nullptr;
+
+size_t addEntryPoint(const char *name) {
+  EntryPoint entry;
+  entry.name = name;
+  entry.get = !std::strncmp(name, "glGet", 5);
+  g_entryPoints.push_back(entry);
+  return g_entryPoints.size() - 1;
+}
+
+// Times one call into the driver
+class CallScope {
+public:
+  explicit CallScope(size_t entry) : m_entry(entry), m_start(std::chrono::steady_clock::now()) {}
+  ~CallScope() {
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count();
+    EntryPoint &entry = g_entryPoints[m_entry];
+    if(g_inFrame) {
+      ++entry.frameCalls;
+      entry.frameNs += ns;
+    } else {
+      ++entry.outsideCalls;
+    }
+  }
+
+private:
+  size_t m_entry;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+// One wrapper per entry point: Id tells apart those of the same signature
+template <int Id, typename Pointer> struct Hook;
+
+template <int Id, typename R, typename... Args>
+struct Hook<Id, R (GLAD_API_PTR *)(Args...)> {
+  typedef R (GLAD_API_PTR *Pointer)(Args...);
+  static Pointer real;
+  static size_t entry;
+
+  static R GLAD_API_PTR call(Args... args) {
+    CallScope scope(entry);
+    return real(args...);
+  }
+};
+
+template <int Id, typename R, typename... Args>
+typename Hook<Id, R (GLAD_API_PTR *)(Args...)>::Pointer Hook<Id, R (GLAD_API_PTR *)(Args...)>::real = nullptr;
+template <int Id, typename R, typename... Args>
+size_t Hook<Id, R (GLAD_API_PTR *)(Args...)>::entry = 0;
+
+// Swaps the entry point for its wrapper, unless the context does not have it
+template <int Id, typename Pointer>
+void hook(Pointer &pointer, const char *name) {
+  if(!pointer)
+    return;
+  Hook<Id, Pointer>::real = pointer;
+  Hook<Id, Pointer>::entry = addEntryPoint(name);
+  pointer = &Hook<Id, Pointer>::call;
+}
+
+// One per line, so that __LINE__ is unique
+#define GL_TRACE_HOOK(name) hook<__LINE__>(glad_##name, #name)
+
+// The entry points of glad (gl:core=3.3), then those of GLExtensions.hpp
+void hookEntryPoints() {
+  GL_TRACE_HOOK(glActiveTexture);
+  GL_TRACE_HOOK(glAttachShader);
+  GL_TRACE_HOOK(glBeginConditionalRender);
+  GL_TRACE_HOOK(glBeginQuery);
+  GL_TRACE_HOOK(glBeginTransformFeedback);
+  GL_TRACE_HOOK(glBindAttribLocation);
+  GL_TRACE_HOOK(glBindBuffer);
+  GL_TRACE_HOOK(glBindBufferBase);
+  GL_TRACE_HOOK(glBindBufferRange);
+  GL_TRACE_HOOK(glBindFragDataLocation);
+  GL_TRACE_HOOK(glBindFragDataLocationIndexed);
+  GL_TRACE_HOOK(glBindFramebuffer);
+  GL_TRACE_HOOK(glBindRenderbuffer);
+  GL_TRACE_HOOK(glBindSampler);
+  GL_TRACE_HOOK(glBindTexture);
+  GL_TRACE_HOOK(glBindVertexArray);
+  GL_TRACE_HOOK(glBlendColor);
+  GL_TRACE_HOOK(glBlendEquation);
+  GL_TRACE_HOOK(glBlendEquationSeparate);
+  GL_TRACE_HOOK(glBlendFunc);
+  GL_TRACE_HOOK(glBlendFuncSeparate);
+  GL_TRACE_HOOK(glBlitFramebuffer);
+  GL_TRACE_HOOK(glBufferData);
+  GL_TRACE_HOOK(glBufferSubData);
+  GL_TRACE_HOOK(glCheckFramebufferStatus);
+  GL_TRACE_HOOK(glClampColor);
+  GL_TRACE_HOOK(glClear);
+  GL_TRACE_HOOK(glClearBufferfi);
+  GL_TRACE_HOOK(glClearBufferfv);
+  GL_TRACE_HOOK(glClearBufferiv);
+  GL_TRACE_HOOK(glClearBufferuiv);
+  GL_TRACE_HOOK(glClearColor);
+  GL_TRACE_HOOK(glClearDepth);
+  GL_TRACE_HOOK(glClearStencil);
+  GL_TRACE_HOOK(glClientWaitSync);
+  GL_TRACE_HOOK(glColorMask);
+  GL_TRACE_HOOK(glColorMaski);
+  GL_TRACE_HOOK(glCompileShader);
+  GL_TRACE_HOOK(glCompressedTexImage1D);
+  GL_TRACE_HOOK(glCompressedTexImage2D);
+  GL_TRACE_HOOK(glCompressedTexImage3D);
+  GL_TRACE_HOOK(glCompressedTexSubImage1D);
+  GL_TRACE_HOOK(glCompressedTexSubImage2D);
+  GL_TRACE_HOOK(glCompressedTexSubImage3D);
+  GL_TRACE_HOOK(glCopyBufferSubData);
+  GL_TRACE_HOOK(glCopyTexImage1D);
+  GL_TRACE_HOOK(glCopyTexImage2D);
+  GL_TRACE_HOOK(glCopyTexSubImage1D);
+  GL_TRACE_HOOK(glCopyTexSubImage2D);
+  GL_TRACE_HOOK(glCopyTexSubImage3D);
+  GL_TRACE_HOOK(glCreateProgram);
+  GL_TRACE_HOOK(glCreateShader);
+  GL_TRACE_HOOK(glCullFace);
+  GL_TRACE_HOOK(glDeleteBuffers);
+  GL_TRACE_HOOK(glDeleteFramebuffers);
+  GL_TRACE_HOOK(glDeleteProgram);
+  GL_TRACE_HOOK(glDeleteQueries);
+  GL_TRACE_HOOK(glDeleteRenderbuffers);
+  GL_TRACE_HOOK(glDeleteSamplers);
+  GL_TRACE_HOOK(glDeleteShader);
+  GL_TRACE_HOOK(glDeleteSync);
+  GL_TRACE_HOOK(glDeleteTextures);
+  GL_TRACE_HOOK(glDeleteVertexArrays);
+  GL_TRACE_HOOK(glDepthFunc);
+  GL_TRACE_HOOK(glDepthMask);
+  GL_TRACE_HOOK(glDepthRange);
+  GL_TRACE_HOOK(glDetachShader);
+  GL_TRACE_HOOK(glDisable);
+  GL_TRACE_HOOK(glDisableVertexAttribArray);
+  GL_TRACE_HOOK(glDisablei);
+  GL_TRACE_HOOK(glDrawArrays);
+  GL_TRACE_HOOK(glDrawArraysInstanced);
+  GL_TRACE_HOOK(glDrawBuffer);
+  GL_TRACE_HOOK(glDrawBuffers);
+  GL_TRACE_HOOK(glDrawElements);
+  GL_TRACE_HOOK(glDrawElementsBaseVertex);
+  GL_TRACE_HOOK(glDrawElementsInstanced);
+  GL_TRACE_HOOK(glDrawElementsInstancedBaseVertex);
+  GL_TRACE_HOOK(glDrawRangeElements);
+  GL_TRACE_HOOK(glDrawRangeElementsBaseVertex);
+  GL_TRACE_HOOK(glEnable);
+  GL_TRACE_HOOK(glEnableVertexAttribArray);
+  GL_TRACE_HOOK(glEnablei);
+  GL_TRACE_HOOK(glEndConditionalRender);
+  GL_TRACE_HOOK(glEndQuery);
+  GL_TRACE_HOOK(glEndTransformFeedback);
+  GL_TRACE_HOOK(glFenceSync);
+  GL_TRACE_HOOK(glFinish);
+  GL_TRACE_HOOK(glFlush);
+  GL_TRACE_HOOK(glFlushMappedBufferRange);
+  GL_TRACE_HOOK(glFramebufferRenderbuffer);
+  GL_TRACE_HOOK(glFramebufferTexture);
+  GL_TRACE_HOOK(glFramebufferTexture1D);
+  GL_TRACE_HOOK(glFramebufferTexture2D);
+  GL_TRACE_HOOK(glFramebufferTexture3D);
+  GL_TRACE_HOOK(glFramebufferTextureLayer);
+  GL_TRACE_HOOK(glFrontFace);
+  GL_TRACE_HOOK(glGenBuffers);
+  GL_TRACE_HOOK(glGenFramebuffers);
+  GL_TRACE_HOOK(glGenQueries);
+  GL_TRACE_HOOK(glGenRenderbuffers);
+  GL_TRACE_HOOK(glGenSamplers);
+  GL_TRACE_HOOK(glGenTextures);
+  GL_TRACE_HOOK(glGenVertexArrays);
+  GL_TRACE_HOOK(glGenerateMipmap);
+  GL_TRACE_HOOK(glGetActiveAttrib);
+  GL_TRACE_HOOK(glGetActiveUniform);
+  GL_TRACE_HOOK(glGetActiveUniformBlockName);
+  GL_TRACE_HOOK(glGetActiveUniformBlockiv);
+  GL_TRACE_HOOK(glGetActiveUniformName);
+  GL_TRACE_HOOK(glGetActiveUniformsiv);
+  GL_TRACE_HOOK(glGetAttachedShaders);
+  GL_TRACE_HOOK(glGetAttribLocation);
+  GL_TRACE_HOOK(glGetBooleani_v);
+  GL_TRACE_HOOK(glGetBooleanv);
+  GL_TRACE_HOOK(glGetBufferParameteri64v);
+  GL_TRACE_HOOK(glGetBufferParameteriv);
+  GL_TRACE_HOOK(glGetBufferPointerv);
+  GL_TRACE_HOOK(glGetBufferSubData);
+  GL_TRACE_HOOK(glGetCompressedTexImage);
+  GL_TRACE_HOOK(glGetDoublev);
+  GL_TRACE_HOOK(glGetError);
+  GL_TRACE_HOOK(glGetFloatv);
+  GL_TRACE_HOOK(glGetFragDataIndex);
+  GL_TRACE_HOOK(glGetFragDataLocation);
+  GL_TRACE_HOOK(glGetFramebufferAttachmentParameteriv);
+  GL_TRACE_HOOK(glGetInteger64i_v);
+  GL_TRACE_HOOK(glGetInteger64v);
+  GL_TRACE_HOOK(glGetIntegeri_v);
+  GL_TRACE_HOOK(glGetIntegerv);
+  GL_TRACE_HOOK(glGetMultisamplefv);
+  GL_TRACE_HOOK(glGetProgramInfoLog);
+  GL_TRACE_HOOK(glGetProgramiv);
+  GL_TRACE_HOOK(glGetQueryObjecti64v);
+  GL_TRACE_HOOK(glGetQueryObjectiv);
+  GL_TRACE_HOOK(glGetQueryObjectui64v);
+  GL_TRACE_HOOK(glGetQueryObjectuiv);
+  GL_TRACE_HOOK(glGetQueryiv);
+  GL_TRACE_HOOK(glGetRenderbufferParameteriv);
+  GL_TRACE_HOOK(glGetSamplerParameterIiv);
+  GL_TRACE_HOOK(glGetSamplerParameterIuiv);
+  GL_TRACE_HOOK(glGetSamplerParameterfv);
+  GL_TRACE_HOOK(glGetSamplerParameteriv);
+  GL_TRACE_HOOK(glGetShaderInfoLog);
+  GL_TRACE_HOOK(glGetShaderSource);
+  GL_TRACE_HOOK(glGetShaderiv);
+  GL_TRACE_HOOK(glGetString);
+  GL_TRACE_HOOK(glGetStringi);
+  GL_TRACE_HOOK(glGetSynciv);
+  GL_TRACE_HOOK(glGetTexImage);
+  GL_TRACE_HOOK(glGetTexLevelParameterfv);
+  GL_TRACE_HOOK(glGetTexLevelParameteriv);
+  GL_TRACE_HOOK(glGetTexParameterIiv);
+  GL_TRACE_HOOK(glGetTexParameterIuiv);
+  GL_TRACE_HOOK(glGetTexParameterfv);
+  GL_TRACE_HOOK(glGetTexParameteriv);
+  GL_TRACE_HOOK(glGetTransformFeedbackVarying);
+  GL_TRACE_HOOK(glGetUniformBlockIndex);
+  GL_TRACE_HOOK(glGetUniformIndices);
+  GL_TRACE_HOOK(glGetUniformLocation);
+  GL_TRACE_HOOK(glGetUniformfv);
+  GL_TRACE_HOOK(glGetUniformiv);
+  GL_TRACE_HOOK(glGetUniformuiv);
+  GL_TRACE_HOOK(glGetVertexAttribIiv);
+  GL_TRACE_HOOK(glGetVertexAttribIuiv);
+  GL_TRACE_HOOK(glGetVertexAttribPointerv);
+  GL_TRACE_HOOK(glGetVertexAttribdv);
+  GL_TRACE_HOOK(glGetVertexAttribfv);
+  GL_TRACE_HOOK(glGetVertexAttribiv);
+  GL_TRACE_HOOK(glHint);
+  GL_TRACE_HOOK(glIsBuffer);
+  GL_TRACE_HOOK(glIsEnabled);
+  GL_TRACE_HOOK(glIsEnabledi);
+  GL_TRACE_HOOK(glIsFramebuffer);
+  GL_TRACE_HOOK(glIsProgram);
+  GL_TRACE_HOOK(glIsQuery);
+  GL_TRACE_HOOK(glIsRenderbuffer);
+  GL_TRACE_HOOK(glIsSampler);
+  GL_TRACE_HOOK(glIsShader);
+  GL_TRACE_HOOK(glIsSync);
+  GL_TRACE_HOOK(glIsTexture);
+  GL_TRACE_HOOK(glIsVertexArray);
+  GL_TRACE_HOOK(glLineWidth);
+  GL_TRACE_HOOK(glLinkProgram);
+  GL_TRACE_HOOK(glLogicOp);
+  GL_TRACE_HOOK(glMapBuffer);
+  GL_TRACE_HOOK(glMapBufferRange);
+  GL_TRACE_HOOK(glMultiDrawArrays);
+  GL_TRACE_HOOK(glMultiDrawElements);
+  GL_TRACE_HOOK(glMultiDrawElementsBaseVertex);
+  GL_TRACE_HOOK(glPixelStoref);
+  GL_TRACE_HOOK(glPixelStorei);
+  GL_TRACE_HOOK(glPointParameterf);
+  GL_TRACE_HOOK(glPointParameterfv);
+  GL_TRACE_HOOK(glPointParameteri);
+  GL_TRACE_HOOK(glPointParameteriv);
+  GL_TRACE_HOOK(glPointSize);
+  GL_TRACE_HOOK(glPolygonMode);
+  GL_TRACE_HOOK(glPolygonOffset);
+  GL_TRACE_HOOK(glPrimitiveRestartIndex);
+  GL_TRACE_HOOK(glProvokingVertex);
+  GL_TRACE_HOOK(glQueryCounter);
+  GL_TRACE_HOOK(glReadBuffer);
+  GL_TRACE_HOOK(glReadPixels);
+  GL_TRACE_HOOK(glRenderbufferStorage);
+  GL_TRACE_HOOK(glRenderbufferStorageMultisample);
+  GL_TRACE_HOOK(glSampleCoverage);
+  GL_TRACE_HOOK(glSampleMaski);
+  GL_TRACE_HOOK(glSamplerParameterIiv);
+  GL_TRACE_HOOK(glSamplerParameterIuiv);
+  GL_TRACE_HOOK(glSamplerParameterf);
+  GL_TRACE_HOOK(glSamplerParameterfv);
+  GL_TRACE_HOOK(glSamplerParameteri);
+  GL_TRACE_HOOK(glSamplerParameteriv);
+  GL_TRACE_HOOK(glScissor);
+  GL_TRACE_HOOK(glShaderSource);
+  GL_TRACE_HOOK(glStencilFunc);
+  GL_TRACE_HOOK(glStencilFuncSeparate);
+  GL_TRACE_HOOK(glStencilMask);
+  GL_TRACE_HOOK(glStencilMaskSeparate);
+  GL_TRACE_HOOK(glStencilOp);
+  GL_TRACE_HOOK(glStencilOpSeparate);
+  GL_TRACE_HOOK(glTexBuffer);
+  GL_TRACE_HOOK(glTexImage1D);
+  GL_TRACE_HOOK(glTexImage2D);
+  GL_TRACE_HOOK(glTexImage2DMultisample);
+  GL_TRACE_HOOK(glTexImage3D);
+  GL_TRACE_HOOK(glTexImage3DMultisample);
+  GL_TRACE_HOOK(glTexParameterIiv);
+  GL_TRACE_HOOK(glTexParameterIuiv);
+  GL_TRACE_HOOK(glTexParameterf);
+  GL_TRACE_HOOK(glTexParameterfv);
+  GL_TRACE_HOOK(glTexParameteri);
+  GL_TRACE_HOOK(glTexParameteriv);
+  GL_TRACE_HOOK(glTexSubImage1D);
+  GL_TRACE_HOOK(glTexSubImage2D);
+  GL_TRACE_HOOK(glTexSubImage3D);
+  GL_TRACE_HOOK(glTransformFeedbackVaryings);
+  GL_TRACE_HOOK(glUniform1f);
+  GL_TRACE_HOOK(glUniform1fv);
+  GL_TRACE_HOOK(glUniform1i);
+  GL_TRACE_HOOK(glUniform1iv);
+  GL_TRACE_HOOK(glUniform1ui);
+  GL_TRACE_HOOK(glUniform1uiv);
+  GL_TRACE_HOOK(glUniform2f);
+  GL_TRACE_HOOK(glUniform2fv);
+  GL_TRACE_HOOK(glUniform2i);
+  GL_TRACE_HOOK(glUniform2iv);
+  GL_TRACE_HOOK(glUniform2ui);
+  GL_TRACE_HOOK(glUniform2uiv);
+  GL_TRACE_HOOK(glUniform3f);
+  GL_TRACE_HOOK(glUniform3fv);
+  GL_TRACE_HOOK(glUniform3i);
+  GL_TRACE_HOOK(glUniform3iv);
+  GL_TRACE_HOOK(glUniform3ui);
+  GL_TRACE_HOOK(glUniform3uiv);
+  GL_TRACE_HOOK(glUniform4f);
+  GL_TRACE_HOOK(glUniform4fv);
+  GL_TRACE_HOOK(glUniform4i);
+  GL_TRACE_HOOK(glUniform4iv);
+  GL_TRACE_HOOK(glUniform4ui);
+  GL_TRACE_HOOK(glUniform4uiv);
+  GL_TRACE_HOOK(glUniformBlockBinding);
+  GL_TRACE_HOOK(glUniformMatrix2fv);
+  GL_TRACE_HOOK(glUniformMatrix2x3fv);
+  GL_TRACE_HOOK(glUniformMatrix2x4fv);
+  GL_TRACE_HOOK(glUniformMatrix3fv);
+  GL_TRACE_HOOK(glUniformMatrix3x2fv);
+  GL_TRACE_HOOK(glUniformMatrix3x4fv);
+  GL_TRACE_HOOK(glUniformMatrix4fv);
+  GL_TRACE_HOOK(glUniformMatrix4x2fv);
+  GL_TRACE_HOOK(glUniformMatrix4x3fv);
+  GL_TRACE_HOOK(glUnmapBuffer);
+  GL_TRACE_HOOK(glUseProgram);
+  GL_TRACE_HOOK(glValidateProgram);
+  GL_TRACE_HOOK(glVertexAttrib1d);
+  GL_TRACE_HOOK(glVertexAttrib1dv);
+  GL_TRACE_HOOK(glVertexAttrib1f);
+  GL_TRACE_HOOK(glVertexAttrib1fv);
+  GL_TRACE_HOOK(glVertexAttrib1s);
+  GL_TRACE_HOOK(glVertexAttrib1sv);
+  GL_TRACE_HOOK(glVertexAttrib2d);
+  GL_TRACE_HOOK(glVertexAttrib2dv);
+  GL_TRACE_HOOK(glVertexAttrib2f);
+  GL_TRACE_HOOK(glVertexAttrib2fv);
+  GL_TRACE_HOOK(glVertexAttrib2s);
+  GL_TRACE_HOOK(glVertexAttrib2sv);
+  GL_TRACE_HOOK(glVertexAttrib3d);
+  GL_TRACE_HOOK(glVertexAttrib3dv);
+  GL_TRACE_HOOK(glVertexAttrib3f);
+  GL_TRACE_HOOK(glVertexAttrib3fv);
+  GL_TRACE_HOOK(glVertexAttrib3s);
+  GL_TRACE_HOOK(glVertexAttrib3sv);
+  GL_TRACE_HOOK(glVertexAttrib4Nbv);
+  GL_TRACE_HOOK(glVertexAttrib4Niv);
+  GL_TRACE_HOOK(glVertexAttrib4Nsv);
+  GL_TRACE_HOOK(glVertexAttrib4Nub);
+  GL_TRACE_HOOK(glVertexAttrib4Nubv);
+  GL_TRACE_HOOK(glVertexAttrib4Nuiv);
+  GL_TRACE_HOOK(glVertexAttrib4Nusv);
+  GL_TRACE_HOOK(glVertexAttrib4bv);
+  GL_TRACE_HOOK(glVertexAttrib4d);
+  GL_TRACE_HOOK(glVertexAttrib4dv);
+  GL_TRACE_HOOK(glVertexAttrib4f);
+  GL_TRACE_HOOK(glVertexAttrib4fv);
+  GL_TRACE_HOOK(glVertexAttrib4iv);
+  GL_TRACE_HOOK(glVertexAttrib4s);
+  GL_TRACE_HOOK(glVertexAttrib4sv);
+  GL_TRACE_HOOK(glVertexAttrib4ubv);
+  GL_TRACE_HOOK(glVertexAttrib4uiv);
+  GL_TRACE_HOOK(glVertexAttrib4usv);
+  GL_TRACE_HOOK(glVertexAttribDivisor);
+  GL_TRACE_HOOK(glVertexAttribI1i);
+  GL_TRACE_HOOK(glVertexAttribI1iv);
+  GL_TRACE_HOOK(glVertexAttribI1ui);
+  GL_TRACE_HOOK(glVertexAttribI1uiv);
+  GL_TRACE_HOOK(glVertexAttribI2i);
+  GL_TRACE_HOOK(glVertexAttribI2iv);
+  GL_TRACE_HOOK(glVertexAttribI2ui);
+  GL_TRACE_HOOK(glVertexAttribI2uiv);
+  GL_TRACE_HOOK(glVertexAttribI3i);
+  GL_TRACE_HOOK(glVertexAttribI3iv);
+  GL_TRACE_HOOK(glVertexAttribI3ui);
+  GL_TRACE_HOOK(glVertexAttribI3uiv);
+  GL_TRACE_HOOK(glVertexAttribI4bv);
+  GL_TRACE_HOOK(glVertexAttribI4i);
+  GL_TRACE_HOOK(glVertexAttribI4iv);
+  GL_TRACE_HOOK(glVertexAttribI4sv);
+  GL_TRACE_HOOK(glVertexAttribI4ubv);
+  GL_TRACE_HOOK(glVertexAttribI4ui);
+  GL_TRACE_HOOK(glVertexAttribI4uiv);
+  GL_TRACE_HOOK(glVertexAttribI4usv);
+  GL_TRACE_HOOK(glVertexAttribIPointer);
+  GL_TRACE_HOOK(glVertexAttribP1ui);
+  GL_TRACE_HOOK(glVertexAttribP1uiv);
+  GL_TRACE_HOOK(glVertexAttribP2ui);
+  GL_TRACE_HOOK(glVertexAttribP2uiv);
+  GL_TRACE_HOOK(glVertexAttribP3ui);
+  GL_TRACE_HOOK(glVertexAttribP3uiv);
+  GL_TRACE_HOOK(glVertexAttribP4ui);
+  GL_TRACE_HOOK(glVertexAttribP4uiv);
+  GL_TRACE_HOOK(glVertexAttribPointer);
+  GL_TRACE_HOOK(glViewport);
+  GL_TRACE_HOOK(glWaitSync);
+  // GLExtensions.hpp
+  GL_TRACE_HOOK(glGetProgramBinary);
+  GL_TRACE_HOOK(glProgramBinary);
+  GL_TRACE_HOOK(glProgramParameteri);
+  GL_TRACE_HOOK(glMaxShaderCompilerThreadsKHR);
+  GL_TRACE_HOOK(glPatchParameteri);
+  GL_TRACE_HOOK(glBufferStorage);
+  GL_TRACE_HOOK(glDispatchCompute);
+  GL_TRACE_HOOK(glMemoryBarrier);
+  GL_TRACE_HOOK(glMultiDrawElementsIndirect);
+  GL_TRACE_HOOK(glClipControl);
+  GL_TRACE_HOOK(glTexStorage2D);
+}
+
+#undef GL_TRACE_HOOK
+
+} // namespace
+
+bool installGLTrace(const std::string &reportPath) {
+  if(reportPath == "-") {
+    g_report = &std::cout;
+  } else {
+    g_reportFile.open(reportPath);
+    if(!g_reportFile) {
+      std::cerr << "ERROR: Cannot write the GL trace to " << reportPath << std::endl;
+      return false;
+    }
+    g_report = &g_reportFile;
+  }
+  if(g_entryPoints.empty())
+    hookEntryPoints();
+  return true;
+}
+
+void glTraceBeginFrame() {
+  g_inFrame = g_report != nullptr;
+}
+
+void glTraceEndFrame() {
+  if(!g_inFrame)
+    return;
+  g_inFrame = false;
+  std::vector<EntryPoint *> called;
+  size_t calls = 0;
+  size_t gets = 0;
+  double ns = 0.0;
+  for(EntryPoint &entry : g_entryPoints) {
+    if(entry.frameCalls == 0)
+      continue;
+    called.push_back(&entry);
+    calls += entry.frameCalls;
+    gets += entry.get ? entry.frameCalls : 0;
+    ns += entry.frameNs;
+  }
+  std::sort(called.begin(), called.end(), [](const EntryPoint *a, const EntryPoint *b) { return a->frameNs > b->frameNs; });
+
+  char line[256];
+  std::snprintf(line, sizeof(line), "Frame %zu: %zu calls, %.3f ms in the driver, %zu glGet*", g_frames, calls, 1e-6*ns, gets);
+  *g_report << line << '\n';
+  for(EntryPoint *entry : called) {
+    std::snprintf(line, sizeof(line), "  %-36s %6zu %9.3f ms%s", entry->name, entry->frameCalls, 1e-6*entry->frameNs,
+                  entry->get ? "  glGet* on the hot path" : "");
+    *g_report << line << '\n';
+    entry->calls += entry->frameCalls;
+    entry->ns += entry->frameNs;
+    entry->frameCalls = 0;
+    entry->frameNs = 0.0;
+  }
+  *g_report << std::flush;
+  ++g_frames;
+}
+
+void printGLTraceStats() {
+  if(g_frames == 0)
+    return;
+  std::vector<const EntryPoint *> called;
+  size_t calls = 0;
+  size_t outsideCalls = 0;
+  double ns = 0.0;
+  for(const EntryPoint &entry : g_entryPoints) {
+    outsideCalls += entry.outsideCalls;
+    if(entry.calls == 0)
+      continue;
+    called.push_back(&entry);
+    calls += entry.calls;
+    ns += entry.ns;
+  }
+  std::sort(called.begin(), called.end(), [](const EntryPoint *a, const EntryPoint *b) { return a->ns > b->ns; });
+
+  char line[256];
+  std::snprintf(line, sizeof(line), "GL trace: %zu frames, %.1f calls and %.3f ms in the driver per frame (%zu entry points), %zu calls outside the frames",
+                g_frames, static_cast<double>(calls)/g_frames, 1e-6*ns/g_frames, called.size(), outsideCalls);
+  std::cout << line << std::endl;
+  const size_t kTop = 8;
+  for(size_t i = 0; i < std::min(kTop, called.size()); ++i) {
+    std::snprintf(line, sizeof(line), "  %-36s %8.1f calls %8.3f ms per frame", called[i]->name,
+                  static_cast<double>(called[i]->calls)/g_frames, 1e-6*called[i]->ns/g_frames);
+    std::cout << line << std::endl;
+  }
+  for(const EntryPoint *entry : called) {
+    if(!entry->get)
+      continue;
+    std::snprintf(line, sizeof(line), "  glGet* on the hot path: %s, %.1f calls per frame", entry->name,
+                  static_cast<double>(entry->calls)/g_frames);
+    std::cout << line << std::endl;
+  }
+}
@@ -0,0 +1,39 @@
+// ----------------------------------------------------------------------------
+// GLTrace.hpp
+//
+// Description: Interception of the OpenGL calls, for development builds
+//              (Debug builds, unless configured with -DGL_TRACE=OFF). Every
+//              entry point of the glad table, and of GLExtensions.hpp, is
+//              replaced by a wrapper that counts its calls and the CPU time
+//              spent in the driver. Each frame is written to a report, with
+//              the glGet* calls of the frame flagged: they stall the driver
+//              on the hot path. Without GL_TRACE, nothing is compiled in.
+// ----------------------------------------------------------------------------
+
+#ifndef GL_TRACE_HPP
+#define GL_TRACE_HPP
+
+#ifdef GL_TRACE
+
+#include <string>
+
+// Wraps the loaded entry points; call after loadGLExtensions(). The frames
+// are reported to reportPath ("-" for stdout).
+bool installGLTrace(const std::string &reportPath);
+
+// Calls between these are those of the frame, reported when it ends
+void glTraceBeginFrame();
+void glTraceEndFrame();
+
+// Calls and driver time per frame over the run, and the glGet* of the frames
+void printGLTraceStats();
+
+#else
+
+inline void glTraceBeginFrame() {}
+inline void glTraceEndFrame() {}
+inline void printGLTraceStats() {}
+
+#endif // GL_TRACE
+
+#endif // GL_TRACE_HPP
@@ -0,0 +1,227 @@
+// ----------------------------------------------------------------------------
+// GpuDrivenRenderer.cpp
+//
+// Description: GL 4.3 rendering path for scenes with many bodies. Bodies
+//              live in a shader storage buffer; a compute shader culls them,
+//              selects their LOD or a ray-traced impostor and writes the
+//              indirect draw commands, and the frame is submitted with one
+//              glMultiDrawElementsIndirect for the meshes and one for the
+//              impostors.
+// ----------------------------------------------------------------------------
+
+#include "GpuDrivenRenderer.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+#include "Mesh.hpp"
+#include "ShaderLibrary.hpp"
+#include "UniformBlocks.hpp"
+
+#include <glm/ext.hpp>
+
+#include <algorithm>
+#include <memory>
+
+namespace {
+
+// Sphere resolution of each LOD, and the projected radius (in pixels) from
+// which a LOD is used
+const size_t kLodResolutions[GpuDrivenRenderer::kNumLods] = { 32, 16, 8, 4 };
+const float kLodPixelRadius[GpuDrivenRenderer::kNumLods - 1] = { 64.0f, 16.0f, 4.0f };
+const float kMinPixelRadius = 0.5f;
+
+bool isLinked(GLuint program) {
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  return success == GL_TRUE;
+}
+
+} // namespace
+
+bool GpuDrivenRenderer::init(ProgramCache &cache, const std::string &materialDefines, size_t maxBodies,
+                             const std::function<void(GLuint)> &onProgramReady) {
+  m_maxBodies = maxBodies;
+  m_cullProgram = loadProgram(cache, { { GL_COMPUTE_SHADER, "cullComputeShader.glsl" } },
+                              "#define NUM_LODS " + std::to_string(kNumLods) + "\n");
+  m_drawProgram = loadProgram(cache, { { GL_VERTEX_SHADER, "gpuDrivenVertexShader.glsl" }, { GL_FRAGMENT_SHADER, "fragmentShader.glsl" } },
+                              materialDefines + "#define GPU_DRIVEN\n");
+  m_impostorProgram = loadProgram(cache, { { GL_VERTEX_SHADER, "gpuDrivenVertexShader.glsl" }, { GL_FRAGMENT_SHADER, "fragmentShader.glsl" } },
+                                  materialDefines + "#define GPU_DRIVEN\n#define IMPOSTOR\n");
+  if(!isLinked(m_cullProgram) || !isLinked(m_drawProgram) || !isLinked(m_impostorProgram))
+    return false;
+
+  m_bodyCountLoc = glGetUniformLocation(m_cullProgram, "bodyCount");
+  m_frustumPlanesLoc = glGetUniformLocation(m_cullProgram, "frustumPlanes");
+  m_camPositionLoc = glGetUniformLocation(m_cullProgram, "camPosition");
+  m_pixelScaleLoc = glGetUniformLocation(m_cullProgram, "pixelScale");
+  m_minPixelRadiusLoc = glGetUniformLocation(m_cullProgram, "minPixelRadius");
+  m_lodPixelRadiusLoc = glGetUniformLocation(m_cullProgram, "lodPixelRadius");
+  m_impostorPixelRadiusLoc = glGetUniformLocation(m_cullProgram, "impostorPixelRadius");
+  for(GLuint program : { m_drawProgram, m_impostorProgram }) {
+    g_glState.useProgram(program);
+    glUniform1i(glGetUniformLocation(program, "albedoArray"), 1); // texture unit 1
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameBlock"), FRAME_BLOCK_BINDING);
+    onProgramReady(program);
+  }
+
+  // Pack the LODs one after the other; each indirect command addresses its
+  // range with firstIndex/baseVertex
+  std::vector<float> positions, normals, texCoords;
+  std::vector<unsigned int> indices;
+  for(int lod = 0; lod < kNumLods; ++lod) {
+    std::shared_ptr<Mesh> mesh = Mesh::genSphere(kLodResolutions[lod]);
+    DrawCommand command;
+    command.count = static_cast<GLuint>(mesh->triangleIndices().size());
+    command.instanceCount = 0;
+    command.firstIndex = static_cast<GLuint>(indices.size());
+    command.baseVertex = static_cast<GLint>(positions.size()/3);
+    command.baseInstance = static_cast<GLuint>(lod*maxBodies);
+    m_commandTemplate.push_back(command);
+    positions.insert(positions.end(), mesh->vertexPositions().begin(), mesh->vertexPositions().end());
+    normals.insert(normals.end(), mesh->vertexNormals().begin(), mesh->vertexNormals().end());
+    texCoords.insert(texCoords.end(), mesh->vertexTexCoords().begin(), mesh->vertexTexCoords().end());
+    indices.insert(indices.end(), mesh->triangleIndices().begin(), mesh->triangleIndices().end());
+  }
+
+  // Square of the impostors, whose corners gpuDrivenVertexShader.glsl turns
+  // to face the camera
+  DrawCommand impostorCommand = { 6, 0, static_cast<GLuint>(indices.size()), static_cast<GLint>(positions.size()/3),
+                                  static_cast<GLuint>(kNumLods*maxBodies) };
+  m_commandTemplate.push_back(impostorCommand);
+  const float corners[] = { -1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f, -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f };
+  positions.insert(positions.end(), corners, corners + 12);
+  normals.insert(normals.end(), 12, 0.0f);
+  texCoords.insert(texCoords.end(), 8, 0.0f);
+  const unsigned int quadIndices[] = { 0, 1, 2, 2, 1, 3 };
+  indices.insert(indices.end(), quadIndices, quadIndices + 6);
+
+  glGenVertexArrays(1, &m_vao);
+  g_glState.bindVertexArray(m_vao);
+  glGenBuffers(1, &m_posVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_posVbo);
+  glBufferData(GL_ARRAY_BUFFER, positions.size()*sizeof(float), positions.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), 0);
+  glEnableVertexAttribArray(0);
+  glGenBuffers(1, &m_normalVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_normalVbo);
+  glBufferData(GL_ARRAY_BUFFER, normals.size()*sizeof(float), normals.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), 0);
+  glEnableVertexAttribArray(1);
+  glGenBuffers(1, &m_texCoordVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_texCoordVbo);
+  glBufferData(GL_ARRAY_BUFFER, texCoords.size()*sizeof(float), texCoords.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), 0);
+  glEnableVertexAttribArray(2);
+  glGenBuffers(1, &m_ibo);
+  g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+  // The visible list written by the culling pass doubles as a per-instance
+  // attribute; baseInstance selects the region of each LOD
+  glGenBuffers(1, &m_visibleBuffer);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+  glBufferData(GL_ARRAY_BUFFER, kNumCommands*maxBodies*sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+  glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+  glVertexAttribDivisor(3, 1);
+  glEnableVertexAttribArray(3);
+  g_glState.bindVertexArray(0);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glGenBuffers(1, &m_bodyBuffer);
+  g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, m_bodyBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, maxBodies*sizeof(GpuBody), nullptr, GL_STREAM_DRAW);
+  g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  glGenBuffers(1, &m_commandBuffer);
+  g_glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commandTemplate.size()*sizeof(DrawCommand), m_commandTemplate.data(), GL_DYNAMIC_COPY);
+  g_glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  return true;
+}
+
+void GpuDrivenRenderer::buildAlbedoArray(const std::vector<GLuint> &textures, GLsizei width, GLsizei height) {
+  glGenTextures(1, &m_albedoArray);
+  g_glState.bindTexture(GL_TEXTURE_2D_ARRAY, m_albedoArray);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, width, height, std::max<GLsizei>(1, static_cast<GLsizei>(textures.size())),
+               0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+  // Resample each texture into its layer with a filtered blit
+  GLuint fbos[2];
+  glGenFramebuffers(2, fbos);
+  g_glState.bindFramebuffer(GL_READ_FRAMEBUFFER, fbos[0]);
+  g_glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[1]);
+  for(size_t layer = 0; layer < textures.size(); ++layer) {
+    GLint srcWidth = 0, srcHeight = 0;
+    g_glState.bindTexture(GL_TEXTURE_2D, textures[layer]);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &srcWidth);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &srcHeight);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[layer], 0);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_albedoArray, 0, static_cast<GLint>(layer));
+    glBlitFramebuffer(0, 0, srcWidth, srcHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  }
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+  g_glState.deleteFramebuffers(2, fbos);
+  glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  g_glState.bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void GpuDrivenRenderer::render(const std::vector<GpuBody> &bodies, const glm::mat4 &viewProj, const glm::vec3 &camPosition, float pixelScale) {
+  const size_t count = std::min(bodies.size(), m_maxBodies);
+  if(count == 0)
+    return;
+
+  // Upload the bodies and reset the instance counts of the commands
+  g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, m_bodyBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, m_maxBodies*sizeof(GpuBody), nullptr, GL_STREAM_DRAW); // Orphan
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count*sizeof(GpuBody), bodies.data());
+  g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  g_glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, m_commandTemplate.size()*sizeof(DrawCommand), m_commandTemplate.data());
+
+  // Frustum planes from the rows of the view-projection matrix (Gribb-Hartmann)
+  const glm::mat4 m = glm::transpose(viewProj);
+  glm::vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+  for(glm::vec4 &plane : planes)
+    plane /= glm::length(glm::vec3(plane));
+
+  g_glState.useProgram(m_cullProgram);
+  glUniform1ui(m_bodyCountLoc, static_cast<GLuint>(count));
+  glUniform4fv(m_frustumPlanesLoc, 6, glm::value_ptr(planes[0]));
+  glUniform3fv(m_camPositionLoc, 1, glm::value_ptr(camPosition));
+  glUniform1f(m_pixelScaleLoc, pixelScale);
+  glUniform1f(m_minPixelRadiusLoc, kMinPixelRadius);
+  glUniform1fv(m_lodPixelRadiusLoc, kNumLods - 1, kLodPixelRadius);
+  glUniform1f(m_impostorPixelRadiusLoc, m_impostorPixelRadius);
+  g_glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_bodyBuffer);
+  g_glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_commandBuffer);
+  g_glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleBuffer);
+  glDispatchCompute(static_cast<GLuint>((count + 63)/64), 1, 1);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+  g_glState.useProgram(m_drawProgram);
+  g_glState.activeTexture(GL_TEXTURE1);
+  g_glState.bindTexture(GL_TEXTURE_2D_ARRAY, m_albedoArray);
+  g_glState.bindVertexArray(m_vao);
+  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, kNumLods, 0);
+  g_glState.useProgram(m_impostorProgram);
+  glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void *>(kNumLods*sizeof(DrawCommand)), 1, 0);
+  g_glState.bindVertexArray(0);
+  g_glState.bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  g_glState.activeTexture(GL_TEXTURE0);
+  g_glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuDrivenRenderer::clear() {
+  const GLuint buffers[] = { m_posVbo, m_normalVbo, m_texCoordVbo, m_ibo, m_bodyBuffer, m_commandBuffer, m_visibleBuffer };
+  g_glState.deleteBuffers(7, buffers);
+  g_glState.deleteVertexArrays(1, &m_vao);
+  g_glState.deleteTextures(1, &m_albedoArray);
+  g_glState.deleteProgram(m_cullProgram);
+  g_glState.deleteProgram(m_drawProgram);
+  g_glState.deleteProgram(m_impostorProgram);
+  *this = GpuDrivenRenderer();
+}
@@ -0,0 +1,92 @@
+// ----------------------------------------------------------------------------
+// GpuDrivenRenderer.hpp
+//
+// Description: GL 4.3 rendering path for scenes with many bodies. Bodies
+//              live in a shader storage buffer; a compute shader culls them,
+//              selects their LOD or a ray-traced impostor and writes the
+//              indirect draw commands, and the frame is submitted with one
+//              glMultiDrawElementsIndirect for the meshes and one for the
+//              impostors.
+// ----------------------------------------------------------------------------
+
+#ifndef GPU_DRIVEN_RENDERER_HPP
+#define GPU_DRIVEN_RENDERER_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class ProgramCache;
+
+// std430 record of the body buffer
+struct GpuBody {
+  glm::mat4 modelMatrix;
+  glm::vec4 boundingSphere; // xyz: center in world space, w: radius
+  glm::vec4 color;          // rgb: albedo or emissive color, a: albedo layer (negative when untextured)
+  glm::vec4 material;       // x: 1 for emissive bodies, y: mask of the occluders that may shadow the body
+};
+
+class GpuDrivenRenderer {
+public:
+  static const int kNumLods = 4;
+  static const int kNumCommands = kNumLods + 1; // The last command draws the impostors
+
+  // Returns false when the programs fail to link; the caller then keeps the
+  // per-draw path. onProgramReady is called with the bound draw programs.
+  bool init(ProgramCache &cache, const std::string &materialDefines, size_t maxBodies,
+            const std::function<void(GLuint)> &onProgramReady);
+
+  // Copies the given 2D textures into the layers of one texture array, since
+  // a single multi-draw cannot switch textures between bodies
+  void buildAlbedoArray(const std::vector<GLuint> &textures, GLsizei width = 1024, GLsizei height = 512);
+
+  // Bodies whose projected radius is below this many pixels are drawn as
+  // impostors (0 disables them)
+  inline void setImpostorPixelRadius(float pixels) { m_impostorPixelRadius = pixels; }
+
+  // Culls and draws all bodies; the FrameBlock must already be bound
+  void render(const std::vector<GpuBody> &bodies, const glm::mat4 &viewProj, const glm::vec3 &camPosition, float pixelScale);
+
+  void clear();
+
+private:
+  struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  GLuint m_cullProgram = 0;
+  GLuint m_drawProgram = 0;
+  GLuint m_impostorProgram = 0;
+  GLint m_bodyCountLoc = -1;
+  GLint m_frustumPlanesLoc = -1;
+  GLint m_camPositionLoc = -1;
+  GLint m_pixelScaleLoc = -1;
+  GLint m_minPixelRadiusLoc = -1;
+  GLint m_lodPixelRadiusLoc = -1;
+  GLint m_impostorPixelRadiusLoc = -1;
+  float m_impostorPixelRadius = 0.0f;
+
+  // All LODs of the sphere, then the impostor square, packed in shared
+  // vertex and index buffers
+  GLuint m_vao = 0;
+  GLuint m_posVbo = 0;
+  GLuint m_normalVbo = 0;
+  GLuint m_texCoordVbo = 0;
+  GLuint m_ibo = 0;
+
+  GLuint m_bodyBuffer = 0;     // SSBO of GpuBody
+  GLuint m_commandBuffer = 0;  // One DrawCommand per LOD, plus the impostors
+  GLuint m_visibleBuffer = 0;  // Compacted body indices, one region of maxBodies per command
+  GLuint m_albedoArray = 0;
+  size_t m_maxBodies = 0;
+  std::vector<DrawCommand> m_commandTemplate; // Commands with zero instances, restored every frame
+};
+
+#endif // GPU_DRIVEN_RENDERER_HPP
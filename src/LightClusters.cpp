@@ -0,0 +1,243 @@
+// ----------------------------------------------------------------------------
+// LightClusters.cpp
+//
+// Description: Clustered forward lighting. The view frustum is split into a
+//              grid of clusters (screen tiles times exponential depth
+//              slices); every frame the lights are binned on the CPU into the
+//              clusters their sphere of influence overlaps, and the fragment
+//              shader only iterates the lights of its own cluster. Lights,
+//              cluster ranges and light indices are read from buffer
+//              textures, available since GL 3.1.
+// ----------------------------------------------------------------------------
+
+#include "LightClusters.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+#include "UniformBlocks.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+const int kNumClusters = LightClusters::kTilesX*LightClusters::kTilesY*LightClusters::kSlices;
+
+// Counters written by the LIGHT_STATS variants of fragmentShader.glsl
+const GLuint kStatsBinding = 3;
+struct FragmentStats {
+  GLuint fragments;
+  GLuint lights;
+  GLuint maxLights;
+  GLuint histogram[LightClusters::kHistogramBuckets];
+};
+
+} // namespace
+
+void LightClusters::init(bool gatherFragmentStats) {
+  const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+  glGenBuffers(3, m_buffers);
+  glGenTextures(3, m_textures);
+  for(int i = 0; i < 3; ++i) {
+    g_glState.bindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+    g_glState.bindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_buffers[i]);
+  }
+  g_glState.bindTexture(GL_TEXTURE_BUFFER, 0);
+  g_glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+  m_clusters.resize(2*kNumClusters);
+
+  if(gatherFragmentStats) {
+    const FragmentStats zero = {};
+    glGenBuffers(1, &m_statsBuffer);
+    g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(FragmentStats), &zero, GL_DYNAMIC_READ);
+    g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+}
+
+void LightClusters::setupProgram(GLuint program) {
+  glUniform1i(glGetUniformLocation(program, "lightData"), kLightUnit);
+  glUniform1i(glGetUniformLocation(program, "clusterRanges"), kClusterUnit);
+  glUniform1i(glGetUniformLocation(program, "lightIndices"), kIndexUnit);
+  const GLuint blockIndex = glGetUniformBlockIndex(program, "LightingBlock");
+  if(blockIndex != GL_INVALID_INDEX)
+    glUniformBlockBinding(program, blockIndex, LIGHTING_BLOCK_BINDING);
+}
+
+int LightClusters::slice(float depth) const {
+  return std::min(kSlices - 1, std::max(0, static_cast<int>(std::floor(std::log(depth)*m_sliceScale + m_sliceBias))));
+}
+
+bool LightClusters::clusterRange(const PointLight &light, const glm::mat4 &viewMat, const glm::mat4 &projMat, ClusterRange &range) const {
+  range.min = glm::ivec3(0);
+  range.max = glm::ivec3(kTilesX - 1, kTilesY - 1, kSlices - 1);
+  if(light.range <= 0.0f)
+    return true; // Lights every cluster
+
+  const glm::vec3 center = glm::vec3(viewMat*glm::vec4(light.position, 1.0f));
+  const float depth = -center.z;
+  const float r = light.range;
+  if(depth + r < m_near || depth - r > m_far)
+    return false;
+  range.min.z = slice(std::max(depth - r, m_near));
+  range.max.z = slice(std::min(depth + r, m_far));
+  if(depth - r <= m_near)
+    return true; // The sphere reaches the camera: every tile
+
+  // Screen-space bounds of the corners of the bounding box, all in front of
+  // the camera
+  glm::vec2 ndcMin(1e30f), ndcMax(-1e30f);
+  for(int corner = 0; corner < 8; ++corner) {
+    const glm::vec3 offset((corner & 1) ? r : -r, (corner & 2) ? r : -r, (corner & 4) ? r : -r);
+    const glm::vec4 clip = projMat*glm::vec4(center + offset, 1.0f);
+    const glm::vec2 ndc = glm::vec2(clip)/clip.w;
+    ndcMin = glm::min(ndcMin, ndc);
+    ndcMax = glm::max(ndcMax, ndc);
+  }
+  if(ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+    return false;
+  const glm::vec2 tiles(kTilesX, kTilesY);
+  const glm::ivec2 tileMin = glm::ivec2(glm::floor((0.5f*ndcMin + 0.5f)*tiles));
+  const glm::ivec2 tileMax = glm::ivec2(glm::floor((0.5f*ndcMax + 0.5f)*tiles));
+  range.min.x = std::max(0, tileMin.x);
+  range.min.y = std::max(0, tileMin.y);
+  range.max.x = std::min(kTilesX - 1, tileMax.x);
+  range.max.y = std::min(kTilesY - 1, tileMax.y);
+  return true;
+}
+
+// Adds the counters of the previous frame, and resets them. The 32-bit
+// counters would overflow over a few frames, so they are read back every
+// frame; this synchronizes with the GPU: the statistics are for
+// measurements, not for timing.
+void LightClusters::readFragmentStats() {
+  if(!m_statsBuffer)
+    return;
+  FragmentStats stats;
+  const FragmentStats zero = {};
+  g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffer);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), &stats);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+  g_glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  m_statsFragments += stats.fragments;
+  m_statsLights += stats.lights;
+  m_statsMaxLights = std::max(m_statsMaxLights, stats.maxLights);
+  for(int i = 0; i < kHistogramBuckets; ++i)
+    m_statsHistogram[i] += stats.histogram[i];
+}
+
+void LightClusters::update(const std::vector<PointLight> &lights, const glm::mat4 &viewMat, const glm::mat4 &projMat,
+                           float near, float far, int viewportWidth, int viewportHeight, LightingBlock &block) {
+  readFragmentStats();
+
+  // Exponential slices: each one spans the same ratio of depths, so that
+  // clusters stay roughly cubic from near to far
+  m_near = near;
+  m_far = far;
+  m_sliceScale = kSlices/std::log(far/near);
+  m_sliceBias = -std::log(near)*m_sliceScale;
+  m_numLights = lights.size();
+
+  // Count the lights of each cluster, then place the index lists one after
+  // the other
+  std::fill(m_clusters.begin(), m_clusters.end(), 0u);
+  m_lightRanges.resize(lights.size());
+  std::vector<bool> binned(lights.size());
+  for(size_t i = 0; i < lights.size(); ++i) {
+    const ClusterRange &range = m_lightRanges[i];
+    binned[i] = clusterRange(lights[i], viewMat, projMat, m_lightRanges[i]);
+    if(!binned[i])
+      continue;
+    for(int z = range.min.z; z <= range.max.z; ++z)
+      for(int y = range.min.y; y <= range.max.y; ++y)
+        for(int x = range.min.x; x <= range.max.x; ++x)
+          ++m_clusters[2*(x + kTilesX*(y + kTilesY*z)) + 1];
+  }
+  GLuint offset = 0;
+  GLuint occupied = 0;
+  for(int c = 0; c < kNumClusters; ++c) {
+    const GLuint count = m_clusters[2*c + 1];
+    m_clusters[2*c] = offset;
+    m_clusters[2*c + 1] = 0;
+    offset += count;
+    occupied += count > 0;
+    m_maxLightsPerCluster = std::max(m_maxLightsPerCluster, count);
+  }
+  m_indices.resize(std::max<size_t>(offset, 1));
+  for(size_t i = 0; i < lights.size(); ++i) {
+    if(!binned[i])
+      continue;
+    const ClusterRange &range = m_lightRanges[i];
+    for(int z = range.min.z; z <= range.max.z; ++z)
+      for(int y = range.min.y; y <= range.max.y; ++y)
+        for(int x = range.min.x; x <= range.max.x; ++x) {
+          GLuint *cluster = &m_clusters[2*(x + kTilesX*(y + kTilesY*z))];
+          m_indices[cluster[0] + cluster[1]++] = static_cast<GLuint>(i);
+        }
+  }
+  ++m_frames;
+  m_sumLightsPerCluster += offset;
+  m_sumOccupiedClusters += occupied;
+
+  m_lightData.resize(std::max<size_t>(2*lights.size(), 2));
+  for(size_t i = 0; i < lights.size(); ++i) {
+    m_lightData[2*i] = glm::vec4(lights[i].position, lights[i].range);
+    m_lightData[2*i + 1] = glm::vec4(lights[i].color, 0.0f);
+  }
+
+  // The buffers are orphaned: the draws of the previous frame keep their copy
+  const size_t sizes[3] = { m_lightData.size()*sizeof(glm::vec4), m_clusters.size()*sizeof(GLuint), m_indices.size()*sizeof(GLuint) };
+  const void *data[3] = { m_lightData.data(), m_clusters.data(), m_indices.data() };
+  for(int i = 0; i < 3; ++i) {
+    g_glState.bindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+  }
+  g_glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  block.clusterDims = glm::ivec4(kTilesX, kTilesY, kSlices, static_cast<int>(lights.size()));
+  block.clusterScale = glm::vec4(static_cast<float>(kTilesX)/viewportWidth, static_cast<float>(kTilesY)/viewportHeight,
+                                 m_sliceScale, m_sliceBias);
+}
+
+void LightClusters::bind() const {
+  const GLint units[3] = { kLightUnit, kClusterUnit, kIndexUnit };
+  for(int i = 0; i < 3; ++i) {
+    g_glState.activeTexture(GL_TEXTURE0 + units[i]);
+    g_glState.bindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+  }
+  g_glState.activeTexture(GL_TEXTURE0);
+  if(m_statsBuffer)
+    g_glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, kStatsBinding, m_statsBuffer);
+}
+
+void LightClusters::printStats() {
+  if(m_frames == 0)
+    return;
+  char line[256];
+  std::snprintf(line, sizeof(line), "Lighting: %zu lights, %dx%dx%d clusters, %.1f%% occupied, %.2f lights per occupied cluster (max %u)",
+                m_numLights, kTilesX, kTilesY, kSlices, 100.0*m_sumOccupiedClusters/(m_frames*double(kNumClusters)),
+                m_sumOccupiedClusters > 0.0 ? m_sumLightsPerCluster/m_sumOccupiedClusters : 0.0, m_maxLightsPerCluster);
+  std::cout << line << std::endl;
+  readFragmentStats(); // The last frame
+  if(m_statsFragments > 0.0) {
+    std::snprintf(line, sizeof(line), "  per lit fragment: %.2f lights on average, %u at most, over %.0f fragments",
+                  m_statsLights/m_statsFragments, m_statsMaxLights, m_statsFragments);
+    std::cout << line << std::endl << "  lights per fragment:";
+    const char *labels[kHistogramBuckets] = { "0", "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64+" };
+    for(int i = 0; i < kHistogramBuckets; ++i) {
+      std::snprintf(line, sizeof(line), " %s %.1f%%", labels[i], 100.0*m_statsHistogram[i]/m_statsFragments);
+      std::cout << line;
+    }
+    std::cout << std::endl;
+  }
+}
+
+void LightClusters::clear() {
+  g_glState.deleteTextures(3, m_textures);
+  g_glState.deleteBuffers(3, m_buffers);
+  g_glState.deleteBuffers(1, &m_statsBuffer);
+  *this = LightClusters();
+}
@@ -0,0 +1,100 @@
+// ----------------------------------------------------------------------------
+// LightClusters.hpp
+//
+// Description: Clustered forward lighting. The view frustum is split into a
+//              grid of clusters (screen tiles times exponential depth
+//              slices); every frame the lights are binned on the CPU into the
+//              clusters their sphere of influence overlaps, and the fragment
+//              shader only iterates the lights of its own cluster. Lights,
+//              cluster ranges and light indices are read from buffer
+//              textures, available since GL 3.1.
+// ----------------------------------------------------------------------------
+
+#ifndef LIGHT_CLUSTERS_HPP
+#define LIGHT_CLUSTERS_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct LightingBlock;
+
+struct PointLight {
+  glm::vec3 position; // World space
+  float range;        // Distance at which the light fades out; 0 for an unattenuated light (the sun)
+  glm::vec3 color;
+};
+
+class LightClusters {
+public:
+  static const int kTilesX = 16;
+  static const int kTilesY = 9;
+  static const int kSlices = 24;
+
+  // Texture units of the light, cluster and index buffers
+  static const GLint kLightUnit = 2;
+  static const GLint kClusterUnit = 3;
+  static const GLint kIndexUnit = 4;
+
+  static const int kHistogramBuckets = 8; // Lights per fragment: 0, 1, 2-3, 4-7, ..., 64 and more
+
+  // With gatherFragmentStats, the lit fragments count the lights they
+  // evaluate into a storage buffer (GL 4.3, the LIGHT_STATS variants)
+  void init(bool gatherFragmentStats);
+
+  // Binds the samplers and blocks of a program drawing lit surfaces
+  static void setupProgram(GLuint program);
+
+  // Bins the lights for the frame, uploads the buffers and fills the
+  // parameters of the lookup
+  void update(const std::vector<PointLight> &lights, const glm::mat4 &viewMat, const glm::mat4 &projMat,
+              float near, float far, int viewportWidth, int viewportHeight, LightingBlock &block);
+
+  // Binds the buffers for the draws of the frame
+  void bind() const;
+
+  // Lights per cluster, averaged over the frames, and lights per fragment
+  // when gathered
+  void printStats();
+
+  void clear();
+
+private:
+  // Inclusive cluster range of one light
+  struct ClusterRange {
+    glm::ivec3 min;
+    glm::ivec3 max;
+  };
+
+  bool clusterRange(const PointLight &light, const glm::mat4 &viewMat, const glm::mat4 &projMat, ClusterRange &range) const;
+  int slice(float depth) const;
+  void readFragmentStats();
+
+  float m_near = 0.1f;
+  float m_far = 10.0f;
+  float m_sliceScale = 1.0f; // Slices per unit of log(depth)
+  float m_sliceBias = 0.0f;
+
+  GLuint m_buffers[3] = { 0, 0, 0 };  // Lights, cluster ranges, light indices
+  GLuint m_textures[3] = { 0, 0, 0 };
+  GLuint m_statsBuffer = 0;
+  size_t m_numLights = 0;
+
+  std::vector<ClusterRange> m_lightRanges;
+  std::vector<GLuint> m_clusters;     // (offset, count) per cluster
+  std::vector<GLuint> m_indices;
+  std::vector<glm::vec4> m_lightData; // (position, range), (color, 0) per light
+
+  // Accumulated over the frames
+  size_t m_frames = 0;
+  double m_sumLightsPerCluster = 0.0;
+  double m_sumOccupiedClusters = 0.0;
+  GLuint m_maxLightsPerCluster = 0;
+  double m_statsFragments = 0.0;
+  double m_statsLights = 0.0;
+  GLuint m_statsMaxLights = 0;
+  double m_statsHistogram[kHistogramBuckets] = {};
+};
+
+#endif // LIGHT_CLUSTERS_HPP
@@ -0,0 +1,67 @@
+// ----------------------------------------------------------------------------
+// MappedFile.cpp
+//
+// Description: Read-only view of a whole file, mapped into memory (mmap) so
+//              that large binary tables are paged in on use instead of read
+//              and copied; read into memory where mmap is not available
+// ----------------------------------------------------------------------------
+
+#include "MappedFile.hpp"
+
+#include <fstream>
+
+#ifdef _WIN32
+#define HAS_MMAP 0
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAS_MMAP 1
+#endif
+
+bool MappedFile::open(const std::string &path) {
+  close();
+#if HAS_MMAP
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+  struct stat status;
+  if(fstat(fd, &status) == 0 && status.st_size > 0) {
+    void *mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping != MAP_FAILED) {
+      m_mapping = mapping;
+      m_data = static_cast<const char *>(mapping);
+      m_size = static_cast<size_t>(status.st_size);
+    }
+  }
+  ::close(fd); // The mapping stays valid
+  return m_data != nullptr;
+#else
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  if(!file)
+    return false;
+  m_copy.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(m_copy.data(), m_copy.size());
+  if(!file || m_copy.empty()) {
+    m_copy.clear();
+    return false;
+  }
+  m_data = m_copy.data();
+  m_size = m_copy.size();
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+#if HAS_MMAP
+  if(m_mapping)
+    munmap(m_mapping, m_size);
+#endif
+  m_mapping = nullptr;
+  m_copy.clear();
+  m_copy.shrink_to_fit();
+  m_data = nullptr;
+  m_size = 0;
+}
@@ -0,0 +1,33 @@
+// ----------------------------------------------------------------------------
+// MappedFile.hpp
+//
+// Description: Read-only view of a whole file, mapped into memory (mmap) so
+//              that large binary tables are paged in on use instead of read
+//              and copied; read into memory where mmap is not available
+// ----------------------------------------------------------------------------
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class MappedFile {
+public:
+  bool open(const std::string &path);
+
+  inline const char *data() const { return m_data; }
+  inline size_t size() const { return m_size; }
+  inline bool mapped() const { return m_mapping != nullptr; }
+
+  void close();
+
+private:
+  void *m_mapping = nullptr;
+  std::vector<char> m_copy; // Without mmap
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,123 @@
+// ----------------------------------------------------------------------------
+// Mesh.cpp
+//
+// Description: Triangle mesh stored in GPU buffers (VAO, VBOs and IBO)
+// ----------------------------------------------------------------------------
+
+#define _USE_MATH_DEFINES
+
+#include "Mesh.hpp"
+#include "GLState.hpp"
+
+#include <cmath>
+
+void Mesh::init() {
+  // Set up the VAO, VBOs, and IBO for the mesh geometry
+
+  // Create and bind the Vertex Array Object (VAO)
+#ifdef _MY_OPENGL_IS_33_
+  glGenVertexArrays(1, &m_vao); // If your system doesn't support OpenGL 4.5, you should use this instead of glCreateVertexArrays.
+#else
+  glCreateVertexArrays(1, &m_vao);
+#endif
+
+  g_glState.bindVertexArray(m_vao);
+
+  // Generate and bind the Vertex Buffer Object (VBO) for positions
+  glGenBuffers(1, &m_posVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_posVbo);
+  glBufferData(GL_ARRAY_BUFFER, m_vertexPositions.size() * sizeof(float), m_vertexPositions.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+  glEnableVertexAttribArray(0); // position is index 0 in the shader
+
+  // Generate and bind the Vertex Buffer Object (VBO) for normals
+  glGenBuffers(1, &m_normalVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_normalVbo);
+  glBufferData(GL_ARRAY_BUFFER, m_vertexNormals.size() * sizeof(float), m_vertexNormals.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+  glEnableVertexAttribArray(1); // normals are index 1 in the shader
+
+  glGenBuffers(1, &m_texCoordVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_texCoordVbo);
+  glBufferData(GL_ARRAY_BUFFER, m_vertexTexCoords.size() * sizeof(float), m_vertexTexCoords.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0); // Texture coordinates are at index 2
+  glEnableVertexAttribArray(2);
+
+  // Generate and bind the Index Buffer Object (IBO) for triangle indices
+  size_t indexBufferSize = sizeof(unsigned int)*m_triangleIndices.size();
+#ifdef _MY_OPENGL_IS_33_  //Should be irrelevant since Vincent's laptop has OpenGL version 4.6
+  glGenBuffers(1, &m_ibo);
+  g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, m_triangleIndices.data(), GL_STATIC_DRAW);
+#else
+  glCreateBuffers(1, &m_ibo);
+  g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+  glNamedBufferStorage(m_ibo, indexBufferSize, m_triangleIndices.data(), GL_DYNAMIC_STORAGE_BIT);
+#endif
+  // Unbind the VAO for now
+  g_glState.bindVertexArray(0);
+}
+
+void Mesh::render() {
+  // Bind the VAO and issue the drawing commands
+  g_glState.bindVertexArray(m_vao);
+  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m_triangleIndices.size()), GL_UNSIGNED_INT, 0);
+}
+
+std::shared_ptr<Mesh> Mesh::genSphere(const size_t resolution) {
+  auto mesh = std::make_shared<Mesh>();
+
+  const float radius = 1.0f; // Unit sphere
+
+  const size_t latSegments = resolution; // Number of latitude segments
+  const size_t lonSegments = resolution; // Number of longitude segments
+
+  // Generate vertices and normals
+  for (size_t lat = 0; lat <= latSegments; ++lat) {
+    for (size_t lon = 0; lon <= lonSegments; ++lon) {
+      float theta = M_PI/2.0-lat *M_PI / latSegments;  // latitude angle
+      float phi = lon * 2.0f * M_PI / lonSegments; // longitude angle
+
+      float x = radius * cosf(theta) * cosf(phi);
+      float y = radius * cosf(theta) * sinf(phi);
+      float z = radius * sinf(theta);
+
+      // Vertex position
+      mesh->m_vertexPositions.push_back(x);
+      mesh->m_vertexPositions.push_back(z);
+      mesh->m_vertexPositions.push_back(y);
+
+      // Vertex normal (same as position for a unit sphere)
+      mesh->m_vertexNormals.push_back(x/radius);
+      mesh->m_vertexNormals.push_back(z/radius);
+      mesh->m_vertexNormals.push_back(y/radius);
+
+      // Texture coordinates
+      float u = (float)lon / lonSegments;
+      float v = (float)lat / latSegments;
+      mesh->m_vertexTexCoords.push_back(u);
+      mesh->m_vertexTexCoords.push_back(v);
+    }
+  }
+
+  // Generate indices for triangle strips.
+  for (size_t lat = 0; lat < latSegments; ++lat) {
+    for (size_t lon = 0; lon < lonSegments; ++lon) {
+      unsigned int first = (lat * (lonSegments + 1)) + lon;
+      unsigned int second = first + lonSegments + 1;
+
+      // First triangle (counter-clockwise seen from outside, so that back
+      // face culling keeps the near hemisphere)
+      mesh->m_triangleIndices.push_back(first);
+      mesh->m_triangleIndices.push_back(first + 1);
+      mesh->m_triangleIndices.push_back(second);
+
+      // Second triangle
+      mesh->m_triangleIndices.push_back(second);
+      mesh->m_triangleIndices.push_back(first + 1);
+      mesh->m_triangleIndices.push_back(second + 1);
+    }
+  }
+
+  return mesh;
+}
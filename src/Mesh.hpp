@@ -0,0 +1,53 @@
+// ----------------------------------------------------------------------------
+// Mesh.hpp
+//
+// Description: Triangle mesh stored in GPU buffers (VAO, VBOs and IBO)
+// ----------------------------------------------------------------------------
+
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <glad/gl.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Mesh {
+public:
+  // Initializes the geometry buffer
+  void init();
+
+  // Called in the main rendering loop to render the mesh
+  void render();
+
+  // Generates a unit sphere with the given resolution
+  static std::shared_ptr<Mesh> genSphere(const size_t resolution);
+
+  // CPU-side geometry, e.g., to pack several meshes in shared buffers
+  inline const std::vector<float> &vertexPositions() const { return m_vertexPositions; }
+  inline const std::vector<float> &vertexNormals() const { return m_vertexNormals; }
+  inline const std::vector<float> &vertexTexCoords() const { return m_vertexTexCoords; }
+  inline const std::vector<unsigned int> &triangleIndices() const { return m_triangleIndices; }
+
+private:
+  // Vertex positions for the mesh
+  std::vector<float> m_vertexPositions;
+
+  // Vertex normals for the mesh
+  std::vector<float> m_vertexNormals;
+
+  // Triangle indices for the mesh
+  std::vector<unsigned int> m_triangleIndices;
+
+  std::vector<float> m_vertexTexCoords;  // Texture coordinates
+
+  // OpenGL-related buffers
+  GLuint m_vao = 0;        // Vertex Array Object (VAO)
+  GLuint m_posVbo = 0;     // Vertex Buffer Object (VBO) for the positions
+  GLuint m_normalVbo = 0;  // Vertex Buffer Object (VBO) for the normals
+  GLuint m_ibo = 0;        // Index Buffer Object (IBO)
+  GLuint m_texCoordVbo = 0; //Vertex Buffer Object (VBO) for the texture coordinates
+};
+
+#endif // MESH_HPP
@@ -0,0 +1,139 @@
+// ----------------------------------------------------------------------------
+// ParticleBelt.cpp
+//
+// Description: Belts of small bodies (main belt, Kuiper belt) drawn as point
+//              sprites. Orbital elements are generated from seed parameters
+//              and uploaded once; beltVertexShader.glsl solves Kepler's
+//              equation for every body from the time uniform, so the CPU cost
+//              per frame does not depend on the number of bodies.
+// ----------------------------------------------------------------------------
+
+#define _USE_MATH_DEFINES
+
+#include "ParticleBelt.hpp"
+#include "GLState.hpp"
+#include "ShaderLibrary.hpp"
+#include "UniformBlocks.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+
+namespace {
+
+const float kTwoPi = 2.0f*static_cast<float>(M_PI);
+
+// Every mean motion is a whole number of revolutions over this period, in
+// seconds, so the time sent to the GPU is taken modulo it and stays small
+// enough for a float, without a jump when it wraps
+const double kCommonPeriod = 8192.0;
+const float kMeanMotionStep = kTwoPi/static_cast<float>(kCommonPeriod);
+
+inline uint8_t toByte(float v) {
+  return static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, 255.0f*v + 0.5f)));
+}
+
+} // namespace
+
+void ParticleBelt::generate(const BeltParams &params, std::vector<BeltParticle> &particles) {
+  std::mt19937 rng(params.seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  const auto rayleigh = [&](float sigma) { return sigma*std::sqrt(-2.0f*std::log(1.0f - unit(rng))); };
+  const float inner2 = params.innerRadius*params.innerRadius;
+  const float outer2 = params.outerRadius*params.outerRadius;
+  const float sizeRatio = std::pow(params.minSize/params.maxSize, params.sizeExponent);
+
+  particles.reserve(particles.size() + params.count);
+  for(size_t i = 0; i < params.count; ++i) {
+    // Uniform surface density across the belt, with depleted gaps
+    float a;
+    bool inGap;
+    do {
+      a = std::sqrt(inner2 + unit(rng)*(outer2 - inner2));
+      inGap = false;
+      for(const glm::vec2 &gap : params.gaps)
+        inGap = inGap || (std::fabs(a - gap.x) < gap.y && unit(rng) < 0.9f);
+    } while(inGap);
+
+    BeltParticle particle;
+    const float e = std::min(rayleigh(params.eccentricitySigma), 0.8f);
+    const float inclination = rayleigh(params.inclinationSigma);
+    particle.orbit = glm::vec4(a, e, inclination, kTwoPi*unit(rng));
+    const float keplerMeanMotion = params.meanMotionAt15*std::pow(15.0f/a, 1.5f);
+    const float meanMotion = kMeanMotionStep*std::max(1.0f, std::round(keplerMeanMotion/kMeanMotionStep));
+    const float radius = params.minSize*std::pow(1.0f - unit(rng)*(1.0f - sizeRatio), -1.0f/params.sizeExponent);
+    particle.phase = glm::vec4(kTwoPi*unit(rng), kTwoPi*unit(rng), meanMotion, radius);
+
+    const glm::vec3 color = (unit(rng) < params.brightFraction ? params.brightColor : params.darkColor)*(0.85f + 0.3f*unit(rng));
+    particle.color[0] = toByte(color.r);
+    particle.color[1] = toByte(color.g);
+    particle.color[2] = toByte(color.b);
+    particle.color[3] = 255;
+    particles.push_back(particle);
+  }
+}
+
+bool ParticleBelt::init(ProgramCache &cache, const std::string &materialDefines) {
+  m_program = loadProgram(cache, { { GL_VERTEX_SHADER, "beltVertexShader.glsl" }, { GL_FRAGMENT_SHADER, "beltFragmentShader.glsl" } },
+                          materialDefines);
+  GLint success = GL_FALSE;
+  glGetProgramiv(m_program, GL_LINK_STATUS, &success);
+  if(!success)
+    return false;
+  m_timeLoc = glGetUniformLocation(m_program, "time");
+  m_cameraHighLoc = glGetUniformLocation(m_program, "cameraHigh");
+  m_cameraLowLoc = glGetUniformLocation(m_program, "cameraLow");
+  m_pixelScaleLoc = glGetUniformLocation(m_program, "pixelScale");
+  glUniformBlockBinding(m_program, glGetUniformBlockIndex(m_program, "FrameBlock"), FRAME_BLOCK_BINDING);
+  glGenVertexArrays(1, &m_vao);
+  glGenBuffers(1, &m_vbo);
+  return true;
+}
+
+void ParticleBelt::upload(const std::vector<BeltParticle> &particles) {
+  m_count = particles.size();
+  g_glState.bindVertexArray(m_vao);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferData(GL_ARRAY_BUFFER, particles.size()*sizeof(BeltParticle), particles.data(), GL_STATIC_DRAW);
+  // One vertex per body: the elements are plain vertex attributes of GL_POINTS
+  const GLsizei stride = sizeof(BeltParticle);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void *>(offsetof(BeltParticle, orbit)));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void *>(offsetof(BeltParticle, phase)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, reinterpret_cast<const void *>(offsetof(BeltParticle, color)));
+  glEnableVertexAttribArray(2);
+  g_glState.bindVertexArray(0);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleBelt::render(double time, const glm::dvec3 &camera, float pixelScale) {
+  if(m_count == 0)
+    return;
+  // The camera is split into a float and the remainder, which the shader
+  // subtracts in turn, so that the positions keep their precision far from
+  // the world origin like the camera-relative models of the bodies
+  double periodTime = std::fmod(time, kCommonPeriod);
+  if(periodTime < 0.0)
+    periodTime += kCommonPeriod;
+  const glm::vec3 cameraHigh(camera);
+  const glm::vec3 cameraLow(camera - glm::dvec3(cameraHigh));
+  g_glState.useProgram(m_program);
+  glUniform1f(m_timeLoc, static_cast<float>(periodTime));
+  glUniform3fv(m_cameraHighLoc, 1, &cameraHigh[0]);
+  glUniform3fv(m_cameraLowLoc, 1, &cameraLow[0]);
+  glUniform1f(m_pixelScaleLoc, pixelScale);
+  g_glState.enable(GL_PROGRAM_POINT_SIZE);
+  g_glState.bindVertexArray(m_vao);
+  glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(m_count));
+  g_glState.bindVertexArray(0);
+  g_glState.disable(GL_PROGRAM_POINT_SIZE);
+}
+
+void ParticleBelt::clear() {
+  g_glState.deleteBuffers(1, &m_vbo);
+  g_glState.deleteVertexArrays(1, &m_vao);
+  g_glState.deleteProgram(m_program);
+  *this = ParticleBelt();
+}
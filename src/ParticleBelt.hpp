@@ -0,0 +1,80 @@
+// ----------------------------------------------------------------------------
+// ParticleBelt.hpp
+//
+// Description: Belts of small bodies (main belt, Kuiper belt) drawn as point
+//              sprites. Orbital elements are generated from seed parameters
+//              and uploaded once; beltVertexShader.glsl solves Kepler's
+//              equation for every body from the time uniform, so the CPU cost
+//              per frame does not depend on the number of bodies.
+// ----------------------------------------------------------------------------
+
+#ifndef PARTICLE_BELT_HPP
+#define PARTICLE_BELT_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ProgramCache;
+
+// Statistical description of a belt, in scene units and radians
+struct BeltParams {
+  std::string name;
+  uint32_t seed = 1;
+  size_t count = 0;
+  float innerRadius = 16.0f;         // Range of the semi-major axes
+  float outerRadius = 19.5f;
+  std::vector<glm::vec2> gaps;       // (center, half width) of depleted bands, e.g., Kirkwood gaps
+  float eccentricitySigma = 0.07f;   // Rayleigh-distributed eccentricities
+  float inclinationSigma = 0.12f;    // Rayleigh-distributed inclinations
+  float minSize = 0.004f;            // Radius range, with a power-law size distribution
+  float maxSize = 0.04f;
+  float sizeExponent = 2.5f;         // N(>r) ~ r^-sizeExponent
+  glm::vec3 darkColor = glm::vec3(0.25f, 0.24f, 0.22f); // Two populations of albedo (e.g., C- and S-type)
+  glm::vec3 brightColor = glm::vec3(0.62f, 0.5f, 0.38f);
+  float brightFraction = 0.3f;
+  float meanMotionAt15 = 0.3f;       // Angular speed at radius 15 (Mars), scaled by Kepler's third law
+                                     // and rounded to whole revolutions over a common period
+};
+
+// Vertex attributes of one body, drawn as a point
+struct BeltParticle {
+  glm::vec4 orbit; // Semi-major axis, eccentricity, inclination, longitude of the ascending node
+  glm::vec4 phase; // Argument of periapsis, mean anomaly at time 0, mean motion, radius
+  uint8_t color[4];
+};
+
+class ParticleBelt {
+public:
+  // Draws orbital elements following the statistics of the parameters;
+  // the same seed gives the same belt
+  static void generate(const BeltParams &params, std::vector<BeltParticle> &particles);
+
+  bool init(ProgramCache &cache, const std::string &materialDefines);
+
+  // Uploads the bodies of all belts, once
+  void upload(const std::vector<BeltParticle> &particles);
+
+  // Draws all bodies at the given simulation time, in seconds, relative to
+  // the camera at the given world position; the FrameBlock must be bound
+  void render(double time, const glm::dvec3 &camera, float pixelScale);
+
+  inline size_t count() const { return m_count; }
+
+  void clear();
+
+private:
+  GLuint m_program = 0;
+  GLint m_timeLoc = -1;
+  GLint m_cameraHighLoc = -1;
+  GLint m_cameraLowLoc = -1;
+  GLint m_pixelScaleLoc = -1;
+  GLuint m_vao = 0;
+  GLuint m_vbo = 0;
+  size_t m_count = 0;
+};
+
+#endif // PARTICLE_BELT_HPP
@@ -0,0 +1,193 @@
+// ----------------------------------------------------------------------------
+// PostProcess.cpp
+//
+// Description: HDR pipeline. The scene is rendered into a half-float target;
+//              bloom is derived through a chain of dual-filter downsamples
+//              and upsamples at decreasing resolutions, then the scene and
+//              the bloom are tone-mapped into the output framebuffer. Every
+//              pass is timed on the GPU.
+// ----------------------------------------------------------------------------
+
+#include "PostProcess.hpp"
+#include "GLState.hpp"
+#include "ShaderLibrary.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+enum Pass { PASS_PREFILTER = 0, PASS_DOWNSAMPLE, PASS_UPSAMPLE, PASS_COMPOSITE };
+
+GLuint loadPostProgram(ProgramCache &cache, const char *pass) {
+  const GLuint program = loadProgram(cache, { { GL_VERTEX_SHADER, "postVertexShader.glsl" }, { GL_FRAGMENT_SHADER, "postFragmentShader.glsl" } },
+                                     std::string("#define ") + pass + "\n");
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if(!success)
+    return 0;
+  g_glState.useProgram(program);
+  glUniform1i(glGetUniformLocation(program, "source"), 0);
+  glUniform1i(glGetUniformLocation(program, "bloom"), 1);
+  return program;
+}
+
+GLuint createTexture(GLenum internalFormat, GLsizei width, GLsizei height) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  g_glState.bindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+
+} // namespace
+
+bool PostProcess::init(ProgramCache &cache, const Settings &settings) {
+  m_settings = settings;
+  m_prefilterProgram = loadPostProgram(cache, "PREFILTER");
+  m_downsampleProgram = loadPostProgram(cache, "DOWNSAMPLE");
+  m_upsampleProgram = loadPostProgram(cache, "UPSAMPLE");
+  m_compositeProgram = loadPostProgram(cache, "COMPOSITE");
+  if(!m_prefilterProgram || !m_downsampleProgram || !m_upsampleProgram || !m_compositeProgram)
+    return false;
+
+  // Quadratic knee of the threshold, with its constants precomputed
+  const float knee = std::max(settings.bloomKnee, 1e-4f);
+  g_glState.useProgram(m_prefilterProgram);
+  glUniform4f(glGetUniformLocation(m_prefilterProgram, "threshold"), settings.bloomThreshold, knee, 2.0f*knee, 0.25f/knee);
+  g_glState.useProgram(m_compositeProgram);
+  glUniform1f(glGetUniformLocation(m_compositeProgram, "exposure"), settings.exposure);
+  glUniform1f(glGetUniformLocation(m_compositeProgram, "bloomIntensity"), settings.bloomIntensity);
+  g_glState.useProgram(0);
+
+  glGenVertexArrays(1, &m_vao);
+  m_profiler.init({ "prefilter", "downsample", "upsample", "composite" });
+  return true;
+}
+
+void PostProcess::resize(GLsizei width, GLsizei height) {
+  g_glState.deleteFramebuffers(1, &m_sceneFbo);
+  g_glState.deleteTextures(1, &m_sceneColor);
+  g_glState.deleteRenderbuffers(1, &m_sceneDepth);
+  g_glState.deleteFramebuffers(m_numLevels, m_bloomFbos);
+  g_glState.deleteTextures(m_numLevels, m_bloomTextures);
+  m_width = width;
+  m_height = height;
+
+  m_sceneColor = createTexture(GL_RGBA16F, width, height);
+  glGenRenderbuffers(1, &m_sceneDepth);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, m_sceneDepth);
+  glRenderbufferStorage(GL_RENDERBUFFER, m_settings.depthFormat, width, height);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, 0);
+  glGenFramebuffers(1, &m_sceneFbo);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, m_sceneFbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_sceneColor, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_sceneDepth);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    std::cerr << "ERROR: Incomplete HDR framebuffer" << std::endl;
+
+  // Halve the size down to kMinBloomSize; the bloom needs no alpha nor sign,
+  // so the packed float format halves the bandwidth of RGBA16F
+  m_numLevels = 0;
+  GLsizei levelWidth = width, levelHeight = height;
+  while(m_numLevels < kMaxBloomLevels && std::min(levelWidth, levelHeight)/2 >= kMinBloomSize) {
+    levelWidth /= 2;
+    levelHeight /= 2;
+    m_bloomSizes[m_numLevels][0] = levelWidth;
+    m_bloomSizes[m_numLevels][1] = levelHeight;
+    m_bloomTextures[m_numLevels] = createTexture(GL_R11F_G11F_B10F, levelWidth, levelHeight);
+    glGenFramebuffers(1, &m_bloomFbos[m_numLevels]);
+    g_glState.bindFramebuffer(GL_FRAMEBUFFER, m_bloomFbos[m_numLevels]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_bloomTextures[m_numLevels], 0);
+    ++m_numLevels;
+  }
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PostProcess::beginScene() {
+  m_outputFbo = g_glState.getDrawFramebuffer();
+  g_glState.getViewport(m_viewport);
+  if(m_viewport[2] != m_width || m_viewport[3] != m_height)
+    resize(m_viewport[2], m_viewport[3]);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, m_sceneFbo);
+  g_glState.viewport(0, 0, m_width, m_height);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void PostProcess::drawPass(GLuint program, GLuint source, GLuint targetFbo, GLsizei width, GLsizei height,
+                           GLsizei sourceWidth, GLsizei sourceHeight) {
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+  g_glState.viewport(0, 0, width, height);
+  g_glState.useProgram(program);
+  glUniform2f(glGetUniformLocation(program, "halfTexel"), 0.5f/sourceWidth, 0.5f/sourceHeight);
+  g_glState.bindTexture(GL_TEXTURE_2D, source);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void PostProcess::endScene() {
+  m_profiler.beginFrame();
+  const GLenum polygonMode = g_glState.getPolygonMode();
+  g_glState.polygonMode(GL_FILL);
+  g_glState.disable(GL_DEPTH_TEST);
+  g_glState.bindVertexArray(m_vao);
+  g_glState.activeTexture(GL_TEXTURE0);
+
+  if(m_numLevels > 0)
+    drawPass(m_prefilterProgram, m_sceneColor, m_bloomFbos[0], m_bloomSizes[0][0], m_bloomSizes[0][1], m_width, m_height);
+  m_profiler.mark(PASS_PREFILTER);
+  for(int i = 1; i < m_numLevels; ++i)
+    drawPass(m_downsampleProgram, m_bloomTextures[i - 1], m_bloomFbos[i], m_bloomSizes[i][0], m_bloomSizes[i][1],
+             m_bloomSizes[i - 1][0], m_bloomSizes[i - 1][1]);
+  m_profiler.mark(PASS_DOWNSAMPLE);
+  // Each level accumulates the upsampled blur of the level below
+  g_glState.enable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  for(int i = m_numLevels - 1; i > 0; --i)
+    drawPass(m_upsampleProgram, m_bloomTextures[i], m_bloomFbos[i - 1], m_bloomSizes[i - 1][0], m_bloomSizes[i - 1][1],
+             m_bloomSizes[i][0], m_bloomSizes[i][1]);
+  g_glState.disable(GL_BLEND);
+  m_profiler.mark(PASS_UPSAMPLE);
+
+  g_glState.activeTexture(GL_TEXTURE1);
+  g_glState.bindTexture(GL_TEXTURE_2D, m_bloomTextures[0]);
+  g_glState.activeTexture(GL_TEXTURE0);
+  drawPass(m_compositeProgram, m_sceneColor, m_outputFbo, m_width, m_height, m_width, m_height);
+  g_glState.viewport(m_viewport[0], m_viewport[1], m_viewport[2], m_viewport[3]);
+  m_profiler.mark(PASS_COMPOSITE);
+  m_profiler.endFrame();
+
+  g_glState.activeTexture(GL_TEXTURE1);
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  g_glState.activeTexture(GL_TEXTURE0);
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  g_glState.bindVertexArray(0);
+  g_glState.enable(GL_DEPTH_TEST);
+  g_glState.polygonMode(polygonMode);
+}
+
+void PostProcess::printStats(double budgetMs) {
+  char title[128];
+  std::snprintf(title, sizeof(title), "HDR post-processing at %dx%d, %d bloom levels", m_width, m_height, m_numLevels);
+  m_profiler.print(title, budgetMs);
+}
+
+void PostProcess::clear() {
+  m_profiler.clear();
+  g_glState.deleteFramebuffers(1, &m_sceneFbo);
+  g_glState.deleteTextures(1, &m_sceneColor);
+  g_glState.deleteRenderbuffers(1, &m_sceneDepth);
+  g_glState.deleteFramebuffers(m_numLevels, m_bloomFbos);
+  g_glState.deleteTextures(m_numLevels, m_bloomTextures);
+  g_glState.deleteVertexArrays(1, &m_vao);
+  g_glState.deleteProgram(m_prefilterProgram);
+  g_glState.deleteProgram(m_downsampleProgram);
+  g_glState.deleteProgram(m_upsampleProgram);
+  g_glState.deleteProgram(m_compositeProgram);
+  *this = PostProcess();
+}
@@ -0,0 +1,76 @@
+// ----------------------------------------------------------------------------
+// PostProcess.hpp
+//
+// Description: HDR pipeline. The scene is rendered into a half-float target;
+//              bloom is derived through a chain of dual-filter downsamples
+//              and upsamples at decreasing resolutions, then the scene and
+//              the bloom are tone-mapped into the output framebuffer. Every
+//              pass is timed on the GPU.
+// ----------------------------------------------------------------------------
+
+#ifndef POST_PROCESS_HPP
+#define POST_PROCESS_HPP
+
+#include "Profiler.hpp"
+
+#include <glad/gl.h>
+
+class ProgramCache;
+
+class PostProcess {
+public:
+  static const int kMaxBloomLevels = 6;
+  static const GLsizei kMinBloomSize = 8; // Smallest side of the last level
+
+  struct Settings {
+    float exposure = 1.0f;
+    float bloomThreshold = 1.0f; // Emissive and highlight values above this bloom
+    float bloomKnee = 0.5f;
+    float bloomIntensity = 0.6f;
+    GLenum depthFormat = GL_DEPTH_COMPONENT24;
+  };
+
+  bool init(ProgramCache &cache, const Settings &settings);
+
+  // Redirects the scene into the HDR target; the framebuffer and viewport
+  // bound now receive the tone-mapped image
+  void beginScene();
+
+  // Bloom and tone mapping into the output
+  void endScene();
+
+  // GPU time of each pass, against the budget
+  void printStats(double budgetMs);
+
+  void clear();
+
+private:
+  void resize(GLsizei width, GLsizei height);
+  void drawPass(GLuint program, GLuint source, GLuint targetFbo, GLsizei width, GLsizei height,
+                GLsizei sourceWidth, GLsizei sourceHeight);
+
+  Settings m_settings;
+  GLuint m_prefilterProgram = 0;
+  GLuint m_downsampleProgram = 0;
+  GLuint m_upsampleProgram = 0;
+  GLuint m_compositeProgram = 0;
+  GLuint m_vao = 0;
+
+  GLsizei m_width = 0;
+  GLsizei m_height = 0;
+  GLuint m_sceneFbo = 0;
+  GLuint m_sceneColor = 0; // RGBA16F texture
+  GLuint m_sceneDepth = 0;
+  int m_numLevels = 0;
+  GLuint m_bloomFbos[kMaxBloomLevels] = {};
+  GLuint m_bloomTextures[kMaxBloomLevels] = {}; // R11F_G11F_B10F, half the size of the level above
+  GLsizei m_bloomSizes[kMaxBloomLevels][2] = {};
+
+  // Output, saved by beginScene()
+  GLuint m_outputFbo = 0;
+  GLint m_viewport[4] = {};
+
+  GpuProfiler m_profiler;
+};
+
+#endif // POST_PROCESS_HPP
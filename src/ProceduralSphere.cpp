@@ -0,0 +1,25 @@
+// ----------------------------------------------------------------------------
+// ProceduralSphere.cpp
+//
+// Description: Unit sphere generated in the vertex shader (PROCEDURAL_SPHERE
+//              in vertexShader.glsl) from gl_VertexID, without any vertex or
+//              index buffer
+// ----------------------------------------------------------------------------
+
+#include "ProceduralSphere.hpp"
+#include "GLState.hpp"
+
+void ProceduralSphere::init() {
+  glGenVertexArrays(1, &m_vao);
+}
+
+void ProceduralSphere::render(GLint resolutionLocation, GLsizei resolution) {
+  glUniform1i(resolutionLocation, resolution);
+  g_glState.bindVertexArray(m_vao);
+  glDrawArrays(GL_TRIANGLES, 0, vertexCount(resolution));
+}
+
+void ProceduralSphere::clear() {
+  g_glState.deleteVertexArrays(1, &m_vao);
+  m_vao = 0;
+}
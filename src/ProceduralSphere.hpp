@@ -0,0 +1,32 @@
+// ----------------------------------------------------------------------------
+// ProceduralSphere.hpp
+//
+// Description: Unit sphere generated in the vertex shader (PROCEDURAL_SPHERE
+//              in vertexShader.glsl) from gl_VertexID, without any vertex or
+//              index buffer
+// ----------------------------------------------------------------------------
+
+#ifndef PROCEDURAL_SPHERE_HPP
+#define PROCEDURAL_SPHERE_HPP
+
+#include <glad/gl.h>
+
+class ProceduralSphere {
+public:
+  // Creates the empty VAO that the core profile requires for any draw
+  void init();
+
+  // Draws the sphere with the given resolution on the current program, whose
+  // sphereResolution uniform is at resolutionLocation
+  void render(GLint resolutionLocation, GLsizei resolution);
+
+  void clear();
+
+  // Same triangles as Mesh::genSphere(resolution), unindexed
+  static inline GLsizei vertexCount(GLsizei resolution) { return 6*resolution*resolution; }
+
+private:
+  GLuint m_vao = 0;
+};
+
+#endif // PROCEDURAL_SPHERE_HPP
@@ -0,0 +1,126 @@
+// ----------------------------------------------------------------------------
+// Profiler.cpp
+//
+// Description: Timing helpers, GPU timers, input latency and the startup
+//              report
+// ----------------------------------------------------------------------------
+
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+void GpuProfiler::init(const std::vector<std::string> &sections, unsigned int numFrames) {
+  m_sections = sections;
+  m_numFrames = numFrames;
+  m_queries.resize(numFrames*(sections.size() + 1));
+  glGenQueries(static_cast<GLsizei>(m_queries.size()), m_queries.data());
+  m_pending.assign(numFrames, false);
+  m_sumMs.assign(sections.size(), 0.0);
+}
+
+void GpuProfiler::collect(unsigned int frame) {
+  if(!m_pending[frame])
+    return;
+  const size_t stride = m_sections.size() + 1;
+  std::vector<GLuint64> stamps(stride);
+  for(size_t i = 0; i < stride; ++i)
+    glGetQueryObjectui64v(m_queries[frame*stride + i], GL_QUERY_RESULT, &stamps[i]);
+  for(size_t i = 0; i < m_sections.size(); ++i)
+    m_sumMs[i] += 1e-6*static_cast<double>(stamps[i + 1] - stamps[i]);
+  ++m_framesRead;
+  m_pending[frame] = false;
+}
+
+void GpuProfiler::beginFrame() {
+  if(m_queries.empty())
+    return;
+  collect(m_frame); // Issued numFrames frames ago
+  glQueryCounter(m_queries[m_frame*(m_sections.size() + 1)], GL_TIMESTAMP);
+}
+
+void GpuProfiler::mark(size_t section) {
+  if(m_queries.empty())
+    return;
+  glQueryCounter(m_queries[m_frame*(m_sections.size() + 1) + section + 1], GL_TIMESTAMP);
+}
+
+void GpuProfiler::endFrame() {
+  if(m_queries.empty())
+    return;
+  m_pending[m_frame] = true;
+  m_frame = (m_frame + 1) % m_numFrames;
+}
+
+double GpuProfiler::averageMs(size_t section) const {
+  return m_framesRead ? m_sumMs[section]/m_framesRead : 0.0;
+}
+
+void GpuProfiler::print(const char *title, double budgetMs) {
+  for(unsigned int i = 0; i < m_numFrames; ++i)
+    collect((m_frame + i) % m_numFrames);
+  if(m_framesRead == 0)
+    return;
+  double total = 0.0;
+  char line[256];
+  std::cout << title << ", GPU ms/frame over " << m_framesRead << " frames:" << std::endl;
+  for(size_t i = 0; i < m_sections.size(); ++i) {
+    std::snprintf(line, sizeof(line), "  %-12s %8.3f", m_sections[i].c_str(), averageMs(i));
+    std::cout << line << std::endl;
+    total += averageMs(i);
+  }
+  std::snprintf(line, sizeof(line), "  %-12s %8.3f (budget %.3f)%s", "total", total, budgetMs, total > budgetMs ? " OVER BUDGET" : "");
+  std::cout << line << std::endl;
+}
+
+void GpuProfiler::clear() {
+  glDeleteQueries(static_cast<GLsizei>(m_queries.size()), m_queries.data());
+  *this = GpuProfiler();
+}
+
+void StartupReport::add(const std::string &stage, double ms, const std::string &note) {
+  Entry entry = { stage, ms, note };
+  m_entries.push_back(entry);
+}
+
+void LatencyMeter::input() {
+  if(m_pending)
+    return;
+  m_pending = true;
+  m_firstInput = std::chrono::steady_clock::now();
+}
+
+void LatencyMeter::present() {
+  if(!m_pending)
+    return;
+  m_pending = false;
+  m_samplesMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_firstInput).count());
+}
+
+void LatencyMeter::print(const char *title) const {
+  if(m_samplesMs.empty())
+    return;
+  std::vector<double> sorted = m_samplesMs;
+  std::sort(sorted.begin(), sorted.end());
+  double sum = 0.0;
+  for(double ms : sorted)
+    sum += ms;
+  char line[256];
+  std::snprintf(line, sizeof(line), "%s: %zu frames after input, %.1f ms average, %.1f ms 95th percentile, %.1f ms max (event to swap)",
+                title, sorted.size(), sum/sorted.size(), sorted[(sorted.size() - 1)*95/100], sorted.back());
+  std::cout << line << std::endl;
+}
+
+void StartupReport::print() const {
+  double total = 0.0;
+  char line[256];
+  std::cout << "Startup report:" << std::endl;
+  for(const Entry &entry : m_entries) {
+    std::snprintf(line, sizeof(line), "  %-24s %9.2f ms  %s", entry.stage.c_str(), entry.ms, entry.note.c_str());
+    std::cout << line << std::endl;
+    total += entry.ms;
+  }
+  std::snprintf(line, sizeof(line), "  %-24s %9.2f ms", "total", total);
+  std::cout << line << std::endl;
+}
@@ -0,0 +1,99 @@
+// ----------------------------------------------------------------------------
+// Profiler.hpp
+//
+// Description: Timing helpers, GPU timers, input latency and the startup
+//              report
+// ----------------------------------------------------------------------------
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <glad/gl.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Wall-clock stopwatch, started on construction
+class Timer {
+public:
+  Timer() : m_start(std::chrono::steady_clock::now()) {}
+  inline void restart() { m_start = std::chrono::steady_clock::now(); }
+  inline double elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point m_start;
+};
+
+// GPU duration of consecutive sections of a frame, from timestamp queries.
+// Results are read numFrames-1 frames late, so that reading them does not
+// stall the pipeline.
+class GpuProfiler {
+public:
+  void init(const std::vector<std::string> &sections, unsigned int numFrames = 3);
+
+  // Starts the first section
+  void beginFrame();
+
+  // Ends the given section, and starts the next one; every section is
+  // marked once per frame, in order
+  void mark(size_t section);
+
+  void endFrame();
+
+  // Average over the frames read back so far
+  double averageMs(size_t section) const;
+
+  // Per-section averages, and their total against a budget
+  void print(const char *title, double budgetMs);
+
+  void clear();
+
+private:
+  void collect(unsigned int frame);
+
+  std::vector<std::string> m_sections;
+  std::vector<GLuint> m_queries;        // (sections + 1) timestamps per frame in flight
+  std::vector<bool> m_pending;          // Per frame in flight
+  unsigned int m_numFrames = 0;
+  unsigned int m_frame = 0;
+  std::vector<double> m_sumMs;
+  size_t m_framesRead = 0;
+};
+
+// Time from input events to the swap of the first frame drawn after them.
+// GLFW does not timestamp its events, so an event counts from its callback,
+// the earliest the application sees it; of several events before a frame,
+// the first one counts.
+class LatencyMeter {
+public:
+  void input();
+  void present(); // Right after the swap
+
+  // Average, 95th percentile and maximum over the run, if there was any input
+  void print(const char *title) const;
+
+private:
+  bool m_pending = false;
+  std::chrono::steady_clock::time_point m_firstInput;
+  std::vector<double> m_samplesMs;
+};
+
+// Duration of each initialization stage, printed once init() is done
+class StartupReport {
+public:
+  void add(const std::string &stage, double ms, const std::string &note = "");
+  void print() const;
+
+private:
+  struct Entry {
+    std::string stage;
+    double ms;
+    std::string note;
+  };
+  std::vector<Entry> m_entries;
+};
+
+#endif // PROFILER_HPP
@@ -0,0 +1,118 @@
+// ----------------------------------------------------------------------------
+// ProgramCache.cpp
+//
+// Description: On-disk cache of linked GPU programs (glGetProgramBinary),
+//              keyed by the shader sources, the defines and the driver
+// ----------------------------------------------------------------------------
+
+#include "ProgramCache.hpp"
+#include "FileUtil.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const uint32_t kMagic = 0x42504c47; // "GLPB"
+const uint32_t kVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t binaryFormat;
+  uint32_t length;
+};
+
+// 64-bit FNV-1a, chained over several strings
+uint64_t fnv1a(const std::string &data, uint64_t hash) {
+  for(unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash ^ data.size(); // Separate consecutive strings
+}
+
+std::string glString(GLenum name) {
+  const GLubyte *s = glGetString(name);
+  return s ? reinterpret_cast<const char *>(s) : "";
+}
+
+} // namespace
+
+void ProgramCache::init(const std::string &directory) {
+  m_directory = directory;
+  m_driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION) + "|" + glString(GL_SHADING_LANGUAGE_VERSION);
+  m_enabled = g_glCaps.programBinary;
+  if(m_enabled)
+    makeDirectory(m_directory);
+}
+
+uint64_t ProgramCache::computeKey(const std::vector<std::string> &sources, const std::string &defines) const {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for(const std::string &source : sources)
+    hash = fnv1a(source, hash);
+  hash = fnv1a(defines, hash);
+  return fnv1a(m_driver, hash);
+}
+
+std::string ProgramCache::pathFor(uint64_t key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(key));
+  return m_directory + name;
+}
+
+GLuint ProgramCache::load(uint64_t key) {
+  if(!m_enabled)
+    return 0;
+  // Mapped, so that the binary goes to the driver without a copy; a file
+  // whose length disagrees with its header is treated as a miss
+  MappedFile file;
+  Header header;
+  if(!file.open(pathFor(key)) || file.size() < sizeof(header)) {
+    ++m_misses;
+    return 0;
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if(header.magic != kMagic || header.version != kVersion || header.key != key
+     || header.length == 0 || file.size() - sizeof(header) != header.length) {
+    ++m_misses;
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), static_cast<GLsizei>(header.length));
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if(!success) { // The driver may reject binaries from another build of itself
+    g_glState.deleteProgram(program);
+    ++m_misses;
+    return 0;
+  }
+  ++m_hits;
+  return program;
+}
+
+void ProgramCache::store(uint64_t key, GLuint program) {
+  if(!m_enabled)
+    return;
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if(length <= 0)
+    return;
+  std::vector<char> binary(length);
+  GLenum binaryFormat = 0;
+  glGetProgramBinary(program, length, nullptr, &binaryFormat, binary.data());
+
+  Header header = { kMagic, kVersion, key, binaryFormat, static_cast<uint32_t>(length) };
+  std::ofstream file(pathFor(key).c_str(), std::ios::binary);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(binary.data(), binary.size());
+  if(!file)
+    std::cerr << "ERROR: Failed to write the program cache " << pathFor(key) << std::endl;
+}
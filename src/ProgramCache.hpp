@@ -0,0 +1,47 @@
+// ----------------------------------------------------------------------------
+// ProgramCache.hpp
+//
+// Description: On-disk cache of linked GPU programs (glGetProgramBinary),
+//              keyed by the shader sources, the defines and the driver
+// ----------------------------------------------------------------------------
+
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+
+#include <glad/gl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ProgramCache {
+public:
+  // Prepares the cache directory; the cache stays disabled when the driver
+  // exposes no program binary format
+  void init(const std::string &directory);
+
+  // Hash of everything the compiled binary depends on
+  uint64_t computeKey(const std::vector<std::string> &sources, const std::string &defines) const;
+
+  // Returns a linked program created from the cached binary, or 0 on a miss
+  // (no entry, driver update, rejected binary)
+  GLuint load(uint64_t key);
+
+  // Saves the binary of a freshly linked program under the given key
+  void store(uint64_t key, GLuint program);
+
+  inline bool enabled() const { return m_enabled; }
+  inline unsigned int hits() const { return m_hits; }
+  inline unsigned int misses() const { return m_misses; }
+
+private:
+  std::string pathFor(uint64_t key) const;
+
+  bool m_enabled = false;
+  std::string m_directory;
+  std::string m_driver; // Vendor, renderer and version strings of the context
+  unsigned int m_hits = 0;
+  unsigned int m_misses = 0;
+};
+
+#endif // PROGRAM_CACHE_HPP
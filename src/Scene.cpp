@@ -0,0 +1,425 @@
+// ----------------------------------------------------------------------------
+// Scene.cpp
+//
+// Description: Bodies of the scene, described in a JSON text file and
+//              compiled to a flat binary form: a header, the body records,
+//              then a string table. The binary form is mapped into memory and
+//              its records are used in place as the body table.
+// ----------------------------------------------------------------------------
+
+#include "Scene.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+// Start of the binary form; the records follow, then the string table. The
+// host byte order is assumed, as for the other caches.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t bodyCount;
+  uint32_t stringBytes;
+};
+
+const char kMagic[4] = { 'S', 'C', 'N', 'B' };
+
+static_assert(sizeof(Header) == 16, "Header must have no padding");
+static_assert(sizeof(SceneBody) == 68, "SceneBody must have no padding");
+
+// Reads JSON values in place, for the fixed schema of a scene; the first
+// error is kept, with its line
+class JsonReader {
+public:
+  JsonReader(const char *begin, const char *end) : m_begin(begin), m_pos(begin), m_end(end) {}
+
+  inline bool failed() const { return !m_error.empty(); }
+  inline const std::string &error() const { return m_error; }
+
+  void fail(const std::string &message) {
+    if(failed())
+      return;
+    int line = 1;
+    for(const char *c = m_begin; c < m_pos; ++c)
+      line += *c == '\n';
+    m_error = "line " + std::to_string(line) + ": " + message;
+  }
+
+  // Consumes c if it comes next
+  bool consume(char c) {
+    skipSpace();
+    if(m_pos < m_end && *m_pos == c) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  bool expect(char c) {
+    if(!consume(c))
+      fail(std::string("expected '") + c + "'");
+    return !failed();
+  }
+
+  bool atEnd() {
+    skipSpace();
+    return m_pos == m_end;
+  }
+
+  bool readString(std::string &out) {
+    out.clear();
+    if(!expect('"'))
+      return false;
+    while(m_pos < m_end && *m_pos != '"') {
+      char c = *m_pos++;
+      if(c == '\\' && m_pos < m_end) {
+        c = *m_pos++;
+        switch(c) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case '"': case '\\': case '/': break;
+        default: fail(std::string("unsupported escape '\\") + c + "'"); return false;
+        }
+      }
+      out += c;
+    }
+    return expect('"');
+  }
+
+  bool readNumber(float &out) {
+    skipSpace();
+    // strtod needs a terminated copy: the text may be a mapping, not a string
+    char token[64];
+    size_t n = 0;
+    while(m_pos + n < m_end && n + 1 < sizeof(token) && std::strchr("+-.0123456789eE", m_pos[n]))
+      token[n] = m_pos[n], ++n;
+    token[n] = '\0';
+    char *tokenEnd = nullptr;
+    const double value = std::strtod(token, &tokenEnd);
+    if(n == 0 || tokenEnd != token + n) {
+      fail("expected a number");
+      return false;
+    }
+    m_pos += n;
+    out = static_cast<float>(value);
+    return true;
+  }
+
+  bool readBool(bool &out) {
+    skipSpace();
+    if(matchWord("true"))
+      out = true;
+    else if(matchWord("false"))
+      out = false;
+    else
+      fail("expected true or false");
+    return !failed();
+  }
+
+  // Reads "key": and returns false at the end of the object
+  bool nextKey(bool &first, std::string &key) {
+    if(consume('}'))
+      return false;
+    if(!first && !expect(','))
+      return false;
+    first = false;
+    return readString(key) && expect(':');
+  }
+
+  // Returns false at the end of the array
+  bool nextElement(bool &first) {
+    if(consume(']'))
+      return false;
+    if(!first && !expect(','))
+      return false;
+    first = false;
+    return true;
+  }
+
+private:
+  void skipSpace() {
+    while(m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\n' || *m_pos == '\r'))
+      ++m_pos;
+  }
+
+  bool matchWord(const char *word) {
+    const size_t n = std::strlen(word);
+    if(static_cast<size_t>(m_end - m_pos) < n || std::strncmp(m_pos, word, n))
+      return false;
+    m_pos += n;
+    return true;
+  }
+
+  const char *m_begin;
+  const char *m_pos;
+  const char *m_end;
+  std::string m_error;
+};
+
+// Appends a string to the table and returns its offset; equal strings share
+// their entry (many bodies use the same texture)
+class StringTable {
+public:
+  StringTable() : m_bytes(1, '\0') {}
+
+  uint32_t add(const std::string &s) {
+    if(s.empty())
+      return 0;
+    auto it = m_offsets.find(s);
+    if(it != m_offsets.end())
+      return it->second;
+    const uint32_t offset = static_cast<uint32_t>(m_bytes.size());
+    m_bytes.insert(m_bytes.end(), s.begin(), s.end());
+    m_bytes.push_back('\0');
+    m_offsets[s] = offset;
+    return offset;
+  }
+
+  inline const std::vector<char> &bytes() const { return m_bytes; }
+
+private:
+  std::vector<char> m_bytes;
+  std::unordered_map<std::string, uint32_t> m_offsets;
+};
+
+bool readBody(JsonReader &reader, StringTable &strings, const std::unordered_map<std::string, uint32_t> &indices,
+              SceneBody &body, std::string &name) {
+  body = SceneBody();
+  body.parent = Scene::kNoParent;
+  body.color[0] = body.color[1] = body.color[2] = 1.0f;
+  body.size = 1.0f;
+  name.clear();
+  if(!reader.expect('{'))
+    return false;
+  std::string key, value;
+  bool first = true;
+  while(reader.nextKey(first, key)) {
+    bool emissive = false;
+    if(key == "name") {
+      reader.readString(name);
+    } else if(key == "texture") {
+      if(reader.readString(value))
+        body.texture = strings.add(value);
+    } else if(key == "parent") {
+      if(reader.readString(value)) {
+        auto parent = indices.find(value);
+        if(parent == indices.end())
+          reader.fail("parent \"" + value + "\" is not defined before");
+        else
+          body.parent = parent->second;
+      }
+    } else if(key == "emissive") {
+      if(reader.readBool(emissive) && emissive)
+        body.flags |= SceneBody::EMISSIVE;
+    } else if(key == "color") {
+      reader.expect('[') && reader.readNumber(body.color[0]) && reader.expect(',') && reader.readNumber(body.color[1])
+        && reader.expect(',') && reader.readNumber(body.color[2]) && reader.expect(']');
+    } else if(key == "size") {
+      reader.readNumber(body.size);
+    } else if(key == "orbitRadius") {
+      reader.readNumber(body.orbitRadius);
+    } else if(key == "orbitSpeed") {
+      reader.readNumber(body.orbitSpeed);
+    } else if(key == "orbitPhase") {
+      reader.readNumber(body.orbitPhase);
+    } else if(key == "orbitHeight") {
+      reader.readNumber(body.orbitHeight);
+    } else if(key == "rotationSpeed") {
+      reader.readNumber(body.rotationSpeed);
+    } else if(key == "axialTilt") {
+      reader.readNumber(body.axialTilt);
+    } else if(key == "heightMap") {
+      if(reader.readString(value))
+        body.heightMap = strings.add(value);
+    } else if(key == "heightScale") {
+      reader.readNumber(body.heightScale);
+    } else if(key == "radiusKm") {
+      reader.readNumber(body.radiusKm);
+    } else {
+      reader.fail("unknown body key \"" + key + "\"");
+    }
+    if(reader.failed())
+      return false;
+  }
+  if(reader.failed())
+    return false;
+  if(name.empty()) {
+    reader.fail("body without a name");
+    return false;
+  }
+  if(indices.count(name)) {
+    reader.fail("body \"" + name + "\" is defined twice");
+    return false;
+  }
+  body.name = strings.add(name);
+  return true;
+}
+
+// Parses the text description into the binary form
+bool compileText(const char *begin, const char *end, const std::string &path, std::vector<char> &binary) {
+  JsonReader reader(begin, end);
+  StringTable strings;
+  std::vector<SceneBody> bodies;
+  std::unordered_map<std::string, uint32_t> indices;
+  std::string key, name;
+  float version = 0.0f;
+  bool first = true;
+  if(reader.expect('{')) {
+    while(reader.nextKey(first, key)) {
+      // Descriptions of earlier versions lack only optional keys
+      if(key == "version") {
+        if(reader.readNumber(version) && (version < 1.0f || version > static_cast<float>(Scene::kVersion)))
+          reader.fail("unsupported version " + std::to_string(static_cast<int>(version)));
+      } else if(key == "bodies") {
+        bool firstBody = true;
+        if(reader.expect('[')) {
+          while(reader.nextElement(firstBody)) {
+            SceneBody body;
+            if(!readBody(reader, strings, indices, body, name))
+              break;
+            indices[name] = static_cast<uint32_t>(bodies.size());
+            bodies.push_back(body);
+          }
+        }
+      } else {
+        reader.fail("unknown key \"" + key + "\"");
+      }
+      if(reader.failed())
+        break;
+    }
+  }
+  if(!reader.failed() && !reader.atEnd())
+    reader.fail("unexpected text after the scene");
+  if(!reader.failed() && version == 0.0f)
+    reader.fail("missing version");
+  if(reader.failed()) {
+    std::cerr << "ERROR: " << path << ": " << reader.error() << std::endl;
+    return false;
+  }
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = Scene::kVersion;
+  header.bodyCount = static_cast<uint32_t>(bodies.size());
+  header.stringBytes = static_cast<uint32_t>(strings.bytes().size());
+  const size_t bodyBytes = bodies.size()*sizeof(SceneBody);
+  binary.resize(sizeof(Header) + bodyBytes + header.stringBytes);
+  std::memcpy(binary.data(), &header, sizeof(header));
+  if(bodyBytes > 0)
+    std::memcpy(binary.data() + sizeof(Header), bodies.data(), bodyBytes);
+  std::memcpy(binary.data() + sizeof(Header) + bodyBytes, strings.bytes().data(), header.stringBytes);
+  return true;
+}
+
+bool readFile(const std::string &path, std::vector<char> &data) {
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  if(!file)
+    return false;
+  data.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(data.data(), data.size());
+  return static_cast<bool>(file);
+}
+
+} // namespace
+
+bool Scene::compile(const std::string &textPath, const std::string &binaryPath) {
+  std::vector<char> text, binary;
+  if(!readFile(textPath, text)) {
+    std::cerr << "ERROR: Failed to read the scene " << textPath << std::endl;
+    return false;
+  }
+  if(!compileText(text.data(), text.data() + text.size(), textPath, binary))
+    return false;
+  std::ofstream file(binaryPath.c_str(), std::ios::binary);
+  file.write(binary.data(), binary.size());
+  if(!file) {
+    std::cerr << "ERROR: Failed to write the compiled scene " << binaryPath << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Scene::load(const std::string &path) {
+  clear();
+  if(!m_file.open(path)) {
+    std::cerr << "ERROR: Failed to read the scene " << path << std::endl;
+    return false;
+  }
+  const char *data = m_file.data();
+  size_t size = m_file.size();
+
+  // Anything but the binary form is a text description, compiled in memory
+  if(size < sizeof(kMagic) || std::memcmp(data, kMagic, sizeof(kMagic))) {
+    std::vector<char> binary;
+    const bool compiled = compileText(data, data + size, path, binary);
+    clear();
+    if(!compiled)
+      return false;
+    m_owned.swap(binary);
+    data = m_owned.data();
+    size = m_owned.size();
+  }
+  if(!attach(data, size, path)) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+bool Scene::attach(const char *data, size_t size, const std::string &path) {
+  Header header;
+  if(size < sizeof(Header)) {
+    std::cerr << "ERROR: " << path << ": truncated scene" << std::endl;
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if(header.version != kVersion) {
+    std::cerr << "ERROR: " << path << ": scene version " << header.version << ", expected " << kVersion
+              << " (compile it again)" << std::endl;
+    return false;
+  }
+  const uint64_t bodyBytes = static_cast<uint64_t>(header.bodyCount)*sizeof(SceneBody);
+  if(size != sizeof(Header) + bodyBytes + header.stringBytes || header.stringBytes == 0) {
+    std::cerr << "ERROR: " << path << ": scene size does not match its header" << std::endl;
+    return false;
+  }
+  m_bodies = reinterpret_cast<const SceneBody *>(data + sizeof(Header));
+  m_strings = data + sizeof(Header) + bodyBytes;
+  m_count = header.bodyCount;
+
+  // A single pass, so that the renderer can trust every index and offset
+  if(m_strings[header.stringBytes - 1] != '\0') {
+    std::cerr << "ERROR: " << path << ": unterminated string table" << std::endl;
+    return false;
+  }
+  for(uint32_t i = 0; i < m_count; ++i) {
+    const SceneBody &body = m_bodies[i];
+    if(body.name >= header.stringBytes || body.texture >= header.stringBytes || body.heightMap >= header.stringBytes
+     || (body.parent != kNoParent && body.parent >= i)) {
+      std::cerr << "ERROR: " << path << ": invalid body " << i << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t Scene::find(const std::string &name) const {
+  for(size_t i = 0; i < m_count; ++i)
+    if(name == string(m_bodies[i].name))
+      return i;
+  return m_count;
+}
+
+void Scene::clear() {
+  m_file.close();
+  m_owned.clear();
+  m_owned.shrink_to_fit();
+  m_bodies = nullptr;
+  m_strings = nullptr;
+  m_count = 0;
+}
@@ -0,0 +1,72 @@
+// ----------------------------------------------------------------------------
+// Scene.hpp
+//
+// Description: Bodies of the scene, described in a JSON text file and
+//              compiled to a flat binary form: a header, the body records,
+//              then a string table. The binary form is mapped into memory and
+//              its records are used in place as the body table.
+// ----------------------------------------------------------------------------
+
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One body, as stored in the binary form. Strings are offsets into the string
+// table, where offset 0 is the empty string. Bodies come after their parent.
+struct SceneBody {
+  enum Flags { EMISSIVE = 1 };
+  uint32_t name;
+  uint32_t texture;       // Empty for untextured bodies
+  uint32_t parent;        // Scene::kNoParent, or the index of the body it orbits
+  uint32_t flags;
+  float color[3];         // Emissive color, or albedo of untextured bodies
+  float size;             // Radius
+  float orbitRadius;      // Circular orbit in the xz plane, around the parent
+  float orbitSpeed;       // Radians per second
+  float orbitPhase;       // Radians at time 0
+  float orbitHeight;      // Offset from the orbital plane
+  float rotationSpeed;    // Radians per second
+  float axialTilt;        // Degrees, from y toward x
+  uint32_t heightMap;     // Empty for smooth bodies; equirectangular, 16-bit gray
+  float heightScale;      // Height of the white texels of the height map, relative to the radius
+  float radiusKm;         // Physical radius, for the altitudes of --approach
+};
+
+class Scene {
+public:
+  static const uint32_t kVersion = 2;
+  static const uint32_t kNoParent = 0xffffffffu;
+
+  // Compiles a text description into the binary form, which load() maps
+  static bool compile(const std::string &textPath, const std::string &binaryPath);
+
+  // Maps a compiled scene, or compiles a text description in memory
+  bool load(const std::string &path);
+
+  inline size_t count() const { return m_count; }
+  inline const SceneBody &body(size_t i) const { return m_bodies[i]; }
+  inline const char *string(uint32_t offset) const { return m_strings + offset; }
+  inline bool mapped() const { return m_file.mapped(); }
+
+  // Index of the named body, or count() if there is none
+  size_t find(const std::string &name) const;
+
+  void clear();
+
+private:
+  // Checks the binary form and points the table into it
+  bool attach(const char *data, size_t size, const std::string &path);
+
+  MappedFile m_file;         // Binary form, in place
+  std::vector<char> m_owned; // Binary form compiled in memory from a text description
+  const SceneBody *m_bodies = nullptr;
+  const char *m_strings = nullptr;
+  uint32_t m_count = 0;
+};
+
+#endif // SCENE_HPP
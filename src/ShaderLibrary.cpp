@@ -0,0 +1,197 @@
+// ----------------------------------------------------------------------------
+// ShaderLibrary.cpp
+//
+// Description: Shader loading and the preprocessor permutations (variants)
+//              of the main shader pair
+// ----------------------------------------------------------------------------
+
+#include "ShaderLibrary.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+#include "ProgramCache.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const char *kVariantNames[NUM_SHADER_VARIANTS] = { "emissive", "lit textured", "lit untextured", "lit virtual" };
+const char *kVariantDefines[NUM_SHADER_VARIANTS] = {
+  "#define EMISSIVE\n",
+  "#define LIT\n#define TEXTURED\n",
+  "#define LIT\n",
+  "#define LIT\n#define TEXTURED\n#define VIRTUAL_TEXTURE\n"
+};
+
+// The #version directive must stay first, so defines go right after it
+std::string injectDefines(const std::string &source, const std::string &defines) {
+  if(defines.empty())
+    return source;
+  size_t insertAt = 0;
+  if(source.compare(0, 8, "#version") == 0) {
+    insertAt = source.find('\n');
+    insertAt = insertAt == std::string::npos ? source.size() : insertAt + 1;
+  }
+  return source.substr(0, insertAt) + defines + source.substr(insertAt);
+}
+
+// Replaces the #include "file" lines by the content of the file, before
+// compilation and before the cache key is computed
+std::string resolveIncludes(const std::string &source, const std::string &filename, int depth = 0) {
+  std::istringstream lines(source);
+  std::string line, resolved;
+  while(std::getline(lines, line)) {
+    size_t open, close;
+    if(line.compare(0, 8, "#include") == 0 && (open = line.find('"')) != std::string::npos
+       && (close = line.find('"', open + 1)) != std::string::npos) {
+      const std::string included = line.substr(open + 1, close - open - 1);
+      const std::string content = file2String(included);
+      if(content.empty() || depth >= 8)
+        std::cerr << "ERROR: Cannot include " << included << " in " << filename << std::endl;
+      else
+        resolved += resolveIncludes(content, included, depth + 1);
+    } else {
+      resolved += line + "\n";
+    }
+  }
+  return resolved;
+}
+
+} // namespace
+
+std::string file2String(const std::string &filename) {
+  std::ifstream t(filename.c_str());
+  std::stringstream buffer;
+  buffer << t.rdbuf();
+  return buffer.str();
+}
+
+void loadShader(GLuint program, GLenum type, const std::string &shaderFilename,
+                const std::string &shaderSourceString, const std::string &defines) {
+  GLuint shader = glCreateShader(type); // Create the shader, e.g., a vertex shader to be applied to every single vertex of a mesh
+  const std::string specializedSource = injectDefines(shaderSourceString, defines);
+  const GLchar *shaderSource = (const GLchar *)specializedSource.c_str(); // Interface the C++ string through a C pointer
+  glShaderSource(shader, 1, &shaderSource, NULL); // load the vertex shader code
+  glCompileShader(shader);
+  // With parallel compilation, querying the status here would wait for the
+  // compiler thread; errors are reported from the link log instead
+  if(!g_glCaps.parallelShaderCompile) {
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if(!success) {
+      glGetShaderInfoLog(shader, 512, NULL, infoLog);
+      std::cout << "ERROR in compiling " << shaderFilename << "\n\t" << infoLog << std::endl;
+    }
+  }
+  glAttachShader(program, shader);
+  glDeleteShader(shader);
+}
+
+PendingProgram beginProgram(ProgramCache &cache, const std::vector<ShaderStage> &stages, const std::string &defines) {
+  PendingProgram pending;
+  std::vector<std::string> sources;
+  for(const ShaderStage &stage : stages) {
+    sources.push_back(resolveIncludes(file2String(stage.filename), stage.filename));
+    pending.name += (pending.name.empty() ? "" : " + ") + stage.filename;
+  }
+  pending.key = cache.computeKey(sources, defines);
+  pending.program = cache.load(pending.key);
+  if(pending.program) {
+    pending.fromCache = true;
+    return pending;
+  }
+
+  pending.program = glCreateProgram();
+  if(cache.enabled())
+    glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  for(size_t i = 0; i < stages.size(); ++i)
+    loadShader(pending.program, stages[i].type, stages[i].filename, sources[i], defines);
+  glLinkProgram(pending.program);
+  return pending;
+}
+
+bool isProgramReady(const PendingProgram &pending) {
+  if(pending.fromCache || !g_glCaps.parallelShaderCompile)
+    return true;
+  GLint done = GL_FALSE;
+  glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+  return done == GL_TRUE;
+}
+
+GLuint finishProgram(ProgramCache &cache, PendingProgram &pending) {
+  if(pending.fromCache)
+    return pending.program;
+  GLint success;
+  glGetProgramiv(pending.program, GL_LINK_STATUS, &success);
+  if(!success) {
+    GLchar infoLog[1024];
+    glGetProgramInfoLog(pending.program, 1024, NULL, infoLog);
+    std::cout << "ERROR in linking " << pending.name << "\n\t" << infoLog << std::endl;
+    return pending.program;
+  }
+  cache.store(pending.key, pending.program);
+  return pending.program;
+}
+
+void ShaderLibrary::init(ProgramCache *cache, const std::vector<ShaderStage> &stages, const std::string &commonDefines,
+                         const std::function<void(GLuint)> &onReady) {
+  m_cache = cache;
+  m_stages = stages;
+  m_commonDefines = commonDefines;
+  m_onReady = onReady;
+  if(g_glCaps.parallelShaderCompile)
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // Let the driver pick its thread count
+}
+
+void ShaderLibrary::prefetch(ShaderVariant variant) {
+  request(variant);
+  if(!g_glCaps.parallelShaderCompile && !m_entries[variant].program)
+    finish(variant);
+}
+
+void ShaderLibrary::poll() {
+  for(int v = 0; v < NUM_SHADER_VARIANTS; ++v) {
+    Entry &entry = m_entries[v];
+    if(entry.requested && !entry.program && isProgramReady(entry.pending))
+      finish(static_cast<ShaderVariant>(v));
+  }
+}
+
+GLuint ShaderLibrary::program(ShaderVariant variant) {
+  Entry &entry = m_entries[variant];
+  if(!entry.program) {
+    request(variant);
+    finish(variant);
+  }
+  return entry.program;
+}
+
+const char *ShaderLibrary::name(ShaderVariant variant) {
+  return kVariantNames[variant];
+}
+
+void ShaderLibrary::request(ShaderVariant variant) {
+  Entry &entry = m_entries[variant];
+  if(entry.requested)
+    return;
+  entry.pending = beginProgram(*m_cache, m_stages, m_commonDefines + kVariantDefines[variant]);
+  entry.requested = true;
+}
+
+void ShaderLibrary::finish(ShaderVariant variant) {
+  Entry &entry = m_entries[variant];
+  entry.program = finishProgram(*m_cache, entry.pending);
+  g_glState.useProgram(entry.program);
+  if(m_onReady)
+    m_onReady(entry.program);
+}
+
+void ShaderLibrary::clear() {
+  for(Entry &entry : m_entries) {
+    if(entry.requested)
+      g_glState.deleteProgram(entry.pending.program);
+    entry = Entry();
+  }
+}
@@ -0,0 +1,105 @@
+// ----------------------------------------------------------------------------
+// ShaderLibrary.hpp
+//
+// Description: Shader loading and the preprocessor permutations (variants)
+//              of the main shader pair
+// ----------------------------------------------------------------------------
+
+#ifndef SHADER_LIBRARY_HPP
+#define SHADER_LIBRARY_HPP
+
+#include <glad/gl.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ProgramCache;
+
+struct ShaderStage {
+  GLenum type;
+  std::string filename;
+};
+
+// A program whose compilation and link may still be running on driver threads
+struct PendingProgram {
+  GLuint program = 0;
+  uint64_t key = 0;
+  bool fromCache = false;
+  std::string name; // For error messages
+};
+
+// Loads the content of an ASCII file in standard C++ string
+std::string file2String(const std::string &filename);
+
+// Compiles a shader with the given #define lines injected after its #version
+// directive, before attaching it to a program
+void loadShader(GLuint program, GLenum type, const std::string &shaderFilename,
+                const std::string &shaderSourceString, const std::string &defines);
+
+// Issues the compilation and link of a program without waiting for them,
+// unless the binary could be taken from the cache. Lines #include "file" in
+// the stages are replaced by the content of the file.
+PendingProgram beginProgram(ProgramCache &cache, const std::vector<ShaderStage> &stages, const std::string &defines);
+
+// True once the program can be used without stalling
+bool isProgramReady(const PendingProgram &pending);
+
+// Waits for the link, reports errors and stores the binary in the cache
+GLuint finishProgram(ProgramCache &cache, PendingProgram &pending);
+
+inline GLuint loadProgram(ProgramCache &cache, const std::vector<ShaderStage> &stages, const std::string &defines = "") {
+  PendingProgram pending = beginProgram(cache, stages, defines);
+  return finishProgram(cache, pending);
+}
+
+// Specializations of vertexShader.glsl/fragmentShader.glsl, so that the
+// fragment shader does not branch on per-object uniforms
+enum ShaderVariant {
+  SHADER_EMISSIVE = 0,    // Flat emissive color (the sun)
+  SHADER_LIT_TEXTURED,    // Phong lighting on the albedo texture
+  SHADER_LIT_UNTEXTURED,  // Phong lighting on objectColor
+  SHADER_LIT_VIRTUAL,     // Phong lighting on a virtual texture (VirtualTexture.hpp)
+  NUM_SHADER_VARIANTS
+};
+
+class ShaderLibrary {
+public:
+  // commonDefines are shared by every variant (e.g., lighting constants).
+  // onReady is called with each program once it is linked and bound.
+  void init(ProgramCache *cache, const std::vector<ShaderStage> &stages, const std::string &commonDefines,
+            const std::function<void(GLuint)> &onReady);
+
+  // Starts compiling a variant ahead of its first use, on the driver's
+  // threads when it supports parallel compilation, synchronously otherwise
+  void prefetch(ShaderVariant variant);
+
+  // Finalizes variants whose background compilation has completed
+  void poll();
+
+  // Returns the program of a variant, compiling or waiting for it if needed
+  GLuint program(ShaderVariant variant);
+
+  static const char *name(ShaderVariant variant);
+
+  void clear();
+
+private:
+  struct Entry {
+    PendingProgram pending;
+    GLuint program = 0;
+    bool requested = false;
+  };
+
+  void request(ShaderVariant variant);
+  void finish(ShaderVariant variant);
+
+  ProgramCache *m_cache = nullptr;
+  std::vector<ShaderStage> m_stages;
+  std::string m_commonDefines;
+  std::function<void(GLuint)> m_onReady;
+  Entry m_entries[NUM_SHADER_VARIANTS];
+};
+
+#endif // SHADER_LIBRARY_HPP
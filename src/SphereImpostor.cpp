@@ -0,0 +1,30 @@
+// ----------------------------------------------------------------------------
+// SphereImpostor.cpp
+//
+// Description: Sphere drawn as a camera-facing square, on which the IMPOSTOR
+//              variants of the shaders ray-trace the exact sphere (see
+//              impostor.glsl). Used for bodies that cover few pixels.
+// ----------------------------------------------------------------------------
+
+#include "SphereImpostor.hpp"
+#include "GLState.hpp"
+
+#include <algorithm>
+
+void SphereImpostor::init() {
+  glGenVertexArrays(1, &m_vao);
+}
+
+void SphereImpostor::render() {
+  g_glState.bindVertexArray(m_vao);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // Corners come from gl_VertexID
+}
+
+void SphereImpostor::clear() {
+  g_glState.deleteVertexArrays(1, &m_vao);
+  m_vao = 0;
+}
+
+float SphereImpostor::projectedRadius(const glm::vec3 &center, float radius, const glm::vec3 &eye, float pixelScale) {
+  return radius*pixelScale/std::max(glm::distance(center, eye), 1e-6f);
+}
@@ -0,0 +1,34 @@
+// ----------------------------------------------------------------------------
+// SphereImpostor.hpp
+//
+// Description: Sphere drawn as a camera-facing square, on which the IMPOSTOR
+//              variants of the shaders ray-trace the exact sphere (see
+//              impostor.glsl). Used for bodies that cover few pixels.
+// ----------------------------------------------------------------------------
+
+#ifndef SPHERE_IMPOSTOR_HPP
+#define SPHERE_IMPOSTOR_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+class SphereImpostor {
+public:
+  // Creates the empty VAO that the core profile requires for any draw
+  void init();
+
+  // Draws the square of the body whose ObjectBlock is bound, with an IMPOSTOR
+  // program in use
+  void render();
+
+  void clear();
+
+  // Radius in pixels of a sphere seen from eye, with pixelScale the viewport
+  // height divided by 2 tan(fov/2)
+  static float projectedRadius(const glm::vec3 &center, float radius, const glm::vec3 &eye, float pixelScale);
+
+private:
+  GLuint m_vao = 0;
+};
+
+#endif // SPHERE_IMPOSTOR_HPP
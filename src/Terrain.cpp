@@ -0,0 +1,391 @@
+// ----------------------------------------------------------------------------
+// Terrain.cpp
+//
+// Description: Planetary terrain for close approaches (CDLOD)
+// ----------------------------------------------------------------------------
+
+#include "Terrain.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// Faces of the cube, as in terrainVertexShader.glsl: u x v is the outward
+// normal, so that the grids wind counterclockwise seen from outside
+const glm::vec3 kFaceNormals[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+const glm::vec3 kFaceU[6] = { { 0, 0, -1 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 } };
+const glm::vec3 kFaceV[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+
+const float kRangeFactor = 3.5f;  // Range of a level, in node widths
+const float kMorphStart = 0.8f;   // Fraction of the range where the morph toward the coarser grid starts
+const float kHalfPi = 1.57079633f;
+
+// Point (s, t) of a face in [-1, 1]^2, projected on the unit sphere with the
+// mapping of Nowell, whose cells vary less in area than after a plain
+// normalization (cubeSphere.glsl on the GPU)
+glm::vec3 cubeToSphere(int face, float s, float t) {
+  const glm::vec3 c = kFaceNormals[face] + s*kFaceU[face] + t*kFaceV[face];
+  const glm::vec3 c2 = c*c;
+  const glm::vec3 p(c.x*std::sqrt(std::max(0.0f, 1.0f - 0.5f*c2.y - 0.5f*c2.z + c2.y*c2.z/3.0f)),
+                    c.y*std::sqrt(std::max(0.0f, 1.0f - 0.5f*c2.z - 0.5f*c2.x + c2.z*c2.x/3.0f)),
+                    c.z*std::sqrt(std::max(0.0f, 1.0f - 0.5f*c2.x - 0.5f*c2.y + c2.x*c2.y/3.0f)));
+  return glm::normalize(p);
+}
+
+// Lowest and highest of the texels that bilinear filtering reads at a
+// direction, with the texture coordinates of Mesh::genSphere()
+void heightRange(const std::vector<uint16_t> &heights, int width, int height, const glm::vec3 &n,
+                 uint16_t &low, uint16_t &high) {
+  float u = std::atan2(n.z, n.x)*0.15915494f;
+  if(u < 0.0f)
+    u += 1.0f;
+  const float v = std::acos(std::max(-1.0f, std::min(1.0f, n.y)))*0.31830989f;
+  const int x0 = static_cast<int>(std::floor(u*width - 0.5f));
+  const int y0 = static_cast<int>(std::floor(v*height - 0.5f));
+  for(int dy = 0; dy < 2; ++dy) {
+    const int y = std::max(0, std::min(height - 1, y0 + dy));
+    for(int dx = 0; dx < 2; ++dx) {
+      const int x = ((x0 + dx) % width + width) % width;
+      const uint16_t h = heights[static_cast<size_t>(y)*width + x];
+      low = std::min(low, h);
+      high = std::max(high, h);
+    }
+  }
+}
+
+} // namespace
+
+void Terrain::init() {
+  // Grid coordinates of the vertices, in quads from the corner of the patch
+  std::vector<GLubyte> vertices;
+  for(int j = 0; j <= kGridSize; ++j)
+    for(int i = 0; i <= kGridSize; ++i) {
+      vertices.push_back(static_cast<GLubyte>(i));
+      vertices.push_back(static_cast<GLubyte>(j));
+    }
+  // The diagonals all go the same way, along which the vertices of both odd
+  // coordinates morph (terrainVertexShader.glsl); the quarter grid covers
+  // the first 16x16 quads, spaced as the whole grid of the parent
+  std::vector<GLushort> indices[2];
+  for(int k = 0; k < 2; ++k) {
+    const int quads = k ? kGridSize/2 : kGridSize;
+    for(int j = 0; j < quads; ++j)
+      for(int i = 0; i < quads; ++i) {
+        const GLushort v00 = static_cast<GLushort>(j*(kGridSize + 1) + i), v10 = v00 + 1;
+        const GLushort v01 = static_cast<GLushort>(v00 + kGridSize + 1), v11 = v01 + 1;
+        indices[k].insert(indices[k].end(), { v00, v10, v11, v00, v11, v01 });
+      }
+    m_indexCounts[k] = static_cast<GLsizei>(indices[k].size());
+  }
+
+  glGenVertexArrays(1, &m_vao);
+  g_glState.bindVertexArray(m_vao);
+  glGenBuffers(1, &m_vertexBuffer);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 2, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0);
+  glEnableVertexAttribArray(0);
+  glGenBuffers(2, m_indexBuffers);
+  for(int k = 0; k < 2; ++k) {
+    g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffers[k]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices[k].size()*sizeof(GLushort), indices[k].data(), GL_STATIC_DRAW);
+  }
+  glGenBuffers(1, &m_instanceBuffer);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+  for(GLuint location = 3; location <= 4; ++location) {
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+  }
+  g_glState.bindVertexArray(0);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+int Terrain::add(const std::string &heightMapPath, float heightScale) {
+  int width, height, numComponents;
+  stbi_us *data = stbi_load_16(heightMapPath.c_str(), &width, &height, &numComponents, 1);
+  if(!data) {
+    std::cerr << "ERROR: Failed to load the height map " << heightMapPath << std::endl;
+    return -1;
+  }
+  std::unique_ptr<Body> body(new Body);
+  body->path = heightMapPath;
+  body->heightScale = heightScale;
+  body->width = width;
+  body->height = height;
+  body->heights.assign(data, data + static_cast<size_t>(width)*height);
+
+  glGenTextures(1, &body->heightMap);
+  g_glState.bindTexture(GL_TEXTURE_2D, body->heightMap);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 2); // Rows of odd widths
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, width, height, 0, GL_RED, GL_UNSIGNED_SHORT, data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  stbi_image_free(data);
+
+  // The grid reaches the spacing of the texels (a quarter of the width
+  // across a face) two levels before the finest; the bounds stop at nodes
+  // of about 4 texels
+  const double texelsPerRoot = width/4.0;
+  body->numLevels = std::max(4, std::min(kMaxLevels, static_cast<int>(std::floor(std::log2(texelsPerRoot/kGridSize))) + 3));
+  body->numBoundsLevels = 1 + std::max(0, std::min(std::min(kMaxBoundsLevel, body->numLevels - 1),
+                                                   static_cast<int>(std::ceil(std::log2(texelsPerRoot/4.0)))));
+  for(int level = 0; level < kMaxLevels; ++level)
+    body->ranges[level] = kRangeFactor*kHalfPi/static_cast<float>(1 << level);
+
+  body->boundsThread = std::thread(&Terrain::buildBounds, body.get());
+  m_bodies.push_back(std::move(body));
+  return static_cast<int>(m_bodies.size()) - 1;
+}
+
+void Terrain::buildBounds(Body *body) {
+  Timer timer;
+  const int finest = body->numBoundsLevels - 1;
+  body->bounds.resize(body->numBoundsLevels);
+
+  // Finest level from the texels, sampled at least once per texel
+  const int n = 1 << finest;
+  const int texelsPerNode = static_cast<int>(std::ceil(body->width/4.0/n));
+  const int samples = std::max(9, std::min(33, texelsPerNode + 2));
+  std::vector<uint16_t> &finestBounds = body->bounds[finest];
+  finestBounds.resize(2*6*static_cast<size_t>(n)*n);
+  for(int face = 0; face < 6; ++face)
+    for(int y = 0; y < n && !body->stop; ++y)
+      for(int x = 0; x < n; ++x) {
+        uint16_t low = 0xffff, high = 0;
+        for(int j = 0; j < samples; ++j)
+          for(int i = 0; i < samples; ++i) {
+            const float s = -1.0f + 2.0f*(x + i/(samples - 1.0f))/n;
+            const float t = -1.0f + 2.0f*(y + j/(samples - 1.0f))/n;
+            heightRange(body->heights, body->width, body->height, cubeToSphere(face, s, t), low, high);
+          }
+        const size_t node = (static_cast<size_t>(face)*n + y)*n + x;
+        finestBounds[2*node] = low;
+        finestBounds[2*node + 1] = high;
+      }
+
+  if(body->stop)
+    return;
+
+  // Coarser levels from their children
+  for(int level = finest - 1; level >= 0; --level) {
+    const int m = 1 << level;
+    const std::vector<uint16_t> &children = body->bounds[level + 1];
+    std::vector<uint16_t> &bounds = body->bounds[level];
+    bounds.resize(2*6*static_cast<size_t>(m)*m);
+    for(int face = 0; face < 6; ++face)
+      for(int y = 0; y < m; ++y)
+        for(int x = 0; x < m; ++x) {
+          uint16_t low = 0xffff, high = 0;
+          for(int c = 0; c < 4; ++c) {
+            const size_t child = (static_cast<size_t>(face)*2*m + 2*y + (c >> 1))*2*m + 2*x + (c & 1);
+            low = std::min(low, children[2*child]);
+            high = std::max(high, children[2*child + 1]);
+          }
+          const size_t node = (static_cast<size_t>(face)*m + y)*m + x;
+          bounds[2*node] = low;
+          bounds[2*node + 1] = high;
+        }
+  }
+  body->boundsMs = timer.elapsedMs();
+  body->boundsReady.store(true, std::memory_order_release);
+}
+
+float Terrain::surfaceHeight(int index, const glm::dvec3 &direction) const {
+  const Body &body = *m_bodies[index];
+  const glm::vec3 n = glm::normalize(glm::vec3(direction));
+  float u = std::atan2(n.z, n.x)*0.15915494f;
+  if(u < 0.0f)
+    u += 1.0f;
+  const float x = u*body.width - 0.5f;
+  const float y = std::acos(std::max(-1.0f, std::min(1.0f, n.y)))*0.31830989f*body.height - 0.5f;
+  const int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+  const float fx = x - x0, fy = y - y0;
+  float h[2][2];
+  for(int dy = 0; dy < 2; ++dy)
+    for(int dx = 0; dx < 2; ++dx) {
+      const int tx = ((x0 + dx) % body.width + body.width) % body.width;
+      const int ty = std::max(0, std::min(body.height - 1, y0 + dy));
+      h[dy][dx] = body.heights[static_cast<size_t>(ty)*body.width + tx]/65535.0f;
+    }
+  const float height = (1.0f - fy)*((1.0f - fx)*h[0][0] + fx*h[0][1]) + fy*((1.0f - fx)*h[1][0] + fx*h[1][1]);
+  return body.heightScale*height;
+}
+
+void Terrain::nodeBox(const Body &body, int face, int level, int x, int y, glm::vec3 &boxMin, glm::vec3 &boxMax) const {
+  // Height bounds of the node, or of its finest ancestor that has some;
+  // the whole range until they are built
+  float low = 0.0f, high = 1.0f;
+  if(body.boundsReady.load(std::memory_order_acquire)) {
+    const int boundsLevel = std::min(level, body.numBoundsLevels - 1);
+    const int shift = level - boundsLevel, n = 1 << boundsLevel;
+    const size_t node = (static_cast<size_t>(face)*n + (y >> shift))*n + (x >> shift);
+    low = body.bounds[boundsLevel][2*node]/65535.0f;
+    high = body.bounds[boundsLevel][2*node + 1]/65535.0f;
+  }
+  // The unit sphere is always inside, as the morph measures distances on it
+  const float inner = 1.0f + body.heightScale*std::min(low, 0.0f);
+  const float outer = 1.0f + body.heightScale*high;
+
+  // A 3x3 grid of directions, and the bulge of the sphere between them
+  const float size = 2.0f/static_cast<float>(1 << level);
+  const float s0 = -1.0f + x*size, t0 = -1.0f + y*size;
+  boxMin = glm::vec3(outer);
+  boxMax = glm::vec3(-outer);
+  for(int j = 0; j <= 2; ++j)
+    for(int i = 0; i <= 2; ++i) {
+      const glm::vec3 n = cubeToSphere(face, s0 + 0.5f*size*i, t0 + 0.5f*size*j);
+      boxMin = glm::min(boxMin, glm::min(inner*n, outer*n));
+      boxMax = glm::max(boxMax, glm::max(inner*n, outer*n));
+    }
+  const float bulge = outer*(1.0f - std::cos(0.5f*kHalfPi/static_cast<float>(1 << level)));
+  boxMin -= glm::vec3(bulge);
+  boxMax += glm::vec3(bulge);
+}
+
+void Terrain::addPatch(Body &body, std::vector<Patch> &patches, int face, int level, int x, int y, int morphLevel) const {
+  const float size = 2.0f/static_cast<float>(1 << level);
+  Patch patch;
+  patch.origin = glm::vec4(-1.0f + x*size, -1.0f + y*size, size, static_cast<float>(face));
+  // Level of the height map whose texels match the quads, negative where
+  // the quads are finer (the shader clamps it after adding the morph)
+  const float heightLevel = static_cast<float>(std::log2(body.width/4.0/kGridSize)) - morphLevel;
+  patch.morph = glm::vec4(kMorphStart*body.ranges[morphLevel], body.ranges[morphLevel], heightLevel, 0.0f);
+  patches.push_back(patch);
+}
+
+bool Terrain::selectNode(Body &body, int face, int level, int x, int y) {
+  glm::vec3 boxMin, boxMax;
+  nodeBox(body, face, level, x, y, boxMin, boxMax);
+  const float distance = glm::length(glm::max(glm::max(boxMin - body.camera, body.camera - boxMax), glm::vec3(0.0f)));
+  if(level > 0 && distance > body.ranges[level])
+    return false; // The roots are always drawn
+  for(const glm::vec4 &plane : m_planes) {
+    const glm::vec3 farthest(plane.x > 0.0f ? boxMax.x : boxMin.x, plane.y > 0.0f ? boxMax.y : boxMin.y, plane.z > 0.0f ? boxMax.z : boxMin.z);
+    if(glm::dot(glm::vec3(plane), farthest) + plane.w < 0.0f)
+      return true; // Covered, and not visible
+  }
+  if(level + 1 == body.numLevels || distance > body.ranges[level + 1]) {
+    addPatch(body, body.fullPatches, face, level, x, y, level);
+    body.nearest = std::min(body.nearest, distance);
+    return true;
+  }
+  for(int c = 0; c < 4; ++c) {
+    const int cx = 2*x + (c & 1), cy = 2*y + (c >> 1);
+    if(!selectNode(body, face, level + 1, cx, cy)) {
+      addPatch(body, body.quarterPatches, face, level + 1, cx, cy, level);
+      body.nearest = std::min(body.nearest, distance);
+    }
+  }
+  return true;
+}
+
+void Terrain::select(int index, const glm::dvec3 &camera, const glm::vec4 planes[4]) {
+  Timer timer;
+  Body &body = *m_bodies[index];
+  if(m_synchronous && body.boundsThread.joinable())
+    body.boundsThread.join();
+  body.camera = glm::vec3(camera);
+  std::copy(planes, planes + 4, m_planes);
+  body.fullPatches.clear();
+  body.quarterPatches.clear();
+  body.nearest = std::numeric_limits<float>::max();
+  for(int face = 0; face < 6; ++face)
+    selectNode(body, face, 0, 0, 0);
+  const size_t numPatches = body.fullPatches.size() + body.quarterPatches.size();
+  ++body.frames;
+  body.totalPatches += numPatches;
+  body.maxPatches = std::max(body.maxPatches, numPatches);
+  body.selectMs += timer.elapsedMs();
+}
+
+void Terrain::render(int index, GLuint program) {
+  const Body &body = *m_bodies[index];
+  const size_t numPatches = body.fullPatches.size() + body.quarterPatches.size();
+  if(numPatches == 0)
+    return;
+  if(program != m_program) {
+    m_program = program;
+    m_cameraLoc = glGetUniformLocation(program, "terrainCamera");
+    m_heightScaleLoc = glGetUniformLocation(program, "heightScale");
+    m_gridSizeLoc = glGetUniformLocation(program, "gridSize");
+  }
+  glUniform3fv(m_cameraLoc, 1, &body.camera[0]);
+  glUniform1f(m_heightScaleLoc, body.heightScale);
+
+  // Whole patches, then the quarters, in one upload
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+  const size_t bytes = numPatches*sizeof(Patch);
+  if(bytes > m_instanceCapacity)
+    m_instanceCapacity = std::max(bytes, 2*m_instanceCapacity);
+  glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity, nullptr, GL_STREAM_DRAW); // Orphaned, so as not to wait for the previous draws
+  glBufferSubData(GL_ARRAY_BUFFER, 0, body.fullPatches.size()*sizeof(Patch), body.fullPatches.data());
+  glBufferSubData(GL_ARRAY_BUFFER, body.fullPatches.size()*sizeof(Patch), body.quarterPatches.size()*sizeof(Patch),
+                  body.quarterPatches.data());
+
+  g_glState.activeTexture(GL_TEXTURE0 + kHeightMapUnit);
+  g_glState.bindTexture(GL_TEXTURE_2D, body.heightMap);
+  g_glState.activeTexture(GL_TEXTURE0);
+  g_glState.bindVertexArray(m_vao);
+  size_t first = 0;
+  for(int k = 0; k < 2; ++k) {
+    const size_t count = k ? body.quarterPatches.size() : body.fullPatches.size();
+    if(count == 0)
+      continue;
+    const size_t offset = first*sizeof(Patch);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Patch), reinterpret_cast<const void *>(offset));
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Patch), reinterpret_cast<const void *>(offset + sizeof(glm::vec4)));
+    g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffers[k]);
+    glUniform1f(m_gridSizeLoc, static_cast<float>(k ? kGridSize/2 : kGridSize));
+    glDrawElementsInstanced(GL_TRIANGLES, m_indexCounts[k], GL_UNSIGNED_SHORT, nullptr, static_cast<GLsizei>(count));
+    first += count;
+  }
+}
+
+void Terrain::setupProgram(GLuint program) {
+  const GLint location = glGetUniformLocation(program, "heightMap");
+  if(location >= 0)
+    glUniform1i(location, kHeightMapUnit);
+}
+
+void Terrain::printStats() const {
+  for(const auto &body : m_bodies) {
+    char line[512];
+    std::snprintf(line, sizeof(line), "Terrain %s: %dx%d height map, %d levels, bounds of %d levels in %.0f ms, "
+                  "%.0f patches per frame (max %zu), selection %.3f ms per frame",
+                  body->path.c_str(), body->width, body->height, body->numLevels, body->numBoundsLevels,
+                  body->boundsReady ? body->boundsMs : 0.0, body->frames ? static_cast<double>(body->totalPatches)/body->frames : 0.0,
+                  body->maxPatches, body->frames ? body->selectMs/body->frames : 0.0);
+    std::cout << line << std::endl;
+  }
+}
+
+void Terrain::clear() {
+  for(auto &body : m_bodies) {
+    body->stop = true;
+    if(body->boundsThread.joinable())
+      body->boundsThread.join();
+    g_glState.deleteTextures(1, &body->heightMap);
+  }
+  m_bodies.clear();
+  g_glState.deleteVertexArrays(1, &m_vao);
+  g_glState.deleteBuffers(1, &m_vertexBuffer);
+  g_glState.deleteBuffers(2, m_indexBuffers);
+  g_glState.deleteBuffers(1, &m_instanceBuffer);
+  m_vao = m_vertexBuffer = m_instanceBuffer = 0;
+  m_indexBuffers[0] = m_indexBuffers[1] = 0;
+  m_instanceCapacity = 0;
+  m_program = 0;
+}
@@ -0,0 +1,144 @@
+// ----------------------------------------------------------------------------
+// Terrain.hpp
+//
+// Description: Planetary terrain for close approaches (CDLOD). A body is a
+//              cube whose six faces are quadtrees, projected onto the sphere.
+//              Every frame, the nodes within the distance range of their level
+//              are selected; each is drawn as the same fixed grid patch,
+//              instanced, and terrainVertexShader.glsl displaces it by the
+//              height map and morphs its odd vertices toward the next coarser
+//              grid near the end of the range, so that levels meet without
+//              cracks nor popping. The height bounds of the nodes, which the
+//              selection culls and measures distances with, are computed by a
+//              background thread; conservative bounds stand in until then.
+// ----------------------------------------------------------------------------
+
+#ifndef TERRAIN_HPP
+#define TERRAIN_HPP
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Terrain {
+public:
+  static const int kGridSize = 32;        // Quads of a patch, per side
+  static const int kMaxLevels = 17;       // Root level included
+  static const int kMaxBoundsLevel = 9;   // Finer nodes take the bounds of their ancestor
+  static const GLint kHeightMapUnit = 7;  // Texture unit, after those of VirtualTexture
+
+  // Grid vertices and index buffers of the patches, shared by every body
+  void init();
+
+  // Terrain of a body from an equirectangular height map (8 or 16-bit
+  // gray), whose white texels are heightScale above the unit sphere; starts
+  // computing the bounds of its nodes. Returns its index, or -1.
+  int add(const std::string &heightMapPath, float heightScale);
+
+  // Selects the patches of a body for this frame. camera is the camera in
+  // the body's frame (where the body is the unit sphere), planes the side
+  // planes of the frustum in the same frame.
+  void select(int index, const glm::dvec3 &camera, const glm::vec4 planes[4]);
+
+  // Draws the patches last selected for a body with a program of
+  // terrainVertexShader.glsl; the ObjectBlock of the body must be bound
+  void render(int index, GLuint program);
+
+  // The sampler unit of the height map
+  static void setupProgram(GLuint program);
+
+  // The bounds are computed before the first selection, so that offline
+  // exports do not depend on the timing of the background thread
+  void setSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+  inline size_t count() const { return m_bodies.size(); }
+
+  // For the tessellated sphere (TessellatedSphere.hpp), which displaces it
+  inline GLuint heightMap(int index) const { return m_bodies[index]->heightMap; }
+  inline float heightScale(int index) const { return m_bodies[index]->heightScale; }
+
+  // Distance from the camera to the bounds of the closest patch of the last
+  // selection, in radii of the body, for the near plane
+  inline float nearestDistance(int index) const { return m_bodies[index]->nearest; }
+
+  // Height of the finest level of the height map in a direction of the
+  // body's frame, in radii above the unit sphere
+  float surfaceHeight(int index, const glm::dvec3 &direction) const;
+
+  // Levels, bounds and patches per frame of every terrain, over the run
+  void printStats() const;
+
+  void clear();
+
+private:
+  // Per instance: where the patch lies and how it morphs (locations 3 and 4)
+  struct Patch {
+    glm::vec4 origin; // Corner on the cube face in [-1, 1]^2, size on the face, face
+    glm::vec4 morph;  // Distances where the morph starts and ends, level of the height map, 0
+  };
+
+  struct Body {
+    std::string path;
+    float heightScale = 0.0f;
+    GLuint heightMap = 0;
+    int width = 0;
+    int height = 0;
+    int numLevels = 0;      // Of the quadtrees, at most kMaxLevels
+    int numBoundsLevels = 0;
+    float ranges[kMaxLevels]; // Distance within which the nodes of a level are drawn, in radii
+
+    // Per bounds level, the (min, max) height of each node, face-major then
+    // row-major, as fractions of 65535; written by the bounds thread
+    std::vector<std::vector<uint16_t>> bounds;
+    std::vector<uint16_t> heights; // The height map, read by the bounds thread and surfaceHeight()
+    std::thread boundsThread;
+    std::atomic<bool> boundsReady;
+    std::atomic<bool> stop;
+    double boundsMs = 0.0;
+
+    glm::vec3 camera;                  // Of the last selection, in the body's frame
+    float nearest = 0.0f;
+
+    std::vector<Patch> fullPatches;    // Nodes drawn whole
+    std::vector<Patch> quarterPatches; // Quarters of nodes drawn where their children are out of range
+    size_t frames = 0;
+    size_t totalPatches = 0;
+    size_t maxPatches = 0;
+    double selectMs = 0.0;
+
+    Body() : boundsReady(false), stop(false) {}
+  };
+
+  // Selects a node or its children; false when it is out of the range of
+  // its level, so that its parent covers it
+  bool selectNode(Body &body, int face, int level, int x, int y);
+  void nodeBox(const Body &body, int face, int level, int x, int y, glm::vec3 &boxMin, glm::vec3 &boxMax) const;
+  void addPatch(Body &body, std::vector<Patch> &patches, int face, int level, int x, int y, int morphLevel) const;
+
+  static void buildBounds(Body *body);
+
+  GLuint m_vao = 0;
+  GLuint m_vertexBuffer = 0;
+  GLuint m_indexBuffers[2] = { 0, 0 }; // Whole grid, and the half-resolution grid of a quarter
+  GLsizei m_indexCounts[2] = { 0, 0 };
+  GLuint m_instanceBuffer = 0;
+  size_t m_instanceCapacity = 0;
+  bool m_synchronous = false;
+  std::vector<std::unique_ptr<Body>> m_bodies;
+
+  glm::vec4 m_planes[4]; // Of the current selection, in the body's frame
+
+  // Uniform locations of the last program
+  GLuint m_program = 0;
+  GLint m_cameraLoc = -1;
+  GLint m_heightScaleLoc = -1;
+  GLint m_gridSizeLoc = -1;
+};
+
+#endif // TERRAIN_HPP
@@ -0,0 +1,99 @@
+// ----------------------------------------------------------------------------
+// TessellatedSphere.cpp
+//
+// Description: Unit sphere refined on the GPU (GL 4.0). A coarse cube of
+//              quad patches is drawn with the tessellation stages
+//              (tessControlShader.glsl, tessEvaluationShader.glsl), which cut
+//              each patch edge by its length on screen and project the new
+//              vertices on the sphere, displaced by the body's height map if
+//              any: the triangles follow the pixels the body covers, without
+//              any mesh built on the CPU.
+// ----------------------------------------------------------------------------
+
+#include "TessellatedSphere.hpp"
+
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+#include "Terrain.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace {
+
+// Faces of the cube, as in Terrain.cpp: u x v is the outward normal, so that
+// the patches, counterclockwise in (u, v), face outward
+const glm::vec3 kFaceNormals[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+const glm::vec3 kFaceU[6] = { { 0, 0, -1 }, { 0, 0, 1 }, { 1, 0, 0 }, { 1, 0, 0 }, { 1, 0, 0 }, { -1, 0, 0 } };
+const glm::vec3 kFaceV[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+
+} // namespace
+
+void TessellatedSphere::init(float edgePixels) {
+  m_edgePixels = edgePixels;
+
+  // Points of the cube, a grid per face; the edges of the faces are repeated
+  // with the same coordinates, so that the patches across them agree
+  const int side = kPatchesPerSide + 1;
+  std::vector<glm::vec3> vertices;
+  std::vector<GLushort> indices;
+  for(int face = 0; face < 6; ++face) {
+    const GLushort first = static_cast<GLushort>(vertices.size());
+    for(int j = 0; j < side; ++j)
+      for(int i = 0; i < side; ++i) {
+        const float s = -1.0f + 2.0f*i/kPatchesPerSide, t = -1.0f + 2.0f*j/kPatchesPerSide;
+        vertices.push_back(kFaceNormals[face] + s*kFaceU[face] + t*kFaceV[face]);
+      }
+    // Corners at (u, v) = (0, 0), (1, 0), (1, 1), (0, 1)
+    for(int j = 0; j < kPatchesPerSide; ++j)
+      for(int i = 0; i < kPatchesPerSide; ++i) {
+        const GLushort v00 = static_cast<GLushort>(first + j*side + i);
+        indices.insert(indices.end(), { v00, static_cast<GLushort>(v00 + 1), static_cast<GLushort>(v00 + side + 1),
+                                        static_cast<GLushort>(v00 + side) });
+      }
+  }
+  m_bufferBytes = vertices.size()*sizeof(glm::vec3) + indices.size()*sizeof(GLushort);
+
+  glGenVertexArrays(1, &m_vao);
+  g_glState.bindVertexArray(m_vao);
+  glGenBuffers(1, &m_vertexBuffer);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+  glEnableVertexAttribArray(0);
+  glGenBuffers(1, &m_indexBuffer);
+  g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+  g_glState.bindVertexArray(0);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TessellatedSphere::render(GLuint program, float pixelScale, GLuint heightMap, float heightScale) {
+  if(program != m_program) {
+    m_program = program;
+    m_pixelScaleLoc = glGetUniformLocation(program, "pixelScale");
+    m_edgePixelsLoc = glGetUniformLocation(program, "edgePixels");
+    m_heightScaleLoc = glGetUniformLocation(program, "heightScale");
+  }
+  glUniform1f(m_pixelScaleLoc, pixelScale);
+  glUniform1f(m_edgePixelsLoc, m_edgePixels);
+  glUniform1f(m_heightScaleLoc, heightMap ? heightScale : 0.0f);
+  if(heightMap) {
+    g_glState.activeTexture(GL_TEXTURE0 + Terrain::kHeightMapUnit);
+    g_glState.bindTexture(GL_TEXTURE_2D, heightMap);
+    g_glState.activeTexture(GL_TEXTURE0);
+  }
+
+  g_glState.bindVertexArray(m_vao);
+  glPatchParameteri(GL_PATCH_VERTICES, 4);
+  glDrawElements(GL_PATCHES, 4*patchCount(), GL_UNSIGNED_SHORT, nullptr);
+}
+
+void TessellatedSphere::clear() {
+  g_glState.deleteBuffers(1, &m_vertexBuffer);
+  g_glState.deleteBuffers(1, &m_indexBuffer);
+  g_glState.deleteVertexArrays(1, &m_vao);
+  m_vertexBuffer = m_indexBuffer = m_vao = 0;
+  m_program = 0;
+}
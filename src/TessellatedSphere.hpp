@@ -0,0 +1,52 @@
+// ----------------------------------------------------------------------------
+// TessellatedSphere.hpp
+//
+// Description: Unit sphere refined on the GPU (GL 4.0). A coarse cube of
+//              quad patches is drawn with the tessellation stages
+//              (tessControlShader.glsl, tessEvaluationShader.glsl), which cut
+//              each patch edge by its length on screen and project the new
+//              vertices on the sphere, displaced by the body's height map if
+//              any: the triangles follow the pixels the body covers, without
+//              any mesh built on the CPU.
+// ----------------------------------------------------------------------------
+
+#ifndef TESSELLATED_SPHERE_HPP
+#define TESSELLATED_SPHERE_HPP
+
+#include <glad/gl.h>
+
+#include <cstddef>
+
+class TessellatedSphere {
+public:
+  static const int kPatchesPerSide = 8; // Base patches along each edge of a cube face
+
+  // Base patches; the generated edges aim at edgePixels on screen
+  void init(float edgePixels);
+
+  // Draws the sphere with a program of the tessellation stages; the
+  // ObjectBlock of the body must be bound. pixelScale is the size in pixels
+  // of a unit at a unit view distance. heightMap (0 for none) is bound on
+  // Terrain::kHeightMapUnit.
+  void render(GLuint program, float pixelScale, GLuint heightMap, float heightScale);
+
+  static inline GLsizei patchCount() { return 6*kPatchesPerSide*kPatchesPerSide; }
+  inline size_t bufferBytes() const { return m_bufferBytes; }
+
+  void clear();
+
+private:
+  float m_edgePixels = 8.0f;
+  GLuint m_vao = 0;
+  GLuint m_vertexBuffer = 0;
+  GLuint m_indexBuffer = 0;
+  size_t m_bufferBytes = 0;
+
+  // Uniform locations of the last program
+  GLuint m_program = 0;
+  GLint m_pixelScaleLoc = -1;
+  GLint m_edgePixelsLoc = -1;
+  GLint m_heightScaleLoc = -1;
+};
+
+#endif // TESSELLATED_SPHERE_HPP
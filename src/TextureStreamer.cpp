@@ -0,0 +1,476 @@
+// ----------------------------------------------------------------------------
+// TextureStreamer.cpp
+//
+// Description: Progressive mip streaming of the albedo textures
+// ----------------------------------------------------------------------------
+
+#include "TextureStreamer.hpp"
+#include "FileUtil.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+
+#include "stb_image.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+
+namespace {
+
+// Start of a cached mip chain; the levels follow, finest first, as tightly
+// packed RGB rows. The source is identified by its size and modification
+// time, and the host byte order is assumed, as for the other caches.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint64_t sourceSize;
+  uint64_t sourceTime;
+};
+
+const char kMagic[4] = { 'M', 'I', 'P', 'C' };
+const uint32_t kVersion = 1;
+const size_t kGpuBytesPerTexel = 4; // RGB8 is padded to RGBA8 by most drivers
+
+static_assert(sizeof(Header) == 32, "Header must have no padding");
+
+// 64-bit FNV-1a
+uint64_t fnv1a(const void *data, size_t size, uint64_t hash) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for(size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+int numMipLevels(int width, int height) {
+  return 1 + static_cast<int>(std::floor(std::log2(static_cast<double>(std::max(width, height)))));
+}
+
+// Texels of the levels of a chain from a level to the coarsest
+size_t chainTexels(int width, int height, int firstLevel) {
+  size_t texels = 0;
+  for(int l = firstLevel; l < numMipLevels(width, height); ++l)
+    texels += static_cast<size_t>(std::max(1, width >> l))*std::max(1, height >> l);
+  return texels;
+}
+
+// Box filter into the next level (sizes rounded down, as in OpenGL)
+void downsample(const std::vector<unsigned char> &src, int width, int height, std::vector<unsigned char> &dst) {
+  const int dstWidth = std::max(1, width/2), dstHeight = std::max(1, height/2);
+  dst.resize(3*static_cast<size_t>(dstWidth)*dstHeight);
+  for(int y = 0; y < dstHeight; ++y) {
+    const int y0 = std::min(2*y, height - 1), y1 = std::min(2*y + 1, height - 1);
+    for(int x = 0; x < dstWidth; ++x) {
+      const int x0 = std::min(2*x, width - 1), x1 = std::min(2*x + 1, width - 1);
+      for(int c = 0; c < 3; ++c) {
+        const unsigned sum = src[3*(static_cast<size_t>(y0)*width + x0) + c] + src[3*(static_cast<size_t>(y0)*width + x1) + c]
+          + src[3*(static_cast<size_t>(y1)*width + x0) + c] + src[3*(static_cast<size_t>(y1)*width + x1) + c];
+        dst[3*(static_cast<size_t>(y)*dstWidth + x) + c] = static_cast<unsigned char>((sum + 2)/4);
+      }
+    }
+  }
+}
+
+} // namespace
+
+void TextureStreamer::init(const std::string &cacheDirectory, int coarseWidth, size_t uploadBudget, size_t residentBudget) {
+  m_cacheDirectory = cacheDirectory;
+  m_coarseWidth = std::max(1, coarseWidth);
+  m_uploadBudget = uploadBudget;
+  m_residentBudget = residentBudget;
+  makeDirectory(cacheDirectory);
+  m_stop = false;
+  m_loader = std::thread(&TextureStreamer::loaderLoop, this);
+}
+
+int TextureStreamer::add(const std::string &path) {
+  std::unique_ptr<Entry> entry(new Entry);
+  entry->path = path;
+  char name[48];
+  std::snprintf(name, sizeof(name), "/texture_%016llx.mips",
+                static_cast<unsigned long long>(fnv1a(path.data(), path.size(), 0xcbf29ce484222325ull)));
+  entry->cachePath = m_cacheDirectory + name;
+  bool cached = openCache(*entry);
+  if(cached) {
+    ++m_cacheHits;
+  } else if(m_synchronous) {
+    if(!buildCache(*entry) || !openCache(*entry))
+      return -1;
+    cached = true;
+  } else {
+    int numComponents;
+    if(!stbi_info(path.c_str(), &entry->width, &entry->height, &numComponents)) {
+      std::cerr << "ERROR: Failed to load texture " << path << std::endl;
+      return -1;
+    }
+  }
+  entry->numLevels = numMipLevels(entry->width, entry->height);
+  entry->coarseLevel = 0;
+  while(entry->coarseLevel + 1 < entry->numLevels && levelSize(entry->width, entry->coarseLevel) > m_coarseWidth)
+    ++entry->coarseLevel;
+  entry->requestedLevel = entry->numLevels - 1;
+
+  const int index = static_cast<int>(m_entries.size());
+  m_entries.push_back(std::move(entry));
+  Entry &added = *m_entries.back();
+  if(cached) {
+    // The coarse levels now
+    added.texture = createStorage(added, added.coarseLevel);
+    m_startupBytes += uploadLevels(added, added.texture, added.coarseLevel, added.coarseLevel);
+    added.residentLevel = added.coarseLevel;
+  } else {
+    added.texture = createStorage(added, added.numLevels - 1);
+    const unsigned char gray[3] = { 128, 128, 128 };
+    g_glState.bindTexture(GL_TEXTURE_2D, added.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, gray);
+    added.residentLevel = added.numLevels; // None yet
+  }
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  return index;
+}
+
+int TextureStreamer::levelFor(int index, float pixelRadius) const {
+  const Entry &entry = *m_entries[index];
+  const float texelsPerPixel = entry.width/std::max(4.0f*pixelRadius, 1.0f);
+  return std::min(entry.numLevels - 1, std::max(0, static_cast<int>(std::floor(std::log2(std::max(texelsPerPixel, 1.0f))))));
+}
+
+void TextureStreamer::request(int index, int level) {
+  Entry &entry = *m_entries[index];
+  entry.requestedLevel = std::min(entry.requestedLevel, level);
+  entry.lastVisible = m_frame;
+}
+
+bool TextureStreamer::openCache(Entry &entry) const {
+  struct stat source;
+  if(stat(entry.path.c_str(), &source) != 0 || !entry.cache.open(entry.cachePath))
+    return false;
+  Header header;
+  if(entry.cache.size() >= sizeof(header))
+    std::memcpy(&header, entry.cache.data(), sizeof(header));
+  if(entry.cache.size() < sizeof(header) || std::memcmp(header.magic, kMagic, sizeof(kMagic)) || header.version != kVersion
+     || header.sourceSize != static_cast<uint64_t>(source.st_size) || header.sourceTime != static_cast<uint64_t>(source.st_mtime)
+     || header.width == 0 || header.height == 0
+     || entry.cache.size() < sizeof(header) + 3*chainTexels(header.width, header.height, 0)) {
+    entry.cache.close(); // Stale: the source changed, or another version wrote it
+    return false;
+  }
+  entry.width = header.width;
+  entry.height = header.height;
+  return true;
+}
+
+bool TextureStreamer::buildCache(Entry &entry) const {
+  struct stat source;
+  int width, height, numComponents;
+  unsigned char *data = stbi_load(entry.path.c_str(), &width, &height, &numComponents, 3);
+  if(!data || stat(entry.path.c_str(), &source) != 0) {
+    std::cerr << "ERROR: Failed to load texture " << entry.path << std::endl;
+    stbi_image_free(data);
+    return false;
+  }
+  std::vector<unsigned char> level(data, data + 3*static_cast<size_t>(width)*height), next;
+  stbi_image_free(data);
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.width = width;
+  header.height = height;
+  header.sourceSize = static_cast<uint64_t>(source.st_size);
+  header.sourceTime = static_cast<uint64_t>(source.st_mtime);
+  std::ofstream file(entry.cachePath.c_str(), std::ios::binary);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for(int l = 0; l < numMipLevels(width, height); ++l) {
+    if(l > 0) {
+      downsample(level, levelSize(width, l - 1), levelSize(height, l - 1), next);
+      level.swap(next);
+    }
+    file.write(reinterpret_cast<const char *>(level.data()), level.size());
+  }
+  if(!file) {
+    std::cerr << "ERROR: Failed to write the texture cache " << entry.cachePath << std::endl;
+    return false;
+  }
+  file.close();
+  return entry.cache.open(entry.cachePath);
+}
+
+void TextureStreamer::readLevel(Entry &entry, LoadedLevel &loaded) const {
+  const size_t offset = sizeof(Header) + 3*(chainTexels(entry.width, entry.height, 0) - chainTexels(entry.width, entry.height, loaded.level));
+  const size_t size = 3*static_cast<size_t>(levelSize(entry.width, loaded.level))*levelSize(entry.height, loaded.level);
+  const unsigned char *texels = reinterpret_cast<const unsigned char *>(entry.cache.data()) + offset;
+  loaded.texels.assign(texels, texels + size); // Faults the level in from the disk
+}
+
+size_t TextureStreamer::storageBytes(const Entry &entry, int firstLevel) const {
+  return kGpuBytesPerTexel*chainTexels(entry.width, entry.height, firstLevel);
+}
+
+GLuint TextureStreamer::createStorage(const Entry &entry, int firstLevel) {
+  const int numLevels = entry.numLevels - firstLevel;
+  const int width = levelSize(entry.width, firstLevel), height = levelSize(entry.height, firstLevel);
+  GLuint texture;
+  glGenTextures(1, &texture);
+  g_glState.bindTexture(GL_TEXTURE_2D, texture);
+  if(g_glCaps.textureStorage) {
+    glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_RGB8, width, height);
+  } else {
+    for(int l = 0; l < numLevels; ++l)
+      glTexImage2D(GL_TEXTURE_2D, l, GL_RGB8, levelSize(width, l), levelSize(height, l), 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+  m_residentBytes += storageBytes(entry, firstLevel);
+  m_peakResidentBytes = std::max(m_peakResidentBytes, m_residentBytes);
+  return texture;
+}
+
+void TextureStreamer::deleteStorage(const Entry &entry, GLuint &texture, int firstLevel) {
+  if(!texture)
+    return;
+  g_glState.deleteTextures(1, &texture);
+  texture = 0;
+  m_residentBytes -= storageBytes(entry, firstLevel);
+}
+
+size_t TextureStreamer::uploadLevels(const Entry &entry, GLuint texture, int firstLevel, int fromLevel) {
+  const unsigned char *texels = reinterpret_cast<const unsigned char *>(entry.cache.data()) + sizeof(Header)
+    + 3*(chainTexels(entry.width, entry.height, 0) - chainTexels(entry.width, entry.height, fromLevel));
+  size_t bytes = 0;
+  g_glState.bindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows of odd widths
+  for(int l = fromLevel; l < entry.numLevels; ++l) {
+    const int width = levelSize(entry.width, l), height = levelSize(entry.height, l);
+    glTexSubImage2D(GL_TEXTURE_2D, l - firstLevel, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, texels);
+    texels += 3*static_cast<size_t>(width)*height;
+    bytes += 3*static_cast<size_t>(width)*height;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return bytes;
+}
+
+size_t TextureStreamer::uploadRows(LoadedLevel &loaded, size_t budget) {
+  const Entry &entry = *m_entries[loaded.index];
+  const int width = levelSize(entry.width, loaded.level), height = levelSize(entry.height, loaded.level);
+  const size_t rowBytes = 3*static_cast<size_t>(width);
+  const int rows = std::min(height - loaded.uploadedRows, std::max(1, static_cast<int>(std::min<size_t>(budget/rowBytes, height))));
+  g_glState.bindTexture(GL_TEXTURE_2D, entry.pending);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, loaded.uploadedRows, width, rows, GL_RGB, GL_UNSIGNED_BYTE,
+                  loaded.texels.data() + loaded.uploadedRows*rowBytes);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  loaded.uploadedRows += rows;
+  return rows*rowBytes;
+}
+
+// The coarser levels are uploaded again from the cache rather than copied
+// from the previous texture, which would need GL 4.3; they are a third of the
+// size of the new level at most
+void TextureStreamer::finishLevel(const LoadedLevel &loaded) {
+  Entry &entry = *m_entries[loaded.index];
+  m_bytesStreamed += uploadLevels(entry, entry.pending, loaded.level, loaded.level + 1);
+  deleteStorage(entry, entry.texture, std::min(entry.residentLevel, entry.numLevels - 1));
+  entry.texture = entry.pending;
+  entry.residentLevel = loaded.level;
+  entry.pending = 0;
+  entry.streaming = false;
+  ++m_levelsStreamed;
+  ++m_frameLevels;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, const Entry *requester) {
+  if(!m_residentBudget || m_residentBytes + bytes <= m_residentBudget)
+    return true;
+  // Nothing is evicted for a request that would not fit anyway
+  std::vector<Entry *> victims;
+  size_t evictable = 0;
+  for(auto &entry : m_entries) {
+    if(entry.get() == requester || entry->streaming || entry->residentLevel >= entry->targetLevel)
+      continue;
+    victims.push_back(entry.get());
+    evictable += storageBytes(*entry, entry->residentLevel) - storageBytes(*entry, entry->targetLevel);
+  }
+  if(m_residentBytes - evictable + bytes > m_residentBudget)
+    return false;
+  std::stable_sort(victims.begin(), victims.end(), [](const Entry *a, const Entry *b) { return a->lastVisible < b->lastVisible; });
+  for(Entry *victim : victims) {
+    while(victim->residentLevel < victim->targetLevel && m_residentBytes + bytes > m_residentBudget)
+      evict(*victim);
+  }
+  return true;
+}
+
+size_t TextureStreamer::rebuildTexture(Entry &entry, int residentLevel) {
+  deleteStorage(entry, entry.texture, std::min(entry.residentLevel, entry.numLevels - 1));
+  entry.texture = createStorage(entry, residentLevel);
+  entry.residentLevel = residentLevel;
+  return uploadLevels(entry, entry.texture, residentLevel, residentLevel);
+}
+
+void TextureStreamer::evict(Entry &entry) {
+  rebuildTexture(entry, entry.residentLevel + 1);
+  ++m_evictions;
+  ++m_frameEvictions;
+}
+
+void TextureStreamer::update() {
+  m_frameLevels = m_frameEvictions = m_frameDeferred = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(LoadedLevel &loaded : m_loaded)
+      m_uploading.push_back(std::move(loaded));
+    m_loaded.clear();
+  }
+
+  // Levels in the order they were read, each made visible once complete
+  size_t budget = m_synchronous ? SIZE_MAX : m_uploadBudget;
+  while(!m_uploading.empty() && budget > 0) {
+    LoadedLevel &loaded = m_uploading.front();
+    Entry &entry = *m_entries[loaded.index];
+    if(loaded.texels.empty()) {
+      deleteStorage(entry, entry.pending, loaded.level);
+      entry.streaming = false;
+      entry.broken = true; // Reported by the loader
+    } else {
+      const size_t bytes = uploadRows(loaded, budget);
+      budget -= std::min(bytes, budget);
+      m_bytesStreamed += bytes;
+      if(loaded.uploadedRows < levelSize(entry.height, loaded.level))
+        break;
+      finishLevel(loaded);
+    }
+    m_uploading.pop_front();
+  }
+
+  // Levels beyond what a texture needs this frame may be evicted (never its
+  // coarse ones)
+  for(auto &entry : m_entries) {
+    entry->targetLevel = std::min(entry->requestedLevel, entry->coarseLevel);
+    entry->requestedLevel = entry->numLevels - 1;
+  }
+
+  // The next finer level of each texture short of its target, with storage
+  // for it and the resident ones made in the budget first
+  std::vector<std::pair<int, int>> jobs;
+  for(size_t i = 0; i < m_entries.size(); ++i) {
+    Entry &entry = *m_entries[i];
+    if(entry.streaming || entry.broken || entry.residentLevel <= entry.targetLevel)
+      continue;
+    if(!m_synchronous) {
+      const int level = entry.residentLevel - 1;
+      if(!makeRoom(storageBytes(entry, level), &entry)) {
+        ++m_frameDeferred;
+        continue;
+      }
+      entry.pending = createStorage(entry, level);
+      entry.streaming = true;
+      jobs.push_back(std::make_pair(static_cast<int>(i), level));
+      continue;
+    }
+    if(!entry.cache.data() && !buildCache(entry)) {
+      entry.broken = true;
+      continue;
+    }
+    // The finest level that fits, at once, in place of the resident ones
+    const size_t residentBytes = storageBytes(entry, std::min(entry.residentLevel, entry.numLevels - 1));
+    int level = entry.targetLevel;
+    while(level < entry.residentLevel && !makeRoom(storageBytes(entry, level) - residentBytes, &entry))
+      ++level;
+    m_frameDeferred += level - entry.targetLevel;
+    if(level == entry.residentLevel)
+      continue;
+    m_levelsStreamed += entry.residentLevel - level;
+    m_frameLevels += entry.residentLevel - level;
+    m_bytesStreamed += rebuildTexture(entry, level);
+  }
+  makeRoom(0, nullptr); // Whatever is no longer needed, when over the budget
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  m_deferred += m_frameDeferred;
+  ++m_frame;
+  if(!jobs.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_jobs.insert(m_jobs.end(), jobs.begin(), jobs.end());
+    }
+    m_wake.notify_one();
+  }
+}
+
+// Textures are only added before the first update(), so the entries are
+// stable here; the cache of an entry is only touched by this thread once its
+// first job is queued
+void TextureStreamer::loaderLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for(;;) {
+    m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+    if(m_stop)
+      return;
+    LoadedLevel loaded = { m_jobs.front().first, m_jobs.front().second, 0, std::vector<unsigned char>() };
+    m_jobs.pop_front();
+    lock.unlock();
+    Entry &entry = *m_entries[loaded.index];
+    if(entry.cache.data() || buildCache(entry))
+      readLevel(entry, loaded);
+    lock.lock();
+    m_loaded.push_back(std::move(loaded));
+  }
+}
+
+size_t TextureStreamer::totalBytes() const {
+  size_t bytes = 0;
+  for(const auto &entry : m_entries)
+    bytes += storageBytes(*entry, 0);
+  return bytes;
+}
+
+void TextureStreamer::printFrameStats() const {
+  char line[256];
+  std::snprintf(line, sizeof(line), "Textures, frame %llu: %.1f MB resident (budget %.1f MB), %zu levels streamed, %zu evicted, %zu deferred",
+                static_cast<unsigned long long>(m_frame - 1), m_residentBytes/1048576.0, m_residentBudget/1048576.0,
+                m_frameLevels, m_frameEvictions, m_frameDeferred);
+  std::cout << line << std::endl;
+}
+
+void TextureStreamer::printStats() const {
+  char line[320];
+  std::snprintf(line, sizeof(line), "Texture streaming: %zu textures, %zu levels streamed (%.1f MB), %zu evicted, %zu deferred, "
+                "%.1f MB resident (peak %.1f, budget %.1f) of %.1f MB",
+                m_entries.size(), m_levelsStreamed, m_bytesStreamed/1048576.0, m_evictions, m_deferred, m_residentBytes/1048576.0,
+                m_peakResidentBytes/1048576.0, m_residentBudget/1048576.0, totalBytes()/1048576.0);
+  std::cout << line << std::endl;
+}
+
+void TextureStreamer::clear() {
+  if(m_loader.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_one();
+    m_loader.join();
+  }
+  m_jobs.clear();
+  m_loaded.clear();
+  m_uploading.clear();
+  for(auto &entry : m_entries) {
+    g_glState.deleteTextures(1, &entry->texture);
+    g_glState.deleteTextures(1, &entry->pending);
+    entry->cache.close();
+  }
+  m_entries.clear();
+  m_frame = 1;
+  m_residentBytes = m_peakResidentBytes = 0;
+  m_cacheHits = m_startupBytes = m_levelsStreamed = m_bytesStreamed = 0;
+  m_evictions = m_deferred = m_frameLevels = m_frameEvictions = m_frameDeferred = 0;
+}
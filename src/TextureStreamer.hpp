@@ -0,0 +1,164 @@
+// ----------------------------------------------------------------------------
+// TextureStreamer.hpp
+//
+// Description: Progressive mip streaming of the albedo textures, within a GPU
+//              memory budget. Each image is decoded once into a mip chain
+//              cached on disk; a texture holds only its resident levels, its
+//              coarse ones from startup, and finer levels are read by a loader
+//              thread and uploaded within a per-frame budget as the projected
+//              size of the bodies demands them. When the resident levels would
+//              exceed the memory budget, the finest levels of the least
+//              recently visible textures are evicted first.
+// ----------------------------------------------------------------------------
+
+#ifndef TEXTURE_STREAMER_HPP
+#define TEXTURE_STREAMER_HPP
+
+#include "MappedFile.hpp"
+
+#include <glad/gl.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TextureStreamer {
+public:
+  // Levels at most coarseWidth wide are uploaded by add() and never evicted;
+  // at most uploadBudget bytes of finer levels are uploaded per frame, and
+  // the textures are kept within residentBudget bytes of GPU memory (0 for
+  // no limit) as long as their coarse levels fit
+  void init(const std::string &cacheDirectory, int coarseWidth, size_t uploadBudget, size_t residentBudget);
+
+  // Texture of an image file, with its coarse levels, or -1. Without a
+  // cached mip chain, the image is decoded by the loader thread (on the
+  // calling thread when synchronous) and a gray texel stands in until then.
+  int add(const std::string &path);
+
+  // Current texture object: it is replaced whenever levels are streamed in
+  // or evicted, so it is looked up at bind time
+  inline GLuint texture(int index) const { return m_entries[index]->texture; }
+  inline size_t count() const { return m_entries.size(); }
+
+  // Finest level needed to draw a body of this radius on screen: half of the
+  // texture spans its diameter
+  int levelFor(int index, float pixelRadius) const;
+
+  // Level a visible texture should reach; the finest request of a frame
+  // wins. Textures not requested in a frame are not visible in it.
+  void request(int index, int level);
+
+  // Uploads the levels read since the last frame within the budget (all of
+  // them, read on the calling thread, when synchronous), then hands the next
+  // finer level of each texture below its request to the loader, evicting
+  // levels to make room for it
+  void update();
+
+  // Levels are read and uploaded when requested, so that offline exports do
+  // not depend on the timing of the loader
+  inline void setSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+  inline size_t cacheHits() const { return m_cacheHits; }
+  inline size_t startupBytes() const { return m_startupBytes; }
+  inline size_t levelsStreamed() const { return m_levelsStreamed; }
+  inline size_t bytesStreamed() const { return m_bytesStreamed; }
+  inline size_t evictions() const { return m_evictions; }
+  inline size_t residentBytes() const { return m_residentBytes; } // GPU storage of every texture
+  inline size_t residentBudget() const { return m_residentBudget; }
+  size_t totalBytes() const;                                       // Were every level resident
+
+  // Residency, and the levels streamed, evicted and deferred by the last update()
+  void printFrameStats() const;
+
+  // Over the run
+  void printStats() const;
+
+  void clear();
+
+private:
+  struct Entry {
+    std::string path;
+    std::string cachePath;
+    MappedFile cache;         // Mip chain; opened by the loader when it builds it
+    GLuint texture = 0;       // Resident levels, from residentLevel (its level 0)
+    GLuint pending = 0;       // Resident levels and the one being streamed
+    int width = 0;
+    int height = 0;
+    int numLevels = 0;
+    int coarseLevel = 0;      // Finest level at most coarseWidth wide, always kept
+    int residentLevel = 0;    // Finest level uploaded, numLevels for none
+    int requestedLevel = 0;   // This frame
+    int targetLevel = 0;      // This frame, never coarser than coarseLevel
+    uint64_t lastVisible = 0; // Frame of its last request
+    bool streaming = false;   // A level is with the loader or being uploaded
+    bool broken = false;      // The image could not be read
+  };
+
+  // A level read by the loader, uploaded a band of rows at a time
+  struct LoadedLevel {
+    int index;
+    int level;
+    int uploadedRows;
+    std::vector<unsigned char> texels; // RGB, tightly packed
+  };
+
+  static inline int levelSize(int size, int level) { return std::max(1, size >> level); }
+
+  bool openCache(Entry &entry) const;
+  bool buildCache(Entry &entry) const;
+  void readLevel(Entry &entry, LoadedLevel &loaded) const;
+
+  // Storage of the levels of a texture from firstLevel, counted as resident
+  size_t storageBytes(const Entry &entry, int firstLevel) const;
+  GLuint createStorage(const Entry &entry, int firstLevel);
+  void deleteStorage(const Entry &entry, GLuint &texture, int firstLevel);
+  size_t uploadLevels(const Entry &entry, GLuint texture, int firstLevel, int fromLevel); // From the cache, in bytes
+  size_t rebuildTexture(Entry &entry, int residentLevel); // New storage from residentLevel, filled from the cache
+
+  size_t uploadRows(LoadedLevel &loaded, size_t budget); // Bytes uploaded, at least a row
+  void finishLevel(const LoadedLevel &loaded);
+
+  // Evicts the finest level of the least recently visible textures holding
+  // more than they need until bytes more fit in the budget, if they can
+  bool makeRoom(size_t bytes, const Entry *requester);
+  void evict(Entry &entry);
+
+  void loaderLoop();
+
+  std::string m_cacheDirectory;
+  int m_coarseWidth = 64;
+  size_t m_uploadBudget = 0;
+  size_t m_residentBudget = 0;
+  bool m_synchronous = false;
+  std::vector<std::unique_ptr<Entry>> m_entries;
+  std::deque<LoadedLevel> m_uploading;
+  uint64_t m_frame = 1;
+
+  size_t m_residentBytes = 0;
+  size_t m_peakResidentBytes = 0;
+  size_t m_cacheHits = 0;
+  size_t m_startupBytes = 0;
+  size_t m_levelsStreamed = 0;
+  size_t m_bytesStreamed = 0;
+  size_t m_evictions = 0;
+  size_t m_deferred = 0;      // Levels not streamed for lack of room, summed over frames
+  size_t m_frameLevels = 0;   // By the last update()
+  size_t m_frameEvictions = 0;
+  size_t m_frameDeferred = 0;
+
+  // Loader thread: (texture, level) jobs in, levels out
+  std::thread m_loader;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::deque<std::pair<int, int>> m_jobs;
+  std::deque<LoadedLevel> m_loaded;
+  bool m_stop = false;
+};
+
+#endif // TEXTURE_STREAMER_HPP
@@ -0,0 +1,56 @@
+// ----------------------------------------------------------------------------
+// UniformBlocks.hpp
+//
+// Description: CPU mirrors of the std140 uniform blocks shared with the
+//              shaders, and their binding points
+// ----------------------------------------------------------------------------
+
+#ifndef UNIFORM_BLOCKS_HPP
+#define UNIFORM_BLOCKS_HPP
+
+#include <glm/glm.hpp>
+
+enum UniformBinding {
+  FRAME_BLOCK_BINDING = 0,
+  OBJECT_BLOCK_BINDING = 1,
+  LIGHTING_BLOCK_BINDING = 2,
+  SHADOW_BLOCK_BINDING = 3
+};
+
+// Capacity of the occluder list of ShadowBlock, injected as MAX_OCCLUDERS;
+// the bits of the per-body occluder masks
+const int kMaxOccluders = 8;
+
+// layout(std140) uniform FrameBlock
+struct FrameBlock {
+  glm::mat4 viewMat;
+  glm::mat4 projMat;
+  glm::mat4 viewProjMat;   // projMat*viewMat, one product per vertex less
+  glm::vec4 camPosition;   // xyz
+  glm::vec4 lightPosition; // xyz
+  glm::vec4 lightColor;    // rgb
+};
+
+// layout(std140) uniform ObjectBlock
+struct ObjectBlock {
+  glm::mat4 modelMatrix;
+  glm::mat4 normalMatrix; // Inverse transpose of modelMatrix, computed once per object on the CPU
+  glm::vec4 objectColor;  // rgb
+  glm::uint occluderMask; // Bits of the ShadowBlock occluders that may shadow the body
+  glm::uint padding[3];
+};
+
+// layout(std140) uniform LightingBlock, the lookup of the light clusters
+struct LightingBlock {
+  glm::ivec4 clusterDims;  // Tiles in x and y, depth slices, number of lights
+  glm::vec4 clusterScale;  // Tiles per pixel in x and y, slices per unit of log(depth), slice bias
+};
+
+// layout(std140) uniform ShadowBlock, the occluders of the sun this frame
+struct ShadowBlock {
+  glm::vec4 lightSphere;                // Center and radius of the sun
+  glm::vec4 occluders[kMaxOccluders];   // Center and radius
+  glm::ivec4 occluderCount;             // x
+};
+
+#endif // UNIFORM_BLOCKS_HPP
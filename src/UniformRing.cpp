@@ -0,0 +1,93 @@
+// ----------------------------------------------------------------------------
+// UniformRing.cpp
+//
+// Description: Per-frame uniform data suballocated from one uniform buffer.
+//              With ARB_buffer_storage the buffer is triple-buffered and
+//              persistently mapped, sections being recycled behind fences;
+//              otherwise it is orphaned and filled with glBufferSubData.
+// ----------------------------------------------------------------------------
+
+#include "UniformRing.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+
+#include <cstring>
+#include <iostream>
+
+bool UniformRing::init(size_t bytesPerFrame, bool allowPersistentMapping, unsigned int numSections) {
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  m_alignment = static_cast<size_t>(alignment);
+  m_sectionSize = (bytesPerFrame + m_alignment - 1)/m_alignment*m_alignment;
+
+  glGenBuffers(1, &m_buffer);
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  if(allowPersistentMapping && g_glCaps.bufferStorage) {
+    m_numSections = numSections;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, m_sectionSize*m_numSections, nullptr, flags);
+    m_mapped = static_cast<unsigned char *>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, m_sectionSize*m_numSections, flags));
+    m_fences.assign(m_numSections, nullptr);
+  }
+  if(!m_mapped) {
+    m_numSections = 1;
+    glBufferData(GL_UNIFORM_BUFFER, m_sectionSize, nullptr, GL_STREAM_DRAW);
+    m_staging.resize(m_sectionSize);
+  }
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+  return true;
+}
+
+void UniformRing::beginFrame() {
+  m_section = (m_section + 1) % m_numSections;
+  m_head = 0;
+  if(m_mapped && m_fences[m_section]) {
+    // Normally already signaled: the GPU is at most numSections-1 frames behind
+    glClientWaitSync(m_fences[m_section], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000)*1000*1000);
+    glDeleteSync(m_fences[m_section]);
+    m_fences[m_section] = nullptr;
+  }
+}
+
+GLintptr UniformRing::push(const void *data, size_t size) {
+  if(m_head + size > m_sectionSize) {
+    if(!m_overflowReported)
+      std::cerr << "ERROR: Uniform ring section of " << m_sectionSize << " bytes is full" << std::endl;
+    m_overflowReported = true;
+    return -1;
+  }
+  const size_t offset = m_head;
+  std::memcpy((m_mapped ? m_mapped + m_section*m_sectionSize : m_staging.data()) + offset, data, size);
+  m_head = (m_head + size + m_alignment - 1)/m_alignment*m_alignment;
+  return static_cast<GLintptr>(m_section*m_sectionSize + offset);
+}
+
+void UniformRing::upload() {
+  if(m_mapped || m_head == 0)
+    return; // Coherent mapping: writes are already visible to the next draws
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  glBufferData(GL_UNIFORM_BUFFER, m_sectionSize, nullptr, GL_STREAM_DRAW); // Orphan: the driver hands out fresh storage
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, m_head, m_staging.data());
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformRing::endFrame() {
+  if(m_mapped)
+    m_fences[m_section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UniformRing::clear() {
+  for(GLsync &fence : m_fences) {
+    if(fence)
+      glDeleteSync(fence);
+    fence = nullptr;
+  }
+  if(m_mapped) {
+    g_glState.bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    g_glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_mapped = nullptr;
+  }
+  g_glState.deleteBuffers(1, &m_buffer);
+  m_buffer = 0;
+}
@@ -0,0 +1,63 @@
+// ----------------------------------------------------------------------------
+// UniformRing.hpp
+//
+// Description: Per-frame uniform data suballocated from one uniform buffer.
+//              With ARB_buffer_storage the buffer is triple-buffered and
+//              persistently mapped, sections being recycled behind fences;
+//              otherwise it is orphaned and filled with glBufferSubData.
+// ----------------------------------------------------------------------------
+
+#ifndef UNIFORM_RING_HPP
+#define UNIFORM_RING_HPP
+
+#include "GLState.hpp"
+
+#include <glad/gl.h>
+
+#include <cstddef>
+#include <vector>
+
+class UniformRing {
+public:
+  // bytesPerFrame bounds the data pushed between beginFrame() and upload()
+  bool init(size_t bytesPerFrame, bool allowPersistentMapping, unsigned int numSections = 3);
+
+  // Waits until the GPU is done with the section about to be rewritten
+  void beginFrame();
+
+  // Copies a block into the current section and returns its offset in the
+  // buffer, or -1 when the section is full
+  GLintptr push(const void *data, size_t size);
+
+  // Makes the pushed blocks visible to the GPU; call before the draws
+  void upload();
+
+  inline void bindRange(GLuint binding, GLintptr offset, size_t size) const {
+    g_glState.bindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, offset, size);
+  }
+
+  // Fences the section once the frame's draws are issued
+  void endFrame();
+
+  void clear();
+
+  inline bool persistent() const { return m_mapped != nullptr; }
+
+private:
+  GLuint m_buffer = 0;
+  size_t m_sectionSize = 0;
+  size_t m_alignment = 256;
+  unsigned int m_numSections = 1;
+  unsigned int m_section = 0;
+  size_t m_head = 0; // Write position inside the current section
+
+  // Persistent path
+  unsigned char *m_mapped = nullptr;
+  std::vector<GLsync> m_fences;
+
+  // Fallback path: blocks are staged and uploaded in one glBufferSubData
+  std::vector<unsigned char> m_staging;
+  bool m_overflowReported = false;
+};
+
+#endif // UNIFORM_RING_HPP
@@ -0,0 +1,682 @@
+// ----------------------------------------------------------------------------
+// VirtualTexture.cpp
+//
+// Description: Virtual texturing of images too large for the GPU: offline
+//              tiling, page cache, page table, feedback pass and page loader
+// ----------------------------------------------------------------------------
+
+#include "VirtualTexture.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+#include "ShaderLibrary.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Start of a tiled file; the level table follows, then the pages from
+// dataOffset: level by level, row by row, kSlotSize x kSlotSize RGB texels
+// each, borders included. The host byte order is assumed, as for the other
+// caches.
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t width;     // Of level 0, in texels
+  uint32_t height;
+  uint32_t pageSize;  // kPageSize and kPageBorder of the tiler
+  uint32_t border;
+  uint32_t numLevels;
+  uint32_t dataOffset;
+};
+
+struct FileLevel {
+  uint32_t pagesX;
+  uint32_t pagesY;
+  uint32_t firstPage;
+  uint32_t reserved;
+};
+
+const char kMagic[4] = { 'V', 'T', 'E', 'X' };
+const uint32_t kVersion = 1;
+const size_t kPageBytes = 3*VirtualTexture::kSlotSize*VirtualTexture::kSlotSize;
+const uint32_t kNoRequest = 0xffffffffu; // Clear value of the feedback target
+
+static_assert(sizeof(Header) == 32, "Header must have no padding");
+static_assert(sizeof(FileLevel) == 16, "FileLevel must have no padding");
+
+// Level l covers 2^l x 2^l texels of level 0; the last row and column keep
+// the remainder of odd sizes
+inline int levelSize(int size, int level) {
+  return (size + (1 << level) - 1) >> level;
+}
+
+// Source image, read a row at a time from the top. Binary PPM (P6, 8 bits)
+// is streamed from the file, so that its size is only bounded by the disk;
+// the other formats are decoded whole by stb_image, which refuses images of
+// more than 2 GB.
+class SourceImage {
+public:
+  ~SourceImage() { stbi_image_free(m_decoded); }
+
+  bool open(const std::string &path) {
+    m_file.open(path.c_str(), std::ios::binary);
+    int maxValue = 0;
+    if(m_file.get() == 'P' && m_file.get() == '6') {
+      if(!readNumber(m_width) || !readNumber(m_height) || !readNumber(maxValue) || maxValue != 255) {
+        std::cerr << "ERROR: " << path << ": only 8-bit binary PPM images are supported" << std::endl;
+        return false;
+      }
+      return m_width > 0 && m_height > 0;
+    }
+    m_file.close();
+    int numComponents;
+    m_decoded = stbi_load(path.c_str(), &m_width, &m_height, &numComponents, 3);
+    if(!m_decoded) {
+      std::cerr << "ERROR: Failed to load texture " << path << " (" << stbi_failure_reason()
+                << "), convert images larger than 2 GB to binary PPM" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Next row, 3*width bytes
+  bool read(unsigned char *row) {
+    const size_t bytes = 3*static_cast<size_t>(m_width);
+    if(m_decoded) {
+      std::memcpy(row, m_decoded + m_row++*bytes, bytes);
+      return true;
+    }
+    return static_cast<bool>(m_file.read(reinterpret_cast<char *>(row), bytes));
+  }
+
+  inline int width() const { return m_width; }
+  inline int height() const { return m_height; }
+
+private:
+  // Next decimal number of the header, after whitespace and comments, and
+  // the single whitespace that ends it
+  bool readNumber(int &value) {
+    int c = m_file.get();
+    while(c == '#' || std::isspace(c)) {
+      if(c == '#')
+        while(c != '\n' && c != EOF)
+          c = m_file.get();
+      c = m_file.get();
+    }
+    long number = 0;
+    if(!std::isdigit(c))
+      return false;
+    for(; std::isdigit(c) && number <= INT_MAX; c = m_file.get())
+      number = 10*number + (c - '0');
+    value = static_cast<int>(number);
+    return number <= INT_MAX && std::isspace(c);
+  }
+
+  std::ifstream m_file;
+  unsigned char *m_decoded = nullptr;
+  size_t m_row = 0;
+  int m_width = 0;
+  int m_height = 0;
+};
+
+// One level of the pyramid, fed its rows from the top: a row of pages is
+// written once the rows of its bottom border have arrived, and every pair of
+// rows goes box filtered, clamped at odd edges, to the next level. Only the
+// rows of a row of pages and its borders are kept, so the memory grows with
+// the width of the image but not with its height.
+class LevelWriter {
+public:
+  static const int kWindowRows = VirtualTexture::kPageSize + 2*VirtualTexture::kPageBorder;
+
+  LevelWriter(int width, int height, const FileLevel &level, size_t offset, std::ofstream &out, LevelWriter *next)
+    : m_width(width), m_height(height), m_level(level), m_offset(offset), m_out(out), m_next(next),
+      m_rows(kWindowRows*3*static_cast<size_t>(width)), m_pages(level.pagesX*kPageBytes) {
+    if(next)
+      m_filtered.resize(3*static_cast<size_t>((width + 1)/2));
+  }
+
+  void push(const unsigned char *source) {
+    const int y = m_received++;
+    std::memcpy(row(y), source, 3*static_cast<size_t>(m_width));
+    while(m_nextPageRow < m_level.pagesY
+          && y >= std::min(static_cast<int>(m_nextPageRow + 1)*VirtualTexture::kPageSize + VirtualTexture::kPageBorder, m_height) - 1)
+      writePageRow(m_nextPageRow++);
+
+    if(m_next && (y % 2 == 1 || y == m_height - 1)) {
+      const unsigned char *row0 = row(y - y % 2), *row1 = row(y);
+      for(int x = 0; x < (m_width + 1)/2; ++x) {
+        const int x0 = 3*(2*x), x1 = 3*std::min(2*x + 1, m_width - 1);
+        for(int c = 0; c < 3; ++c) {
+          const unsigned sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+          m_filtered[3*x + c] = static_cast<unsigned char>((sum + 2)/4);
+        }
+      }
+      m_next->push(m_filtered.data());
+    }
+  }
+
+private:
+  inline unsigned char *row(int y) {
+    return &m_rows[static_cast<size_t>(y % kWindowRows)*3*m_width];
+  }
+
+  // Each page with its border: wrapped around in u (longitude), clamped in v
+  void writePageRow(uint32_t py) {
+    const int pageSize = VirtualTexture::kPageSize, border = VirtualTexture::kPageBorder, slotSize = VirtualTexture::kSlotSize;
+    for(uint32_t px = 0; px < m_level.pagesX; ++px) {
+      unsigned char *page = &m_pages[px*kPageBytes];
+      for(int ty = 0; ty < slotSize; ++ty) {
+        const unsigned char *source = row(std::min(std::max(static_cast<int>(py)*pageSize + ty - border, 0), m_height - 1));
+        for(int tx = 0; tx < slotSize; ++tx) {
+          const int sx = ((static_cast<int>(px)*pageSize + tx - border) % m_width + m_width) % m_width;
+          std::memcpy(&page[3*(ty*slotSize + tx)], &source[3*sx], 3);
+        }
+      }
+    }
+    m_out.seekp(m_offset + static_cast<size_t>(py)*m_level.pagesX*kPageBytes);
+    m_out.write(reinterpret_cast<const char *>(m_pages.data()), m_pages.size());
+  }
+
+  int m_width;
+  int m_height;
+  FileLevel m_level;
+  size_t m_offset;   // Of its first page in the file
+  std::ofstream &m_out;
+  LevelWriter *m_next; // Coarser level, or nullptr for the last one
+  std::vector<unsigned char> m_rows;     // kWindowRows rows, row y at y % kWindowRows
+  std::vector<unsigned char> m_pages;    // A row of pages
+  std::vector<unsigned char> m_filtered; // A row of the next level
+  int m_received = 0;
+  uint32_t m_nextPageRow = 0;
+};
+
+} // namespace
+
+// Bound to references by std::min and std::vector
+const int VirtualTexture::kPageSize;
+const int VirtualTexture::kSlotSize;
+const uint32_t VirtualTexture::kNoKey;
+
+bool VirtualTexture::tile(const std::string &imagePath, const std::string &tiledPath) {
+  SourceImage image;
+  if(!image.open(imagePath))
+    return false;
+  const int width = image.width(), height = image.height();
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.width = width;
+  header.height = height;
+  header.pageSize = kPageSize;
+  header.border = kPageBorder;
+  header.dataOffset = 4096; // Pages aligned on memory pages
+  std::vector<FileLevel> levels;
+  uint32_t numPages = 0;
+  for(int l = 0; l < kMaxLevels; ++l) {
+    FileLevel fileLevel = { 0, 0, numPages, 0 };
+    fileLevel.pagesX = (levelSize(width, l) + kPageSize - 1)/kPageSize;
+    fileLevel.pagesY = (levelSize(height, l) + kPageSize - 1)/kPageSize;
+    levels.push_back(fileLevel);
+    numPages += fileLevel.pagesX*fileLevel.pagesY;
+    if(fileLevel.pagesX == 1 && fileLevel.pagesY == 1)
+      break;
+  }
+  if(levels.back().pagesX > 1 || levels.back().pagesY > 1 || levels[0].pagesX > kMaxPagesX || levels[0].pagesY > kMaxPagesX) {
+    std::cerr << "ERROR: " << imagePath << " is larger than virtual textures of " << kMaxPagesX*kPageSize << " texels" << std::endl;
+    return false;
+  }
+  header.numLevels = static_cast<uint32_t>(levels.size());
+
+  std::ofstream out(tiledPath.c_str(), std::ios::binary);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(levels.data()), levels.size()*sizeof(FileLevel));
+  out.write(std::vector<char>(header.dataOffset - sizeof(header) - levels.size()*sizeof(FileLevel), 0).data(),
+            header.dataOffset - sizeof(header) - levels.size()*sizeof(FileLevel));
+
+  // The rows of the image flow through the levels, each writing its pages
+  // in place and filtering the next one, in a single pass over the image
+  std::vector<std::unique_ptr<LevelWriter>> writers(levels.size());
+  for(size_t l = levels.size(); l-- > 0;)
+    writers[l].reset(new LevelWriter(levelSize(width, static_cast<int>(l)), levelSize(height, static_cast<int>(l)), levels[l],
+                                     header.dataOffset + levels[l].firstPage*kPageBytes, out,
+                                     l + 1 < levels.size() ? writers[l + 1].get() : nullptr));
+  std::vector<unsigned char> row(3*static_cast<size_t>(width));
+  for(int y = 0; y < height; ++y) {
+    if(!image.read(row.data())) {
+      std::cerr << "ERROR: " << imagePath << " is truncated" << std::endl;
+      return false;
+    }
+    writers[0]->push(row.data());
+  }
+  if(!out) {
+    std::cerr << "ERROR: Failed to write " << tiledPath << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool VirtualTexture::isTiled(const std::string &path) {
+  return path.size() > 3 && path.compare(path.size() - 3, 3, ".vt") == 0;
+}
+
+std::string VirtualTexture::defines() {
+  return "#define PAGE_SIZE " + std::to_string(kPageSize) + "\n"
+    "#define PAGE_BORDER " + std::to_string(kPageBorder) + "\n"
+    "#define MAX_VIRTUAL_LEVELS " + std::to_string(kMaxLevels) + "\n";
+}
+
+bool VirtualTexture::init(const std::string &path, int cacheSlots, int pagesPerFrame) {
+  m_path = path;
+  if(!m_file.open(path)) {
+    std::cerr << "ERROR: Failed to read the virtual texture " << path << std::endl;
+    return false;
+  }
+  Header header;
+  if(m_file.size() < sizeof(header) || std::memcmp(m_file.data(), kMagic, sizeof(kMagic))) {
+    std::cerr << "ERROR: " << path << " is not a tiled texture" << std::endl;
+    clear();
+    return false;
+  }
+  std::memcpy(&header, m_file.data(), sizeof(header));
+  if(header.version != kVersion || header.pageSize != static_cast<uint32_t>(kPageSize) || header.border != static_cast<uint32_t>(kPageBorder)
+     || header.numLevels == 0 || header.numLevels > static_cast<uint32_t>(kMaxLevels)
+     || header.dataOffset < sizeof(header) + header.numLevels*sizeof(FileLevel) || m_file.size() < header.dataOffset
+     || header.width == 0 || header.height == 0
+     || header.width > static_cast<uint32_t>(kMaxPagesX*kPageSize) || header.height > static_cast<uint32_t>(kMaxPagesX*kPageSize)) {
+    std::cerr << "ERROR: " << path << " was tiled with another version or page size, tile it again" << std::endl;
+    clear();
+    return false;
+  }
+
+  // The levels must be those the tiler lays out for this size, since the
+  // page indices and the page table are derived from them
+  const FileLevel *levels = reinterpret_cast<const FileLevel *>(m_file.data() + sizeof(header));
+  uint32_t numPages = 0, numRows = 0;
+  for(uint32_t l = 0; l < header.numLevels; ++l) {
+    const uint32_t pagesX = (levelSize(static_cast<int>(header.width), static_cast<int>(l)) + kPageSize - 1)/kPageSize;
+    const uint32_t pagesY = (levelSize(static_cast<int>(header.height), static_cast<int>(l)) + kPageSize - 1)/kPageSize;
+    if(levels[l].firstPage != numPages || levels[l].pagesX != pagesX || levels[l].pagesY != pagesY) {
+      std::cerr << "ERROR: " << path << " has an invalid level table, tile it again" << std::endl;
+      clear();
+      return false;
+    }
+    m_levels.push_back({ pagesX, pagesY, numPages, numRows });
+    numPages += pagesX*pagesY;
+    numRows += pagesY;
+  }
+  if(m_file.size() < header.dataOffset + static_cast<uint64_t>(numPages)*kPageBytes || m_levels.back().pagesX != 1 || m_levels.back().pagesY != 1) {
+    std::cerr << "ERROR: " << path << " is truncated" << std::endl;
+    clear();
+    return false;
+  }
+  m_pages = reinterpret_cast<const unsigned char *>(m_file.data()) + header.dataOffset;
+  m_width = header.width;
+  m_height = header.height;
+  m_pagesPerFrame = std::max(1, pagesPerFrame);
+
+  // Slot coordinates are bytes of the page table entries
+  m_cacheSlots = std::min(std::max(cacheSlots, 2), 255);
+  m_slots.assign(m_cacheSlots*m_cacheSlots, Slot());
+  m_pageSlots.assign(numPages, kNoKey);
+  glGenTextures(1, &m_cache);
+  g_glState.bindTexture(GL_TEXTURE_2D, m_cache);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, m_cacheSlots*kSlotSize, m_cacheSlots*kSlotSize, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  m_tableEntries.assign(static_cast<size_t>(m_levels[0].pagesX)*numRows, 0);
+  glGenTextures(1, &m_pageTable);
+  g_glState.bindTexture(GL_TEXTURE_2D, m_pageTable);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, m_levels[0].pagesX, numRows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+
+  LoadedPage top;
+  top.key = pageKey(numLevels() - 1, 0, 0);
+  readPage(top.key, top.texels);
+  upload(top, true);
+  updatePageTable();
+
+  m_stop = false;
+  m_loader = std::thread(&VirtualTexture::loaderLoop, this);
+  return true;
+}
+
+GLuint VirtualTexture::createFallbackTexture(int maxWidth) const {
+  int l = 0;
+  while(l + 1 < numLevels() && levelSize(m_width, l) > maxWidth)
+    ++l;
+  const int width = levelSize(m_width, l), height = levelSize(m_height, l);
+  std::vector<unsigned char> texels(3*static_cast<size_t>(width)*height), page;
+  for(uint32_t py = 0; py < m_levels[l].pagesY; ++py) {
+    for(uint32_t px = 0; px < m_levels[l].pagesX; ++px) {
+      readPage(pageKey(l, px, py), page);
+      const int columns = std::min(kPageSize, width - static_cast<int>(px)*kPageSize);
+      for(int ty = 0; ty < kPageSize && static_cast<int>(py)*kPageSize + ty < height; ++ty)
+        std::memcpy(&texels[3*((static_cast<size_t>(py)*kPageSize + ty)*width + px*kPageSize)],
+                    &page[3*((ty + kPageBorder)*kSlotSize + kPageBorder)], 3*columns);
+    }
+  }
+  GLuint texture;
+  glGenTextures(1, &texture);
+  g_glState.bindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Rows of odd widths
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  return texture;
+}
+
+size_t VirtualTexture::pageIndex(uint32_t key) const {
+  const Level &level = m_levels[key >> 24];
+  return level.firstPage + ((key >> 12) & 0xfffu)*level.pagesX + (key & 0xfffu);
+}
+
+void VirtualTexture::readPage(uint32_t key, std::vector<unsigned char> &texels) const {
+  texels.resize(kPageBytes);
+  std::memcpy(texels.data(), m_pages + pageIndex(key)*kPageBytes, kPageBytes); // Faults the page in from the disk
+}
+
+void VirtualTexture::request(int level, int x, int y) {
+  if(level < 0 || level >= numLevels() || x < 0 || y < 0)
+    return;
+  if(static_cast<uint32_t>(x) >= m_levels[level].pagesX || static_cast<uint32_t>(y) >= m_levels[level].pagesY)
+    return;
+  for(; level < numLevels(); ++level, x /= 2, y /= 2) {
+    const uint32_t key = pageKey(level, x, y);
+    const uint32_t slot = m_pageSlots[pageIndex(key)];
+    if(slot == kNoKey) {
+      m_missing.push_back(key);
+    } else {
+      if(m_slots[slot].lastUsed == m_frame)
+        break; // So were its ancestors
+      m_slots[slot].lastUsed = m_frame;
+    }
+  }
+}
+
+bool VirtualTexture::upload(const LoadedPage &page, bool pinned) {
+  const size_t index = pageIndex(page.key);
+  if(m_pageSlots[index] != kNoKey)
+    return false; // Loaded twice
+
+  // A free slot, or the least recently used one, unless it was used this frame
+  uint32_t slot = kNoKey;
+  for(uint32_t s = 0; s < m_slots.size(); ++s) {
+    const Slot &candidate = m_slots[s];
+    if(candidate.key == kNoKey) {
+      slot = s;
+      break;
+    }
+    if(!candidate.pinned && candidate.lastUsed < m_frame && (slot == kNoKey || candidate.lastUsed < m_slots[slot].lastUsed))
+      slot = s;
+  }
+  if(slot == kNoKey)
+    return false; // The cache is too small for the frame
+  Slot &target = m_slots[slot];
+  if(target.key != kNoKey) {
+    m_pageSlots[pageIndex(target.key)] = kNoKey;
+    --m_numResident;
+    ++m_evictions;
+  }
+  target.key = page.key;
+  target.lastUsed = m_frame;
+  target.pinned = pinned;
+  m_pageSlots[index] = slot;
+  ++m_numResident;
+  ++m_uploads;
+  m_tableDirty = true;
+
+  g_glState.bindTexture(GL_TEXTURE_2D, m_cache);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % m_cacheSlots)*kSlotSize, (slot / m_cacheSlots)*kSlotSize, kSlotSize, kSlotSize,
+                  GL_RGB, GL_UNSIGNED_BYTE, page.texels.data());
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  return true;
+}
+
+// From the coarsest level down, a page that is not resident takes the entry
+// of its parent
+void VirtualTexture::updatePageTable() {
+  const size_t rowLength = m_levels[0].pagesX;
+  for(int l = numLevels() - 1; l >= 0; --l) {
+    const Level &level = m_levels[l];
+    for(uint32_t y = 0; y < level.pagesY; ++y) {
+      for(uint32_t x = 0; x < level.pagesX; ++x) {
+        const uint32_t slot = m_pageSlots[level.firstPage + y*level.pagesX + x];
+        uint32_t &entry = m_tableEntries[(level.tableRow + y)*rowLength + x];
+        if(slot != kNoKey)
+          entry = slot % m_cacheSlots | (slot / m_cacheSlots) << 8 | static_cast<uint32_t>(l) << 16;
+        else
+          entry = m_tableEntries[(m_levels[l + 1].tableRow + y/2)*rowLength + x/2]; // The coarsest level is pinned
+      }
+    }
+  }
+  g_glState.bindTexture(GL_TEXTURE_2D, m_pageTable);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, static_cast<GLsizei>(rowLength), static_cast<GLsizei>(m_tableEntries.size()/rowLength),
+                  GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, m_tableEntries.data());
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  m_tableDirty = false;
+}
+
+void VirtualTexture::update() {
+  std::sort(m_missing.begin(), m_missing.end());
+  m_missing.erase(std::unique(m_missing.begin(), m_missing.end()), m_missing.end());
+  std::reverse(m_missing.begin(), m_missing.end()); // Coarsest first: they fill the most holes
+  m_misses += m_missing.size();
+
+  if(m_synchronous) {
+    LoadedPage page;
+    for(uint32_t key : m_missing) {
+      page.key = key;
+      readPage(key, page.texels);
+      upload(page, false);
+    }
+  } else {
+    std::deque<LoadedPage> loaded;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for(int i = 0; i < m_pagesPerFrame && !m_loaded.empty(); ++i) {
+        loaded.push_back(std::move(m_loaded.front()));
+        m_loaded.pop_front();
+      }
+      m_queue.assign(m_missing.begin(), m_missing.end()); // The requests of older frames are stale
+    }
+    m_wake.notify_one();
+    for(const LoadedPage &page : loaded)
+      upload(page, false);
+  }
+  m_missing.clear();
+  if(m_tableDirty)
+    updatePageTable();
+  ++m_frame;
+}
+
+void VirtualTexture::loaderLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for(;;) {
+    // At most two frames of budget wait for their upload
+    m_wake.wait(lock, [this] { return m_stop || (!m_queue.empty() && m_loaded.size() < 2*static_cast<size_t>(m_pagesPerFrame)); });
+    if(m_stop)
+      return;
+    LoadedPage page;
+    page.key = m_queue.front();
+    m_queue.pop_front();
+    if(std::any_of(m_loaded.begin(), m_loaded.end(), [&page](const LoadedPage &p) { return p.key == page.key; }))
+      continue;
+    lock.unlock();
+    readPage(page.key, page.texels);
+    lock.lock();
+    m_loaded.push_back(std::move(page));
+  }
+}
+
+void VirtualTexture::setUniforms(GLuint program) const {
+  GLint rows[kMaxLevels] = { 0 };
+  for(int l = 0; l < numLevels(); ++l)
+    rows[l] = static_cast<GLint>(m_levels[l].tableRow);
+  glUniform3i(glGetUniformLocation(program, "virtualSize"), m_width, m_height, numLevels());
+  glUniform1iv(glGetUniformLocation(program, "virtualLevelRows"), numLevels(), rows);
+}
+
+void VirtualTexture::bind(GLuint program) const {
+  g_glState.activeTexture(GL_TEXTURE0 + kPageTableUnit);
+  g_glState.bindTexture(GL_TEXTURE_2D, m_pageTable);
+  g_glState.activeTexture(GL_TEXTURE0 + kCacheUnit);
+  g_glState.bindTexture(GL_TEXTURE_2D, m_cache);
+  g_glState.activeTexture(GL_TEXTURE0);
+  setUniforms(program);
+}
+
+void VirtualTexture::setupProgram(GLuint program) {
+  glUniform1i(glGetUniformLocation(program, "pageTable"), kPageTableUnit);
+  glUniform1i(glGetUniformLocation(program, "pageCache"), kCacheUnit);
+}
+
+void VirtualTexture::clear() {
+  if(m_loader.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_one();
+    m_loader.join();
+  }
+  m_queue.clear();
+  m_loaded.clear();
+  g_glState.deleteTextures(1, &m_cache);
+  g_glState.deleteTextures(1, &m_pageTable);
+  m_cache = m_pageTable = 0;
+  m_file.close();
+  m_pages = nullptr;
+  m_levels.clear();
+  m_slots.clear();
+  m_pageSlots.clear();
+  m_tableEntries.clear();
+  m_missing.clear();
+  m_numResident = 0;
+}
+
+bool VirtualTextureFeedback::init(ProgramCache &cache, const std::string &defines, int divisor, GLenum depthFormat,
+                                  bool tessellated, const std::function<void(GLuint)> &onReady) {
+  const std::vector<ShaderStage> stages = { { GL_VERTEX_SHADER, "vertexShader.glsl" }, { GL_FRAGMENT_SHADER, "feedbackFragmentShader.glsl" } };
+  const std::vector<ShaderStage> tessellatedStages = { { GL_VERTEX_SHADER, "tessVertexShader.glsl" },
+    { GL_TESS_CONTROL_SHADER, "tessControlShader.glsl" }, { GL_TESS_EVALUATION_SHADER, "tessEvaluationShader.glsl" },
+    { GL_FRAGMENT_SHADER, "feedbackFragmentShader.glsl" } };
+  for(int impostor = 0; impostor < 2; ++impostor) {
+    const bool tessellatedMesh = tessellated && !impostor;
+    m_programs[impostor] = loadProgram(cache, tessellatedMesh ? tessellatedStages : stages, defines + "#define TEXTURED\n"
+                                       + (impostor ? "#define IMPOSTOR\n" : "") + (tessellatedMesh ? "#define TESSELLATED\n" : ""));
+    if(!m_programs[impostor])
+      return false;
+    g_glState.useProgram(m_programs[impostor]);
+    glUniform1f(glGetUniformLocation(m_programs[impostor], "lodBias"), -std::log2(static_cast<float>(divisor)));
+    onReady(m_programs[impostor]);
+  }
+  g_glState.useProgram(0);
+  m_divisor = std::max(1, divisor);
+  m_depthFormat = depthFormat;
+  glGenFramebuffers(1, &m_fbo);
+  glGenRenderbuffers(1, &m_colorRbo);
+  glGenRenderbuffers(1, &m_depthRbo);
+  glGenBuffers(2, m_pbos);
+  return true;
+}
+
+void VirtualTextureFeedback::begin(int viewportWidth, int viewportHeight) {
+  m_previousFbo = g_glState.getDrawFramebuffer();
+  g_glState.getViewport(m_previousViewport);
+  const int width = std::max(1, viewportWidth/m_divisor), height = std::max(1, viewportHeight/m_divisor);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  if(width != m_width || height != m_height) {
+    m_width = width;
+    m_height = height;
+    g_glState.bindRenderbuffer(GL_RENDERBUFFER, m_colorRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, width, height);
+    g_glState.bindRenderbuffer(GL_RENDERBUFFER, m_depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, m_depthFormat, width, height);
+    g_glState.bindRenderbuffer(GL_RENDERBUFFER, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRbo);
+  }
+  g_glState.viewport(0, 0, width, height);
+  glClearBufferuiv(GL_COLOR, 0, &kNoRequest);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+GLuint VirtualTextureFeedback::program(bool impostor, int textureIndex, const VirtualTexture &texture) {
+  const GLuint program = m_programs[impostor ? 1 : 0];
+  g_glState.useProgram(program);
+  glUniform1ui(glGetUniformLocation(program, "textureIndex"), static_cast<GLuint>(textureIndex));
+  texture.setUniforms(program);
+  return program;
+}
+
+void VirtualTextureFeedback::end(const std::vector<std::unique_ptr<VirtualTexture>> &textures) {
+  const size_t current = m_frame % 2;
+  const size_t pixels = static_cast<size_t>(m_width)*m_height;
+  g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[current]);
+  if(m_pboCapacity[current] < pixels) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, pixels*sizeof(uint32_t), nullptr, GL_STREAM_READ);
+    m_pboCapacity[current] = pixels;
+  }
+  glReadPixels(0, 0, m_width, m_height, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+  m_pboPixels[current] = pixels;
+  ++m_frame;
+
+  // The readback of the previous frame has had a frame to complete
+  const size_t read = m_synchronous ? current : 1 - current;
+  m_requests.clear();
+  if(m_pboPixels[read] > 0) {
+    g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[read]);
+    const uint32_t *values = static_cast<const uint32_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_pboPixels[read]*sizeof(uint32_t),
+                                                                            GL_MAP_READ_BIT));
+    if(values) {
+      m_requests.assign(values, values + m_pboPixels[read]);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    m_pboPixels[read] = 0;
+  }
+  g_glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, m_previousFbo);
+  g_glState.viewport(m_previousViewport[0], m_previousViewport[1], m_previousViewport[2], m_previousViewport[3]);
+
+  // Neighboring pixels mostly sample the same pages
+  std::sort(m_requests.begin(), m_requests.end());
+  m_requests.erase(std::unique(m_requests.begin(), m_requests.end()), m_requests.end());
+  for(uint32_t request : m_requests) {
+    const size_t texture = request >> 24;
+    if(request != kNoRequest && texture < textures.size())
+      textures[texture]->request((request >> 20) & 0xfu, request & 0x3ffu, (request >> 10) & 0x3ffu);
+  }
+}
+
+void VirtualTextureFeedback::clear() {
+  for(GLuint &program : m_programs) {
+    g_glState.deleteProgram(program);
+    program = 0;
+  }
+  g_glState.deleteBuffers(2, m_pbos);
+  g_glState.deleteRenderbuffers(1, &m_colorRbo);
+  g_glState.deleteRenderbuffers(1, &m_depthRbo);
+  g_glState.deleteFramebuffers(1, &m_fbo);
+  m_pbos[0] = m_pbos[1] = m_colorRbo = m_depthRbo = m_fbo = 0;
+  m_pboPixels[0] = m_pboPixels[1] = m_pboCapacity[0] = m_pboCapacity[1] = 0;
+  m_width = m_height = 0;
+  m_frame = 0;
+}
@@ -0,0 +1,214 @@
+// ----------------------------------------------------------------------------
+// VirtualTexture.hpp
+//
+// Description: Virtual texturing of images too large for the GPU (e.g., 64k x
+//              32k planet surfaces). An offline step cuts the mip pyramid of
+//              the image into fixed-size pages with a filtering border; at run
+//              time a low-resolution feedback pass finds the pages that the
+//              frame samples, a loader thread reads them from the mapped file
+//              and at most a budget of them is uploaded per frame into a cache
+//              texture, which a page table indirects into (virtualTexture.glsl).
+// ----------------------------------------------------------------------------
+
+#ifndef VIRTUAL_TEXTURE_HPP
+#define VIRTUAL_TEXTURE_HPP
+
+#include "MappedFile.hpp"
+
+#include <glad/gl.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ProgramCache;
+
+class VirtualTexture {
+public:
+  static const int kPageSize = 120;                       // Texels of a page, per side
+  static const int kPageBorder = 4;                       // Texels of the neighbors around a page, for filtering
+  static const int kSlotSize = kPageSize + 2*kPageBorder; // Texels of a page in the cache
+  static const int kMaxLevels = 16;
+  static const int kMaxPagesX = 1024;                     // Of level 0, as encoded by the feedback pass
+  static const GLint kPageTableUnit = 5;                  // Texture units, after those of LightClusters
+  static const GLint kCacheUnit = 6;
+
+  // Cuts an image into the pages of its mip pyramid, down to a level of a
+  // single page, in one pass over its rows. Binary PPM images are streamed,
+  // so that 64k x 32k sources fit in memory; other formats are decoded whole.
+  static bool tile(const std::string &imagePath, const std::string &tiledPath);
+
+  // True for the paths of tiled files (".vt")
+  static bool isTiled(const std::string &path);
+
+  // Page size and border of virtualTexture.glsl
+  static std::string defines();
+
+  // Maps a tiled file, creates a cache of cacheSlots x cacheSlots pages and
+  // its page table, loads the coarsest level (pinned, so that every lookup
+  // finds a page) and starts the loader thread
+  bool init(const std::string &path, int cacheSlots, int pagesPerFrame);
+
+  // Plain texture of the finest level at most maxWidth wide, for the paths
+  // that do not sample virtual textures (the GPU-driven path)
+  GLuint createFallbackTexture(int maxWidth) const;
+
+  // A page sampled this frame, reported by the feedback pass; its ancestors
+  // are requested with it
+  void request(int level, int x, int y);
+
+  // Uploads the pages loaded since the last frame (all of them when
+  // synchronous, at most the budget otherwise), updates the page table and
+  // hands the missing pages of this frame to the loader, coarsest first
+  void update();
+
+  // Binds the page table and the cache, and sets the uniforms of
+  // virtualTexture.glsl
+  void bind(GLuint program) const;
+
+  // Uniforms of virtualTexture.glsl only, for the feedback pass
+  void setUniforms(GLuint program) const;
+
+  // Sampler units of the page table and the cache
+  static void setupProgram(GLuint program);
+
+  // Pages are read on the calling thread and uploaded without budget, so
+  // that offline exports do not depend on the timing of the loader
+  inline void setSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+  inline int width() const { return m_width; }
+  inline int height() const { return m_height; }
+  inline int numLevels() const { return static_cast<int>(m_levels.size()); }
+  inline size_t residentPages() const { return m_numResident; }
+  inline size_t numSlots() const { return m_slots.size(); }
+  inline size_t uploads() const { return m_uploads; }
+  inline size_t evictions() const { return m_evictions; }
+  inline size_t misses() const { return m_misses; }
+  inline const std::string &path() const { return m_path; }
+
+  void clear();
+
+private:
+  struct Level {
+    uint32_t pagesX;
+    uint32_t pagesY;
+    uint32_t firstPage; // Index of its first page in the file
+    uint32_t tableRow;  // First row of its entries in the page table
+  };
+
+  struct Slot {
+    uint32_t key = kNoKey; // Resident page
+    uint64_t lastUsed = 0; // Frame of its last request
+    bool pinned = false;
+  };
+
+  struct LoadedPage {
+    uint32_t key;
+    std::vector<unsigned char> texels; // RGB, kSlotSize x kSlotSize
+  };
+
+  static const uint32_t kNoKey = 0xffffffffu;
+
+  // Finer levels sort first: level 0 is the finest, so update() reverses the
+  // sorted missing pages to load the coarsest ones first
+  static inline uint32_t pageKey(int level, int x, int y) {
+    return static_cast<uint32_t>(level) << 24 | static_cast<uint32_t>(y) << 12 | static_cast<uint32_t>(x);
+  }
+  size_t pageIndex(uint32_t key) const;
+
+  void readPage(uint32_t key, std::vector<unsigned char> &texels) const;
+  bool upload(const LoadedPage &page, bool pinned);
+  void updatePageTable();
+  void loaderLoop();
+
+  std::string m_path;
+  MappedFile m_file;
+  const unsigned char *m_pages = nullptr; // First page in the file
+  int m_width = 0;                        // Of level 0, in texels
+  int m_height = 0;
+  std::vector<Level> m_levels;
+  int m_pagesPerFrame = 0;
+  bool m_synchronous = false;
+
+  // Cache: the slot of every resident page, and the least recently used
+  // slots are reused first
+  GLuint m_cache = 0;
+  int m_cacheSlots = 0; // Per side
+  std::vector<Slot> m_slots;
+  std::vector<uint32_t> m_pageSlots; // Per page of the file, its slot or kNoKey
+  size_t m_numResident = 0;
+  uint64_t m_frame = 1;
+
+  // Page table: for every page of every level, the cache slot and the level
+  // of the finest resident page covering it (RGBA8UI)
+  GLuint m_pageTable = 0;
+  std::vector<uint32_t> m_tableEntries;
+  bool m_tableDirty = true;
+
+  std::vector<uint32_t> m_missing; // Requested this frame and not resident
+  size_t m_uploads = 0;
+  size_t m_evictions = 0;
+  size_t m_misses = 0;
+
+  // Loader thread: the missing pages of the last frame, and the pages read
+  std::thread m_loader;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::deque<uint32_t> m_queue;
+  std::deque<LoadedPage> m_loaded;
+  bool m_stop = false;
+};
+
+// Low-resolution pass that draws the virtually textured bodies into an
+// integer target, each fragment writing the page it samples. The target is
+// read back through two PBOs, so the requests lag one frame without stalling.
+class VirtualTextureFeedback {
+public:
+  // onReady binds the uniform blocks of the programs; divisor is the ratio
+  // of the viewport to the feedback target. With tessellated, the meshes
+  // are drawn through the stages of TessellatedSphere, as in the scene.
+  bool init(ProgramCache &cache, const std::string &defines, int divisor, GLenum depthFormat,
+            bool tessellated, const std::function<void(GLuint)> &onReady);
+
+  // Binds the feedback target, sized after the viewport, and clears it
+  void begin(int viewportWidth, int viewportHeight);
+
+  // Program for meshes or impostors, with the uniforms of the texture
+  // (index in the textures passed to end()) set
+  GLuint program(bool impostor, int textureIndex, const VirtualTexture &texture);
+
+  // Queues the readback of this frame, reports the requests of the previous
+  // one (of this one when synchronous) to their textures and restores the
+  // framebuffer and the viewport
+  void end(const std::vector<std::unique_ptr<VirtualTexture>> &textures);
+
+  inline void setSynchronous(bool synchronous) { m_synchronous = synchronous; }
+
+  void clear();
+
+private:
+  GLuint m_programs[2] = { 0, 0 }; // Mesh, impostor
+  GLuint m_fbo = 0;
+  GLuint m_colorRbo = 0;
+  GLuint m_depthRbo = 0;
+  GLuint m_pbos[2] = { 0, 0 };
+  size_t m_pboPixels[2] = { 0, 0 }; // Read into each PBO
+  size_t m_pboCapacity[2] = { 0, 0 };
+  GLenum m_depthFormat = GL_DEPTH_COMPONENT24;
+  int m_divisor = 8;
+  int m_width = 0;
+  int m_height = 0;
+  size_t m_frame = 0;
+  bool m_synchronous = false;
+  GLuint m_previousFbo = 0;
+  GLint m_previousViewport[4] = { 0, 0, 0, 0 };
+  std::vector<uint32_t> m_requests;
+};
+
+#endif // VIRTUAL_TEXTURE_HPP
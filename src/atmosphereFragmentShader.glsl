@@ -0,0 +1,118 @@
+#version 330 core
+
+// Single scattering in the atmosphere of a body, from the tables built by
+// Atmosphere.cpp: the cost per fragment is a ray-sphere intersection and at
+// most four texture fetches, whatever the optical depth. Lengths are in planet
+// radii, with the ground at r = 1. The table sizes are injected.
+#include "impostor.glsl"
+
+in vec3 fPosition;
+
+layout(location = 0, index = 0) out vec4 color;         // Light scattered towards the eye, added
+layout(location = 0, index = 1) out vec4 transmittance; // Multiplies what lies behind
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+uniform vec4 planet;             // Center and radius of the body
+uniform float top;               // Radius of the top of the atmosphere
+uniform vec3 rayleighScattering; // Per planet radius, at the ground
+uniform float mieG;
+uniform vec3 sunIrradiance;
+uniform sampler2D transmittanceTable; // (view zenith, altitude)
+uniform sampler3D scatteringTable;    // (view-sun angle and sun zenith, view zenith, altitude)
+
+// Texture coordinate of x in [0, 1] on a table axis of n texels, on the
+// centers of the first and last texels
+float texCoord(float x, float n) {
+    return 0.5 / n + clamp(x, 0.0, 1.0) * (1.0 - 1.0 / n);
+}
+
+float distanceToTop(float r, float mu) {
+    return max(-r * mu + sqrt(max(r * r * (mu * mu - 1.0) + top * top, 0.0)), 0.0);
+}
+
+float distanceToGround(float r, float mu) {
+    return max(-r * mu - sqrt(max(r * r * (mu * mu - 1.0) + 1.0, 0.0)), 0.0);
+}
+
+vec3 transmittanceToTop(float r, float mu) {
+    float horizon = sqrt(top * top - 1.0);
+    float rho = sqrt(max(r * r - 1.0, 0.0));
+    float dMin = top - r, dMax = rho + horizon;
+    return texture(transmittanceTable, vec2(texCoord((distanceToTop(r, mu) - dMin) / (dMax - dMin), float(TRANSMITTANCE_MU)),
+                                            texCoord(rho / horizon, float(TRANSMITTANCE_R)))).rgb;
+}
+
+// Interpolated in the view-sun angle between two slices of the table
+vec4 scattering(float r, float mu, float muS, float nu, bool ground) {
+    float horizon = sqrt(top * top - 1.0);
+    float rho = sqrt(max(r * r - 1.0, 0.0));
+    float halfMu = float(SCATTERING_MU / 2);
+    float uMu;
+    if (ground) {
+        float dMin = r - 1.0, dMax = rho;
+        uMu = 0.5 - 0.5 * texCoord(dMax == dMin ? 0.0 : (distanceToGround(r, mu) - dMin) / (dMax - dMin), halfMu);
+    } else {
+        float dMin = top - r, dMax = rho + horizon;
+        uMu = 0.5 + 0.5 * texCoord((distanceToTop(r, mu) - dMin) / (dMax - dMin), halfMu);
+    }
+    float uMuS = texCoord((1.0 - exp(-3.0 * muS - 0.6)) / (1.0 - exp(-3.6)), float(SCATTERING_MU_S));
+    float uR = texCoord(rho / horizon, float(SCATTERING_R));
+    float slice = (nu + 1.0) * 0.5 * float(SCATTERING_NU - 1);
+    float slice0 = min(floor(slice), float(SCATTERING_NU - 2));
+    vec4 a = texture(scatteringTable, vec3((slice0 + uMuS) / float(SCATTERING_NU), uMu, uR));
+    vec4 b = texture(scatteringTable, vec3((slice0 + 1.0 + uMuS) / float(SCATTERING_NU), uMu, uR));
+    return mix(a, b, slice - slice0);
+}
+
+float rayleighPhase(float nu) {
+    return 0.05968310 * (1.0 + nu * nu); // 3/(16 pi)
+}
+
+float miePhase(float nu) {
+    float g2 = mieG * mieG;
+    return 0.11936621 * (1.0 - g2) * (1.0 + nu * nu) / ((2.0 + g2) * pow(1.0 + g2 - 2.0 * mieG * nu, 1.5)); // 3/(8 pi)
+}
+
+void main()
+{
+    vec3 eye = (camPosition.xyz - planet.xyz) / planet.w;
+    vec3 v = normalize(fPosition - camPosition.xyz);
+    float b = dot(eye, v);
+    float h = b * b - dot(eye, eye) + top * top;
+    if (h < 0.0 || -b + sqrt(h) <= 0.0)
+        discard; // Misses the atmosphere, or it lies behind the eye
+    float entry = max(-b - sqrt(h), 0.0);
+
+    vec3 x = eye + entry * v;
+    float r = clamp(length(x), 1.0, top);
+    float mu = dot(x, v) / r;
+    vec3 s = normalize(lightPosition.xyz - planet.xyz);
+    float muS = dot(x, s) / r;
+    float nu = dot(v, s);
+    bool ground = mu < 0.0 && r * r * (mu * mu - 1.0) + 1.0 >= 0.0;
+
+    // Rayleigh in rgb, and Mie rebuilt from its red channel (Bruneton 2008)
+    vec4 scattered = scattering(r, mu, muS, nu, ground);
+    vec3 mie = scattered.rgb * (scattered.a / max(scattered.r, 1e-6)) * (rayleighScattering.r / rayleighScattering);
+    color = vec4(sunIrradiance * (scattered.rgb * rayleighPhase(nu) + mie * miePhase(nu)), 1.0);
+
+    // To the ground, both ends are looked up upwards (see Atmosphere.cpp)
+    vec3 through;
+    if (ground) {
+        float muGround = clamp(r * mu + distanceToGround(r, mu), -1.0, 1.0);
+        through = min(transmittanceToTop(1.0, -muGround) / max(transmittanceToTop(r, -mu), vec3(1e-20)), vec3(1.0));
+    } else {
+        through = transmittanceToTop(r, mu);
+    }
+    transmittance = vec4(through, 1.0);
+
+    gl_FragDepth = entry > 0.0 ? impostorDepth(viewProjMat, planet.xyz + planet.w * x) : nearestDepth();
+}
@@ -0,0 +1,36 @@
+#version 330 core
+
+// Shell of an atmosphere, drawn as the camera-facing square around the top
+// of the atmosphere (see impostor.glsl), or over the whole viewport when the
+// camera is inside or close to it. The corners come from gl_VertexID.
+#include "impostor.glsl"
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+uniform vec4 planet; // Center and radius of the body
+uniform float top;   // Radius of the top of the atmosphere, in planet radii
+
+out vec3 fPosition;  // Point of the view ray in world space
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    float radius = top * planet.w;
+    if (distance(camPosition.xyz, planet.xyz) < 1.1 * radius) {
+        // The square would grow without bound: cover the screen, with points
+        // of the view rays at the clip depth 1 (the near plane with reversed-Z)
+        vec4 onRay = inverse(viewProjMat) * vec4(corner, 1.0, 1.0);
+        fPosition = onRay.xyz / onRay.w;
+        gl_Position = vec4(corner, 0.0, 1.0);
+    } else {
+        fPosition = impostorCorner(planet.xyz, radius, camPosition.xyz, corner);
+        gl_Position = viewProjMat * vec4(fPosition, 1.0);
+    }
+}
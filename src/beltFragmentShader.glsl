@@ -0,0 +1,30 @@
+#version 330 core
+
+// Point sprite of a belt body, shaded as a lit sphere seen head-on
+
+#ifndef AMBIENT
+#define AMBIENT vec3(0.4, 0.4, 0.4)
+#endif
+
+#include "depth.glsl"
+
+flat in vec3 fColor;
+flat in vec3 fLightDir;
+#ifdef LOG_DEPTH
+flat in float fClipW;
+#endif
+
+out vec4 color;
+
+void main()
+{
+    vec2 p = vec2(2.0 * gl_PointCoord.x - 1.0, 1.0 - 2.0 * gl_PointCoord.y);
+    float r2 = dot(p, p);
+    if (r2 > 1.0)
+        discard; // Outside the disc; sprites of one pixel keep their center
+    vec3 n = vec3(p, sqrt(1.0 - r2)); // Normal of the visible hemisphere, in view space
+    color = vec4(fColor * (AMBIENT + max(dot(n, fLightDir), 0.0)), 1.0);
+#ifdef LOG_DEPTH
+    gl_FragDepth = logDepth(fClipW);
+#endif
+}
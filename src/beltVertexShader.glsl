@@ -0,0 +1,59 @@
+#version 330 core
+
+// Bodies of the particle belts: the position of each body is computed from
+// its orbital elements at the current time, then drawn as a point sprite.
+
+layout(location=0) in vec4 vOrbit; // semi-major axis, eccentricity, inclination, longitude of the ascending node
+layout(location=1) in vec4 vPhase; // argument of periapsis, mean anomaly at time 0, mean motion, radius
+layout(location=2) in vec4 vColor;
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+uniform float time;       // Simulation time modulo the common period of the orbits, in seconds
+uniform vec3 cameraHigh;  // World position of the camera, the origin of the frame,
+uniform vec3 cameraLow;   // as a float and the remainder
+uniform float pixelScale; // Viewport height / (2 tan(fov/2))
+
+flat out vec3 fColor;
+flat out vec3 fLightDir;  // Toward the light, in view space
+#ifdef LOG_DEPTH
+flat out float fClipW;    // View distance, for the logarithmic depth
+#endif
+
+void main()
+{
+    float e = vOrbit.y;
+    float meanAnomaly = vPhase.y + mod(vPhase.z * time, 6.28318531);
+
+    // Kepler's equation M = E - e sin(E), by Newton's method from E = M
+    float E = meanAnomaly;
+    for (int i = 0; i < 4; ++i)
+        E -= (E - e * sin(E) - meanAnomaly) / (1.0 - e * cos(E));
+
+    // Position in the orbital plane, periapsis along x
+    vec2 p = vOrbit.x * vec2(cos(E) - e, sqrt(1.0 - e * e) * sin(E));
+
+    // Rotate by the argument of periapsis, the inclination and the node
+    float cw = cos(vPhase.x), sw = sin(vPhase.x);
+    float ci = cos(vOrbit.z), si = sin(vOrbit.z);
+    float cn = cos(vOrbit.w), sn = sin(vOrbit.w);
+    vec2 q = vec2(cw * p.x - sw * p.y, sw * p.x + cw * p.y);
+    vec3 ecliptic = vec3(cn * q.x - sn * ci * q.y, sn * q.x + cn * ci * q.y, si * q.y);
+    vec3 position = (ecliptic.xzy - cameraHigh) - cameraLow; // The planets orbit in the xz plane, y up
+
+    vec4 viewPosition = viewMat * vec4(position, 1.0);
+    gl_Position = projMat * viewPosition;
+    gl_PointSize = clamp(2.0 * vPhase.w * pixelScale / max(-viewPosition.z, 1e-3), 1.0, 64.0);
+    fColor = vColor.rgb;
+    fLightDir = normalize(mat3(viewMat) * (lightPosition.xyz - position));
+#ifdef LOG_DEPTH
+    fClipW = gl_Position.w;
+#endif
+}
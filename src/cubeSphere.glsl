@@ -0,0 +1,16 @@
+// Cube-to-sphere mapping of the terrain and the tessellated sphere, shared
+// through #include "cubeSphere.glsl"; cubeToSphere() in Terrain.cpp is its
+// CPU counterpart.
+#ifndef CUBE_SPHERE_GLSL
+#define CUBE_SPHERE_GLSL
+
+// Point of the cube [-1, 1]^3 on one of its faces, projected on the unit
+// sphere with the mapping of Nowell, whose cells vary less in area than
+// after a plain normalization
+vec3 cubeToSphere(vec3 c)
+{
+    vec3 c2 = c * c;
+    return normalize(c * sqrt(max(1.0 - 0.5 * c2.yzx - 0.5 * c2.zxy + c2.yzx * c2.zxy / 3.0, 0.0)));
+}
+
+#endif // CUBE_SPHERE_GLSL
@@ -0,0 +1,71 @@
+#version 430 core
+
+// Frustum and size culling of every body, with LOD selection. Each visible
+// body is appended to the instance list of its LOD, whose indirect draw
+// command counts it. Command NUM_LODS collects the bodies small enough to be
+// drawn as ray-traced impostors.
+
+#ifndef NUM_LODS
+#define NUM_LODS 4
+#endif
+
+layout(local_size_x = 64) in;
+
+struct Body {
+    mat4 modelMatrix;
+    vec4 boundingSphere; // xyz: center in world space, w: radius
+    vec4 color;
+    vec4 material;
+};
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer BodyBuffer { Body bodies[]; };
+layout(std430, binding = 1) buffer CommandBuffer { DrawCommand commands[]; };
+layout(std430, binding = 2) writeonly buffer VisibleBuffer { uint visible[]; };
+
+uniform uint bodyCount;
+uniform vec4 frustumPlanes[6];     // Normalized, pointing inside
+uniform vec3 camPosition;
+uniform float pixelScale;          // Viewport height / (2 tan(fov/2))
+uniform float minPixelRadius;      // Bodies smaller than this on screen are skipped
+uniform float lodPixelRadius[NUM_LODS - 1]; // Decreasing thresholds of LODs 0..NUM_LODS-2
+uniform float impostorPixelRadius; // Bodies smaller than this on screen become impostors
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= bodyCount)
+        return;
+
+    vec4 sphere = bodies[i].boundingSphere;
+    for (int p = 0; p < 6; ++p) {
+        if (dot(frustumPlanes[p].xyz, sphere.xyz) + frustumPlanes[p].w < -sphere.w)
+            return;
+    }
+
+    float pixelRadius = sphere.w * pixelScale / max(distance(camPosition, sphere.xyz), 1e-6);
+    if (pixelRadius < minPixelRadius)
+        return;
+
+    uint lod = NUM_LODS - 1;
+    if (pixelRadius < impostorPixelRadius) {
+        lod = NUM_LODS;
+    } else {
+        for (uint l = 0; l < NUM_LODS - 1; ++l) {
+            if (pixelRadius >= lodPixelRadius[l]) {
+                lod = l;
+                break;
+            }
+        }
+    }
+
+    uint slot = atomicAdd(commands[lod].instanceCount, 1u);
+    visible[commands[lod].baseInstance + slot] = i;
+}
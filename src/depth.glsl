@@ -0,0 +1,40 @@
+// Depth conventions, shared by the shaders through #include "depth.glsl".
+// The mode is injected by the application:
+//   (none)      standard: clip depth in [-1, 1], from the near to the far plane
+//   REVERSED_Z  clip depth in [0, 1] (glClipControl), from 1 at the near plane
+//               to 0 at infinity, into a floating-point buffer (GL_GREATER)
+//   LOG_DEPTH   GL 3.3 fallback: standard projection, but the fragment shaders
+//               write log2(1 + w) / log2(1 + LOG_DEPTH_FAR), w the view distance
+#ifndef DEPTH_GLSL
+#define DEPTH_GLSL
+
+#ifdef LOG_DEPTH
+float logDepth(float w)
+{
+    return log2(1.0 + max(w, 0.0)) / log2(1.0 + LOG_DEPTH_FAR);
+}
+#endif
+
+// Window-space depth of a clip-space position
+float windowDepth(vec4 clip)
+{
+#if defined(LOG_DEPTH)
+    return logDepth(clip.w);
+#elif defined(REVERSED_Z)
+    return gl_DepthRange.near + gl_DepthRange.diff * (clip.z / clip.w);
+#else
+    return 0.5 * gl_DepthRange.diff * (clip.z / clip.w) + 0.5 * (gl_DepthRange.near + gl_DepthRange.far);
+#endif
+}
+
+// Depth of the points closest to the camera
+float nearestDepth()
+{
+#ifdef REVERSED_Z
+    return gl_DepthRange.far;
+#else
+    return gl_DepthRange.near;
+#endif
+}
+
+#endif // DEPTH_GLSL
@@ -0,0 +1,72 @@
+#version 330 core
+
+// Pages sampled by a virtually textured body (VirtualTexture.cpp), drawn into
+// a target a fraction of the viewport: each fragment writes the page of the
+// level that fragmentShader.glsl samples at full resolution, lodBias making up
+// for the larger footprint of its pixels. Paired with vertexShader.glsl, or
+// the tessellation stages with TESSELLATED.
+#define VIRTUAL_FEEDBACK
+#include "depth.glsl"
+#include "virtualTexture.glsl"
+
+#if defined(IMPOSTOR)
+#include "impostor.glsl"
+in vec3 fPosition;
+flat in vec4 fSphere;
+flat in mat3 fRotation;
+#else
+#ifdef LOG_DEPTH
+in float fClipW;
+#endif
+#ifdef TESSELLATED
+#include "impostor.glsl"
+in vec3 fDirection; // In the frame of the body
+#else
+in vec2 fTexCoord;
+#endif
+#endif
+
+out uint request; // Texture, level and page, packed as decoded by VirtualTextureFeedback::end()
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+uniform uint textureIndex;
+uniform float lodBias;
+
+void main()
+{
+#if defined(IMPOSTOR)
+    vec3 position, n;
+    bool hit = traceImpostor(camPosition.xyz, fPosition, fSphere, position, n);
+    gl_FragDepth = impostorDepth(viewProjMat, position);
+    vec2 texCoord = sphereTexCoord(transpose(fRotation) * n);
+    vec2 texDx = dFdx(texCoord), texDy = dFdy(texCoord);
+    texDx.x -= round(texDx.x);
+    texDy.x -= round(texDy.x);
+    if (!hit)
+        discard;
+#else
+#ifdef LOG_DEPTH
+    gl_FragDepth = logDepth(fClipW);
+#endif
+#ifdef TESSELLATED
+    vec2 texCoord = sphereTexCoord(normalize(fDirection));
+    vec2 texDx = dFdx(texCoord), texDy = dFdy(texCoord);
+    texDx.x -= round(texDx.x);
+    texDy.x -= round(texDy.x);
+#else
+    vec2 texCoord = fTexCoord;
+    vec2 texDx = dFdx(texCoord), texDy = dFdy(texCoord);
+#endif
+#endif
+    int level = virtualLevel(texDx, texDy, lodBias);
+    ivec2 page = ivec2(virtualTexel(texCoord, level)) / PAGE_SIZE;
+    request = textureIndex << 24 | uint(level) << 20 | uint(page.y) << 10 | uint(page.x);
+}
@@ -1,14 +1,150 @@
 #version 330 core
 
+#ifdef LIGHT_STATS
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shading_language_420pack : require
+#endif
+
+// Variants are selected by the #defines injected by the application:
+//   EMISSIVE           flat emissive color (the sun), scaled by EMISSIVE_INTENSITY
+//   LIT                Phong lighting from the lights of the fragment's cluster,
+//                      with eclipse shadows from the sun
+//   LIT + TEXTURED     Phong lighting on the albedo texture
+//   VIRTUAL_TEXTURE    (with LIT + TEXTURED) the albedo from a virtual texture,
+//                      see virtualTexture.glsl
+//   GPU_DRIVEN         per-body material from gpuDrivenVertexShader.glsl
+//   IMPOSTOR           (with any of the above) ray-traced sphere on a square
+//   TERRAIN            (with LIT) patches of terrainVertexShader.glsl, textured
+//                      from the direction of each fragment
+//   TESSELLATED        (with any of the above but IMPOSTOR) vertices of
+//                      tessEvaluationShader.glsl, textured as TERRAIN
+//   LIGHT_STATS        (with LIT) count the lights evaluated per fragment
+//   REVERSED_Z, LOG_DEPTH  depth mode, see depth.glsl
+// The material constants are injected as well; the values below are fallbacks.
+#ifndef AMBIENT
+#define AMBIENT vec3(0.4, 0.4, 0.4)
+#endif
+#ifndef SHININESS
+#define SHININESS 32.0
+#endif
+#ifndef SPECULAR_COLOR
+#define SPECULAR_COLOR vec3(1.0, 1.0, 1.0)
+#endif
+#ifndef EMISSIVE_INTENSITY
+#define EMISSIVE_INTENSITY 1.0
+#endif
+#ifndef MAX_OCCLUDERS
+#define MAX_OCCLUDERS 8
+#endif
+
+#ifdef GPU_DRIVEN
+#define LIT
+#define TEXTURED
+flat in vec4 fColor;     // rgb: albedo or emissive color, a: albedo layer (negative when untextured)
+flat in float fEmissive;
+flat in uint fOccluderMask;
+uniform sampler2DArray albedoArray;
+#endif
+
+#include "depth.glsl"
+#ifdef VIRTUAL_TEXTURE
+#include "virtualTexture.glsl"
+#endif
+#if defined(LOG_DEPTH) && !defined(IMPOSTOR)
+in float fClipW;        // View distance
+#endif
+
+#if defined(IMPOSTOR)
+#include "impostor.glsl"
+in vec3 fPosition;      // Point of the impostor square in world space
+flat in vec4 fSphere;   // Center and radius of the body
+#ifdef TEXTURED
+flat in mat3 fRotation; // Orientation of the body
+#endif
+#else
+#ifdef LIT
 in vec3 fPosition;    // Fragment position in world space
 in vec3 fNormal;      // Fragment normal in world space
+#endif
+#if defined(TEXTURED) && (defined(TERRAIN) || defined(TESSELLATED))
+#include "impostor.glsl"
+in vec3 fDirection;   // In the frame of the body
+#elif defined(TEXTURED)
 in vec2 fTexCoord;  // Texture coordinates
+#endif
+#endif
 
 out vec4 color;       // // Shader output: the color response attached to this fragment
 
-uniform vec3 camPosition;  // Camera position
-uniform vec3 objectColor; //Color the object
-uniform int isSun;         // is the object the sun or not
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;   // Camera position
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    vec4 objectColor;   //Color the object
+    uint occluderMask;  // Bits of the ShadowBlock occluders that may shadow the object
+};
+
+#ifdef LIT
+// Lights binned per cluster by LightClusters.cpp: a cluster is a screen tile
+// times an exponential slice of view depth
+layout(std140) uniform LightingBlock {
+    ivec4 clusterDims;  // Tiles in x and y, depth slices, number of lights
+    vec4 clusterScale;  // Tiles per pixel in x and y, slices per unit of log(depth), slice bias
+};
+uniform samplerBuffer lightData;      // (position, range) then (color, 0) per light; range 0: unattenuated
+uniform usamplerBuffer clusterRanges; // (first index, count) per cluster
+uniform usamplerBuffer lightIndices;
+
+// Spheres that may eclipse the sun (light 0), selected by EclipseShadows.cpp
+layout(std140) uniform ShadowBlock {
+    vec4 lightSphere;             // Center and radius of the sun
+    vec4 occluders[MAX_OCCLUDERS];
+    ivec4 occluderCount;
+};
+
+// Fraction of the solar disc visible from p. Seen from p, the sun and each
+// occluder are discs of angular radii a and b, c apart (small angles); the
+// hidden fraction goes smoothly from none (c > a + b) to (b/a)^2 (the
+// occluder inside the sun, transit) or all of it (the sun inside, umbra).
+float sunVisibility(vec3 p, uint mask) {
+    vec3 toLight = lightSphere.xyz - p;
+    float lightDist = length(toLight);
+    vec3 lightDir = toLight / lightDist;
+    float a = lightSphere.w / lightDist;
+    float visibility = 1.0;
+    for (int k = 0; k < occluderCount.x; ++k) {
+        if ((mask & (1u << uint(k))) == 0u)
+            continue;
+        vec3 toOccluder = occluders[k].xyz - p;
+        float along = dot(toOccluder, lightDir);
+        if (along <= 0.0 || along >= lightDist)
+            continue; // Behind the fragment, or beyond the sun
+        float invDist = inversesqrt(dot(toOccluder, toOccluder));
+        float b = occluders[k].w * invDist;
+        float c = length(cross(toOccluder, lightDir)) * invDist;
+        float hidden = min(a, b) / a;
+        visibility *= 1.0 - hidden * hidden * (1.0 - smoothstep(abs(a - b), a + b, c));
+    }
+    return visibility;
+}
+#endif
+
+#ifdef LIGHT_STATS
+layout(std430, binding = 3) buffer LightStats {
+    uint statsFragments;
+    uint statsLights;
+    uint statsMaxLights;
+    uint statsHistogram[8]; // 0, 1, 2-3, 4-7, ..., 64 and more lights
+};
+#endif
 
 struct Material { sampler2D albedoTex;}; 
 
@@ -17,35 +153,124 @@ uniform Material material;
 
 void main() 
 {
-    if (isSun == 1) {
-        color = vec4(objectColor, 1.0);  // Just render Sun's base color
+#if defined(LOG_DEPTH) && !defined(IMPOSTOR)
+    gl_FragDepth = logDepth(fClipW);
+#endif
+#if defined(IMPOSTOR)
+    vec3 position, n;
+    bool hit = traceImpostor(camPosition.xyz, fPosition, fSphere, position, n);
+    gl_FragDepth = impostorDepth(viewProjMat, position);
+#ifdef TEXTURED
+    vec2 texCoord = sphereTexCoord(transpose(fRotation) * n);
+    // Derivatives without the jump of u across the seam, for the mip selection
+    vec2 texDx = dFdx(texCoord), texDy = dFdy(texCoord);
+    texDx.x -= round(texDx.x);
+    texDy.x -= round(texDy.x);
+#define SAMPLE_ALBEDO(tex, coord) textureGrad(tex, coord, texDx, texDy)
+#endif
+#else
+#ifdef LIT
+    vec3 position = fPosition;
+    vec3 n = normalize(fNormal); // Normalize the normal vector
+#endif
+#if defined(TEXTURED) && (defined(TERRAIN) || defined(TESSELLATED))
+    // Per fragment, as the patches do not follow the seam; the derivatives
+    // without its jump, as for the impostors
+    vec2 texCoord = sphereTexCoord(normalize(fDirection));
+    vec2 texDx = dFdx(texCoord), texDy = dFdy(texCoord);
+    texDx.x -= round(texDx.x);
+    texDy.x -= round(texDy.x);
+#define SAMPLE_ALBEDO(tex, coord) textureGrad(tex, coord, texDx, texDy)
+#elif defined(TEXTURED)
+    vec2 texCoord = fTexCoord;
+    vec2 texDx = dFdx(texCoord), texDy = dFdy(texCoord);
+#define SAMPLE_ALBEDO(tex, coord) texture(tex, coord)
+#endif
+#endif
+
+#ifdef EMISSIVE
+#ifdef IMPOSTOR
+    if (!hit)
+        discard;
+#endif
+    color = vec4(objectColor.rgb * EMISSIVE_INTENSITY, 1.0);  // Just render Sun's base color, beyond 1 with HDR
+#else
+
+#if defined(GPU_DRIVEN)
+    vec3 texColor = fColor.a < 0.0 ? fColor.rgb : SAMPLE_ALBEDO(albedoArray, vec3(texCoord, fColor.a)).rgb;
+#elif defined(VIRTUAL_TEXTURE)
+    vec3 texColor = sampleVirtual(texCoord, texDx, texDy);
+#elif defined(TEXTURED)
+    vec3 texColor = SAMPLE_ALBEDO(material.albedoTex, texCoord).rgb;
+#else
+    vec3 texColor = objectColor.rgb;
+#endif
+#ifdef IMPOSTOR
+    if (!hit)
+        discard; // After the texture fetch, which needs the derivatives of the whole quad
+#endif
+#ifdef GPU_DRIVEN
+    if (fEmissive > 0.5) {
+        color = vec4(fColor.rgb * EMISSIVE_INTENSITY, 1.0);
         return;
     }
+#endif
 
-    vec3 texColor = texture(material.albedoTex, fTexCoord).rgb;
+    // Cluster of the fragment
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterScale.xy), clusterDims.xy - 1);
+    float viewDepth = -(viewMat * vec4(position, 1.0)).z;
+    int slice = clamp(int(floor(log(viewDepth) * clusterScale.z + clusterScale.w)), 0, clusterDims.z - 1);
+    uvec2 cluster = texelFetch(clusterRanges, tile.x + clusterDims.x * (tile.y + clusterDims.y * slice)).xy;
 
-    vec3 n = normalize(fNormal); // Normalize the normal vector
-    vec3 lightPosition = vec3(0.0, 0.0, 0.0);
-    vec3 l = normalize(lightPosition-fPosition); // Light direction (hardcoded)
+#ifdef GPU_DRIVEN
+    float sunShadow = sunVisibility(position, fOccluderMask);
+#else
+    float sunShadow = sunVisibility(position, occluderMask);
+#endif
 
     // Ambient lighting  (constant low-intensity light)
-    vec3 ambient = vec3(0.4,0.4, 0.4); // Low ambient light intensity
+    vec3 ambient = AMBIENT; // Low ambient light intensity
 
-    // Diffuse lighting using Lambert's cosine law
-    vec3 lightSourceColor=vec3(1.0 ,1.0,1.0);
-    float diff = max(dot(n, l), 0.0);
-    vec3 diffuse = diff * lightSourceColor; // White light for diffuse component
+    float shininess = SHININESS;     // Shininess factor for specular highlight 
+    vec3 v = normalize(camPosition.xyz - position);       // Calculate view vector (v), pointing from fragment position to camera
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+    for (uint i = 0u; i < cluster.y; ++i) {
+        int light = int(texelFetch(lightIndices, int(cluster.x + i)).x);
+        vec4 lightPositionRange = texelFetch(lightData, 2 * light);
+        vec3 lightSourceColor = texelFetch(lightData, 2 * light + 1).rgb;
+        vec3 toLight = lightPositionRange.xyz - position;
+        float dist = length(toLight);
+        vec3 l = toLight / dist; // Light direction
 
+        // Inverse square falloff, windowed to reach zero at the range
+        float attenuation = light == 0 ? sunShadow : 1.0;
+        if (lightPositionRange.w > 0.0) {
+            float window = clamp(1.0 - pow(dist / lightPositionRange.w, 4.0), 0.0, 1.0);
+            attenuation *= window * window / (1.0 + dist * dist);
+        }
 
-    // Specular lighting using the Phong reflection model
-    float shininess = 32.0;     // Shininess factor for specular highlight 
-    vec3 v = normalize(camPosition - fPosition);       // Calculate view vector (v), pointing from fragment position to camera
-    vec3 r = reflect(-l, n);        // Reflect expects the incoming light vector, so we negate l // Calculate reflection vector (r) using reflect() function     
-    float spec = pow(max(dot(v, r), 0.0), shininess);       // Calculate specular lighting
-    vec3 specular = spec * vec3(1.0, 1.0, 1.0); // White specular highlights
+        // Diffuse lighting using Lambert's cosine law
+        float diff = max(dot(n, l), 0.0);
+        diffuse += diff * attenuation * lightSourceColor;
+
+        // Specular lighting using the Phong reflection model
+        vec3 r = reflect(-l, n);        // Reflect expects the incoming light vector, so we negate l
+        float spec = pow(max(dot(v, r), 0.0), shininess);
+        specular += spec * attenuation * lightSourceColor * SPECULAR_COLOR;
+    }
+#ifdef LIGHT_STATS
+    uint bucket = 0u;
+    for (uint c = cluster.y; c > 0u && bucket < 7u; c >>= 1)
+        ++bucket;
+    atomicAdd(statsFragments, 1u);
+    atomicAdd(statsLights, cluster.y);
+    atomicMax(statsMaxLights, cluster.y);
+    atomicAdd(statsHistogram[bucket], 1u);
+#endif
 
     // Combine all lighting components (ambient + diffuse + specular)
     vec3 finalColor =ambient+diffuse+specular;
     color = vec4(texColor*finalColor, 1.0);
-    return;
-}
\ No newline at end of file
+#endif
+}
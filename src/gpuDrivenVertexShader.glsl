@@ -0,0 +1,69 @@
+#version 430 core
+
+// Vertex shader of the GPU-driven path: per-body data is fetched from the
+// body buffer through the index written by the culling pass. With IMPOSTOR,
+// the vertices are the corners of a square in [-1, 1]^2 that is turned to
+// face the camera, and fragmentShader.glsl ray-traces the sphere inside.
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoord;
+layout(location=3) in uint vBodyIndex; // per instance, from the compacted visible list
+
+struct Body {
+    mat4 modelMatrix;
+    vec4 boundingSphere;
+    vec4 color;    // rgb: albedo or emissive color, a: albedo layer (negative when untextured)
+    vec4 material; // x: 1 for emissive bodies, y: mask of the occluders that may shadow the body
+};
+
+layout(std430, binding = 0) readonly buffer BodyBuffer { Body bodies[]; };
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+#ifdef IMPOSTOR
+#include "impostor.glsl"
+out vec3 fPosition;
+flat out vec4 fSphere;
+flat out mat3 fRotation;
+#else
+out vec3 fNormal;
+out vec3 fPosition;
+out vec2 fTexCoord;
+#endif
+flat out vec4 fColor;
+flat out float fEmissive;
+flat out uint fOccluderMask;
+#if defined(LOG_DEPTH) && !defined(IMPOSTOR)
+out float fClipW;
+#endif
+
+void main()
+{
+    Body body = bodies[vBodyIndex];
+#ifdef IMPOSTOR
+    fSphere = body.boundingSphere;
+    fRotation = mat3(body.modelMatrix) / body.boundingSphere.w;
+    vec4 worldPosition = vec4(impostorCorner(fSphere.xyz, fSphere.w, camPosition.xyz, vPosition.xy), 1.0);
+    fPosition = vec3(worldPosition);
+#else
+    vec4 worldPosition = body.modelMatrix * vec4(vPosition, 1.0);
+    fPosition = vec3(worldPosition);
+    fNormal = mat3(body.modelMatrix) * vNormal; // Bodies are uniformly scaled; the fragment shader normalizes
+    fTexCoord = vTexCoord;
+#endif
+    fColor = body.color;
+    fEmissive = body.material.x;
+    fOccluderMask = uint(body.material.y);
+    gl_Position = viewProjMat * worldPosition;
+#if defined(LOG_DEPTH) && !defined(IMPOSTOR)
+    fClipW = gl_Position.w;
+#endif
+}
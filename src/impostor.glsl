@@ -0,0 +1,47 @@
+// Ray-traced sphere impostors, shared by the vertex and fragment shaders of
+// both render paths through #include "impostor.glsl". A body is drawn as a
+// camera-facing square covering its silhouette, and each fragment intersects
+// its view ray with the exact sphere.
+#include "depth.glsl"
+
+// Corner of the square for a sphere (center, radius) seen from eye; corner is
+// in [-1, 1]^2. The square lies in the plane of the center, where the
+// silhouette cone has a radius of r*d/sqrt(d^2 - r^2).
+vec3 impostorCorner(vec3 center, float radius, vec3 eye, vec2 corner)
+{
+    vec3 toEye = eye - center;
+    float d = length(toEye);
+    vec3 w = toEye / d;
+    vec3 u = normalize(cross(abs(w.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), w));
+    vec3 v = cross(w, u);
+    float halfSize = radius * d / sqrt(max(d * d - radius * radius, 1e-6 * d * d));
+    return center + halfSize * (corner.x * u + corner.y * v);
+}
+
+// Intersects the ray from eye through a point of the square with the sphere.
+// On a miss, position and normal are those of the closest point of the
+// silhouette, so that derivatives stay meaningful until the fragment is
+// discarded.
+bool traceImpostor(vec3 eye, vec3 quadPoint, vec4 sphere, out vec3 position, out vec3 normal)
+{
+    vec3 dir = normalize(quadPoint - eye);
+    vec3 oc = eye - sphere.xyz;
+    float b = dot(oc, dir);
+    float h = b * b - dot(oc, oc) + sphere.w * sphere.w;
+    position = eye + (-b - sqrt(max(h, 0.0))) * dir;
+    normal = normalize(position - sphere.xyz);
+    return h >= 0.0;
+}
+
+// Window-space depth of a world-space point
+float impostorDepth(mat4 viewProj, vec3 position)
+{
+    return windowDepth(viewProj * vec4(position, 1.0));
+}
+
+// Texture coordinates of Mesh::genSphere() for an object-space direction
+vec2 sphereTexCoord(vec3 n)
+{
+    float u = atan(n.z, n.x) * 0.15915494; // 1/(2 pi)
+    return vec2(u < 0.0 ? u + 1.0 : u, acos(clamp(n.y, -1.0, 1.0)) * 0.31830989); // 1/pi
+}
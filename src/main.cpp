@@ -24,32 +24,220 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <map>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <random>
+#include <limits>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "Atmosphere.hpp"
+#include "Mesh.hpp"
+#include "ParticleBelt.hpp"
+#include "PostProcess.hpp"
+#include "Camera.hpp"
+#include "CameraController.hpp"
+#include "Exporter.hpp"
+#include "EclipseShadows.hpp"
+#include "Ephemeris.hpp"
+#include "GLExtensions.hpp"
+#include "GLState.hpp"
+#include "GLTrace.hpp"
+#include "GpuDrivenRenderer.hpp"
+#include "LightClusters.hpp"
+#include "ProceduralSphere.hpp"
+#include "ProgramCache.hpp"
+#include "Profiler.hpp"
+#include "Scene.hpp"
+#include "ShaderLibrary.hpp"
+#include "SphereImpostor.hpp"
+#include "TessellatedSphere.hpp"
+#include "Terrain.hpp"
+#include "TextureStreamer.hpp"
+#include "UniformBlocks.hpp"
+#include "UniformRing.hpp"
+#include "VirtualTexture.hpp"
+
 // constants
-const static float kSizeSun = 1;
-const static float kSizeEarth = 0.5;
-const static float kSizeMoon = 0.25;
-const static float kRadOrbitEarth = 10;
-const static float kRadOrbitMoon = 2;
+// Synthetic asteroid belt between Mars and Jupiter (--bodies)
+const static float kBeltInnerRadius = 16.5f;
+const static float kBeltOuterRadius = 18.5f;
+const static float kBeltThickness = 0.6f;
+const static float kAsteroidMinSize = 0.02f;
+const static float kAsteroidMaxSize = 0.08f;
+const static long kBeltMaxBodies = 16*1024*1024; // Per particle belt (--main-belt, --kuiper-belt), 36 bytes each
+
+// The tessellated sphere (--sphere tessellated) cuts the patch edges into
+// pieces of about this many pixels on screen
+const static float kTessellationEdgePixels = 8.0f;
+
+// The automatic render path switches to the GPU-driven one from this many bodies
+const static size_t kGpuDrivenMinBodies = 256;
+
+// Clip planes of the camera; the far plane is ignored with reversed-Z, and
+// bounds the logarithmic depth
+const static float kCameraNear = 0.1f;
+const static float kCameraFar = 80.1f;
+
+// Close approaches (--approach): the near plane comes down to half the
+// distance of the closest terrain patch, not below kCameraMinNear. The
+// camera hovers where the sun is kApproachSunAngle from the vertical, and
+// looks kApproachPitch below the horizon.
+const static float kCameraMinNear = 1e-6f;
+const static double kApproachSunAngle = 60.0;
+const static double kApproachPitch = 10.0;
+
+// The camera controller integrates at most this many seconds per frame, so
+// that a stall does not throw the camera away
+const static double kMaxFrameStep = 0.1;
+
+// Bounds of the export options; the frame size is checked against the
+// renderbuffer limit of the driver as well
+const static int kExportMaxSize = 16384;
+const static long kExportMaxThreads = 256;
+const static long kExportMaxPbos = 16;
+
+// Light source, sent with the per-frame uniforms; it sits on the first
+// emissive body of the scene
+const static glm::vec3 kLightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+
+// HDR: the sun is emissive beyond 1 so that it blooms. Budgets of the
+// post-processing at 1080p, on a discrete GPU and on a software rasterizer
+// (llvmpipe on one thread, where each full-screen pass costs tens of ms and
+// the chain measures 180-210 ms)
+const static float kSunIntensity = 6.0f;
+const static double kPostBudgetMs = 1.0;
+const static double kPostBudgetSoftwareMs = 250.0;
+
+// Solar irradiance that lights the atmospheres, relative to kLightColor
+const static float kAtmosphereIrradiance = 20.0f;
+
+// Ephemeris (--ephemeris): scene units per astronomical unit, which keeps the
+// Earth on the orbit radius of the default scene, and days per simulated second
+const static double kEphemerisUnitsPerAu = 10.0;
+const static double kEphemerisDaysPerSecond = 10.0;
+const static double kJ2000 = 2451545.0; // Julian day of the default epoch
+const static double kObliquityJ2000 = 23.4392911; // Degrees between the equator of the ephemeris and the ecliptic
+const static int kEphemerisBenchmarkRounds = 5; // Timed passes of each path, the best one is reported
+
+// Virtual textures: a cache of 16x16 pages (2048x2048 texels) per texture
+const static int kVirtualCacheSlots = 16;
+const static int kVirtualPagesPerFrame = 16; // Upload budget, 768 KB per frame and texture
+const static int kVirtualFeedbackDivisor = 8;
+const static int kVirtualFallbackWidth = 2048; // Plain texture of the GPU-driven path
+
+// Texture streaming: mip levels up to 64 texels wide are loaded at startup,
+// the finer ones as the bodies grow on screen
+const static int kStreamCoarseWidth = 64;
+const static size_t kStreamBudget = 2048*1024; // Bytes uploaded per frame
+const static size_t kTextureBudget = 256; // MB of GPU memory for the streamed textures
+
+// Synthetic point lights (spacecraft), added with --lights
+const static float kPointLightInnerRadius = 4.0f;
+const static float kPointLightOuterRadius = 36.0f;
+const static float kPointLightMinRange = 1.5f;
+const static float kPointLightMaxRange = 4.0f;
+const static float kPointLightIntensity = 3.0f;
+
+// Material constants, compiled into the shaders as #defines
+const static glm::vec3 kAmbient = glm::vec3(0.4f, 0.4f, 0.4f);
+const static float kShininess = 32.0f;
+const static glm::vec3 kSpecularColor = glm::vec3(1.0f, 1.0f, 1.0f);
 
 // Window parameters
 GLFWwindow *g_window = nullptr;
+int g_viewportWidth = 1024; // For the screen tiles of the light clusters
+int g_viewportHeight = 768; // For the projected size of bodies in the culling pass
+
+// Command-line options
+struct Options {
+  int exportFrames = 0;       // Number of frames to export offline (0 = interactive)
+  double exportStartTime = 0; // Simulation time of the first exported frame, in seconds
+  Exporter::Settings exportSettings;
+  bool persistentMapping = true; // Write uniforms through a persistently mapped buffer when supported
+  enum RenderPath { RENDER_PATH_AUTO, RENDER_PATH_CPU, RENDER_PATH_GPU } renderPath = RENDER_PATH_AUTO;
+  int numAsteroids = 0;       // Synthetic bodies added to the scene
+  // Sphere read from vertex buffers, generated in the vertex shader, or refined by the tessellation stages (GL 4.0)
+  enum SpherePath { SPHERE_BUFFERED, SPHERE_PROCEDURAL, SPHERE_TESSELLATED, NUM_SPHERE_PATHS } spherePath = SPHERE_BUFFERED;
+  int sphereResolution = 16;
+  int benchmarkFrames = 0;    // Frames rendered per sphere path by the benchmark (0 = no benchmark)
+  float impostorPixelRadius = 16.0f; // Bodies smaller than this on screen are ray-traced impostors (0 = never)
+  size_t mainBeltCount = 0;   // Bodies of the particle belts, whose orbits are evaluated on the GPU
+  size_t kuiperBeltCount = 0;
+  uint32_t beltSeed = 1;
+  int numLights = 0;          // Synthetic point lights, besides the sun
+  bool lightStats = false;    // Count the lights evaluated per fragment (GL 4.3)
+  bool hdr = true;            // Half-float scene, bloom and tone mapping
+  float exposure = 1.0f;
+  double postBudgetMs = 0.0;  // GPU budget of the post-processing (0 = per renderer)
+  bool atmospheres = true;    // Scattering shells around the planets that have an atmosphere
+  DepthMode depthMode = DEPTH_STANDARD;
+  std::string scenePath = "scenes/solarSystem.json"; // Text description, or its compiled binary form
+  std::string compiledScenePath; // Compile the scene to this file and exit
+  std::string ephemerisPath;  // JPL DE binary file positioning the planets of the scene
+  double epoch = kJ2000;      // Julian day (TDB) at simulation time 0
+  int ephemerisBenchmark = 0; // Epochs evaluated by the ephemeris benchmark (0 = no benchmark)
+  std::string tileImagePath;  // Cut this image into the pages of a virtual texture and exit
+  std::string tiledPath;
+  int pagesPerFrame = kVirtualPagesPerFrame;
+  bool textureStreaming = true; // Stream the mip levels of the textures; load them whole otherwise
+  size_t streamBudget = kStreamBudget;
+  size_t textureBudget = kTextureBudget*1024*1024; // Bytes (0 = no limit)
+  bool textureStats = false;  // Report the residency of the streamed textures every frame
+  std::string approachBody;   // Hover over this body (empty = the default camera)
+  double approachAltitudeKm = 0.0;
+#ifdef GL_TRACE
+  std::string glTracePath;    // Per-frame report of the GL calls (empty = not intercepted)
+#endif
+};
+Options g_options;
+
+Exporter g_exporter;
+ProgramCache g_programCache;
+StartupReport g_startupReport;
 
 // GPU objects
-GLuint g_program = 0; // A GPU program contains at least a vertex shader and a fragment shader
+ShaderLibrary g_shaders; // Specialized variants of the main GPU program (vertex and fragment shaders)
+ShaderLibrary g_impostorShaders; // Same variants, ray-tracing the sphere on a camera-facing square
+UniformRing g_uniformRing; // Per-frame and per-object uniform blocks
+std::vector<GLintptr> g_objectBlockOffsets; // Offset of each body's ObjectBlock in the ring, this frame
+GLuint g_frameBlockBuffer = 0; // FrameBlock, outside the ring: rewritten only when the camera or the light moves
+FrameBlock g_frameBlock;       // As last uploaded
+size_t g_frameBlockFrames = 0;
+size_t g_frameBlockUploads = 0;
+size_t g_transformUpdates = 0;  // Body transforms set by update()
+size_t g_transformChanges = 0;  // Those that differed, with a new normal matrix
+GpuDrivenRenderer g_gpuRenderer; // Compute culling and multi-draw indirect (GL 4.3)
+bool g_gpuDriven = false;        // Render path selected at startup; the per-draw loop otherwise
+std::vector<GpuBody> g_gpuBodies;
+PostProcess g_postProcess; // HDR target, bloom chain and tone mapping
+LightClusters g_lightClusters; // Lights binned per view-space cluster, every frame
+EclipseShadows g_eclipseShadows; // Occluders of the sun, selected every frame
+Atmosphere g_atmosphere; // Scattering tables and shells of the atmospheres
+std::vector<size_t> g_atmosphereBodies; // Body of each atmosphere profile
+std::vector<glm::vec4> g_atmosphereSpheres; // Their bounding spheres, this frame
+std::vector<glm::mat4> g_relativeModels; // Model matrix of each body relative to the camera, this frame
+std::vector<glm::vec4> g_bodySpheres;   // Bounding sphere of each body, relative to the camera, this frame
+std::vector<bool> g_castsShadow;        // Per body: lit bodies occlude the sun, the sun does not
+std::vector<uint32_t> g_occluderMasks;  // Per body, this frame
+std::vector<std::unique_ptr<VirtualTexture>> g_virtualTextures; // Textures of the scene tiled for streaming
+VirtualTextureFeedback g_virtualFeedback; // Pages they need, found every frame on the per-draw path
+TextureStreamer g_textureStreamer; // Mip levels of the other textures, on the per-draw path
+Terrain g_terrain; // Cube-sphere terrain of the bodies with a height map, on the per-draw path
+ShaderLibrary g_terrainShaders; // Variants drawing its patches
 
 // OpenGL identifiers
 GLuint g_vao = 0;
@@ -63,189 +251,77 @@ std::vector<float> g_vertexPositions;
 std::vector<unsigned int> g_triangleIndices;
 std::vector<float> g_vertexColors;
 
-glm::mat4 modelSun, modelEarth, modelMoon, modelMars, modelVenus, modelUranus, modelSaturn, modelNeptune, modelJupiter, modelMercury;
-
-GLuint g_earthTexID, g_moonTexID, g_marsTexID, g_venusTexID, g_uranusTexID, g_saturnTexID, g_neptuneTexID, g_jupiterTexID, g_mercuryTexID;
-
-class Mesh {
-public:
-    // Initializes the geometry buffer
-void init() {
-    // Set up the VAO, VBOs, and IBO for the mesh geometry
-
-    // Create and bind the Vertex Array Object (VAO)
-        #ifdef _MY_OPENGL_IS_33_
-        glGenVertexArrays(1, &m_vao); // If your system doesn't support OpenGL 4.5, you should use this instead of glCreateVertexArrays.
-        #else
-        glCreateVertexArrays(1, &m_vao);
-        #endif
-
-        glBindVertexArray(m_vao);
-
-        // Generate and bind the Vertex Buffer Object (VBO) for positions
-        glGenBuffers(1, &m_posVbo);
-        glBindBuffer(GL_ARRAY_BUFFER, m_posVbo);
-        glBufferData(GL_ARRAY_BUFFER, m_vertexPositions.size() * sizeof(float), m_vertexPositions.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0); // position is index 0 in the shader
-
-        // Generate and bind the Vertex Buffer Object (VBO) for normals
-        glGenBuffers(1, &m_normalVbo);
-        glBindBuffer(GL_ARRAY_BUFFER, m_normalVbo);
-        glBufferData(GL_ARRAY_BUFFER, m_vertexNormals.size() * sizeof(float), m_vertexNormals.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(1); // normals are index 1 in the shader
-
-        glGenBuffers(1, &m_texCoordVbo);
-        glBindBuffer(GL_ARRAY_BUFFER, m_texCoordVbo);
-        glBufferData(GL_ARRAY_BUFFER, m_vertexTexCoords.size() * sizeof(float), m_vertexTexCoords.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0); // Texture coordinates are at index 2
-        glEnableVertexAttribArray(2);
-
-        // Generate and bind the Index Buffer Object (IBO) for triangle indices
-        size_t indexBufferSize = sizeof(unsigned int)*m_triangleIndices.size();
-        #ifdef _MY_OPENGL_IS_33_  //Should be irrelevant since Vincent's laptop has OpenGL version 4.6
-            glGenBuffers(1, &m_ibo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, m_triangleIndices.data(), GL_STATIC_DRAW);
-        #else
-            glCreateBuffers(1, &m_ibo);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-            glNamedBufferStorage(m_ibo, indexBufferSize, m_triangleIndices.data(), GL_DYNAMIC_STORAGE_BIT);
-        #endif
-            // Unbind the VAO for now
-            glBindVertexArray(0);
-    }
-    
-    // Called in the main rendering loop to render the mesh
-void render() {
-        // Bind the VAO and issue the drawing commands
-        glBindVertexArray(m_vao);
-        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m_triangleIndices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-    }
-    
-    // Generates a unit sphere with the given resolution
-static std::shared_ptr<Mesh> genSphere(const size_t resolution) {
-      auto mesh = std::make_shared<Mesh>();
-
-          const float radius = 1.0f; // Unit sphere
-
-          const size_t latSegments = resolution; // Number of latitude segments
-          const size_t lonSegments = resolution; // Number of longitude segments
-
-          // Generate vertices and normals
-          for (size_t lat = 0; lat <= latSegments; ++lat) {
-              for (size_t lon = 0; lon <= lonSegments; ++lon) {
-                  float theta = M_PI/2.0-lat *M_PI / latSegments;  // latitude angle
-                  float phi = lon * 2.0f * M_PI / lonSegments; // longitude angle
-
-                  float x = radius * cosf(theta) * cosf(phi);
-                  float y = radius * cosf(theta) * sinf(phi);
-                  float z = radius * sinf(theta);
-
-                  // Vertex position
-                  mesh->m_vertexPositions.push_back(x);
-                  mesh->m_vertexPositions.push_back(z);
-                  mesh->m_vertexPositions.push_back(y);
-
-                  // Vertex normal (same as position for a unit sphere)
-                  mesh->m_vertexNormals.push_back(x/radius);
-                  mesh->m_vertexNormals.push_back(z/radius);
-                  mesh->m_vertexNormals.push_back(y/radius);
-
-                  // Texture coordinates
-                  float u = (float)lon / lonSegments;
-                  float v = (float)lat / latSegments;
-                  mesh->m_vertexTexCoords.push_back(u);
-                  mesh->m_vertexTexCoords.push_back(v);
-              }
-          }
-
-          // Generate indices for triangle strips.
-          for (size_t lat = 0; lat < latSegments; ++lat) {
-              for (size_t lon = 0; lon < lonSegments; ++lon) {
-                  unsigned int first = (lat * (lonSegments + 1)) + lon;
-                  unsigned int second = first + lonSegments + 1;
-
-                  // First triangle
-                  mesh->m_triangleIndices.push_back(first);
-                  mesh->m_triangleIndices.push_back(second);
-                  mesh->m_triangleIndices.push_back(first + 1);
-
-                  // Second triangle
-                  mesh->m_triangleIndices.push_back(second);
-                  mesh->m_triangleIndices.push_back(second + 1);
-                  mesh->m_triangleIndices.push_back(first + 1);
-              }
-          }
-
-          return mesh;
-        }
-
-private:
-    // Vertex positions for the mesh
-    std::vector<float> m_vertexPositions;
+// Celestial bodies: the records of the scene, then the synthetic asteroids
+Scene g_scene;
+size_t g_lightBody = 0; // First emissive body of the scene
+Ephemeris g_ephemeris;
+std::vector<Ephemeris::Target> g_ephemerisTargets; // Per scene body; NUM_TARGETS for the bodies that keep their orbit
+Ephemeris::State g_ephemerisStates[Ephemeris::NUM_TARGETS]; // At the last update()
+
+// Render state of a body
+struct Body {
+  glm::vec3 color;         // Emissive color, or albedo of untextured bodies
+  ShaderVariant variant;
+  GLuint texture;
+  glm::dmat4 modelMatrix;  // World space, in double precision (see renderScene())
+  int albedoLayer;         // Layer in the texture array of the GPU-driven path, -1 if none
+  int virtualTexture;      // Index in g_virtualTextures, -1 if none
+  int streamedTexture;     // Index in g_textureStreamer, -1 if none
+  int terrain;             // Index in g_terrain, -1 for the sphere
+  glm::mat3 normalMatrix;  // Inverse transpose of the rotation and scale of modelMatrix (setModelMatrix())
+};
 
-    // Vertex normals for the mesh
-    std::vector<float> m_vertexNormals;
+// Circular orbit of a synthetic asteroid
+struct Asteroid {
+  float radius;
+  float phase;
+  float speed;  // Angular speed, in radians per second
+  float height; // Offset from the orbital plane
+  float size;
+};
 
-    // Triangle indices for the mesh
-    std::vector<unsigned int> m_triangleIndices;
+// Circular orbit of a synthetic point light
+struct LightOrbit {
+  float radius;
+  float phase;
+  float speed;
+  float height;
+};
 
-    std::vector<float> m_vertexTexCoords;  // Texture coordinates
+std::vector<Body> g_bodies;
+std::vector<Asteroid> g_asteroids; // Orbits of g_bodies[g_scene.count() + i]
+std::vector<PointLight> g_lights; // The sun first, then the synthetic lights
+std::vector<glm::dvec3> g_lightPositions; // World position of each light; g_lights holds them relative to the camera
+std::vector<LightOrbit> g_lightOrbits; // Orbits of g_lights[1 + i]
+std::vector<size_t> g_drawOrder; // Bodies sorted by shader variant then texture, to minimize state changes
 
-    // OpenGL-related buffers
-    GLuint m_vao = 0;        // Vertex Array Object (VAO)
-    GLuint m_posVbo = 0;     // Vertex Buffer Object (VBO) for the positions
-    GLuint m_normalVbo = 0;  // Vertex Buffer Object (VBO) for the normals
-    GLuint m_ibo = 0;        // Index Buffer Object (IBO)
-    GLuint m_texCoordVbo = 0; //Vertex Buffer Object (VBO) for the texture coordinates
-};
 //Sphere mesh
 std::shared_ptr<Mesh> sphere;
+ProceduralSphere g_proceduralSphere; // Buffer-free alternative to sphere
+TessellatedSphere g_tessellatedSphere; // Alternative refined on the GPU by the projected size of the bodies
+Options::SpherePath g_spherePath = Options::SPHERE_BUFFERED;
+SphereImpostor g_sphereImpostor; // For bodies that cover few pixels
+ParticleBelt g_belts; // Main belt and Kuiper belt
+double g_simulationTime = 0.0; // Time of the last update(), which the belts evaluate their orbits at
+std::vector<bool> g_drawAsImpostor; // Per body, this frame
 
-
-// Basic camera model
-class Camera {
-public:
-  inline float getFov() const { return m_fov; }
-  inline void setFoV(const float f) { m_fov = f; }
-  inline float getAspectRatio() const { return m_aspectRatio; }
-  inline void setAspectRatio(const float a) { m_aspectRatio = a; }
-  inline float getNear() const { return m_near; }
-  inline void setNear(const float n) { m_near = n; }
-  inline float getFar() const { return m_far; }
-  inline void setFar(const float n) { m_far = n; }
-  inline void setPosition(const glm::vec3 &p) { m_pos = p; }
-  inline glm::vec3 getPosition() { return m_pos; }
-
-  inline glm::mat4 computeViewMatrix() const {
-    return glm::lookAt(m_pos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-  }
-
-  // Returns the projection matrix stemming from the camera intrinsic parameter.
-  inline glm::mat4 computeProjectionMatrix() const {
-    return glm::perspective(glm::radians(m_fov), m_aspectRatio, m_near, m_far);
-  }
-
-private:
-  glm::vec3 m_pos = glm::vec3(0, 0, 0);
-  float m_fov = 45.f;        // Field of view, in degrees
-  float m_aspectRatio = 1.f; // Ratio between the width and the height of the image
-  float m_near = 0.1f; // Distance before which geometry is excluded from the rasterization process
-  float m_far = 10.f; // Distance after which the geometry is excluded from the rasterization process
-};
 Camera g_camera;
+CameraController g_cameraController; // Interactive motion of g_camera, outside of close approaches
+LatencyMeter g_inputLatency; // From the input events to the swap of the frame that shows them
+size_t g_approachBody = 0; // Body the camera hovers over (--approach), g_scene.count() for none
 
 
 GLuint loadTextureFromFileToGPU(const std::string &filename) {
   // Loading the image in CPU memory using stb_image
   int width, height, numComponents;
   unsigned char *data = stbi_load(filename.c_str(), &width, &height, &numComponents, 0);
+  if(!data) {
+    std::cerr << "ERROR: Failed to load texture " << filename << std::endl;
+    return 0;
+  }
   GLuint texID; // OpenGL texture identifier
   glGenTextures(1, &texID); // generate an OpenGL texture container
-  glBindTexture(GL_TEXTURE_2D, texID); // activate the texture
+  g_glState.bindTexture(GL_TEXTURE_2D, texID); // activate the texture
   // Setup the texture filtering option and repeat mode; check www.opengl.org for details.
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -255,62 +331,53 @@ GLuint loadTextureFromFileToGPU(const std::string &filename) {
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
   // Free useless CPU memory
   stbi_image_free(data);
-  glBindTexture(GL_TEXTURE_2D, 0); // unbind the texture
+  g_glState.bindTexture(GL_TEXTURE_2D, 0); // unbind the texture
   return texID;
 }
 
 // Executed each time the window is resized. Adjust the aspect ratio and the rendering viewport to the current window.
 void windowSizeCallback(GLFWwindow* window, int width, int height) {
   g_camera.setAspectRatio(static_cast<float>(width)/static_cast<float>(height));
-  glViewport(0, 0, (GLint)width, (GLint)height); // Dimension of the rendering region in the window
+  g_glState.viewport(0, 0, (GLint)width, (GLint)height); // Dimension of the rendering region in the window
+  g_viewportWidth = width;
+  g_viewportHeight = height;
 }
 
-// Executed each time a key is entered.
+// Executed each time a key is entered. The camera keys are only tracked as
+// held or released; the controller moves the camera every frame. The input
+// latency is sampled from the presses that the camera responds to.
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
   if(action == GLFW_PRESS && key == GLFW_KEY_W) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    g_glState.polygonMode(GL_LINE);
   } else if(action == GLFW_PRESS && key == GLFW_KEY_F) {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    g_glState.polygonMode(GL_FILL);
   } else if(action == GLFW_PRESS && (key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q)) {
     glfwSetWindowShouldClose(window, true); // Closes the application if the escape key is pressed
-  } 
-  //Move camera down on Z-axis
-  else if((action == GLFW_PRESS || action == GLFW_REPEAT) && key == GLFW_KEY_X) {
-    const glm::vec3 camPosition = g_camera.getPosition();
-    g_camera.setPosition(glm::vec3(camPosition[0], camPosition[1]-1.0, camPosition[2]));
-  } 
-  // Move camera up on Z-axis
-  else if((action == GLFW_PRESS || action == GLFW_REPEAT) && key == GLFW_KEY_S) {
-    const glm::vec3 camPosition = g_camera.getPosition();
-    g_camera.setPosition(glm::vec3(camPosition[0], camPosition[1]+1.0, camPosition[2]));
-  } 
-  // Move camera up on Y-axis 
-  else if((action == GLFW_PRESS || action == GLFW_REPEAT) && key == GLFW_KEY_UP) {
-    const glm::vec3 camPosition = g_camera.getPosition();
-    g_camera.setPosition(glm::vec3(camPosition[0], camPosition[1], camPosition[2]-1.0));
-  } 
-  //  Move camera down on Y-axis
-  else if((action == GLFW_PRESS || action == GLFW_REPEAT) && key == GLFW_KEY_DOWN) {
-    const glm::vec3 camPosition = g_camera.getPosition();
-    g_camera.setPosition(glm::vec3(camPosition[0], camPosition[1], camPosition[2]+1.0));
-  } 
-  // Move camera right on X-axis
-  else if((action == GLFW_PRESS || action == GLFW_REPEAT) && key == GLFW_KEY_RIGHT) {
-    const glm::vec3 camPosition = g_camera.getPosition();
-    g_camera.setPosition(glm::vec3(camPosition[0]+1.0, camPosition[1], camPosition[2]));
-  } 
-  // Move camera left on X-axis
-  else if((action == GLFW_PRESS || action == GLFW_REPEAT) && key == GLFW_KEY_LEFT) {
-    const glm::vec3 camPosition = g_camera.getPosition();
-    g_camera.setPosition(glm::vec3(camPosition[0]-1.0, camPosition[1], camPosition[2]));
-  }
-  // Return camera to initial position
-  else if((action == GLFW_PRESS || action == GLFW_REPEAT) && key == GLFW_KEY_C) { //set back in starting position
-    const glm::vec3 camPosition = g_camera.getPosition();
-    g_camera.setPosition(glm::vec3(0.0, 0.0 , 30.0));
+  } else if(g_cameraController.onKey(key, action) && action == GLFW_PRESS) {
+    g_inputLatency.input();
   }
 }
 
+// Dragging with the left button orbits the camera around its target; the
+// press alone does not move it, the latency is sampled from the first motion
+void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+  double x, y;
+  glfwGetCursorPos(window, &x, &y);
+  g_cameraController.onMouseButton(button, action, x, y);
+}
+
+void cursorPosCallback(GLFWwindow* window, double x, double y) {
+  if(g_cameraController.onCursor(x, y))
+    g_inputLatency.input();
+}
+
+// The wheel zooms toward the target; at the zoom limits nothing changes and
+// the latency is not sampled
+void scrollCallback(GLFWwindow* window, double xOffset, double yOffset) {
+  if(g_cameraController.onScroll(yOffset))
+    g_inputLatency.input();
+}
+
 void errorCallback(int error, const char *desc) {
   std::cout <<  "Error " << error << ": " << desc << std::endl;
 }
@@ -330,6 +397,7 @@ void initGLFW() {
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE, g_options.exportFrames > 0 || g_options.benchmarkFrames > 0 ? GL_FALSE : GL_TRUE); // Exports and benchmarks render off-screen
 
   g_window = glfwCreateWindow(
     1024,768,
@@ -345,6 +413,9 @@ void initGLFW() {
   glfwMakeContextCurrent(g_window);
   glfwSetWindowSizeCallback(g_window, windowSizeCallback);
   glfwSetKeyCallback(g_window, keyCallback);
+  glfwSetMouseButtonCallback(g_window, mouseButtonCallback);
+  glfwSetCursorPosCallback(g_window, cursorPosCallback);
+  glfwSetScrollCallback(g_window, scrollCallback);
 }
 
 void initOpenGL() {
@@ -354,62 +425,368 @@ void initOpenGL() {
     glfwTerminate();
     std::exit(EXIT_FAILURE);
   }
+  loadGLExtensions(glfwGetProcAddress);
+#ifdef GL_TRACE
+  if(!g_options.glTracePath.empty() && !installGLTrace(g_options.glTracePath)) {
+    glfwTerminate();
+    std::exit(EXIT_FAILURE);
+  }
+#endif
+
+  // The initial state, known to g_glState from here on
+  int width, height;
+  glfwGetFramebufferSize(g_window, &width, &height);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+  g_glState.viewport(0, 0, width, height);
+  g_glState.polygonMode(GL_FILL);
 
   glCullFace(GL_BACK); // Specifies the faces to cull (here the ones pointing away from the camera)
-  glEnable(GL_CULL_FACE); // Enables face culling (based on the orientation defined by the CW/CCW enumeration).
+  g_glState.enable(GL_CULL_FACE); // Enables face culling (based on the orientation defined by the CW/CCW enumeration).
   glDepthFunc(GL_LESS);   // Specify the depth test for the z-buffer
-  glEnable(GL_DEPTH_TEST);      // Enable the z-buffer test in the rasterization
+  g_glState.enable(GL_DEPTH_TEST);      // Enable the z-buffer test in the rasterization
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // specify the background color, used any time the framebuffer is cleared
 }
 
-// Loads the content of an ASCII file in standard C++ string
-std::string file2String(const std::string &filename) {
-  std::ifstream t(filename.c_str());
-  std::stringstream buffer;
-  buffer << t.rdbuf();
-  return buffer.str(); 
+// Reversed-Z needs glClipControl (GL 4.5); the logarithmic depth written by
+// the shaders is the fallback. Off-screen targets get a floating-point depth
+// buffer in reversed mode, which is what makes it precise.
+void initDepthMode() {
+  if(g_options.depthMode == DEPTH_REVERSED && !g_glCaps.clipControl) {
+    std::cerr << "ERROR: Reversed-Z needs glClipControl (OpenGL 4.5), falling back to logarithmic depth" << std::endl;
+    g_options.depthMode = DEPTH_LOGARITHMIC;
+  }
+  g_camera.setDepthMode(g_options.depthMode);
+  if(g_options.depthMode == DEPTH_REVERSED) {
+    glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+    glDepthFunc(GL_GREATER);
+    glClearDepth(0.0);
+    g_options.exportSettings.depthFormat = GL_DEPTH_COMPONENT32F;
+  }
+  const char *notes[] = { "standard, 24-bit", "reversed-Z, 32-bit float", "logarithmic, written per fragment" };
+  g_startupReport.add("depth", 0.0, notes[g_options.depthMode]);
+}
+
+GLenum depthFormat() {
+  return g_options.depthMode == DEPTH_REVERSED ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24;
+}
+
+// Selects the depth convention of depth.glsl
+std::string depthDefines() {
+  if(g_options.depthMode == DEPTH_REVERSED)
+    return "#define REVERSED_Z\n";
+  if(g_options.depthMode == DEPTH_LOGARITHMIC)
+    return "#define LOG_DEPTH\n#define LOG_DEPTH_FAR " + std::to_string(kCameraFar) + "\n";
+  return "";
+}
+
+// Formats a vector as a GLSL vec3 constructor
+std::string glslVec3(const glm::vec3 &v) {
+  return "vec3(" + std::to_string(v.x) + ", " + std::to_string(v.y) + ", " + std::to_string(v.z) + ")";
+}
+
+// The bodies of the scene, whose records stay in the mapped file, then the
+// synthetic asteroids
+void initBodies() {
+  Timer timer;
+  if(!g_scene.load(g_options.scenePath)) {
+    glfwTerminate();
+    std::exit(EXIT_FAILURE);
+  }
+  g_lightBody = g_scene.count();
+  for(size_t i = 0; i < g_scene.count() && g_lightBody == g_scene.count(); ++i)
+    if(g_scene.body(i).flags & SceneBody::EMISSIVE)
+      g_lightBody = i;
+  if(g_lightBody == g_scene.count()) {
+    std::cerr << "ERROR: The scene " << g_options.scenePath << " has no emissive body to carry the light" << std::endl;
+    glfwTerminate();
+    std::exit(EXIT_FAILURE);
+  }
+  const double loadMs = timer.elapsedMs();
+
+  // Render state only; the description is read from the records in place
+  g_bodies.resize(g_scene.count());
+  for(size_t i = 0; i < g_scene.count(); ++i) {
+    const SceneBody &record = g_scene.body(i);
+    Body &body = g_bodies[i];
+    body.color = glm::vec3(record.color[0], record.color[1], record.color[2]);
+    body.variant = (record.flags & SceneBody::EMISSIVE) ? SHADER_EMISSIVE : record.texture ? SHADER_LIT_TEXTURED : SHADER_LIT_UNTEXTURED;
+    body.texture = 0;
+    body.modelMatrix = glm::dmat4(1.0);
+    body.albedoLayer = -1;
+    body.virtualTexture = -1;
+    body.streamedTexture = -1;
+    body.terrain = -1;
+    body.normalMatrix = glm::mat3(1.0f);
+  }
+
+  // Fixed seed, so that exports are reproducible
+  std::mt19937 rng(2024);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  g_asteroids.resize(g_options.numAsteroids);
+  for(Asteroid &asteroid : g_asteroids) {
+    asteroid.radius = kBeltInnerRadius + (kBeltOuterRadius - kBeltInnerRadius)*unit(rng);
+    asteroid.phase = 2.0f*static_cast<float>(M_PI)*unit(rng);
+    asteroid.speed = 0.3f*std::pow(15.0f/asteroid.radius, 1.5f); // Kepler's third law, scaled on Mars
+    asteroid.height = kBeltThickness*(unit(rng) - 0.5f);
+    asteroid.size = kAsteroidMinSize + (kAsteroidMaxSize - kAsteroidMinSize)*unit(rng);
+    const float shade = 0.35f + 0.3f*unit(rng);
+    g_bodies.push_back({ glm::vec3(shade, 0.9f*shade, 0.8f*shade), SHADER_LIT_UNTEXTURED, 0, glm::dmat4(1.0), -1, -1, -1, -1, glm::mat3(1.0f) });
+  }
+  g_startupReport.add("scene", timer.elapsedMs(), std::to_string(g_scene.count()) + " bodies, " + (g_scene.mapped() ? "mapped" : "compiled")
+                      + " from " + g_options.scenePath + " in " + std::to_string(static_cast<int>(loadMs)) + " ms");
 }
 
-// Loads and compile a shader, before attaching it to a program
-void loadShader(GLuint program, GLenum type, const std::string &shaderFilename) {
-  GLuint shader = glCreateShader(type); // Create the shader, e.g., a vertex shader to be applied to every single vertex of a mesh
-  std::string shaderSourceString = file2String(shaderFilename); // Loads the shader source from a file to a C++ string
-  const GLchar *shaderSource = (const GLchar *)shaderSourceString.c_str(); // Interface the C++ string through a C pointer
-  glShaderSource(shader, 1, &shaderSource, NULL); // load the vertex shader code
-  glCompileShader(shader);
-  GLint success;
-  GLchar infoLog[512];
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if(!success) {
-    glGetShaderInfoLog(shader, 512, NULL, infoLog);
-    std::cout << "ERROR in compiling " << shaderFilename << "\n\t" << infoLog << std::endl;
+std::string materialDefines() {
+  return "#define AMBIENT " + glslVec3(kAmbient) + "\n"
+    "#define SHININESS " + std::to_string(kShininess) + "\n"
+    "#define SPECULAR_COLOR " + glslVec3(kSpecularColor) + "\n"
+    "#define MAX_OCCLUDERS " + std::to_string(kMaxOccluders) + "\n"
+    "#define EMISSIVE_INTENSITY " + std::to_string(g_options.hdr ? kSunIntensity : 1.0f) + "\n"
+    + (g_options.lightStats ? "#define LIGHT_STATS\n" : "")
+    + VirtualTexture::defines()
+    + depthDefines();
+}
+
+// Lights and shadows, shared by both render paths
+void setupLighting(GLuint program) {
+  LightClusters::setupProgram(program);
+  const GLuint shadowBlock = glGetUniformBlockIndex(program, "ShadowBlock");
+  if(shadowBlock != GL_INVALID_INDEX)
+    glUniformBlockBinding(program, shadowBlock, SHADOW_BLOCK_BINDING);
+}
+
+void setupProgram(GLuint program) {
+  glUniform1i(glGetUniformLocation(program, "material.albedoTex"), 0); // texture unit 0
+  glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameBlock"), FRAME_BLOCK_BINDING);
+  glUniformBlockBinding(program, glGetUniformBlockIndex(program, "ObjectBlock"), OBJECT_BLOCK_BINDING);
+  setupLighting(program);
+  VirtualTexture::setupProgram(program);
+  Terrain::setupProgram(program);
+}
+
+// (Re)starts the shader variants of the per-draw path, for the buffered, the
+// procedural or the tessellated sphere, and their impostor counterparts
+void initShaderLibrary(Options::SpherePath spherePath) {
+  const std::vector<ShaderStage> stages = { { GL_VERTEX_SHADER, "vertexShader.glsl" }, { GL_FRAGMENT_SHADER, "fragmentShader.glsl" } };
+  const std::vector<ShaderStage> tessellatedStages = { { GL_VERTEX_SHADER, "tessVertexShader.glsl" },
+    { GL_TESS_CONTROL_SHADER, "tessControlShader.glsl" }, { GL_TESS_EVALUATION_SHADER, "tessEvaluationShader.glsl" },
+    { GL_FRAGMENT_SHADER, "fragmentShader.glsl" } };
+  g_shaders.clear();
+  if(spherePath == Options::SPHERE_TESSELLATED)
+    g_shaders.init(&g_programCache, tessellatedStages, materialDefines() + "#define TESSELLATED\n", setupProgram);
+  else
+    g_shaders.init(&g_programCache, stages, materialDefines() + (spherePath == Options::SPHERE_PROCEDURAL ? "#define PROCEDURAL_SPHERE\n" : ""), setupProgram);
+  g_impostorShaders.clear();
+  g_impostorShaders.init(&g_programCache, stages, materialDefines() + "#define IMPOSTOR\n", setupProgram);
+  const std::vector<ShaderStage> terrainStages = { { GL_VERTEX_SHADER, "terrainVertexShader.glsl" }, { GL_FRAGMENT_SHADER, "fragmentShader.glsl" } };
+  g_terrainShaders.clear();
+  g_terrainShaders.init(&g_programCache, terrainStages, materialDefines() + "#define TERRAIN\n", setupProgram);
+}
+
+// (Re)creates the feedback programs of the virtual textures, which draw the
+// meshes with the sphere path of the scene
+void initVirtualFeedback() {
+  g_virtualFeedback.clear();
+  if(!g_virtualFeedback.init(g_programCache, materialDefines(), kVirtualFeedbackDivisor, depthFormat(),
+                             g_spherePath == Options::SPHERE_TESSELLATED, [](GLuint program) {
+       glUniformBlockBinding(program, glGetUniformBlockIndex(program, "FrameBlock"), FRAME_BLOCK_BINDING);
+       glUniformBlockBinding(program, glGetUniformBlockIndex(program, "ObjectBlock"), OBJECT_BLOCK_BINDING);
+       Terrain::setupProgram(program);
+     })) {
+    std::cerr << "ERROR: Failed to create the feedback programs of the virtual textures, drawing their coarsest level" << std::endl;
+    g_virtualFeedback.clear();
   }
-  glAttachShader(program, shader);
-  glDeleteShader(shader);
 }
 
+// Variants used by the scene are compiled now (in the background when the
+// driver supports it), the others on first use
+void prefetchUsedVariants() {
+  bool used[NUM_SHADER_VARIANTS] = { false };
+  bool usedByTerrain[NUM_SHADER_VARIANTS] = { false };
+  for(const Body &body : g_bodies) {
+    used[body.variant] = true;
+    usedByTerrain[body.variant] = usedByTerrain[body.variant] || body.terrain >= 0;
+  }
+  for(int v = 0; v < NUM_SHADER_VARIANTS; ++v) {
+    if(!used[v])
+      continue;
+    g_shaders.prefetch(static_cast<ShaderVariant>(v));
+    if(g_options.impostorPixelRadius > 0.0f)
+      g_impostorShaders.prefetch(static_cast<ShaderVariant>(v));
+    if(usedByTerrain[v] && g_spherePath != Options::SPHERE_TESSELLATED)
+      g_terrainShaders.prefetch(static_cast<ShaderVariant>(v));
+  }
+}
 
 void initGPUprogram() {
-  g_program = glCreateProgram(); // Create a GPU program, i.e., two central shaders of the graphics pipeline
-  loadShader(g_program, GL_VERTEX_SHADER, "vertexShader.glsl");
-  loadShader(g_program, GL_FRAGMENT_SHADER, "fragmentShader.glsl");
-  glLinkProgram(g_program); // The main GPU program is ready to handle streams of polygons
-
-  glUseProgram(g_program);
-
-  // Load textures for Earth, Moon, and Mars
-  g_earthTexID = loadTextureFromFileToGPU("media/earth.jpg");
-  g_moonTexID = loadTextureFromFileToGPU("media/moon.jpg");
-  g_marsTexID = loadTextureFromFileToGPU("media/mars.jpg");
-  g_venusTexID = loadTextureFromFileToGPU("media/venus.jpg");
-  g_uranusTexID = loadTextureFromFileToGPU("media/uranus.jpg");
-  g_saturnTexID = loadTextureFromFileToGPU("media/saturn.jpg");
-  g_neptuneTexID = loadTextureFromFileToGPU("media/neptune.jpg");
-  g_jupiterTexID = loadTextureFromFileToGPU("media/jupiter.jpg");
-  g_mercuryTexID = loadTextureFromFileToGPU("media/mercury.jpg");
-
-  glUniform1i(glGetUniformLocation(g_program, "material.albedoTex"), 0); // texture unit 0
-  
+  Timer timer;
+  g_programCache.init("cache");
+  if(g_options.lightStats && !g_glCaps.gpuDriven) {
+    std::cerr << "ERROR: Light statistics need OpenGL 4.3 storage buffers, disabling them" << std::endl;
+    g_options.lightStats = false;
+  }
+  if(g_options.spherePath == Options::SPHERE_TESSELLATED && !g_glCaps.tessellation) {
+    std::cerr << "ERROR: The tessellated sphere needs OpenGL 4.0, drawing the buffered sphere" << std::endl;
+    g_options.spherePath = Options::SPHERE_BUFFERED;
+  }
+  g_spherePath = g_options.spherePath;
+  initShaderLibrary(g_spherePath);
+
+  // The GPU-driven path needs GL 4.3; the per-draw loop stays the fallback
+  const bool wantGpuDriven = g_options.renderPath == Options::RENDER_PATH_GPU
+    || (g_options.renderPath == Options::RENDER_PATH_AUTO && g_bodies.size() >= kGpuDrivenMinBodies);
+  if(g_options.renderPath == Options::RENDER_PATH_GPU && !g_glCaps.gpuDriven)
+    std::cerr << "ERROR: GPU-driven rendering needs OpenGL 4.3, falling back to per-draw rendering" << std::endl;
+  timer.restart();
+  if(wantGpuDriven && g_glCaps.gpuDriven) {
+    g_gpuDriven = g_gpuRenderer.init(g_programCache, materialDefines(), g_bodies.size(), setupLighting);
+    if(!g_gpuDriven) {
+      std::cerr << "ERROR: GPU-driven programs failed, falling back to per-draw rendering" << std::endl;
+      g_gpuRenderer.clear();
+    }
+  }
+
+  // Load the textures of the scene, once per file (equal paths share their
+  // string); bodies whose texture is missing are drawn untextured. Tiled
+  // files (.vt) are streamed as virtual textures, with a plain texture of a
+  // coarse level for the GPU-driven path. The per-draw path streams the mip
+  // levels of the others; the texture array of the GPU-driven path copies
+  // them whole.
+  Timer textureTimer;
+  const bool streaming = g_options.textureStreaming && !g_gpuDriven;
+  if(streaming)
+    g_textureStreamer.init("cache", kStreamCoarseWidth, g_options.streamBudget, g_options.textureBudget);
+  std::map<uint32_t, GLuint> textures;
+  std::map<uint32_t, int> virtualTextures;
+  std::map<uint32_t, int> streamedTextures;
+  for(size_t i = 0; i < g_scene.count(); ++i) {
+    const uint32_t path = g_scene.body(i).texture;
+    if(!path)
+      continue;
+    if(VirtualTexture::isTiled(g_scene.string(path))) {
+      auto it = virtualTextures.find(path);
+      if(it == virtualTextures.end()) {
+        std::unique_ptr<VirtualTexture> texture(new VirtualTexture);
+        int index = -1;
+        if(texture->init(g_scene.string(path), kVirtualCacheSlots, g_options.pagesPerFrame)) {
+          index = static_cast<int>(g_virtualTextures.size());
+          textures[path] = texture->createFallbackTexture(kVirtualFallbackWidth);
+          g_virtualTextures.push_back(std::move(texture));
+        } else {
+          textures[path] = 0;
+        }
+        it = virtualTextures.insert(std::make_pair(path, index)).first;
+      }
+      g_bodies[i].virtualTexture = it->second;
+    }
+    auto it = textures.find(path);
+    if(it == textures.end()) {
+      GLuint texture = 0;
+      if(streaming) {
+        const int index = g_textureStreamer.add(g_scene.string(path));
+        streamedTextures[path] = index;
+        texture = index >= 0 ? g_textureStreamer.texture(index) : 0;
+      } else {
+        texture = loadTextureFromFileToGPU(g_scene.string(path));
+      }
+      it = textures.insert(std::make_pair(path, texture)).first;
+    }
+    g_bodies[i].texture = it->second;
+    auto streamed = streamedTextures.find(path);
+    if(streamed != streamedTextures.end())
+      g_bodies[i].streamedTexture = streamed->second;
+    if(!g_bodies[i].texture)
+      g_bodies[i].variant = SHADER_LIT_UNTEXTURED;
+    else if(g_bodies[i].virtualTexture >= 0)
+      g_bodies[i].variant = SHADER_LIT_VIRTUAL;
+  }
+  const double textureMs = textureTimer.elapsedMs();
+
+  // Bodies with a height map are drawn as terrain on the per-draw path (the
+  // tessellated sphere displaces it instead), and as spheres on the
+  // GPU-driven one
+  Timer terrainTimer;
+  bool terrainGrid = false;
+  for(size_t i = 0; i < g_scene.count() && !g_gpuDriven; ++i) {
+    const SceneBody &record = g_scene.body(i);
+    if(!record.heightMap || g_bodies[i].variant == SHADER_EMISSIVE)
+      continue;
+    if(!terrainGrid)
+      g_terrain.init();
+    terrainGrid = true;
+    g_bodies[i].terrain = g_terrain.add(g_scene.string(record.heightMap), record.heightScale);
+  }
+  const double terrainMs = terrainTimer.elapsedMs();
+
+  if(g_gpuDriven) {
+    // All albedo textures go to one array, so that a single draw covers every body
+    std::vector<GLuint> textures;
+    for(Body &body : g_bodies) {
+      if(!body.texture)
+        continue;
+      body.albedoLayer = static_cast<int>(textures.size());
+      textures.push_back(body.texture);
+    }
+    g_gpuRenderer.buildAlbedoArray(textures);
+    g_gpuBodies.resize(g_bodies.size());
+  } else {
+    prefetchUsedVariants();
+    if(!g_virtualTextures.empty())
+      initVirtualFeedback();
+  }
+  std::string note = "program cache disabled (no binary format)";
+  if(g_programCache.enabled())
+    note = std::string(g_programCache.misses() ? "cold" : "warm") + ": " + std::to_string(g_programCache.hits()) + " cached, "
+      + std::to_string(g_programCache.misses()) + " compiled";
+  if(g_glCaps.parallelShaderCompile)
+    note += ", background compilation";
+  g_startupReport.add("GPU programs", timer.elapsedMs() - textureMs - terrainMs, note);
+  std::string textureNote;
+  if(g_textureStreamer.count())
+    textureNote = std::to_string(g_textureStreamer.count()) + " streamed (" + std::to_string(g_textureStreamer.cacheHits()) + " cached), "
+      + std::to_string(g_textureStreamer.startupBytes()/1024) + " KB of coarse levels, "
+      + std::to_string(g_options.streamBudget/1024) + " KB per frame, "
+      + (g_options.textureBudget ? std::to_string(g_options.textureBudget/(1024*1024)) + " MB budget" : std::string("no budget"));
+  g_startupReport.add("textures", textureMs, textureNote);
+  if(g_terrain.count())
+    g_startupReport.add("terrain", terrainMs, std::to_string(g_terrain.count()) + " bodies, node bounds built in the background");
+  if(!g_virtualTextures.empty()) {
+    size_t numLevels = 0;
+    for(const auto &texture : g_virtualTextures)
+      numLevels = std::max<size_t>(numLevels, texture->numLevels());
+    g_startupReport.add("virtual textures", 0.0, std::to_string(g_virtualTextures.size()) + " streamed, up to " + std::to_string(numLevels)
+                        + " levels, " + std::to_string(g_options.pagesPerFrame) + " pages per frame"
+                        + (g_gpuDriven ? " (GPU-driven path: coarse level only)" : ""));
+  }
+  g_startupReport.add("render path", 0.0, std::string(g_gpuDriven ? "GPU-driven (compute culling, multi-draw indirect)" : "per-draw")
+                      + ", " + std::to_string(g_bodies.size()) + " bodies");
+
+  g_drawOrder.resize(g_bodies.size());
+  for(size_t i = 0; i < g_bodies.size(); ++i)
+    g_drawOrder[i] = i;
+  std::stable_sort(g_drawOrder.begin(), g_drawOrder.end(), [](size_t a, size_t b) {
+    if(g_bodies[a].variant != g_bodies[b].variant)
+      return g_bodies[a].variant < g_bodies[b].variant;
+    if((g_bodies[a].terrain >= 0) != (g_bodies[b].terrain >= 0))
+      return g_bodies[b].terrain >= 0;
+    return g_bodies[a].texture < g_bodies[b].texture;
+  });
+
+  // One LightingBlock and ShadowBlock, plus one ObjectBlock per body on the
+  // per-draw path, at the offset alignment of uniform buffers. The FrameBlock
+  // has its own buffer.
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  const size_t lightingBlockSize = (sizeof(LightingBlock) + alignment - 1)/alignment*alignment;
+  const size_t shadowBlockSize = (sizeof(ShadowBlock) + alignment - 1)/alignment*alignment;
+  const size_t objectBlockSize = (sizeof(ObjectBlock) + alignment - 1)/alignment*alignment;
+  g_uniformRing.init(lightingBlockSize + shadowBlockSize + (g_gpuDriven ? 0 : g_bodies.size()*objectBlockSize), g_options.persistentMapping);
+  g_objectBlockOffsets.resize(g_bodies.size());
+  glGenBuffers(1, &g_frameBlockBuffer);
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, g_frameBlockBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_DYNAMIC_DRAW);
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+  std::memset(&g_frameBlock, 0, sizeof(g_frameBlock)); // Never the first frame's, whose w components are 1
 }
 
 
@@ -442,32 +819,32 @@ void initGPUgeometry() { //THIS FUNCTION IS NOT USED ANYMORE ONCE WE START USING
 #endif
 
 
-  glBindVertexArray(g_vao);
+  g_glState.bindVertexArray(g_vao);
 
   // Generate a GPU buffer to store the positions of the vertices
   size_t vertexBufferSize = sizeof(float)*g_vertexPositions.size(); // Gather the size of the buffer from the CPU-side vector
 #ifdef _MY_OPENGL_IS_33_ //Irrelevant since Vincent's laptop has OpenGL version 4.6
   glGenBuffers(1, &g_posVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, g_posVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, g_posVbo);
   glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, g_vertexPositions.data(), GL_DYNAMIC_READ);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
   glEnableVertexAttribArray(0);
   
   glGenBuffers(1, &g_colVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, g_colVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, g_colVbo);
   glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertexColors), g_vertexColors.data(), GL_DYNAMIC_READ);
   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0); // attention: index=1
   glEnableVertexAttribArray(1); 
 #else
   //Transferring the positions of the vertices in a Vertex Buffer Object VBO (OpenGL object that stores vertex data)
   glCreateBuffers(1, &g_posVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, g_posVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, g_posVbo);
   glNamedBufferStorage(g_posVbo, vertexBufferSize, g_vertexPositions.data(), GL_DYNAMIC_STORAGE_BIT); // Create a data storage on the GPU and fill it from a CPU array
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
   glEnableVertexAttribArray(0);
 
   glCreateBuffers(1, &g_colVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, g_colVbo);
+  g_glState.bindBuffer(GL_ARRAY_BUFFER, g_colVbo);
   glNamedBufferStorage(g_colVbo, sizeof(g_vertexColors), g_vertexColors.data(), GL_DYNAMIC_STORAGE_BIT); // Create a data storage for colors
   glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0); // attention: index=1
   glEnableVertexAttribArray(1); // attention: index=1
@@ -477,15 +854,202 @@ void initGPUgeometry() { //THIS FUNCTION IS NOT USED ANYMORE ONCE WE START USING
   size_t indexBufferSize = sizeof(unsigned int)*g_triangleIndices.size();
 #ifdef _MY_OPENGL_IS_33_  //Irrelevant since Vincent's laptop has OpenGL version 4.6
   glGenBuffers(1, &g_ibo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ibo);
+  g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ibo);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, g_triangleIndices.data(), GL_DYNAMIC_READ);
 #else
   glCreateBuffers(1, &g_ibo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ibo);
+  g_glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ibo);
   glNamedBufferStorage(g_ibo, indexBufferSize, g_triangleIndices.data(), GL_DYNAMIC_STORAGE_BIT);
 #endif
 
-  glBindVertexArray(0); // deactivate the VAO for now, will be activated again when rendering
+  g_glState.bindVertexArray(0); // deactivate the VAO for now, will be activated again when rendering
+}
+
+// Bodies of the scene named after a target of the ephemeris take its
+// positions; satellites keep their orbit around their parent, whose scale
+// is exaggerated in the scene
+void initEphemeris() {
+  g_ephemerisTargets.assign(g_scene.count(), Ephemeris::NUM_TARGETS);
+  if(g_options.ephemerisPath.empty())
+    return;
+  Timer timer;
+  if(!g_ephemeris.load(g_options.ephemerisPath)) {
+    std::cerr << "ERROR: Keeping the orbits of the scene" << std::endl;
+    return;
+  }
+  size_t numPositioned = 0;
+  for(size_t i = 0; i < g_scene.count(); ++i) {
+    if(g_scene.body(i).parent != Scene::kNoParent)
+      continue;
+    g_ephemerisTargets[i] = Ephemeris::find(g_scene.string(g_scene.body(i).name));
+    numPositioned += g_ephemerisTargets[i] != Ephemeris::NUM_TARGETS;
+  }
+  if(g_options.epoch < g_ephemeris.startEpoch() || g_options.epoch > g_ephemeris.endEpoch())
+    std::cerr << "ERROR: The epoch " << std::to_string(g_options.epoch) << " is outside the ephemeris, positions are clamped to it" << std::endl;
+  g_startupReport.add("ephemeris", timer.elapsedMs(), "DE" + std::to_string(g_ephemeris.version()) + ", " + std::to_string(numPositioned)
+                      + " bodies, JD " + std::to_string(g_ephemeris.startEpoch()) + " to " + std::to_string(g_ephemeris.endEpoch()));
+}
+
+void initBelts() {
+  if(g_options.mainBeltCount + g_options.kuiperBeltCount == 0)
+    return;
+  Timer timer;
+  // Main belt between Mars and Jupiter: the real belt spans 2.1-3.3 AU, with
+  // Kirkwood gaps at the 3:1, 5:2 and 7:3 resonances with Jupiter
+  const auto mainBeltRadius = [](float au) { return 16.0f + (au - 2.1f)/1.2f*3.5f; };
+  BeltParams mainBelt;
+  mainBelt.name = "main belt";
+  mainBelt.seed = g_options.beltSeed;
+  mainBelt.count = g_options.mainBeltCount;
+  mainBelt.innerRadius = mainBeltRadius(2.1f);
+  mainBelt.outerRadius = mainBeltRadius(3.3f);
+  for(float au : { 2.5f, 2.82f, 2.95f })
+    mainBelt.gaps.push_back(glm::vec2(mainBeltRadius(au), 0.15f));
+
+  // Kuiper belt beyond Neptune: thicker, larger and redder bodies
+  BeltParams kuiperBelt;
+  kuiperBelt.name = "Kuiper belt";
+  kuiperBelt.seed = g_options.beltSeed + 1;
+  kuiperBelt.count = g_options.kuiperBeltCount;
+  kuiperBelt.innerRadius = 38.0f;
+  kuiperBelt.outerRadius = 48.0f;
+  kuiperBelt.eccentricitySigma = 0.06f;
+  kuiperBelt.inclinationSigma = 0.2f;
+  kuiperBelt.minSize = 0.008f;
+  kuiperBelt.maxSize = 0.08f;
+  kuiperBelt.darkColor = glm::vec3(0.4f, 0.32f, 0.28f);
+  kuiperBelt.brightColor = glm::vec3(0.7f, 0.5f, 0.38f);
+  kuiperBelt.brightFraction = 0.5f;
+
+  std::vector<BeltParticle> particles;
+  ParticleBelt::generate(mainBelt, particles);
+  ParticleBelt::generate(kuiperBelt, particles);
+  const double generateMs = timer.elapsedMs();
+  if(!g_belts.init(g_programCache, materialDefines())) {
+    std::cerr << "ERROR: Failed to create the belt program" << std::endl;
+    return;
+  }
+  g_belts.upload(particles);
+  g_startupReport.add("belts", timer.elapsedMs(), std::to_string(particles.size()) + " bodies, "
+                      + std::to_string(particles.size()*sizeof(BeltParticle) >> 20) + " MiB, generated in "
+                      + std::to_string(static_cast<int>(generateMs)) + " ms");
+}
+
+// The sun lights every cluster; the synthetic lights orbit between Mercury
+// and Neptune and only reach their neighborhood
+void initLights() {
+  g_lights.clear();
+  g_lights.push_back({ glm::vec3(0.0f), 0.0f, kLightColor });
+  g_lightPositions.assign(1 + g_options.numLights, glm::dvec3(0.0));
+  std::mt19937 rng(2025);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  g_lightOrbits.resize(g_options.numLights);
+  for(LightOrbit &orbit : g_lightOrbits) {
+    orbit.radius = kPointLightInnerRadius + (kPointLightOuterRadius - kPointLightInnerRadius)*unit(rng);
+    orbit.phase = 2.0f*static_cast<float>(M_PI)*unit(rng);
+    orbit.speed = 0.3f*std::pow(15.0f/orbit.radius, 1.5f);
+    orbit.height = unit(rng) - 0.5f;
+    // Saturated colors of random hue
+    const float hue = 6.0f*unit(rng);
+    const glm::vec3 color = glm::clamp(glm::vec3(std::fabs(hue - 3.0f) - 1.0f, 2.0f - std::fabs(hue - 2.0f), 2.0f - std::fabs(hue - 4.0f)), 0.0f, 1.0f);
+    const float range = kPointLightMinRange + (kPointLightMaxRange - kPointLightMinRange)*unit(rng);
+    g_lights.push_back({ glm::vec3(0.0f), range, kPointLightIntensity*color });
+  }
+  g_lightClusters.init(g_options.lightStats);
+}
+
+void initPostProcess() {
+  if(!g_options.hdr)
+    return;
+  Timer timer;
+  PostProcess::Settings settings;
+  settings.exposure = g_options.exposure;
+  settings.depthFormat = depthFormat();
+  if(!g_postProcess.init(g_programCache, settings)) {
+    std::cerr << "ERROR: Failed to create the post-processing programs, rendering without HDR" << std::endl;
+    g_postProcess.clear();
+    g_options.hdr = false;
+    return;
+  }
+  g_startupReport.add("post-processing", timer.elapsedMs(), "HDR, dual-filter bloom");
+}
+
+// Profiles in planet radii, with thicknesses exaggerated so that they show
+// at the scale of the scene; the vertical optical depths follow the real
+// atmospheres (Earth's Rayleigh depth at 680, 550 and 440 nm)
+void initAtmospheres() {
+  if(!g_options.atmospheres)
+    return;
+  Timer timer;
+  std::vector<AtmosphereProfile> profiles;
+  g_atmosphereBodies.clear();
+  // Bodies are found by name; a scene without one of them skips its profile
+  const auto add = [&](const char *name, const AtmosphereProfile &profile) {
+    const size_t body = g_scene.find(name);
+    if(body == g_scene.count())
+      return;
+    g_atmosphereBodies.push_back(body);
+    profiles.push_back(profile);
+  };
+
+  AtmosphereProfile earth;
+  add("earth", earth);
+
+  // Haze above the sulfuric acid clouds (the texture), which absorb in the blue
+  AtmosphereProfile venus;
+  venus.rayleighScaleHeight = 0.01f;
+  venus.rayleighDepth = glm::vec3(0.05f, 0.1f, 0.25f);
+  venus.mieScaleHeight = 0.01f;
+  venus.mieDepth = 0.3f;
+  venus.mieG = 0.6f;
+  venus.absorptionDepth = glm::vec3(0.0f, 0.03f, 0.12f);
+  add("venus", venus);
+
+  // Thin, with ochre dust
+  AtmosphereProfile mars;
+  mars.height = 0.04f;
+  mars.rayleighDepth = glm::vec3(0.004f, 0.008f, 0.02f);
+  mars.mieScaleHeight = 0.008f;
+  mars.mieDepth = 0.3f;
+  mars.mieG = 0.65f;
+  mars.absorptionDepth = glm::vec3(0.0f, 0.05f, 0.12f);
+  add("mars", mars);
+
+  // Hydrogen and helium above ammonia hazes; methane absorbs the red of the
+  // ice giants
+  AtmosphereProfile jupiter;
+  jupiter.height = 0.03f;
+  jupiter.rayleighScaleHeight = 0.004f;
+  jupiter.rayleighDepth = glm::vec3(0.1f, 0.2f, 0.45f);
+  jupiter.mieScaleHeight = 0.004f;
+  jupiter.mieDepth = 0.2f;
+  jupiter.mieG = 0.5f;
+  jupiter.absorptionDepth = glm::vec3(0.0f, 0.04f, 0.15f);
+  add("jupiter", jupiter);
+  AtmosphereProfile saturn = jupiter;
+  saturn.absorptionDepth = glm::vec3(0.0f, 0.06f, 0.25f);
+  add("saturn", saturn);
+  AtmosphereProfile uranus = jupiter;
+  uranus.rayleighDepth = glm::vec3(0.1f, 0.2f, 0.4f);
+  uranus.mieDepth = 0.1f;
+  uranus.absorptionDepth = glm::vec3(0.8f, 0.15f, 0.0f);
+  add("uranus", uranus);
+  AtmosphereProfile neptune = uranus;
+  neptune.rayleighDepth = glm::vec3(0.15f, 0.3f, 0.6f);
+  neptune.absorptionDepth = glm::vec3(1.2f, 0.3f, 0.0f);
+  add("neptune", neptune);
+
+  if(!g_atmosphere.init(g_programCache, depthDefines(), "cache", profiles)) {
+    std::cerr << "ERROR: Failed to create the atmosphere program, rendering without atmospheres" << std::endl;
+    g_atmosphere.clear();
+    g_options.atmospheres = false;
+    return;
+  }
+  std::string note = std::to_string(g_atmosphere.count()) + " profiles, " + std::to_string(g_atmosphere.cacheHits()) + " cached";
+  if(g_atmosphere.built() > 0)
+    note += ", " + std::to_string(g_atmosphere.built()) + " built in " + std::to_string(static_cast<int>(g_atmosphere.buildMs()))
+      + " ms on " + std::to_string(g_atmosphere.buildThreads()) + " thread(s)";
+  g_startupReport.add("atmospheres", timer.elapsedMs(), note);
 }
 
 void initCamera() {
@@ -493,197 +1057,822 @@ void initCamera() {
   glfwGetWindowSize(g_window, &width, &height);
   g_camera.setAspectRatio(static_cast<float>(width)/static_cast<float>(height));
 
-  g_camera.setPosition(glm::vec3(0.0, 0.0 , 30.0));
-  g_camera.setNear(0.1);
-  g_camera.setFar(80.1);
+  g_camera.setPosition(glm::dvec3(0.0, 0.0 , 30.0));
+  g_cameraController.reset(30.0);
+  g_camera.setNear(kCameraNear);
+  g_camera.setFar(kCameraFar);
+  g_approachBody = g_scene.count();
+  if(!g_options.approachBody.empty()) {
+    const size_t body = g_scene.find(g_options.approachBody);
+    if(body == g_scene.count())
+      std::cerr << "ERROR: No body named " << g_options.approachBody << " to approach" << std::endl;
+    else if(g_scene.body(body).radiusKm <= 0.0f)
+      std::cerr << "ERROR: The body " << g_options.approachBody << " has no radiusKm to approach it" << std::endl;
+    else
+      g_approachBody = body;
+  }
+  glfwGetFramebufferSize(g_window, &width, &height);
+  g_viewportWidth = width;
+  g_viewportHeight = height;
 }
 
 void init() {
+  Timer timer;
   initGLFW();
   initOpenGL();
-  
+  initBodies();
+  initEphemeris();
+  g_startupReport.add("window and context", timer.elapsedMs(), reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+  initDepthMode();
+
   /* TRIANGLE
   initCPUgeometry();
   */
   initGPUprogram();
 
-  sphere = Mesh::genSphere(16); // Create a sphere mesh
+  timer.restart();
+  sphere = Mesh::genSphere(g_options.sphereResolution); // Create a sphere mesh
   sphere->init(); // Initialize its GPU buffers
-  
+  g_proceduralSphere.init();
+  if(g_glCaps.tessellation)
+    g_tessellatedSphere.init(kTessellationEdgePixels);
+  g_sphereImpostor.init();
+  const char *sphereNotes[Options::NUM_SPHERE_PATHS] = { "buffered sphere", "procedural sphere", "tessellated sphere" };
+  g_startupReport.add("geometry", timer.elapsedMs(), sphereNotes[g_spherePath]);
+  initBelts();
+  initLights();
+  initPostProcess();
+  initAtmospheres();
+
   /* TRIANGLE
   initGPUgeometry();
   */
 
  
   initCamera();
+  g_startupReport.print();
+}
+
+// Residency of the virtual textures, over the run
+void printVirtualTextureStats() {
+  for(const auto &texture : g_virtualTextures) {
+    char line[512];
+    std::snprintf(line, sizeof(line), "Virtual texture %s: %dx%d, %d levels, %zu/%zu pages resident, %zu uploads, %zu evictions, %zu misses",
+                  texture->path().c_str(), texture->width(), texture->height(), texture->numLevels(), texture->residentPages(),
+                  texture->numSlots(), texture->uploads(), texture->evictions(), texture->misses());
+    std::cout << line << std::endl;
+  }
 }
 
 void clear() {
-  glDeleteProgram(g_program);
+  g_lightClusters.printStats();
+  g_inputLatency.print("Input latency");
+  g_glState.printStats();
+  printGLTraceStats();
+  char line[160];
+  std::snprintf(line, sizeof(line), "Frame constants: uploaded in %zu of %zu frames; body transforms: %zu of %zu changed",
+                g_frameBlockUploads, g_frameBlockFrames, g_transformChanges, g_transformUpdates);
+  std::cout << line << std::endl;
+  printVirtualTextureStats();
+  if(g_textureStreamer.count())
+    g_textureStreamer.printStats();
+  g_terrain.printStats();
+  g_eclipseShadows.printStats();
+  if(g_options.hdr) {
+    const std::string renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+    const bool software = renderer.find("llvmpipe") != std::string::npos || renderer.find("softpipe") != std::string::npos;
+    g_postProcess.printStats(g_options.postBudgetMs > 0.0 ? g_options.postBudgetMs : software ? kPostBudgetSoftwareMs : kPostBudgetMs);
+    g_postProcess.clear();
+  }
+  g_lightClusters.clear();
+  for(auto &texture : g_virtualTextures)
+    texture->clear();
+  g_virtualTextures.clear();
+  g_virtualFeedback.clear();
+  // Textures loaded whole, shared by the bodies; the streamed ones belong to g_textureStreamer
+  std::vector<GLuint> textures;
+  for(const Body &body : g_bodies)
+    if(body.texture && body.streamedTexture < 0)
+      textures.push_back(body.texture);
+  std::sort(textures.begin(), textures.end());
+  textures.erase(std::unique(textures.begin(), textures.end()), textures.end());
+  g_glState.deleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+  g_textureStreamer.clear();
+  g_terrain.clear();
+  g_atmosphere.clear();
+  g_belts.clear();
+  g_proceduralSphere.clear();
+  g_tessellatedSphere.clear();
+  g_sphereImpostor.clear();
+  g_gpuRenderer.clear();
+  g_uniformRing.clear();
+  g_glState.deleteBuffers(1, &g_frameBlockBuffer);
+  g_shaders.clear();
+  g_impostorShaders.clear();
+  g_terrainShaders.clear();
 
   glfwDestroyWindow(g_window);
   glfwTerminate();
 }
 
+// Draws the bodies and belts into the bound framebuffer
+// Translucent, after every opaque body of both render paths
+void renderAtmospheres() {
+  if(!g_options.atmospheres)
+    return;
+  g_atmosphereSpheres.resize(g_atmosphereBodies.size());
+  for(size_t i = 0; i < g_atmosphereBodies.size(); ++i)
+    g_atmosphereSpheres[i] = g_bodySpheres[g_atmosphereBodies[i]];
+  g_atmosphere.render(g_atmosphereSpheres, kAtmosphereIrradiance*kLightColor);
+}
+
+// Translation relative to the camera, subtracted in double precision before
+// the cast, so that floats keep their precision far from the world origin
+glm::mat4 relativeToCamera(const glm::dmat4 &model, const glm::dvec3 &camera) {
+  glm::dmat4 relative = model;
+  relative[3] -= glm::dvec4(camera, 0.0);
+  return glm::mat4(relative);
+}
+
+// Pages sampled by the virtually textured bodies, found at a fraction of the
+// resolution, then their streaming, with the meshes of the scene's sphere
+// path. The uniform blocks must be bound.
+void renderVirtualFeedback(float pixelScale) {
+  g_virtualFeedback.begin(g_viewportWidth, g_viewportHeight);
+  for(size_t i : g_drawOrder) {
+    const Body &body = g_bodies[i];
+    if(body.variant != SHADER_LIT_VIRTUAL)
+      continue;
+    const GLuint program = g_virtualFeedback.program(g_drawAsImpostor[i], body.virtualTexture, *g_virtualTextures[body.virtualTexture]);
+    g_uniformRing.bindRange(OBJECT_BLOCK_BINDING, g_objectBlockOffsets[i], sizeof(ObjectBlock));
+    if(g_drawAsImpostor[i])
+      g_sphereImpostor.render();
+    else if(g_spherePath == Options::SPHERE_TESSELLATED)
+      g_tessellatedSphere.render(program, pixelScale, body.terrain >= 0 ? g_terrain.heightMap(body.terrain) : 0,
+                                 body.terrain >= 0 ? g_terrain.heightScale(body.terrain) : 0.0f);
+    else
+      sphere->render();
+  }
+  g_virtualFeedback.end(g_virtualTextures);
+  for(auto &texture : g_virtualTextures)
+    texture->update();
+}
+
+// Patches of the terrains drawn this frame, selected in the frame of each
+// body; then the near plane, which comes down with the closest of them. The
+// side planes of the frustum do not depend on the near plane. The tessellated
+// sphere selects nothing, and the near plane comes down to the highest point
+// of the bodies instead.
+void selectTerrain(const glm::dvec3 &camera) {
+  const glm::mat4 m = glm::transpose(g_camera.computeViewProjectionMatrix());
+  const glm::vec4 planes[4] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1] };
+  const float pixelScale = 0.5f*g_viewportHeight/std::tan(0.5f*glm::radians(g_camera.getFov()));
+  float nearPlane = g_camera.getNear();
+  for(const Body &body : g_bodies) {
+    if(body.terrain < 0)
+      continue;
+    const glm::mat4 model = relativeToCamera(body.modelMatrix, camera);
+    const float radius = glm::length(glm::vec3(model[0]));
+    if(SphereImpostor::projectedRadius(glm::vec3(model[3]), radius, glm::vec3(0.0f), pixelScale) < g_options.impostorPixelRadius)
+      continue; // Drawn as an impostor
+    if(g_spherePath == Options::SPHERE_TESSELLATED) {
+      nearPlane = std::min(nearPlane, 0.5f*(glm::length(glm::vec3(model[3])) - radius*(1.0f + g_terrain.heightScale(body.terrain))));
+      continue;
+    }
+    glm::vec4 localPlanes[4];
+    for(int k = 0; k < 4; ++k)
+      localPlanes[k] = glm::transpose(model)*planes[k];
+    g_terrain.select(body.terrain, glm::dvec3(glm::inverse(body.modelMatrix)*glm::dvec4(camera, 1.0)), localPlanes);
+    nearPlane = std::min(nearPlane, 0.5f*radius*g_terrain.nearestDistance(body.terrain));
+  }
+  g_camera.setNear(std::max(nearPlane, kCameraMinNear));
+}
+
+// The per-frame constants, from the cached matrices of the camera; uploaded
+// only when they differ from the last upload, which a still camera under a
+// still light never does
+void updateFrameBlock(const glm::vec3 &lightPosition) {
+  FrameBlock frame;
+  frame.viewMat = g_camera.computeViewMatrix();
+  frame.projMat = g_camera.computeProjectionMatrix();
+  frame.viewProjMat = g_camera.computeViewProjectionMatrix();
+  frame.camPosition = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  frame.lightPosition = glm::vec4(lightPosition, 1.0f);
+  frame.lightColor = glm::vec4(kLightColor, 1.0f);
+  ++g_frameBlockFrames;
+  if(!std::memcmp(&frame, &g_frameBlock, sizeof(frame)))
+    return;
+  g_frameBlock = frame;
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, g_frameBlockBuffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+  g_glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+  ++g_frameBlockUploads;
+}
+
+void renderScene() {
+  // The GPU works in the camera-relative frame: the camera is at its origin
+  const glm::dvec3 camera = g_camera.getPosition();
+  if(g_terrain.count())
+    selectTerrain(camera);
+  const glm::vec3 lightPosition = glm::vec3(g_lightPositions[0] - camera);
+  for(size_t i = 0; i < g_lights.size(); ++i)
+    g_lights[i].position = glm::vec3(g_lightPositions[i] - camera);
+
+  // Write every uniform block of the frame first: with persistent mapping this
+  // is a plain memcpy, otherwise one glBufferSubData uploads them all
+  g_uniformRing.beginFrame();
+  updateFrameBlock(lightPosition);
+  const FrameBlock &frame = g_frameBlock;
+  LightingBlock lighting;
+  g_lightClusters.update(g_lights, frame.viewMat, frame.projMat, g_camera.getNear(), g_camera.getFar(),
+                         g_viewportWidth, g_viewportHeight, lighting);
+  const GLintptr lightingOffset = g_uniformRing.push(&lighting, sizeof(lighting));
+  g_lightClusters.bind();
+
+  g_relativeModels.resize(g_bodies.size());
+  g_bodySpheres.resize(g_bodies.size());
+  g_castsShadow.resize(g_bodies.size());
+  for(size_t i = 0; i < g_bodies.size(); ++i) {
+    const glm::mat4 &model = g_relativeModels[i] = relativeToCamera(g_bodies[i].modelMatrix, camera);
+    g_bodySpheres[i] = glm::vec4(glm::vec3(model[3]), glm::length(glm::vec3(model[0])));
+    g_castsShadow[i] = g_bodies[i].variant != SHADER_EMISSIVE;
+  }
+  ShadowBlock shadows;
+  g_eclipseShadows.select(glm::vec4(lightPosition, g_bodySpheres[g_lightBody].w), g_bodySpheres, g_castsShadow, shadows, g_occluderMasks);
+  const GLintptr shadowOffset = g_uniformRing.push(&shadows, sizeof(shadows));
+  const float pixelScale = 0.5f*g_viewportHeight/std::tan(0.5f*glm::radians(g_camera.getFov()));
+
+  if(g_gpuDriven) {
+    g_uniformRing.upload();
+    g_glState.bindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, g_frameBlockBuffer);
+    g_uniformRing.bindRange(LIGHTING_BLOCK_BINDING, lightingOffset, sizeof(LightingBlock));
+    g_uniformRing.bindRange(SHADOW_BLOCK_BINDING, shadowOffset, sizeof(ShadowBlock));
+    for(size_t i = 0; i < g_bodies.size(); ++i) {
+      const Body &body = g_bodies[i];
+      GpuBody &gpuBody = g_gpuBodies[i];
+      gpuBody.modelMatrix = g_relativeModels[i];
+      gpuBody.boundingSphere = g_bodySpheres[i];
+      gpuBody.color = glm::vec4(body.color, static_cast<float>(body.albedoLayer));
+      gpuBody.material = glm::vec4(body.variant == SHADER_EMISSIVE ? 1.0f : 0.0f, static_cast<float>(g_occluderMasks[i]), 0.0f, 0.0f);
+    }
+    g_gpuRenderer.setImpostorPixelRadius(g_options.impostorPixelRadius);
+    g_gpuRenderer.render(g_gpuBodies, frame.viewProjMat, glm::vec3(0.0f), pixelScale);
+    g_belts.render(g_simulationTime, camera, pixelScale);
+    renderAtmospheres();
+    g_uniformRing.endFrame();
+    return;
+  }
+
+  // Side planes of the frustum (Gribb-Hartmann), which tell the streamed
+  // textures that are on screen; the depth planes vary with the depth mode
+  const glm::mat4 m = glm::transpose(frame.viewProjMat);
+  glm::vec4 planes[4] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1] };
+  for(glm::vec4 &plane : planes)
+    plane /= glm::length(glm::vec3(plane));
+
+  g_drawAsImpostor.resize(g_bodies.size());
+  for(size_t i = 0; i < g_bodies.size(); ++i) {
+    const Body &body = g_bodies[i];
+    const glm::vec4 &sphere = g_bodySpheres[i];
+    const float pixelRadius = SphereImpostor::projectedRadius(glm::vec3(sphere), sphere.w, glm::vec3(0.0f), pixelScale);
+    g_drawAsImpostor[i] = pixelRadius < g_options.impostorPixelRadius;
+    if(body.streamedTexture >= 0
+       && std::all_of(planes, planes + 4, [&](const glm::vec4 &plane) { return glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w > -sphere.w; }))
+      g_textureStreamer.request(body.streamedTexture, g_textureStreamer.levelFor(body.streamedTexture, pixelRadius));
+    ObjectBlock object;
+    object.modelMatrix = g_relativeModels[i];
+    object.normalMatrix = glm::mat4(body.normalMatrix); // The translation to the camera does not turn normals
+    object.objectColor = glm::vec4(body.color, 1.0f);
+    object.occluderMask = g_occluderMasks[i];
+    g_objectBlockOffsets[i] = g_uniformRing.push(&object, sizeof(object));
+  }
+  g_uniformRing.upload();
+  g_glState.bindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, g_frameBlockBuffer);
+  g_uniformRing.bindRange(LIGHTING_BLOCK_BINDING, lightingOffset, sizeof(LightingBlock));
+  g_uniformRing.bindRange(SHADOW_BLOCK_BINDING, shadowOffset, sizeof(ShadowBlock));
+  if(!g_virtualTextures.empty())
+    renderVirtualFeedback(pixelScale);
+  if(g_textureStreamer.count()) {
+    g_textureStreamer.update();
+    if(g_options.textureStats)
+      g_textureStreamer.printFrameStats();
+  }
+
+  g_glState.activeTexture(GL_TEXTURE0);
+
+  // Draws are sorted by variant: the program changes once per variant, not per body.
+  // Meshes go first, then the bodies small enough on screen to be impostors.
+  for(int pass = 0; pass < 2; ++pass) {
+    const bool impostors = pass == 1;
+    ShaderLibrary &shaders = impostors ? g_impostorShaders : g_shaders;
+    ShaderVariant currentVariant = NUM_SHADER_VARIANTS;
+    bool currentTerrain = false;
+    GLuint program = 0;
+    GLint sphereResolutionLoc = -1;
+    for(size_t i : g_drawOrder) {
+      if(g_drawAsImpostor[i] != impostors)
+        continue;
+      const Body &body = g_bodies[i];
+      const bool terrain = !impostors && body.terrain >= 0 && g_spherePath != Options::SPHERE_TESSELLATED;
+      if(body.variant != currentVariant || terrain != currentTerrain) {
+        currentVariant = body.variant;
+        currentTerrain = terrain;
+        program = (terrain ? g_terrainShaders : shaders).program(currentVariant);
+        g_glState.useProgram(program);
+        if(g_spherePath == Options::SPHERE_PROCEDURAL && !impostors)
+          sphereResolutionLoc = glGetUniformLocation(program, "sphereResolution");
+      }
+      if(body.variant == SHADER_LIT_TEXTURED)
+        g_glState.bindTexture(GL_TEXTURE_2D, body.streamedTexture >= 0 ? g_textureStreamer.texture(body.streamedTexture) : body.texture);
+      else if(body.variant == SHADER_LIT_VIRTUAL)
+        g_virtualTextures[body.virtualTexture]->bind(program);
+      g_uniformRing.bindRange(OBJECT_BLOCK_BINDING, g_objectBlockOffsets[i], sizeof(ObjectBlock));
+      if(impostors)
+        g_sphereImpostor.render();
+      else if(terrain)
+        g_terrain.render(body.terrain, program);
+      else if(g_spherePath == Options::SPHERE_TESSELLATED)
+        g_tessellatedSphere.render(program, pixelScale, body.terrain >= 0 ? g_terrain.heightMap(body.terrain) : 0,
+                                   body.terrain >= 0 ? g_terrain.heightScale(body.terrain) : 0.0f);
+      else if(g_spherePath == Options::SPHERE_PROCEDURAL)
+        g_proceduralSphere.render(sphereResolutionLoc, g_options.sphereResolution);
+      else
+        sphere->render();
+    }
+  }
+
+  g_glState.bindTexture(GL_TEXTURE_2D, 0);
+  g_belts.render(g_simulationTime, camera, pixelScale);
+  renderAtmospheres();
+  g_uniformRing.endFrame();
+}
+
 // The main rendering call
 void render() {
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-  const glm::mat4 viewMatrix = g_camera.computeViewMatrix();
-  const glm::mat4 projMatrix = g_camera.computeProjectionMatrix();
-  const glm::vec3 camPosition = g_camera.getPosition();
-
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "viewMat"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "projMat"), 1, GL_FALSE, glm::value_ptr(projMatrix));
-  glUniform3fv(glGetUniformLocation(g_program, "camPosition"), 1, glm::value_ptr(camPosition));
-
-  // Sun rendering
-  glUniform1i(glGetUniformLocation(g_program, "isSun"), 1);
-  glUniform3f(glGetUniformLocation(g_program, "objectColor"), 1.0f, 1.0f, 0.0f);
-  modelSun = glm::mat4(1.0f);
-  modelSun = glm::scale(modelSun, glm::vec3(kSizeSun));
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelSun));
-  sphere->render();
-
-  glActiveTexture(GL_TEXTURE0);
-  glUniform1i(glGetUniformLocation(g_program, "isSun"), 0);
-
-  // Earth rendering
-  glBindTexture(GL_TEXTURE_2D, g_earthTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelEarth));
-  sphere->render();
-
-  // Moon rendering
-  glBindTexture(GL_TEXTURE_2D, g_moonTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMoon));
-  sphere->render();
-
-  // Mars rendering
-  glBindTexture(GL_TEXTURE_2D, g_marsTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMars));
-  sphere->render();
-
-  // Venus rendering
-  glBindTexture(GL_TEXTURE_2D, g_venusTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelVenus));
-  sphere->render();
-
-  // Jupiter rendering
-  glBindTexture(GL_TEXTURE_2D, g_jupiterTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelJupiter));
-  sphere->render();
-
-  // Saturn rendering
-  glBindTexture(GL_TEXTURE_2D, g_saturnTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelSaturn));
-  sphere->render();
-
-  // Uranus rendering
-  glBindTexture(GL_TEXTURE_2D, g_uranusTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelUranus));
-  sphere->render();
-
-  // Neptune rendering
-  glBindTexture(GL_TEXTURE_2D, g_neptuneTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelNeptune));
-  sphere->render();
-
-  // Mercury rendering
-  glBindTexture(GL_TEXTURE_2D, g_mercuryTexID);
-  glUniformMatrix4fv(glGetUniformLocation(g_program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMercury));
-  sphere->render();
-
-
-  glBindTexture(GL_TEXTURE_2D, 0);
-}
-
-
-void update(const float currentTimeInSec) {
-  // Constants for orbital and rotational periods
-  // Speeds of rotation and orbit for Earth and Moon
-  float speedEarthRotation = 1.0f;
-  float speedEarthOrbit = 0.5f * speedEarthRotation;
-  float speedMoonRotation = 2.0f * speedEarthRotation;
-  float speedMoonOrbit = speedMoonRotation;
-
-  // Initialize Earth's transformation matrix
-  modelEarth = glm::mat4(1.0f);
-  glm::mat4 translateEarth = glm::translate(glm::mat4(1.0f), glm::vec3(kRadOrbitEarth * cos(0.3f * currentTimeInSec), 0.0f, kRadOrbitEarth * sin(0.3f * currentTimeInSec)));
-  glm::mat4 scaleEarth = glm::scale(glm::mat4(1.0f), glm::vec3(kSizeEarth));
-  glm::mat4 rotateEarth = glm::rotate(glm::mat4(1.0f), 0.6f * currentTimeInSec, glm::vec3(sin(glm::radians(23.5f)), cos(glm::radians(23.5f)), 0.0f));
-  modelEarth = translateEarth * scaleEarth * rotateEarth;
-
-  // Initialize Moon's transformation matrix relative to Earth's position
-  modelMoon = glm::mat4(1.0f);
-  glm::mat4 translateMoon = glm::translate(glm::mat4(1.0f), glm::vec3(kRadOrbitMoon * cos(0.6f * currentTimeInSec), 0.0f, kRadOrbitMoon * sin(0.6f * currentTimeInSec)));
-  glm::mat4 rotateMoon = glm::rotate(glm::mat4(1.0f), 0.6f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  glm::mat4 scaleMoon = glm::scale(glm::mat4(1.0f), glm::vec3(kSizeMoon));
-  modelMoon = translateEarth * translateMoon * rotateMoon * scaleMoon;
-
-  // Mars parameters
-  modelMars = glm::mat4(1.0f);
-  float marsOrbitAngle = 0.3f * currentTimeInSec;
-  modelMars = glm::translate(modelMars, glm::vec3(glm::cos(marsOrbitAngle) * 15.0f, 0.0f, glm::sin(marsOrbitAngle) * 15.0f));
-  modelMars = glm::rotate(modelMars, 0.8f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  modelMars = glm::scale(modelMars, glm::vec3(0.3f));
-
-  // Venus parameters
-  modelVenus = glm::mat4(1.0f);
-  float venusOrbitAngle = 0.4f * currentTimeInSec;
-  modelVenus = glm::translate(modelVenus, glm::vec3(glm::cos(venusOrbitAngle) * 8.0f, 0.0f, glm::sin(venusOrbitAngle) * 8.0f));
-  modelVenus = glm::rotate(modelVenus, 0.9f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  modelVenus = glm::scale(modelVenus, glm::vec3(0.4f));
-
-  // Jupiter
-  modelJupiter = glm::mat4(1.0f);
-  float jupiterOrbitAngle = 0.2f * currentTimeInSec;
-  modelJupiter = glm::translate(modelJupiter, glm::vec3(glm::cos(jupiterOrbitAngle) * 20.0f, 0.0f, glm::sin(jupiterOrbitAngle) * 20.0f));
-  modelJupiter = glm::rotate(modelJupiter, 0.5f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  modelJupiter = glm::scale(modelJupiter, glm::vec3(1.0f));
-
-  // Saturn
-  modelSaturn = glm::mat4(1.0f);
-  float saturnOrbitAngle = 0.15f * currentTimeInSec;
-  modelSaturn = glm::translate(modelSaturn, glm::vec3(glm::cos(saturnOrbitAngle) * 25.0f, 0.0f, glm::sin(saturnOrbitAngle) * 25.0f));
-  modelSaturn = glm::rotate(modelSaturn, 0.4f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  modelSaturn = glm::scale(modelSaturn, glm::vec3(0.9f));
-
-  // Uranus
-  modelUranus = glm::mat4(1.0f);
-  float uranusOrbitAngle = 0.1f * currentTimeInSec;
-  modelUranus = glm::translate(modelUranus, glm::vec3(glm::cos(uranusOrbitAngle) * 30.0f, 0.0f, glm::sin(uranusOrbitAngle) * 30.0f));
-  modelUranus = glm::rotate(modelUranus, 0.3f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  modelUranus = glm::scale(modelUranus, glm::vec3(0.7f));
-
-  // Neptune
-  modelNeptune = glm::mat4(1.0f);
-  float neptuneOrbitAngle = 0.08f * currentTimeInSec;
-  modelNeptune = glm::translate(modelNeptune, glm::vec3(glm::cos(neptuneOrbitAngle) * 35.0f, 0.0f, glm::sin(neptuneOrbitAngle) * 35.0f));
-  modelNeptune = glm::rotate(modelNeptune, 0.3f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  modelNeptune = glm::scale(modelNeptune, glm::vec3(0.6f));
-
-  // Mercury
-  modelMercury = glm::mat4(1.0f);
-  float mercuryOrbitAngle = 0.6f * currentTimeInSec;
-  modelMercury = glm::translate(modelMercury, glm::vec3(glm::cos(mercuryOrbitAngle) * 5.0f, 0.0f, glm::sin(mercuryOrbitAngle) * 5.0f));
-  modelMercury = glm::rotate(modelMercury, 1.0f * currentTimeInSec, glm::vec3(0.0f, 1.0f, 0.0f));
-  modelMercury = glm::scale(modelMercury, glm::vec3(0.2f));
+  glTraceBeginFrame();
+  g_glState.beginFrame();
+  if(!g_options.hdr) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    renderScene();
+  } else {
+    g_postProcess.beginScene();
+    renderScene();
+    g_postProcess.endScene();
+  }
+  g_glState.endFrame();
+  glTraceEndFrame();
+}
+
+// Moves a body; its normal matrix only follows when the transform changes,
+// which a body at rest never does
+void setModelMatrix(Body &body, const glm::dmat4 &model) {
+  ++g_transformUpdates;
+  if(model == body.modelMatrix)
+    return;
+  body.modelMatrix = model;
+  body.normalMatrix = glm::mat3(glm::transpose(glm::inverse(glm::dmat3(model))));
+  ++g_transformChanges;
+}
+
+void update(const double currentTimeInSec) {
+  g_simulationTime = currentTimeInSec;
+  const double t = currentTimeInSec; // The positions are computed in double precision
+
+  const double jd = g_options.epoch + kEphemerisDaysPerSecond*t;
+  if(g_ephemeris.endEpoch() > 0.0)
+    g_ephemeris.evaluate(&jd, 1, g_ephemerisStates);
+
+  // Bodies of the scene: the position from the ephemeris, or a circular orbit
+  // around the parent (which comes first); then a spin around the tilted
+  // axis, and the size
+  for(size_t i = 0; i < g_scene.count(); ++i) {
+    const SceneBody &record = g_scene.body(i);
+    glm::dvec3 position;
+    if(g_ephemerisTargets[i] != Ephemeris::NUM_TARGETS) {
+      // Equatorial to ecliptic coordinates, then the ecliptic as the xz
+      // plane with its north pole up
+      const glm::dvec3 &p = g_ephemerisStates[g_ephemerisTargets[i]].position;
+      const double obliquity = glm::radians(kObliquityJ2000);
+      const glm::dvec3 ecliptic(p.x, std::cos(obliquity)*p.y + std::sin(obliquity)*p.z, -std::sin(obliquity)*p.y + std::cos(obliquity)*p.z);
+      position = (kEphemerisUnitsPerAu/g_ephemeris.au())*glm::dvec3(ecliptic.x, ecliptic.z, -ecliptic.y);
+    } else {
+      const double orbitAngle = record.orbitPhase + record.orbitSpeed*t;
+      position = glm::dvec3(std::cos(orbitAngle)*record.orbitRadius, record.orbitHeight, std::sin(orbitAngle)*record.orbitRadius);
+      if(record.parent != Scene::kNoParent)
+        position += glm::dvec3(g_bodies[record.parent].modelMatrix[3]);
+    }
+    const double tilt = glm::radians(static_cast<double>(record.axialTilt));
+    glm::dmat4 model = glm::translate(glm::dmat4(1.0), position);
+    model = glm::rotate(model, record.rotationSpeed*t, glm::dvec3(std::sin(tilt), std::cos(tilt), 0.0));
+    model = glm::scale(model, glm::dvec3(record.size));
+    setModelMatrix(g_bodies[i], model);
+  }
+  g_lightPositions[0] = glm::dvec3(g_bodies[g_lightBody].modelMatrix[3]);
+
+  // Asteroid belt
+  for(size_t i = 0; i < g_asteroids.size(); ++i) {
+    const Asteroid &asteroid = g_asteroids[i];
+    const double angle = asteroid.phase + asteroid.speed*t;
+    glm::dmat4 modelAsteroid = glm::translate(glm::dmat4(1.0), glm::dvec3(glm::cos(angle)*asteroid.radius, asteroid.height, glm::sin(angle)*asteroid.radius));
+    modelAsteroid = glm::scale(modelAsteroid, glm::dvec3(asteroid.size));
+    setModelMatrix(g_bodies[g_scene.count() + i], modelAsteroid);
+  }
+
+  for(size_t i = 0; i < g_lightOrbits.size(); ++i) {
+    const LightOrbit &orbit = g_lightOrbits[i];
+    const double angle = orbit.phase + orbit.speed*t;
+    g_lightPositions[1 + i] = glm::dvec3(glm::cos(angle)*orbit.radius, orbit.height, glm::sin(angle)*orbit.radius);
+  }
+
+  // Close approach: the camera hovers at the altitude over the body, on its
+  // day side, and looks ahead, just below the horizon. The near plane comes
+  // down with the altitude, and with the closest terrain (selectTerrain()).
+  g_camera.setNear(kCameraNear);
+  if(g_approachBody < g_scene.count()) {
+    const SceneBody &record = g_scene.body(g_approachBody);
+    const glm::dvec3 center(g_bodies[g_approachBody].modelMatrix[3]);
+    const double altitude = g_options.approachAltitudeKm/record.radiusKm*record.size;
+    glm::dvec3 toSun = g_lightPositions[0] - center;
+    toSun = glm::length(toSun) > 0.0 ? glm::normalize(toSun) : glm::dvec3(0.0, 0.0, 1.0);
+    glm::dvec3 side = glm::cross(glm::dvec3(0.0, 1.0, 0.0), toSun);
+    side = glm::length(side) > 0.0 ? glm::normalize(side) : glm::dvec3(1.0, 0.0, 0.0);
+    const double sunAngle = glm::radians(kApproachSunAngle);
+    const glm::dvec3 up = std::cos(sunAngle)*toSun + std::sin(sunAngle)*side;
+    double ground = record.size; // The altitude is above the terrain, where there is one
+    const int terrain = g_bodies[g_approachBody].terrain;
+    if(terrain >= 0)
+      ground *= 1.0 + g_terrain.surfaceHeight(terrain, glm::dvec3(glm::inverse(g_bodies[g_approachBody].modelMatrix)*glm::dvec4(up, 0.0)));
+    const glm::dvec3 ahead = glm::normalize(glm::cross(up, side));
+    const double pitch = std::min(0.5*M_PI, std::acos(ground/(ground + altitude)) + glm::radians(kApproachPitch));
+    const glm::dvec3 position = center + (ground + altitude)*up;
+    g_camera.setPosition(position);
+    g_camera.setTarget(position + std::cos(pitch)*ahead - std::sin(pitch)*up, up);
+    g_camera.setNear(std::max(kCameraMinNear, std::min(kCameraNear, static_cast<float>(0.5*altitude))));
+  }
+}
+
+
+
+void printUsage(const char *program) {
+  std::cout << "Usage: " << program << " [options]\n"
+            << "  --export <N>             render N frames off-screen at a fixed time step and exit\n"
+            << "  --export-format png|y4m  PNG sequence (default) or raw YUV4MPEG2 video\n"
+            << "  --export-output <path>   PNG directory, or Y4M file (\"-\" for stdout)\n"
+            << "  --export-size <W>x<H>    frame size (default 1920x1080)\n"
+            << "  --export-fps <fps>       simulation frames per second (default 60)\n"
+            << "  --export-start <sec>     simulation time of the first frame (default 0)\n"
+            << "  --export-threads <N>     encoder threads (default: cores - 1)\n"
+            << "  --export-pbos <N>        depth of the readback PBO ring (default 3)\n"
+            << "  --no-persistent-mapping  upload uniforms with glBufferSubData instead of a mapped ring\n"
+            << "  --render-path auto|cpu|gpu  per-draw loop, or compute culling and multi-draw indirect (GL 4.3);\n"
+            << "                           auto picks the GPU path from " << kGpuDrivenMinBodies << " bodies\n"
+            << "  --bodies <N>             add N asteroids between Mars and Jupiter\n"
+            << "  --sphere buffered|procedural|tessellated  sphere read from vertex buffers (default), generated from\n"
+            << "                           gl_VertexID, or refined by tessellation shaders by its size on screen (GL 4.0)\n"
+            << "  --sphere-resolution <N>  latitude and longitude segments of the sphere (default 16)\n"
+            << "  --benchmark <N>          render N frames off-screen with each sphere path and report the throughput\n"
+            << "  --impostor-radius <px>   ray-trace bodies smaller than this on screen on a square (default 16, 0 = never)\n"
+            << "  --main-belt <N>          add N main-belt bodies, animated on the GPU (up to " << kBeltMaxBodies << ")\n"
+            << "  --kuiper-belt <N>        add N Kuiper-belt bodies, animated on the GPU (up to " << kBeltMaxBodies << ")\n"
+            << "  --belt-seed <seed>       seed of the belt generator (default 1)\n"
+            << "  --lights <N>             add N colored point lights, binned per view-space cluster\n"
+            << "  --light-stats            report the lights evaluated per fragment on exit (GL 4.3, synchronizes every frame)\n"
+            << "  --no-hdr                 render straight to the 8-bit framebuffer, without bloom nor tone mapping\n"
+            << "  --exposure <x>           exposure before tone mapping (default 1)\n"
+            << "  --no-atmospheres         draw the planets without their atmospheres\n"
+            << "  --scene <file>           scene description (JSON) or its compiled form (default scenes/solarSystem.json)\n"
+            << "  --compile-scene <file>   compile the scene into this binary file, to be mapped by --scene, and exit\n"
+            << "  --ephemeris <file>       position the planets from a JPL DE binary ephemeris (e.g., linux_p1550p2650.440)\n"
+            << "  --epoch <JD>             Julian day (TDB) at time 0 with --ephemeris (default " << kJ2000 << ", J2000)\n"
+            << "  --ephemeris-benchmark <N>  evaluate the ephemeris at N random epochs, with and without SIMD, and exit\n"
+            << "  --tile-texture <image> <file.vt>  cut an image into the pages of a virtual texture and exit;\n"
+            << "                           scene textures ending in .vt are then streamed page by page; images\n"
+            << "                           over 2 GB must be binary PPM, which is read row by row\n"
+            << "  --page-budget <N>        virtual texture pages uploaded per frame and texture (default " << kVirtualPagesPerFrame << ")\n"
+            << "  --no-texture-streaming   load the textures whole at startup instead of streaming their mip levels\n"
+            << "  --stream-budget <KB>     texture mip levels uploaded per frame (default " << kStreamBudget/1024 << ")\n"
+            << "  --texture-budget <MB>    GPU memory of the streamed textures, whose finest levels are evicted\n"
+            << "                           least recently visible first (default " << kTextureBudget << ", 0 = no limit)\n"
+            << "  --texture-stats          report the residency of the streamed textures every frame\n"
+            << "  --approach <body> <km>   hover at this altitude over a body of the scene, whose height map (if any)\n"
+            << "                           is drawn as terrain; the scene gives its radiusKm\n"
+            << "  --depth standard|reversed|log  depth buffer: standard, reversed-Z into 32-bit float (GL 4.5),\n"
+            << "                           or logarithmic, written by the shaders (default standard)\n"
+#ifdef GL_TRACE
+            << "  --gl-trace <file>        report the GL calls and their time in the driver every frame (\"-\" for stdout)\n"
+#endif
+            << "  --post-budget <ms>       GPU budget of the post-processing, checked on exit (default "
+            << kPostBudgetMs << ", " << kPostBudgetSoftwareMs << " on llvmpipe)" << std::endl;
+}
+
+// Parses a whole decimal number within [min, max], or exits
+unsigned int parseCount(const char *text, const char *name, long min, long max) {
+  char *end = nullptr;
+  const long value = std::strtol(text, &end, 10);
+  if(end == text || *end != '\0' || value < min || value > max) {
+    std::cerr << "ERROR: Invalid number of " << name << " " << text << ", expected " << min << " to " << max << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  return static_cast<unsigned int>(value);
+}
+
+void parseOptions(int argc, char **argv) {
+  for(int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if(!std::strcmp(arg, "--export") && hasValue) {
+      g_options.exportFrames = std::atoi(argv[++i]);
+    } else if(!std::strcmp(arg, "--export-format") && hasValue) {
+      ++i;
+      g_options.exportSettings.format = std::strcmp(argv[i], "y4m") ? Exporter::FORMAT_PNG : Exporter::FORMAT_Y4M;
+    } else if(!std::strcmp(arg, "--export-output") && hasValue) {
+      g_options.exportSettings.output = argv[++i];
+    } else if(!std::strcmp(arg, "--export-size") && hasValue) {
+      ++i;
+      int width = 0, height = 0, length = 0;
+      if(std::sscanf(argv[i], "%dx%d%n", &width, &height, &length) != 2 || argv[i][length] != '\0'
+         || width < 2 || height < 2 || width > kExportMaxSize || height > kExportMaxSize) {
+        std::cerr << "ERROR: Invalid export size " << argv[i] << ", expected <W>x<H> from 2 to " << kExportMaxSize << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+      g_options.exportSettings.width = width;
+      g_options.exportSettings.height = height;
+    } else if(!std::strcmp(arg, "--export-fps") && hasValue) {
+      g_options.exportSettings.fps = std::max(1, std::atoi(argv[++i]));
+    } else if(!std::strcmp(arg, "--export-start") && hasValue) {
+      g_options.exportStartTime = std::atof(argv[++i]);
+    } else if(!std::strcmp(arg, "--export-threads") && hasValue) {
+      g_options.exportSettings.numThreads = parseCount(argv[++i], "export threads", 1, kExportMaxThreads);
+    } else if(!std::strcmp(arg, "--export-pbos") && hasValue) {
+      g_options.exportSettings.numPbos = parseCount(argv[++i], "export PBOs", 2, kExportMaxPbos);
+    } else if(!std::strcmp(arg, "--no-persistent-mapping")) {
+      g_options.persistentMapping = false;
+    } else if(!std::strcmp(arg, "--render-path") && hasValue) {
+      ++i;
+      g_options.renderPath = !std::strcmp(argv[i], "gpu") ? Options::RENDER_PATH_GPU
+        : !std::strcmp(argv[i], "cpu") ? Options::RENDER_PATH_CPU : Options::RENDER_PATH_AUTO;
+    } else if(!std::strcmp(arg, "--bodies") && hasValue) {
+      g_options.numAsteroids = std::max(0, std::atoi(argv[++i]));
+    } else if(!std::strcmp(arg, "--sphere") && hasValue) {
+      ++i;
+      g_options.spherePath = !std::strcmp(argv[i], "procedural") ? Options::SPHERE_PROCEDURAL
+        : !std::strcmp(argv[i], "tessellated") ? Options::SPHERE_TESSELLATED : Options::SPHERE_BUFFERED;
+    } else if(!std::strcmp(arg, "--sphere-resolution") && hasValue) {
+      g_options.sphereResolution = std::max(3, std::atoi(argv[++i]));
+    } else if(!std::strcmp(arg, "--main-belt") && hasValue) {
+      g_options.mainBeltCount = parseCount(argv[++i], "main-belt bodies", 0, kBeltMaxBodies);
+    } else if(!std::strcmp(arg, "--kuiper-belt") && hasValue) {
+      g_options.kuiperBeltCount = parseCount(argv[++i], "Kuiper-belt bodies", 0, kBeltMaxBodies);
+    } else if(!std::strcmp(arg, "--belt-seed") && hasValue) {
+      g_options.beltSeed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if(!std::strcmp(arg, "--lights") && hasValue) {
+      g_options.numLights = std::max(0, std::atoi(argv[++i]));
+    } else if(!std::strcmp(arg, "--light-stats")) {
+      g_options.lightStats = true;
+    } else if(!std::strcmp(arg, "--no-hdr")) {
+      g_options.hdr = false;
+    } else if(!std::strcmp(arg, "--exposure") && hasValue) {
+      g_options.exposure = static_cast<float>(std::atof(argv[++i]));
+    } else if(!std::strcmp(arg, "--post-budget") && hasValue) {
+      g_options.postBudgetMs = std::atof(argv[++i]);
+#ifdef GL_TRACE
+    } else if(!std::strcmp(arg, "--gl-trace") && hasValue) {
+      g_options.glTracePath = argv[++i];
+#endif
+    } else if(!std::strcmp(arg, "--no-atmospheres")) {
+      g_options.atmospheres = false;
+    } else if(!std::strcmp(arg, "--scene") && hasValue) {
+      g_options.scenePath = argv[++i];
+    } else if(!std::strcmp(arg, "--compile-scene") && hasValue) {
+      g_options.compiledScenePath = argv[++i];
+    } else if(!std::strcmp(arg, "--ephemeris") && hasValue) {
+      g_options.ephemerisPath = argv[++i];
+    } else if(!std::strcmp(arg, "--epoch") && hasValue) {
+      g_options.epoch = std::atof(argv[++i]);
+    } else if(!std::strcmp(arg, "--ephemeris-benchmark") && hasValue) {
+      g_options.ephemerisBenchmark = std::max(1, std::atoi(argv[++i]));
+    } else if(!std::strcmp(arg, "--tile-texture") && i + 2 < argc) {
+      g_options.tileImagePath = argv[++i];
+      g_options.tiledPath = argv[++i];
+    } else if(!std::strcmp(arg, "--page-budget") && hasValue) {
+      g_options.pagesPerFrame = std::max(1, std::atoi(argv[++i]));
+    } else if(!std::strcmp(arg, "--no-texture-streaming")) {
+      g_options.textureStreaming = false;
+    } else if(!std::strcmp(arg, "--stream-budget") && hasValue) {
+      g_options.streamBudget = static_cast<size_t>(std::max(1, std::atoi(argv[++i])))*1024;
+    } else if(!std::strcmp(arg, "--texture-budget") && hasValue) {
+      g_options.textureBudget = static_cast<size_t>(std::max(0, std::atoi(argv[++i])))*1024*1024;
+    } else if(!std::strcmp(arg, "--texture-stats")) {
+      g_options.textureStats = true;
+    } else if(!std::strcmp(arg, "--approach") && i + 2 < argc) {
+      g_options.approachBody = argv[++i];
+      g_options.approachAltitudeKm = std::max(0.0, std::atof(argv[++i]));
+    } else if(!std::strcmp(arg, "--depth") && hasValue) {
+      ++i;
+      g_options.depthMode = !std::strcmp(argv[i], "reversed") ? DEPTH_REVERSED
+        : !std::strcmp(argv[i], "log") ? DEPTH_LOGARITHMIC : DEPTH_STANDARD;
+    } else if(!std::strcmp(arg, "--impostor-radius") && hasValue) {
+      g_options.impostorPixelRadius = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+    } else if(!std::strcmp(arg, "--benchmark") && hasValue) {
+      g_options.benchmarkFrames = std::max(1, std::atoi(argv[++i]));
+    } else {
+      printUsage(argv[0]);
+      std::exit(std::strcmp(arg, "--help") ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+  }
+}
+
+// Renders the animation at a fixed time step into the exporter, independent
+// of real time; false when the export could not be written
+bool runExport() {
+  const Exporter::Settings &settings = g_options.exportSettings;
+  if(!g_exporter.init(settings))
+    return false;
+  g_camera.setAspectRatio(static_cast<float>(settings.width)/static_cast<float>(settings.height));
+  g_viewportWidth = settings.width;
+  g_viewportHeight = settings.height;
+  // Pages stream in within the frame that needs them, whatever the loader timing
+  g_virtualFeedback.setSynchronous(true);
+  for(auto &texture : g_virtualTextures)
+    texture->setSynchronous(true);
+  g_textureStreamer.setSynchronous(true);
+  g_terrain.setSynchronous(true);
+  for(int i = 0; i < g_options.exportFrames && !glfwWindowShouldClose(g_window); ++i) {
+    update(g_options.exportStartTime + static_cast<double>(i)/settings.fps);
+    g_shaders.poll();
+    g_exporter.beginFrame();
+    render();
+    g_exporter.endFrame();
+    glfwPollEvents();
+  }
+  return g_exporter.finish();
 }
 
+// Renders the same frames with the buffered, the procedural and (with GL 4.0)
+// the tessellated sphere into an off-screen target, and compares their
+// throughput and the primitives they rasterize
+void runBenchmark() {
+  const GLsizei width = 1024, height = 768;
+  GLuint fbo, rbos[2];
+  glGenFramebuffers(1, &fbo);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glGenRenderbuffers(2, rbos);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, rbos[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbos[0]);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, rbos[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, depthFormat(), width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbos[1]);
+  g_glState.bindRenderbuffer(GL_RENDERBUFFER, 0);
+  g_glState.viewport(0, 0, width, height);
+  g_camera.setAspectRatio(static_cast<float>(width)/static_cast<float>(height));
+  g_viewportWidth = width;
+  g_viewportHeight = height;
+  GLuint queries[2]; // Time, primitives
+  glGenQueries(2, queries);
+
+  const int res = g_options.sphereResolution;
+  const size_t bufferedBytes = sizeof(float)*(sphere->vertexPositions().size() + sphere->vertexNormals().size() + sphere->vertexTexCoords().size())
+    + sizeof(unsigned int)*sphere->triangleIndices().size();
+  std::cout << "Benchmark: " << g_options.benchmarkFrames << " frames " << width << "x" << height << ", "
+            << g_bodies.size() << " bodies, sphere resolution " << res << " ("
+            << ProceduralSphere::vertexCount(res)/3 << " triangles)" << std::endl;
+  const char *names[Options::NUM_SPHERE_PATHS] = { "buffered", "procedural", "tessellated" };
+  const size_t geometryBytes[Options::NUM_SPHERE_PATHS] = { bufferedBytes, 0, g_tessellatedSphere.bufferBytes() };
+  for(int pass = 0; pass < Options::NUM_SPHERE_PATHS; ++pass) {
+    g_spherePath = static_cast<Options::SpherePath>(pass);
+    if(g_spherePath == Options::SPHERE_TESSELLATED && !g_glCaps.tessellation)
+      continue;
+    initShaderLibrary(g_spherePath);
+    prefetchUsedVariants();
+    if(!g_virtualTextures.empty())
+      initVirtualFeedback();
+    update(0.0);
+    render(); // Warm-up: finishes the compilation of the variants
+    glFinish();
+
+    Timer timer;
+    glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+    glBeginQuery(GL_PRIMITIVES_GENERATED, queries[1]);
+    for(int i = 0; i < g_options.benchmarkFrames; ++i) {
+      update(i/60.0);
+      render();
+    }
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+    glEndQuery(GL_TIME_ELAPSED);
+    glFinish();
+    const double wallMs = timer.elapsedMs();
+    GLuint64 gpuNs = 0, primitives = 0;
+    glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &gpuNs);
+    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &primitives);
+    std::printf("  %-11s %9.1f frames/s  %8.3f ms/frame  GPU %8.3f ms/frame  %9.0f primitives/frame  geometry %zu bytes\n",
+                names[pass], 1000.0*g_options.benchmarkFrames/wallMs, wallMs/g_options.benchmarkFrames,
+                1e-6*gpuNs/g_options.benchmarkFrames, static_cast<double>(primitives)/g_options.benchmarkFrames, geometryBytes[pass]);
+  }
+  std::fflush(stdout);
 
+  glDeleteQueries(2, queries);
+  g_glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+  g_glState.deleteRenderbuffers(2, rbos);
+  g_glState.deleteFramebuffers(1, &fbo);
+}
+
+// Batch throughput of the ephemeris, in body-epochs per second, at random
+// epochs (each one finds its record), with the SSE2 and the scalar recurrence
+int runEphemerisBenchmark() {
+  Ephemeris ephemeris;
+  if(g_options.ephemerisPath.empty() || !ephemeris.load(g_options.ephemerisPath)) {
+    std::cerr << "ERROR: The ephemeris benchmark needs an ephemeris (--ephemeris <file>)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::mt19937 rng(2026);
+  std::uniform_real_distribution<double> epoch(ephemeris.startEpoch(), ephemeris.endEpoch());
+  std::vector<double> epochs(g_options.ephemerisBenchmark);
+  for(double &e : epochs)
+    e = epoch(rng);
+  std::vector<Ephemeris::State> states[2];
+  char line[256];
+  std::snprintf(line, sizeof(line), "Ephemeris benchmark: DE%d, %zu epochs x %d bodies", ephemeris.version(), epochs.size(),
+                static_cast<int>(Ephemeris::NUM_TARGETS));
+  std::cout << line << std::endl;
+  // An untimed pass faults the records in, then both paths alternate so that
+  // neither runs on a colder cache, and the best of the rounds is kept
+  states[0].resize(epochs.size()*Ephemeris::NUM_TARGETS);
+  states[1].resize(epochs.size()*Ephemeris::NUM_TARGETS);
+  ephemeris.evaluate(epochs.data(), epochs.size(), states[0].data(), true);
+  double bestMs[2] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+  for(int round = 0; round < kEphemerisBenchmarkRounds; ++round) {
+    for(int pass = 0; pass < 2; ++pass) {
+      Timer timer;
+      ephemeris.evaluate(epochs.data(), epochs.size(), states[pass].data(), pass == 0);
+      bestMs[pass] = std::min(bestMs[pass], timer.elapsedMs());
+    }
+  }
+  for(int pass = 0; pass < 2; ++pass) {
+    std::snprintf(line, sizeof(line), "  %-7s %8.2f M body-epochs/s (%.1f ns each)", pass == 0 ? "SIMD" : "scalar",
+                  1e-3*states[pass].size()/bestMs[pass], 1e6*bestMs[pass]/states[pass].size());
+    std::cout << line << std::endl;
+  }
+  double maxDifference = 0.0;
+  for(size_t i = 0; i < states[0].size(); ++i)
+    maxDifference = std::max(maxDifference, glm::length(states[0][i].position - states[1][i].position));
+  std::snprintf(line, sizeof(line), "  largest difference between both: %.3g km", maxDifference);
+  std::cout << line << std::endl;
+  return EXIT_SUCCESS;
+}
 
 int main(int argc, char ** argv) {
+  parseOptions(argc, argv);
+  if(g_options.ephemerisBenchmark > 0)
+    return runEphemerisBenchmark();
+  if(!g_options.tiledPath.empty()) {
+    Timer timer;
+    if(!VirtualTexture::tile(g_options.tileImagePath, g_options.tiledPath))
+      return EXIT_FAILURE;
+    char line[256];
+    std::snprintf(line, sizeof(line), "Tiled %s into %s in %.1f ms", g_options.tileImagePath.c_str(), g_options.tiledPath.c_str(),
+                  timer.elapsedMs());
+    std::cout << line << std::endl;
+    return EXIT_SUCCESS;
+  }
+  if(!g_options.compiledScenePath.empty()) {
+    Timer timer;
+    if(!Scene::compile(g_options.scenePath, g_options.compiledScenePath))
+      return EXIT_FAILURE;
+    char line[256];
+    std::snprintf(line, sizeof(line), "Compiled %s into %s in %.1f ms", g_options.scenePath.c_str(),
+                  g_options.compiledScenePath.c_str(), timer.elapsedMs());
+    std::cout << line << std::endl;
+    return EXIT_SUCCESS;
+  }
+  if(g_options.benchmarkFrames > 0)
+    g_options.renderPath = Options::RENDER_PATH_CPU; // The sphere paths are compared on the per-draw loop
   init(); // Your initialization code (user interface, OpenGL states, scene with geometry, material, lights, etc)
+  if(g_options.benchmarkFrames > 0) {
+    runBenchmark();
+    clear();
+    return EXIT_SUCCESS;
+  }
+  if(g_options.exportFrames > 0) {
+    const bool exported = runExport();
+    clear();
+    return exported ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  // Events are polled right before the frame that uses them, rather than
+  // after the swap, where they would wait for a whole frame
+  double lastTime = glfwGetTime();
   while(!glfwWindowShouldClose(g_window)) {
-    update(static_cast<float>(glfwGetTime()));
+    glfwPollEvents();
+    const double time = glfwGetTime();
+    if(g_approachBody == g_scene.count())
+      g_cameraController.update(g_camera, std::min(time - lastTime, kMaxFrameStep));
+    lastTime = time;
+    update(time);
+    g_shaders.poll();
     render();
     glfwSwapBuffers(g_window);
-    glfwPollEvents();
+    g_inputLatency.present();
   }
   clear();
   return EXIT_SUCCESS;
 }
-
-
-
-
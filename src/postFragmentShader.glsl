@@ -0,0 +1,82 @@
+#version 330 core
+
+// Passes of the HDR post-processing, selected by the #defines injected by
+// PostProcess.cpp:
+//   PREFILTER   soft threshold of the scene, then the first downsample
+//   DOWNSAMPLE  dual-filter downsample: 5 bilinear taps, to half resolution
+//   UPSAMPLE    dual-filter upsample: 8 bilinear taps, added to the level above
+//   COMPOSITE   scene plus bloom, exposure and tone mapping to the output
+// The dual filter (Bjorge, "Bandwidth-Efficient Rendering", 2015) reaches
+// a wide blur through the chain of resolutions: each pass reads a few taps
+// of a texture four times smaller than the previous one.
+
+in vec2 fTexCoord;
+out vec4 color;
+
+uniform sampler2D source;  // Scene or previous level, on texture unit 0
+uniform vec2 halfTexel;    // Half the texel size of source
+
+#if defined(PREFILTER) || defined(DOWNSAMPLE)
+#ifdef PREFILTER
+uniform vec4 threshold;    // Threshold, knee, 2 knee, 0.25 / knee
+
+// Keeps what exceeds the threshold, with a quadratic knee instead of a hard
+// cut; applied once to the filtered value rather than to every tap
+vec3 prefilter(vec3 c) {
+    float brightness = max(c.r, max(c.g, c.b));
+    float soft = clamp(brightness - threshold.x + threshold.y, 0.0, threshold.z);
+    soft = soft * soft * threshold.w;
+    return c * max(soft, brightness - threshold.x) / max(brightness, 1e-4);
+}
+#endif
+
+void main()
+{
+    vec3 sum = texture(source, fTexCoord).rgb * 4.0;
+    sum += texture(source, fTexCoord - halfTexel).rgb;
+    sum += texture(source, fTexCoord + halfTexel).rgb;
+    sum += texture(source, fTexCoord + vec2(halfTexel.x, -halfTexel.y)).rgb;
+    sum += texture(source, fTexCoord - vec2(halfTexel.x, -halfTexel.y)).rgb;
+#ifdef PREFILTER
+    color = vec4(prefilter(sum * 0.125), 1.0);
+#else
+    color = vec4(sum * 0.125, 1.0);
+#endif
+}
+#endif
+
+#ifdef UPSAMPLE
+void main()
+{
+    vec3 sum = texture(source, fTexCoord + vec2(-2.0 * halfTexel.x, 0.0)).rgb;
+    sum += texture(source, fTexCoord + vec2(-halfTexel.x, halfTexel.y)).rgb * 2.0;
+    sum += texture(source, fTexCoord + vec2(0.0, 2.0 * halfTexel.y)).rgb;
+    sum += texture(source, fTexCoord + vec2(halfTexel.x, halfTexel.y)).rgb * 2.0;
+    sum += texture(source, fTexCoord + vec2(2.0 * halfTexel.x, 0.0)).rgb;
+    sum += texture(source, fTexCoord + vec2(halfTexel.x, -halfTexel.y)).rgb * 2.0;
+    sum += texture(source, fTexCoord + vec2(0.0, -2.0 * halfTexel.y)).rgb;
+    sum += texture(source, fTexCoord + vec2(-halfTexel.x, -halfTexel.y)).rgb * 2.0;
+    color = vec4(sum / 12.0, 1.0); // Blended additively over the level above
+}
+#endif
+
+#ifdef COMPOSITE
+uniform sampler2D bloom;   // Top of the bloom chain, on texture unit 1
+uniform float bloomIntensity;
+uniform float exposure;
+
+// Identity up to the knee, so that colors in [0, KNEE] look as they did
+// without HDR, then a rational shoulder (no transcendental) with the same
+// slope at the knee, which reaches 1 asymptotically
+#define KNEE 0.8
+vec3 toneMap(vec3 c) {
+    vec3 t = max(c - KNEE, 0.0) / (1.0 - KNEE);
+    return min(c, KNEE + (1.0 - KNEE) * t / (1.0 + t));
+}
+
+void main()
+{
+    vec3 hdr = texture(source, fTexCoord).rgb + bloomIntensity * texture(bloom, fTexCoord).rgb;
+    color = vec4(toneMap(exposure * hdr), 1.0);
+}
+#endif
@@ -0,0 +1,12 @@
+#version 330 core
+
+// Full-screen triangle for the post-processing passes, without vertex
+// buffers: (-1, -1), (3, -1), (-1, 3)
+out vec2 fTexCoord;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    fTexCoord = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
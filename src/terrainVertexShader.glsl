@@ -0,0 +1,110 @@
+#version 330 core
+
+// Patches of the cube-sphere terrain (Terrain.cpp), drawn instanced: a grid
+// of gridSize x gridSize quads on a square of a cube face, projected on the
+// unit sphere and displaced by the height map. Near the end of the range of
+// its level, each odd vertex morphs toward the midpoint of its even
+// neighbors, where the grid of the next coarser level puts the edge, so that
+// the patch meets a coarser neighbor without cracks nor popping.
+#include "cubeSphere.glsl"
+#include "impostor.glsl"
+
+layout(location=0) in vec2 vGrid;   // Vertex of the grid, in quads from the corner of the patch
+layout(location=3) in vec4 vOrigin; // Corner of the patch on the cube face in [-1, 1]^2, size on the face, face
+layout(location=4) in vec4 vMorph;  // Distances where the morph starts and ends, level of the height map
+
+uniform sampler2D heightMap;
+uniform vec3 terrainCamera;         // In the frame of the body, where it is the unit sphere
+uniform float heightScale;          // Height of the white texels
+uniform float gridSize;             // Quads across the patch: the whole grid, or half of it for a quarter
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    vec4 objectColor;
+    uint occluderMask;
+};
+
+#ifdef LOG_DEPTH
+out float fClipW;
+#endif
+#ifdef LIT
+out vec3 fNormal;
+out vec3 fPosition;
+#endif
+#ifdef TEXTURED
+out vec3 fDirection; // In the frame of the body, for the texture coordinates of each fragment
+#endif
+
+// As in Terrain.cpp: u x v is the outward normal of the face
+const vec3 kFaceNormals[6] = vec3[6](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 kFaceU[6] = vec3[6](vec3(0, 0, -1), vec3(0, 0, 1), vec3(1, 0, 0), vec3(1, 0, 0), vec3(1, 0, 0), vec3(-1, 0, 0));
+const vec3 kFaceV[6] = vec3[6](vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 0, -1), vec3(0, 0, 1), vec3(0, 1, 0), vec3(0, 1, 0));
+
+// Direction of a grid vertex, with the cube-to-sphere mapping of Terrain.cpp
+vec3 gridDirection(vec2 grid)
+{
+    int face = int(vOrigin.w);
+    vec2 st = vOrigin.xy + grid * (vOrigin.z / gridSize);
+    return cubeToSphere(kFaceNormals[face] + st.x * kFaceU[face] + st.y * kFaceV[face]);
+}
+
+// Morph of a grid vertex, from its distance on the unit sphere: a function of
+// its position only, so that the patches sharing it agree
+float morphFactor(vec3 direction)
+{
+    return clamp((distance(direction, terrainCamera) - vMorph.x) / (vMorph.y - vMorph.x), 0.0, 1.0);
+}
+
+// Displaced grid vertex. The height map is read one level coarser as the
+// vertex morphs, as the coarser patch next to it reads it.
+vec3 gridPosition(vec2 grid, out float morph)
+{
+    vec3 direction = gridDirection(grid);
+    morph = morphFactor(direction);
+    float height = textureLod(heightMap, sphereTexCoord(direction), max(vMorph.z + morph, 0.0)).r;
+    return direction * (1.0 + heightScale * height);
+}
+
+void main()
+{
+    float morph, unused;
+    vec3 position = gridPosition(vGrid, morph);
+    vec3 left = gridPosition(vGrid - vec2(1.0, 0.0), unused);
+    vec3 right = gridPosition(vGrid + vec2(1.0, 0.0), unused);
+    vec3 down = gridPosition(vGrid - vec2(0.0, 1.0), unused);
+    vec3 up = gridPosition(vGrid + vec2(0.0, 1.0), unused);
+    vec3 normal = normalize(cross(right - left, up - down));
+
+    // Odd vertices on the edges of the coarser quads move to the middle of
+    // the edge; those at their centers, to the middle of their diagonal
+    vec2 odd = mod(vGrid, 2.0);
+    if (odd.x > 0.5 && odd.y > 0.5)
+        position = mix(position, 0.5 * (gridPosition(vGrid - odd, unused) + gridPosition(vGrid + odd, unused)), morph);
+    else if (odd.x > 0.5)
+        position = mix(position, 0.5 * (left + right), morph);
+    else if (odd.y > 0.5)
+        position = mix(position, 0.5 * (down + up), morph);
+
+    vec4 worldPosition = modelMatrix * vec4(position, 1.0);
+#ifdef LIT
+    fPosition = vec3(worldPosition);
+    fNormal = mat3(normalMatrix) * normal;
+#endif
+#ifdef TEXTURED
+    fDirection = position;
+#endif
+    gl_Position = viewProjMat * worldPosition;
+#ifdef LOG_DEPTH
+    fClipW = gl_Position.w;
+#endif
+}
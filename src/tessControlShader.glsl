@@ -0,0 +1,108 @@
+#version 400 core
+
+// Tessellation factors of the base patches of TessellatedSphere.cpp. Each
+// edge is cut so that its pieces span about edgePixels on screen, measured
+// from its two corners only, so that the patches sharing it agree and meet
+// without cracks. Patches outside the frustum or on the far side of the
+// body get factors of 0, which drops them before any vertex is generated.
+#include "cubeSphere.glsl"
+
+layout(vertices = 4) out;
+
+in vec3 cCube[];
+out vec3 eCube[];
+
+uniform float pixelScale;  // Pixels per unit of size at a unit view distance
+uniform float edgePixels;  // Target length of the generated edges on screen
+uniform float heightScale; // Height of the white texels of the height map, 0 without one
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    vec4 objectColor;
+    uint occluderMask;
+};
+
+// Factor of the edge between two corners, in world space: the screen size of
+// the sphere whose diameter is the edge, which does not depend on its
+// direction nor on the patch
+float edgeLevel(vec3 a, vec3 b)
+{
+    float distanceToEdge = max(distance(0.5 * (a + b), camPosition.xyz), 1e-6);
+    return clamp(distance(a, b) * pixelScale / (distanceToEdge * edgePixels), 1.0, float(gl_MaxTessGenLevel));
+}
+
+// Whether none of the patch can be seen: its bounding sphere is outside a
+// side plane of the frustum or, without displacement, the cap of the sphere
+// it spans faces away from the camera
+bool isCulled(vec3 directions[4])
+{
+    vec3 center = normalize(directions[0] + directions[1] + directions[2] + directions[3]);
+    float cosCap = 1.0;
+    float radius = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        cosCap = min(cosCap, dot(directions[i], center));
+        radius = max(radius, distance(directions[i], center));
+    }
+
+    float scale = length(modelMatrix[0].xyz); // Bodies are uniformly scaled unit spheres
+    vec3 worldCenter = vec3(modelMatrix * vec4(center, 1.0));
+    float worldRadius = (radius + heightScale) * scale;
+    mat4 m = transpose(viewProjMat);
+    vec4 planes[4] = vec4[4](m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1]);
+    for (int i = 0; i < 4; ++i) {
+        if (dot(planes[i].xyz, worldCenter) + planes[i].w < -worldRadius * length(planes[i].xyz))
+            return true;
+    }
+
+    // The cap comes closest to the eye's direction at the angle between them,
+    // less its own half-angle
+    vec3 eye = transpose(mat3(modelMatrix)) * (camPosition.xyz - modelMatrix[3].xyz) / (scale * scale);
+    float eyeDistance = length(eye);
+    float angle = acos(clamp(dot(center, eye) / eyeDistance, -1.0, 1.0)) - acos(cosCap);
+    if (heightScale > 0.0) {
+        // Displaced: hidden by the sphere beneath, which the heights never
+        // go below, when beyond its horizon by more than a peak rises above it
+        return eyeDistance > 1.0 && angle > acos(cosCap / eyeDistance) + acos(1.0 / (1.0 + heightScale));
+    }
+    // A triangle of the cap faces the eye only if the eye is above its plane,
+    // at least cosCap from the center
+    return eyeDistance * cos(max(angle, 0.0)) < cosCap;
+}
+
+void main()
+{
+    eCube[gl_InvocationID] = cCube[gl_InvocationID];
+    if (gl_InvocationID != 0)
+        return;
+
+    vec3 directions[4];
+    vec3 corners[4];
+    for (int i = 0; i < 4; ++i) {
+        directions[i] = cubeToSphere(cCube[i]);
+        corners[i] = vec3(modelMatrix * vec4(directions[i], 1.0));
+    }
+    if (isCulled(directions)) {
+        gl_TessLevelOuter[0] = gl_TessLevelOuter[1] = gl_TessLevelOuter[2] = gl_TessLevelOuter[3] = 0.0;
+        gl_TessLevelInner[0] = gl_TessLevelInner[1] = 0.0;
+        return;
+    }
+
+    // Corners 0 to 3 are at (u, v) = (0, 0), (1, 0), (1, 1), (0, 1); the
+    // outer factors are those of the edges u = 0, v = 0, u = 1 and v = 1
+    gl_TessLevelOuter[0] = edgeLevel(corners[0], corners[3]);
+    gl_TessLevelOuter[1] = edgeLevel(corners[0], corners[1]);
+    gl_TessLevelOuter[2] = edgeLevel(corners[1], corners[2]);
+    gl_TessLevelOuter[3] = edgeLevel(corners[3], corners[2]);
+    gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+    gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+}
@@ -0,0 +1,96 @@
+#version 400 core
+
+// Vertices generated in the base patches of TessellatedSphere.cpp: the point
+// of the cube face, projected on the unit sphere and displaced by the height
+// map when the body has one. The level of the height map and the normal
+// follow the size of the generated edges around the vertex, from its position
+// only, so that the patches sharing it read the same height and normal.
+#include "cubeSphere.glsl"
+#include "impostor.glsl"
+
+layout(quads, fractional_odd_spacing, ccw) in;
+
+in vec3 eCube[];
+
+uniform sampler2D heightMap;
+uniform float pixelScale;
+uniform float edgePixels;
+uniform float heightScale;
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    vec4 objectColor;
+    uint occluderMask;
+};
+
+#ifdef LOG_DEPTH
+out float fClipW;
+#endif
+#ifdef LIT
+out vec3 fNormal;
+out vec3 fPosition;
+#endif
+#ifdef TEXTURED
+out vec3 fDirection; // In the frame of the body, for the texture coordinates of each fragment
+#endif
+
+// Length of the generated edges around a point of the surface, in the frame
+// of the body: edgePixels on screen at its distance
+float edgeLength(vec3 direction)
+{
+    return edgePixels * distance(vec3(modelMatrix * vec4(direction, 1.0)), camPosition.xyz) / (pixelScale * length(modelMatrix[0].xyz));
+}
+
+// Point of the surface in a direction, in the frame of the body
+vec3 surfacePoint(vec3 direction)
+{
+    if (heightScale <= 0.0)
+        return direction;
+    // Level whose texels are as long as the edges around the vertex; a texel
+    // spans 2 pi / width radians at the equator
+    float texelLength = 6.28318531 / float(textureSize(heightMap, 0).x);
+    float lod = max(log2(edgeLength(direction) / texelLength), 0.0);
+    return direction * (1.0 + heightScale * textureLod(heightMap, sphereTexCoord(direction), lod).r);
+}
+
+void main()
+{
+    vec3 direction = cubeToSphere(mix(mix(eCube[0], eCube[1], gl_TessCoord.x), mix(eCube[3], eCube[2], gl_TessCoord.x), gl_TessCoord.y));
+    vec3 position = surfacePoint(direction);
+    vec3 normal = position;
+    if (heightScale > 0.0) {
+        // From the neighbors about one generated edge away, along a tangent
+        // frame of the direction: the step and the frame only depend on the
+        // vertex, not on the levels of the patch, so that the patches sharing
+        // it compute the same normal and meet without a lighting seam
+        float step = edgeLength(direction);
+        vec3 tangent = normalize(cross(abs(direction.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), direction));
+        vec3 bitangent = cross(direction, tangent);
+        vec3 du = surfacePoint(normalize(direction + step * tangent)) - surfacePoint(normalize(direction - step * tangent));
+        vec3 dv = surfacePoint(normalize(direction + step * bitangent)) - surfacePoint(normalize(direction - step * bitangent));
+        normal = cross(du, dv);
+    }
+
+    vec4 worldPosition = modelMatrix * vec4(position, 1.0);
+#ifdef LIT
+    fPosition = vec3(worldPosition);
+    fNormal = mat3(normalMatrix) * normal;
+#endif
+#ifdef TEXTURED
+    fDirection = position;
+#endif
+    gl_Position = viewProjMat * worldPosition;
+#ifdef LOG_DEPTH
+    fClipW = gl_Position.w;
+#endif
+}
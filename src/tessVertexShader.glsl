@@ -0,0 +1,13 @@
+#version 400 core
+
+// Corners of the base patches of TessellatedSphere.cpp, on the cube; the
+// tessellation stages (tessControlShader.glsl, tessEvaluationShader.glsl)
+// refine them and project them on the sphere
+layout(location=0) in vec3 vCube;
+
+out vec3 cCube;
+
+void main()
+{
+    cCube = vCube;
+}
@@ -1,22 +1,91 @@
 #version 330 core
 
+#if defined(IMPOSTOR)
+// Camera-facing square around the body, drawn as a 4-vertex triangle strip
+// without vertex buffers; fragmentShader.glsl ray-traces the sphere inside
+#include "impostor.glsl"
+#elif defined(PROCEDURAL_SPHERE)
+// No vertex buffers: the unit sphere of Mesh::genSphere() is rebuilt from
+// gl_VertexID, two triangles per latitude/longitude quad
+uniform int sphereResolution;
+
+const ivec2 kQuadCorners[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1)); // (lat, lon) offsets, in the order of Mesh::genSphere()
+#else
 layout(location=0) in vec3 vPosition; // input vertex positions
 layout(location=1) in vec3 vNormal; // input vertex normals
 layout(location=2) in vec2 vTexCoord; //input texture coordinates
+#endif
+
+layout(std140) uniform FrameBlock {
+    mat4 viewMat;
+    mat4 projMat;
+    mat4 viewProjMat;  // projMat * viewMat
+    vec4 camPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+};
+
+layout(std140) uniform ObjectBlock {
+    mat4 modelMatrix;
+    mat4 normalMatrix; // inverse transpose of modelMatrix, computed once per object on the CPU
+    vec4 objectColor;
+    uint occluderMask;
+};
 
-uniform mat4 viewMat, projMat,modelMatrix;
+#if defined(LOG_DEPTH) && !defined(IMPOSTOR)
+out float fClipW;        // View distance, for the logarithmic depth (impostors compute theirs)
+#endif
 
+#if defined(IMPOSTOR)
+out vec3 fPosition;      // Point of the square in world space
+flat out vec4 fSphere;   // Center and radius of the body
+#ifdef TEXTURED
+flat out mat3 fRotation; // Orientation of the body, for its texture coordinates
+#endif
+#else
+#ifdef LIT
 out vec3 fNormal;
 out vec3 fPosition;
+#endif
+#ifdef TEXTURED
 out vec2 fTexCoord;
+#endif
+#endif
 
 void main() 
 {
+#if defined(IMPOSTOR)
+    float radius = length(modelMatrix[0].xyz); // Bodies are uniformly scaled unit spheres
+    fSphere = vec4(modelMatrix[3].xyz, radius);
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    fPosition = impostorCorner(fSphere.xyz, radius, camPosition.xyz, corner);
+#ifdef TEXTURED
+    fRotation = mat3(modelMatrix) / radius;
+#endif
+    gl_Position = viewProjMat * vec4(fPosition, 1.0);
+#else
+#ifdef PROCEDURAL_SPHERE
+    int quad = gl_VertexID / 6;
+    ivec2 latLon = ivec2(quad / sphereResolution, quad % sphereResolution) + kQuadCorners[gl_VertexID % 6];
+    vec2 vTexCoord = vec2(latLon.yx) / float(sphereResolution);
+    float theta = 1.57079633 - 3.14159265 * vTexCoord.y; // latitude angle
+    float phi = 6.28318531 * vTexCoord.x;                // longitude angle
+    vec3 vPosition = vec3(cos(theta) * cos(phi), sin(theta), cos(theta) * sin(phi));
+    vec3 vNormal = vPosition;
+#endif
     vec4 worldPosition = modelMatrix * vec4(vPosition, 1.0); //World position in 3D space of the planet
+#ifdef LIT
     fPosition = vec3(worldPosition); 
-    fNormal =mat3(transpose(inverse(modelMatrix))) * vNormal;  // Normals must follow the planet after their transformation
-    gl_Position = projMat * viewMat * worldPosition; //this is done to rasterize: rasterization is the process of converting 3D geometric data (like vertices and shapes) into a 2D pixel-based image
+    fNormal =mat3(normalMatrix) * vNormal;  // Normals must follow the planet after their transformation
+#endif
+    gl_Position = viewProjMat * worldPosition; //this is done to rasterize: rasterization is the process of converting 3D geometric data (like vertices and shapes) into a 2D pixel-based image
+#ifdef LOG_DEPTH
+    fClipW = gl_Position.w;
+#endif
+#ifdef TEXTURED
     fTexCoord=vTexCoord;
+#endif
+#endif
 }
 
 
@@ -0,0 +1,57 @@
+// Virtual textures (VirtualTexture.cpp), shared by fragmentShader.glsl and
+// feedbackFragmentShader.glsl through #include "virtualTexture.glsl". Each
+// level of the mip pyramid is cut into pages of PAGE_SIZE texels; the page
+// table holds, for every page of every level (levels stacked by rows), the
+// cache slot and the level of the finest resident page covering it.
+#ifndef VIRTUAL_TEXTURE_GLSL
+#define VIRTUAL_TEXTURE_GLSL
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 120
+#endif
+#ifndef PAGE_BORDER
+#define PAGE_BORDER 4
+#endif
+#ifndef MAX_VIRTUAL_LEVELS
+#define MAX_VIRTUAL_LEVELS 16
+#endif
+
+uniform ivec3 virtualSize;                        // Width and height of level 0 in texels, number of levels
+uniform int virtualLevelRows[MAX_VIRTUAL_LEVELS]; // First row of each level in the page table
+
+// Level of the texture coordinate derivatives dx and dy, plus bias
+int virtualLevel(vec2 dx, vec2 dy, float bias)
+{
+    vec2 size = vec2(virtualSize.xy);
+    vec2 footprintX = dx * size, footprintY = dy * size;
+    float lod = 0.5 * log2(max(dot(footprintX, footprintX), dot(footprintY, footprintY))) + bias;
+    return clamp(int(floor(lod)), 0, virtualSize.z - 1);
+}
+
+// Texel coordinates of uv at a level, where a texel covers 2^level texels of
+// level 0; wrapped around in u, clamped in v
+vec2 virtualTexel(vec2 uv, int level)
+{
+    uv = vec2(fract(uv.x), clamp(uv.y, 0.0, 0.999999));
+    return uv * vec2(virtualSize.xy) / exp2(float(level));
+}
+
+#ifndef VIRTUAL_FEEDBACK
+uniform usampler2D pageTable;
+uniform sampler2D pageCache;
+
+// Bilinear sample of the level of the derivatives, from the page or, until
+// it is streamed in, from its finest resident ancestor
+vec3 sampleVirtual(vec2 uv, vec2 dx, vec2 dy)
+{
+    int level = virtualLevel(dx, dy, 0.0);
+    ivec2 page = ivec2(virtualTexel(uv, level)) / PAGE_SIZE;
+    uvec3 entry = texelFetch(pageTable, ivec2(page.x, virtualLevelRows[level] + page.y), 0).xyz;
+    vec2 texel = virtualTexel(uv, int(entry.z));
+    vec2 inPage = texel - vec2(ivec2(texel) / PAGE_SIZE * PAGE_SIZE);
+    vec2 cacheTexel = vec2(entry.xy) * float(PAGE_SIZE + 2 * PAGE_BORDER) + float(PAGE_BORDER) + inPage;
+    return textureLod(pageCache, cacheTexel / vec2(textureSize(pageCache, 0)), 0.0).rgb;
+}
+#endif
+
+#endif // VIRTUAL_TEXTURE_GLSL